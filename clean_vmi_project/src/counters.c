@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <signal.h>
+#include <pthread.h>
+#include "guest_mem.h"
+#include "counters.h"
+
+// Per-thread counter block. Only the owning thread writes it; the dump
+// reads every block, so fields are accessed with relaxed atomics (plain
+// loads and stores on x86, no locked instructions).
+typedef struct ctr_block {
+    ctr_snapshot_t values;
+    struct ctr_block *prev, *next;
+} ctr_block_t;
+
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static ctr_block_t *blocks;             // blocks of live threads
+static ctr_snapshot_t retired;          // totals of threads that exited
+static pthread_key_t block_key;
+static pthread_once_t block_key_once = PTHREAD_ONCE_INIT;
+static __thread ctr_block_t *thread_block;
+static __thread ctr_class_t thread_class;
+
+static ctr_format_t dump_format;
+static const char *dump_path;
+
+int counters_on;
+
+static const char *class_names[CTR_CLASSES] = {
+    "other", "symbols", "processes", "modules", "threads"
+};
+
+static void add(uint64_t *field, uint64_t value) {
+    __atomic_store_n(field, __atomic_load_n(field, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static void add_snapshot(ctr_snapshot_t *to, const ctr_snapshot_t *from) {
+    const uint64_t *src = (const uint64_t*)from;
+    uint64_t *dst = (uint64_t*)to;
+    size_t i;
+
+    for (i = 0; i < sizeof(*from) / sizeof(uint64_t); i++) {
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Fold an exiting thread's counts into the retired totals
+static void release_block(void *arg) {
+    ctr_block_t *b = arg;
+
+    pthread_mutex_lock(&blocks_lock);
+    add_snapshot(&retired, &b->values);
+    if (b->prev) b->prev->next = b->next;
+    else blocks = b->next;
+    if (b->next) b->next->prev = b->prev;
+    pthread_mutex_unlock(&blocks_lock);
+    free(b);
+}
+
+static void create_key(void) {
+    pthread_key_create(&block_key, release_block);
+}
+
+static ctr_values_t *current(void) {
+    ctr_block_t *b = thread_block;
+
+    if (!b) {
+        b = calloc(1, sizeof(*b));
+        if (!b) return NULL;
+        pthread_once(&block_key_once, create_key);
+        pthread_mutex_lock(&blocks_lock);
+        b->next = blocks;
+        if (blocks) blocks->prev = b;
+        blocks = b;
+        pthread_mutex_unlock(&blocks_lock);
+        pthread_setspecific(block_key, b);
+        thread_block = b;
+    }
+    return &b->values.classes[thread_class];
+}
+
+void counters_enable(void) {
+    counters_on = 1;
+}
+
+void counters_begin(ctr_scope_t *scope, ctr_class_t cls) {
+    scope->prev = thread_class;
+    scope->start = counters_on ? gm_now_ns() : 0;
+    thread_class = cls;
+}
+
+void counters_end(ctr_scope_t *scope) {
+    if (counters_on && scope->start) {
+        ctr_values_t *v = current();
+        if (v) {
+            add(&v->walks, 1);
+            add(&v->walk_ns, gm_now_ns() - scope->start);
+        }
+    }
+    thread_class = scope->prev;
+}
+
+void counters_add_read(size_t requested, size_t done) {
+    ctr_values_t *v = current();
+    if (!v) return;
+    add(&v->reads, 1);
+    add(&v->bytes, done);
+    if (done < requested) add(&v->failed_reads, 1);
+}
+
+void counters_add_translation(uint64_t ns) {
+    ctr_values_t *v = current();
+    if (!v) return;
+    add(&v->translations, 1);
+    add(&v->translate_ns, ns);
+}
+
+void counters_add_fetch(uint64_t pages, uint64_t ns) {
+    ctr_values_t *v = current();
+    if (!v) return;
+    add(&v->fetches, pages);
+    add(&v->fetch_ns, ns);
+}
+
+void counters_add_pause(uint64_t ns) {
+    if (!counters_on || !current()) return;
+    add(&thread_block->values.pauses, 1);
+    add(&thread_block->values.pause_ns, ns);
+}
+
+void counters_snapshot(ctr_snapshot_t *out) {
+    const ctr_block_t *b;
+
+    pthread_mutex_lock(&blocks_lock);
+    *out = retired;
+    for (b = blocks; b; b = b->next) {
+        add_snapshot(out, &b->values);
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+// Per-walker fields in output order; ns fields become seconds in the
+// Prometheus format
+static const struct {
+    const char *name;
+    const char *help;
+    size_t offset;
+    int is_ns;
+} fields[] = {
+    { "walks", "Walker runs", offsetof(ctr_values_t, walks), 0 },
+    { "walk_ns", "Time inside walker runs", offsetof(ctr_values_t, walk_ns), 1 },
+    { "reads", "Guest virtual reads", offsetof(ctr_values_t, reads), 0 },
+    { "bytes", "Bytes returned by guest reads", offsetof(ctr_values_t, bytes), 0 },
+    { "failed_reads", "Guest reads that came back short", offsetof(ctr_values_t, failed_reads), 0 },
+    { "translations", "Guest page-table walks", offsetof(ctr_values_t, translations), 0 },
+    { "translate_ns", "Time in guest page-table walks", offsetof(ctr_values_t, translate_ns), 1 },
+    { "fetches", "Pages fetched from the memory backend", offsetof(ctr_values_t, fetches), 0 },
+    { "fetch_ns", "Time in memory backend fetches", offsetof(ctr_values_t, fetch_ns), 1 },
+};
+
+#define FIELD(v, i) (*(const uint64_t*)((const char*)(v) + fields[i].offset))
+#define NFIELDS (sizeof(fields) / sizeof(fields[0]))
+
+static void write_json(FILE *out, const ctr_snapshot_t *s) {
+    size_t c, i;
+
+    fprintf(out, "{\n  \"pauses\": %llu,\n  \"pause_ns\": %llu,\n  \"walkers\": {\n",
+            (unsigned long long)s->pauses, (unsigned long long)s->pause_ns);
+    for (c = 0; c < CTR_CLASSES; c++) {
+        fprintf(out, "    \"%s\": {", class_names[c]);
+        for (i = 0; i < NFIELDS; i++) {
+            fprintf(out, "%s \"%s\": %llu", i ? "," : "", fields[i].name,
+                    (unsigned long long)FIELD(&s->classes[c], i));
+        }
+        fprintf(out, " }%s\n", c + 1 < CTR_CLASSES ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+}
+
+static void write_prometheus(FILE *out, const ctr_snapshot_t *s) {
+    size_t c, i;
+
+    for (i = 0; i < NFIELDS; i++) {
+        char name[64];
+
+        if (fields[i].is_ns) {
+            snprintf(name, sizeof(name), "vmi_%.*s_seconds_total",
+                     (int)(strlen(fields[i].name) - 3), fields[i].name);
+        } else {
+            snprintf(name, sizeof(name), "vmi_%s_total", fields[i].name);
+        }
+        fprintf(out, "# HELP %s %s.\n# TYPE %s counter\n", name, fields[i].help, name);
+        for (c = 0; c < CTR_CLASSES; c++) {
+            uint64_t v = FIELD(&s->classes[c], i);
+            if (fields[i].is_ns) {
+                fprintf(out, "%s{walker=\"%s\"} %.9f\n", name, class_names[c], v / 1e9);
+            } else {
+                fprintf(out, "%s{walker=\"%s\"} %llu\n", name, class_names[c], (unsigned long long)v);
+            }
+        }
+    }
+    fprintf(out, "# HELP vmi_pauses_total Guest pause windows.\n# TYPE vmi_pauses_total counter\n");
+    fprintf(out, "vmi_pauses_total %llu\n", (unsigned long long)s->pauses);
+    fprintf(out, "# HELP vmi_pause_seconds_total Time the guest spent paused.\n");
+    fprintf(out, "# TYPE vmi_pause_seconds_total counter\n");
+    fprintf(out, "vmi_pause_seconds_total %.9f\n", s->pause_ns / 1e9);
+}
+
+void counters_write(FILE *out, ctr_format_t format) {
+    ctr_snapshot_t s;
+
+    counters_snapshot(&s);
+    if (format == CTR_FORMAT_PROMETHEUS) write_prometheus(out, &s);
+    else write_json(out, &s);
+    fflush(out);
+}
+
+// Replace the dump file in one step, so a scraper never sees half of it
+static void dump(void) {
+    char tmp[4096];
+    FILE *f;
+
+    if (!dump_path || strcmp(dump_path, "-") == 0) {
+        counters_write(stderr, dump_format);
+        return;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", dump_path);
+    f = fopen(tmp, "w");
+    if (!f) return;
+    counters_write(f, dump_format);
+    if (fclose(f) == 0) rename(tmp, dump_path);
+}
+
+static void *dump_thread(void *arg) {
+    sigset_t *set = arg;
+    int sig;
+
+    while (sigwait(set, &sig) == 0) {
+        dump();
+    }
+    return NULL;
+}
+
+int counters_install(ctr_format_t format, const char *path) {
+    static sigset_t set;
+    pthread_t thread;
+
+    dump_format = format;
+    dump_path = path;
+    counters_enable();
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (pthread_create(&thread, NULL, dump_thread, &set) != 0) return -1;
+    pthread_detach(thread);
+    atexit(dump);
+    return 0;
+}
+
+int counters_parse_format(const char *text, ctr_format_t *format) {
+    if (strcmp(text, "json") == 0) {
+        *format = CTR_FORMAT_JSON;
+    } else if (strcmp(text, "prometheus") == 0 || strcmp(text, "prom") == 0) {
+        *format = CTR_FORMAT_PROMETHEUS;
+    } else {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Accounting of guest memory accesses, for seeing where introspection
+// time goes. guest_mem reports every virtual read, page-table walk and
+// backend page fetch; the walkers tag their thread with what they are
+// walking, so the counts are split by walker. Each thread adds to its
+// own block and blocks are summed when dumped, so counting costs no
+// shared cache lines. Everything is off until counters_enable().
+
+typedef enum {
+    CTR_OTHER,
+    CTR_SYMBOLS,                // kernel symbol lookups and reads
+    CTR_PROCESSES,
+    CTR_MODULES,
+    CTR_THREADS,
+    CTR_CLASSES
+} ctr_class_t;
+
+typedef struct {
+    uint64_t walks;             // walker runs (lookups for symbols)
+    uint64_t walk_ns;           // time inside those runs
+    uint64_t reads;             // virtual reads (gm_read_va / gm_map_va)
+    uint64_t bytes;             // bytes returned by them
+    uint64_t failed_reads;      // reads that came back short
+    uint64_t translations;      // page-table walks (translation cache misses)
+    uint64_t translate_ns;      // time in them, including their fetches
+    uint64_t fetches;           // pages fetched from the backend
+    uint64_t fetch_ns;          // time in backend fetches
+} ctr_values_t;
+
+typedef struct {
+    ctr_values_t classes[CTR_CLASSES];
+    uint64_t pauses;            // guest pause windows
+    uint64_t pause_ns;          // time the guest spent paused
+} ctr_snapshot_t;
+
+typedef enum {
+    CTR_FORMAT_JSON,
+    CTR_FORMAT_PROMETHEUS
+} ctr_format_t;
+
+// Set while accounting is on; the hooks below test it first
+extern int counters_on;
+
+void counters_enable(void);
+
+// Dump in format to path (NULL or "-" for stderr) at exit and whenever
+// the process gets SIGUSR1. Call before starting threads: SIGUSR1 is
+// blocked in the caller and handled by a dedicated thread.
+// Returns 0, or -1 if the dump thread could not be started.
+int counters_install(ctr_format_t format, const char *path);
+
+// Parse "json" or "prometheus"/"prom"; returns 0 on success
+int counters_parse_format(const char *text, ctr_format_t *format);
+
+// Tag the calling thread's accesses with cls until counters_end()
+typedef struct {
+    ctr_class_t prev;
+    uint64_t start;
+} ctr_scope_t;
+
+void counters_begin(ctr_scope_t *scope, ctr_class_t cls);
+void counters_end(ctr_scope_t *scope);
+
+// Hooks for guest_mem and the inspectors
+void counters_add_read(size_t requested, size_t done);
+void counters_add_translation(uint64_t ns);
+void counters_add_fetch(uint64_t pages, uint64_t ns);
+void counters_add_pause(uint64_t ns);
+
+void counters_snapshot(ctr_snapshot_t *out);
+void counters_write(FILE *out, ctr_format_t format);
+
+#endif
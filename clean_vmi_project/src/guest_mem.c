@@ -0,0 +1,673 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "guest_mem.h"
+#include "x86_pt.h"
+#include "counters.h"
+
+#define GM_NONE (-1)
+
+// One cached guest physical page
+typedef struct {
+    uint64_t pfn;
+    int32_t prev, next;     // LRU list (head = most recently used)
+    int32_t hnext;          // hash bucket chain
+    uint8_t *data;
+} gm_page_t;
+
+// One cached translation (DTB, VPN) -> PFN
+typedef struct {
+    uint64_t dtb;
+    uint64_t vpn;
+    uint64_t pfn;
+    uint64_t gen;           // valid only when equal to gm->tlb_gen
+} gm_tlb_entry_t;
+
+struct guest_mem {
+    gm_backend_ops_t ops;
+    void *priv;
+
+    gm_page_t *pages;
+    uint8_t *page_data;
+    size_t npages, cap;
+    int32_t *buckets;
+    size_t nbuckets;
+    int32_t lru_head, lru_tail;
+    int32_t free_head;      // slots released after failed fetches
+
+    gm_tlb_entry_t *tlb;
+    size_t ntlb;
+    uint64_t tlb_gen;
+    uint64_t kernel_dtb;        // used by the built-in page walker
+    x86_pwc_t pwc;              // its upper-level entries, for every DTB
+
+    gm_snapshot_t *recorder;    // copies every backend fetch while set
+    int owns_backend;           // clones share the backend but never close it
+
+    gm_stats_t stats;
+};
+
+static size_t round_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static inline size_t hash_pfn(uint64_t pfn, size_t mask) {
+    return (size_t)((pfn * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+static inline size_t hash_va(uint64_t dtb, uint64_t vpn, size_t mask) {
+    uint64_t h = (vpn ^ (dtb >> GM_PAGE_SHIFT) * 0xff51afd7ed558ccdULL) * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 32) & mask;
+}
+
+guest_mem_t *gm_create(const gm_backend_ops_t *ops, void *priv,
+                       size_t cache_pages, size_t tlb_entries) {
+    guest_mem_t *gm = calloc(1, sizeof(*gm));
+    if (!gm) return NULL;
+
+    gm->ops = *ops;
+    gm->priv = priv;
+    gm->owns_backend = 1;
+    gm->cap = cache_pages ? cache_pages : GM_DEFAULT_CACHE_PAGES;
+    gm->nbuckets = round_pow2(gm->cap * 2);
+    gm->ntlb = round_pow2(tlb_entries ? tlb_entries : GM_DEFAULT_TLB_ENTRIES);
+
+    // Page data is reserved up front but only touched as pages get cached
+    gm->pages = calloc(gm->cap, sizeof(*gm->pages));
+    gm->page_data = malloc(gm->cap * GM_PAGE_SIZE);
+    gm->buckets = malloc(gm->nbuckets * sizeof(*gm->buckets));
+    gm->tlb = calloc(gm->ntlb, sizeof(*gm->tlb));
+    if (!gm->pages || !gm->page_data || !gm->buckets || !gm->tlb) {
+        gm_destroy(gm);
+        return NULL;
+    }
+
+    gm->tlb_gen = 1;
+    x86_pwc_init(&gm->pwc);
+    gm_invalidate(gm);
+    return gm;
+}
+
+void gm_destroy(guest_mem_t *gm) {
+    if (!gm) return;
+    if (gm->ops.close && gm->owns_backend) gm->ops.close(gm->priv);
+    free(gm->pages);
+    free(gm->page_data);
+    free(gm->buckets);
+    free(gm->tlb);
+    free(gm);
+}
+
+guest_mem_t *gm_clone(guest_mem_t *gm, size_t cache_pages) {
+    guest_mem_t *view = gm_create(&gm->ops, gm->priv, cache_pages, 0);
+    if (!view) return NULL;
+    view->owns_backend = 0;
+    view->recorder = gm->recorder;
+    view->kernel_dtb = gm->kernel_dtb;
+    return view;
+}
+
+void gm_invalidate(guest_mem_t *gm) {
+    memset(gm->buckets, 0xff, gm->nbuckets * sizeof(*gm->buckets));
+    gm->npages = 0;
+    gm->lru_head = gm->lru_tail = GM_NONE;
+    gm->free_head = GM_NONE;
+    gm->tlb_gen++;
+    x86_pwc_flush(&gm->pwc);
+}
+
+static void lru_unlink(guest_mem_t *gm, int32_t i) {
+    gm_page_t *p = &gm->pages[i];
+    if (p->prev != GM_NONE) gm->pages[p->prev].next = p->next;
+    else gm->lru_head = p->next;
+    if (p->next != GM_NONE) gm->pages[p->next].prev = p->prev;
+    else gm->lru_tail = p->prev;
+}
+
+static void lru_push_front(guest_mem_t *gm, int32_t i) {
+    gm_page_t *p = &gm->pages[i];
+    p->prev = GM_NONE;
+    p->next = gm->lru_head;
+    if (gm->lru_head != GM_NONE) gm->pages[gm->lru_head].prev = i;
+    gm->lru_head = i;
+    if (gm->lru_tail == GM_NONE) gm->lru_tail = i;
+}
+
+static void hash_remove(guest_mem_t *gm, int32_t i) {
+    int32_t *link = &gm->buckets[hash_pfn(gm->pages[i].pfn, gm->nbuckets - 1)];
+    while (*link != GM_NONE) {
+        if (*link == i) {
+            *link = gm->pages[i].hnext;
+            return;
+        }
+        link = &gm->pages[*link].hnext;
+    }
+}
+
+static int32_t find_page(const guest_mem_t *gm, uint64_t pfn) {
+    int32_t i;
+    for (i = gm->buckets[hash_pfn(pfn, gm->nbuckets - 1)]; i != GM_NONE; i = gm->pages[i].hnext) {
+        if (gm->pages[i].pfn == pfn) return i;
+    }
+    return GM_NONE;
+}
+
+// Take a free slot, a fresh one, or recycle the least recently used
+static int32_t take_slot(guest_mem_t *gm) {
+    int32_t i;
+
+    if (gm->free_head != GM_NONE) {
+        i = gm->free_head;
+        gm->free_head = gm->pages[i].next;
+    } else if (gm->npages < gm->cap) {
+        i = (int32_t)gm->npages++;
+        gm->pages[i].data = gm->page_data + (size_t)i * GM_PAGE_SIZE;
+    } else {
+        i = gm->lru_tail;
+        lru_unlink(gm, i);
+        hash_remove(gm, i);
+        gm->stats.page_evictions++;
+    }
+    return i;
+}
+
+// Keep failed fetches out of the cache
+static void release_slot(guest_mem_t *gm, int32_t i) {
+    gm->stats.read_failures++;
+    gm->pages[i].next = gm->free_head;
+    gm->free_head = i;
+}
+
+static void insert_slot(guest_mem_t *gm, int32_t i, uint64_t pfn) {
+    size_t b = hash_pfn(pfn, gm->nbuckets - 1);
+
+    if (gm->recorder) {
+        gm_snapshot_put_page(gm->recorder, pfn, gm->pages[i].data);
+    }
+
+    gm->pages[i].pfn = pfn;
+    gm->pages[i].hnext = gm->buckets[b];
+    gm->buckets[b] = i;
+    lru_push_front(gm, i);
+}
+
+// Return the cached copy of a physical page, fetching it on a miss.
+// Directly mapped backends return their own page instead.
+static const uint8_t *get_page(guest_mem_t *gm, uint64_t pfn) {
+    uint64_t start;
+    int32_t i;
+
+    if (gm->ops.map_page) {
+        const uint8_t *page = gm->ops.map_page(gm->priv, pfn);
+        if (!page) {
+            gm->stats.read_failures++;
+            return NULL;
+        }
+        gm->stats.mapped_reads++;
+        if (gm->recorder) gm_snapshot_put_page(gm->recorder, pfn, page);
+        return page;
+    }
+
+    i = find_page(gm, pfn);
+
+    if (i != GM_NONE) {
+        gm->stats.page_hits++;
+        if (gm->lru_head != i) {
+            lru_unlink(gm, i);
+            lru_push_front(gm, i);
+        }
+        return gm->pages[i].data;
+    }
+
+    gm->stats.page_misses++;
+    i = take_slot(gm);
+    start = counters_on ? gm_now_ns() : 0;
+    if (gm->ops.read_page(gm->priv, pfn, gm->pages[i].data) != 0) {
+        release_slot(gm, i);
+        return NULL;
+    }
+    if (counters_on) counters_add_fetch(1, gm_now_ns() - start);
+    insert_slot(gm, i, pfn);
+    return gm->pages[i].data;
+}
+
+const void *gm_map_pa(guest_mem_t *gm, uint64_t pa, size_t len) {
+    const uint8_t *first, *page;
+    uint64_t pfn = pa >> GM_PAGE_SHIFT;
+    uint64_t last = (pa + len - 1) >> GM_PAGE_SHIFT;
+
+    if (!gm->ops.map_page || len == 0) return NULL;
+    first = get_page(gm, pfn);
+    if (!first) return NULL;
+
+    // Later pages must follow the first one in the mapping as well
+    while (++pfn <= last) {
+        page = get_page(gm, pfn);
+        if (page != first + ((pfn - (pa >> GM_PAGE_SHIFT)) << GM_PAGE_SHIFT)) return NULL;
+    }
+    return first + (pa & GM_PAGE_MASK);
+}
+
+const void *gm_map_va(guest_mem_t *gm, uint64_t dtb, uint64_t va, size_t len) {
+    const uint8_t *start = NULL;
+    size_t done = 0;
+
+    if (!gm->ops.map_page || len == 0) return NULL;
+
+    while (done < len) {
+        size_t chunk = GM_PAGE_SIZE - (size_t)(va & GM_PAGE_MASK);
+        const uint8_t *p;
+        uint64_t pa;
+
+        if (chunk > len - done) chunk = len - done;
+        if (gm_translate(gm, dtb, va, &pa) != 0) return NULL;
+        p = gm_map_pa(gm, pa, chunk);
+        if (!p) return NULL;
+        if (!start) start = p;
+        else if (p != start + done) return NULL;
+
+        done += chunk;
+        va += chunk;
+    }
+    gm->stats.va_reads++;
+    gm->stats.va_bytes += len;
+    if (counters_on) counters_add_read(len, len);
+    return start;
+}
+
+void gm_prefetch_pa(guest_mem_t *gm, const uint64_t *pfns, size_t n) {
+    uint64_t batch[GM_MAX_BATCH];
+    int32_t slots[GM_MAX_BATCH];
+    uint8_t *bufs[GM_MAX_BATCH];
+    int ok[GM_MAX_BATCH];
+    uint64_t start;
+    size_t i, j, k, limit;
+
+    if (gm->ops.map_page) return;   // nothing to fetch ahead
+    if (!gm->ops.read_pages) {
+        for (i = 0; i < n; i++) get_page(gm, pfns[i]);
+        return;
+    }
+
+    // Batches never hold more pages than the cache can keep at once; a
+    // cache of one page still takes them one at a time
+    limit = gm->cap / 2 ? gm->cap / 2 : 1;
+    if (limit > GM_MAX_BATCH) limit = GM_MAX_BATCH;
+    for (i = 0; i < n; ) {
+        k = 0;
+        for (; i < n && k < limit; i++) {
+            int dup = 0;
+            if (find_page(gm, pfns[i]) != GM_NONE) continue;
+            for (j = 0; j < k; j++) {
+                if (batch[j] == pfns[i]) dup = 1;
+            }
+            if (!dup) batch[k++] = pfns[i];
+        }
+        if (k == 0) continue;
+
+        for (j = 0; j < k; j++) {
+            slots[j] = take_slot(gm);
+            bufs[j] = gm->pages[slots[j]].data;
+        }
+        gm->stats.page_misses += k;
+        gm->stats.batch_reads++;
+        start = counters_on ? gm_now_ns() : 0;
+        gm->ops.read_pages(gm->priv, batch, k, bufs, ok);
+        if (counters_on) counters_add_fetch(k, gm_now_ns() - start);
+        for (j = 0; j < k; j++) {
+            if (ok[j]) insert_slot(gm, slots[j], batch[j]);
+            else release_slot(gm, slots[j]);
+        }
+    }
+}
+
+size_t gm_fetch_pfns(guest_mem_t *gm, const uint64_t *pfns, size_t n, uint8_t *buf, const uint8_t **pages) {
+    uint8_t *bufs[GM_MAX_BATCH];
+    int ok[GM_MAX_BATCH];
+    uint64_t start = counters_on ? gm_now_ns() : 0;
+    size_t i, j, k, done = 0;
+
+    for (i = 0; i < n; i += k) {
+        k = n - i < GM_MAX_BATCH ? n - i : GM_MAX_BATCH;
+        for (j = 0; j < k; j++) bufs[j] = buf + (i + j) * GM_PAGE_SIZE;
+        if (gm->ops.map_page) {
+            for (j = 0; j < k; j++) {
+                pages[i + j] = gm->ops.map_page(gm->priv, pfns[i + j]);
+                ok[j] = pages[i + j] != NULL;
+            }
+        } else {
+            if (gm->ops.read_pages) {
+                gm->ops.read_pages(gm->priv, pfns + i, k, bufs, ok);
+                gm->stats.batch_reads++;
+            } else {
+                for (j = 0; j < k; j++) ok[j] = gm->ops.read_page(gm->priv, pfns[i + j], bufs[j]) == 0;
+            }
+            for (j = 0; j < k; j++) pages[i + j] = ok[j] ? bufs[j] : NULL;
+        }
+        for (j = 0; j < k; j++) {
+            if (ok[j]) done++;
+            else gm->stats.read_failures++;
+        }
+    }
+    if (counters_on) counters_add_fetch(done, gm_now_ns() - start);
+    return done;
+}
+
+size_t gm_fetch_pages(guest_mem_t *gm, uint64_t pfn, size_t n, uint8_t *buf, const uint8_t **pages) {
+    uint64_t pfns[GM_MAX_BATCH];
+    size_t i, j, k, done = 0;
+
+    for (i = 0; i < n; i += k) {
+        k = n - i < GM_MAX_BATCH ? n - i : GM_MAX_BATCH;
+        for (j = 0; j < k; j++) pfns[j] = pfn + i + j;
+        done += gm_fetch_pfns(gm, pfns, k, buf + i * GM_PAGE_SIZE, pages + i);
+    }
+    return done;
+}
+
+uint64_t gm_phys_end(const guest_mem_t *gm) {
+    return gm->ops.phys_end ? gm->ops.phys_end(gm->priv) : 0;
+}
+
+int gm_page_hash(guest_mem_t *gm, uint64_t pfn, uint64_t *hash) {
+    return gm->ops.page_hash ? gm->ops.page_hash(gm->priv, pfn, hash) : -1;
+}
+
+void gm_prefetch_va(guest_mem_t *gm, uint64_t dtb, const uint64_t *vas, size_t n) {
+    uint64_t pfns[GM_MAX_BATCH], pas[GM_MAX_BATCH];
+    size_t i, j, k, m;
+
+    for (i = 0; i < n; i += m) {
+        m = n - i < GM_MAX_BATCH ? n - i : GM_MAX_BATCH;
+        gm_translate_batch(gm, dtb, vas + i, pas, m);
+        for (j = 0, k = 0; j < m; j++) {
+            if (pas[j] != GM_NO_PA) pfns[k++] = pas[j] >> GM_PAGE_SHIFT;
+        }
+        if (k) gm_prefetch_pa(gm, pfns, k);
+    }
+}
+
+// Page-table entries are read through the page cache, so the tables
+// below the cached upper levels are fetched only once too
+static int read_pte(void *ctx, uint64_t pa, uint64_t *pte) {
+    guest_mem_t *gm = ctx;
+    gm->stats.pte_reads++;
+    return gm_read_pa(gm, pa, pte, sizeof(*pte)) == sizeof(*pte) ? 0 : -1;
+}
+
+// Start a run of walks of the guest page tables for backends that only
+// provide physical memory; -1 when the kernel DTB is not known yet
+static int walk_begin(guest_mem_t *gm, x86_walk_t *w, uint64_t dtb) {
+    if (dtb == GM_KERNEL_DTB) {
+        dtb = gm->kernel_dtb;
+        if (dtb == 0) return -1;
+    }
+    x86_walk_init(w, read_pte, gm, &gm->pwc, dtb);
+    return 0;
+}
+
+// Translate with the backend, or with the walk begun for dtb
+static int backend_translate(guest_mem_t *gm, x86_walk_t *w, uint64_t dtb, uint64_t va, uint64_t *pa) {
+    if (gm->ops.translate) {
+        return gm->ops.translate(gm->priv, dtb, va, pa);
+    }
+    if (!w) return -1;
+    return x86_walk(w, va, pa, NULL);
+}
+
+void gm_ram_layout_init(gm_ram_layout_t *layout, uint64_t ram_size, uint64_t lowmem) {
+    if (lowmem == 0) {
+        lowmem = ram_size >= 0xb0000000ULL ? 0x80000000ULL : ram_size;
+    }
+    if (lowmem > ram_size) lowmem = ram_size;
+
+    memset(layout, 0, sizeof(*layout));
+    layout->ranges[0].gpa = 0;
+    layout->ranges[0].size = lowmem;
+    layout->ranges[0].offset = 0;
+    layout->count = 1;
+
+    if (ram_size > lowmem) {
+        layout->ranges[1].gpa = GM_4GB;
+        layout->ranges[1].size = ram_size - lowmem;
+        layout->ranges[1].offset = lowmem;
+        layout->count = 2;
+    }
+}
+
+int gm_ram_layout_lookup(const gm_ram_layout_t *layout, uint64_t gpa,
+                         uint64_t *offset, uint64_t *avail) {
+    int i;
+    for (i = 0; i < layout->count; i++) {
+        const gm_ram_range_t *r = &layout->ranges[i];
+        if (gpa >= r->gpa && gpa - r->gpa < r->size) {
+            *offset = r->offset + (gpa - r->gpa);
+            if (avail) *avail = r->size - (gpa - r->gpa);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint64_t gm_ram_layout_end(const gm_ram_layout_t *layout) {
+    const gm_ram_range_t *last;
+
+    if (layout->count == 0) return 0;
+    last = &layout->ranges[layout->count - 1];
+    return last->gpa + last->size;
+}
+
+void gm_set_kernel_dtb(guest_mem_t *gm, uint64_t dtb) {
+    gm->kernel_dtb = dtb;
+    gm->tlb_gen++;
+}
+
+uint64_t gm_kernel_dtb(const guest_mem_t *gm) {
+    return gm->kernel_dtb;
+}
+
+static inline gm_tlb_entry_t *tlb_lookup(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint64_t *pa) {
+    uint64_t vpn = va >> GM_PAGE_SHIFT;
+    gm_tlb_entry_t *e = &gm->tlb[hash_va(dtb, vpn, gm->ntlb - 1)];
+
+    if (e->gen == gm->tlb_gen && e->dtb == dtb && e->vpn == vpn) {
+        gm->stats.tlb_hits++;
+        *pa = (e->pfn << GM_PAGE_SHIFT) | (va & GM_PAGE_MASK);
+        return NULL;
+    }
+    gm->stats.tlb_misses++;
+    return e;
+}
+
+// Fill the slot tlb_lookup() returned for a miss
+static int tlb_fill(guest_mem_t *gm, gm_tlb_entry_t *e, x86_walk_t *w, uint64_t dtb,
+                    uint64_t va, uint64_t *pa) {
+    uint64_t page_pa, start;
+    int rc;
+
+    start = counters_on ? gm_now_ns() : 0;
+    rc = backend_translate(gm, w, dtb, va & ~GM_PAGE_MASK, &page_pa);
+    if (counters_on) counters_add_translation(gm_now_ns() - start);
+    if (rc != 0) {
+        gm->stats.translate_failures++;
+        return -1;
+    }
+    if (gm->recorder) {
+        gm_snapshot_put_translation(gm->recorder, dtb, va, page_pa);
+    }
+
+    e->dtb = dtb;
+    e->vpn = va >> GM_PAGE_SHIFT;
+    e->pfn = page_pa >> GM_PAGE_SHIFT;
+    e->gen = gm->tlb_gen;
+    *pa = (e->pfn << GM_PAGE_SHIFT) | (va & GM_PAGE_MASK);
+    return 0;
+}
+
+int gm_translate(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint64_t *pa) {
+    gm_tlb_entry_t *e = tlb_lookup(gm, dtb, va, pa);
+    x86_walk_t w;
+
+    if (!e) return 0;
+    if (!gm->ops.translate && walk_begin(gm, &w, dtb) != 0) {
+        gm->stats.translate_failures++;
+        return -1;
+    }
+    return tlb_fill(gm, e, gm->ops.translate ? NULL : &w, dtb, va, pa);
+}
+
+size_t gm_translate_batch(guest_mem_t *gm, uint64_t dtb, const uint64_t *vas, uint64_t *pas, size_t n) {
+    x86_walk_t w, *walk = NULL;
+    int can_walk = gm->ops.translate != NULL;
+    size_t i, done = 0;
+
+    if (!can_walk && walk_begin(gm, &w, dtb) == 0) {
+        walk = &w;
+        can_walk = 1;
+    }
+
+    // One walk serves every miss, so neighbours share their upper levels
+    for (i = 0; i < n; i++) {
+        gm_tlb_entry_t *e = tlb_lookup(gm, dtb, vas[i], &pas[i]);
+
+        if (e && (!can_walk || tlb_fill(gm, e, walk, dtb, vas[i], &pas[i]) != 0)) {
+            if (!can_walk) gm->stats.translate_failures++;
+            pas[i] = GM_NO_PA;
+            continue;
+        }
+        done++;
+    }
+    return done;
+}
+
+size_t gm_read_pa(guest_mem_t *gm, uint64_t pa, void *buf, size_t len) {
+    uint8_t *out = buf;
+    size_t done = 0;
+
+    // Fetch every missing page of a multi-page read in one batch
+    if (gm->ops.read_pages && (pa & GM_PAGE_MASK) + len > GM_PAGE_SIZE) {
+        uint64_t pfns[GM_MAX_BATCH];
+        uint64_t first = pa >> GM_PAGE_SHIFT;
+        uint64_t last = (pa + len - 1) >> GM_PAGE_SHIFT;
+        size_t n = 0;
+        while (first + n <= last && n < GM_MAX_BATCH) {
+            pfns[n] = first + n;
+            n++;
+        }
+        gm_prefetch_pa(gm, pfns, n);
+    }
+
+    while (done < len) {
+        size_t off = (size_t)(pa & GM_PAGE_MASK);
+        size_t chunk = GM_PAGE_SIZE - off;
+        const uint8_t *page;
+
+        if (chunk > len - done) chunk = len - done;
+        page = get_page(gm, pa >> GM_PAGE_SHIFT);
+        if (!page) break;
+
+        memcpy(out + done, page + off, chunk);
+        done += chunk;
+        pa += chunk;
+    }
+    return done;
+}
+
+size_t gm_read_va(guest_mem_t *gm, uint64_t dtb, uint64_t va, void *buf, size_t len) {
+    uint8_t *out = buf;
+    size_t done = 0;
+
+    while (done < len) {
+        size_t off = (size_t)(va & GM_PAGE_MASK);
+        size_t chunk = GM_PAGE_SIZE - off;
+        uint64_t pa;
+
+        if (chunk > len - done) chunk = len - done;
+        if (gm_translate(gm, dtb, va, &pa) != 0) break;
+        if (gm_read_pa(gm, pa, out + done, chunk) != chunk) break;
+
+        done += chunk;
+        va += chunk;
+    }
+    gm->stats.va_reads++;
+    gm->stats.va_bytes += done;
+    if (counters_on) counters_add_read(len, done);
+    return done;
+}
+
+int gm_read_u32(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint32_t *out) {
+    return gm_read_va(gm, dtb, va, out, sizeof(*out)) == sizeof(*out) ? 0 : -1;
+}
+
+int gm_read_u64(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint64_t *out) {
+    return gm_read_va(gm, dtb, va, out, sizeof(*out)) == sizeof(*out) ? 0 : -1;
+}
+
+void gm_snapshot_begin(guest_mem_t *gm, gm_snapshot_t *snap) {
+    // Start from empty caches so every page the walk needs reaches the snapshot
+    gm_invalidate(gm);
+    gm->recorder = snap;
+}
+
+void gm_snapshot_end(guest_mem_t *gm) {
+    gm->recorder = NULL;
+}
+
+uint64_t gm_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int gm_grow(void **items, size_t *cap, size_t count, size_t size) {
+    void *p;
+
+    if (count < *cap) return 0;
+    p = realloc(*items, (*cap ? *cap * 2 : 256) * size);
+    if (!p) return -1;
+    *items = p;
+    *cap = *cap ? *cap * 2 : 256;
+    return 0;
+}
+
+const gm_stats_t *gm_get_stats(const guest_mem_t *gm) {
+    return &gm->stats;
+}
+
+void gm_merge_stats(guest_mem_t *gm, const guest_mem_t *from) {
+    gm->stats.page_hits += from->stats.page_hits;
+    gm->stats.page_misses += from->stats.page_misses;
+    gm->stats.page_evictions += from->stats.page_evictions;
+    gm->stats.tlb_hits += from->stats.tlb_hits;
+    gm->stats.tlb_misses += from->stats.tlb_misses;
+    gm->stats.read_failures += from->stats.read_failures;
+    gm->stats.translate_failures += from->stats.translate_failures;
+    gm->stats.batch_reads += from->stats.batch_reads;
+    gm->stats.mapped_reads += from->stats.mapped_reads;
+    gm->stats.va_reads += from->stats.va_reads;
+    gm->stats.va_bytes += from->stats.va_bytes;
+    gm->stats.pte_reads += from->stats.pte_reads;
+}
+
+void gm_reset_stats(guest_mem_t *gm) {
+    memset(&gm->stats, 0, sizeof(gm->stats));
+}
+
+void gm_print_stats(const guest_mem_t *gm, FILE *out) {
+    const gm_stats_t *s = &gm->stats;
+    fprintf(out, "Page cache: %lu hits, %lu misses, %lu evictions, %lu failed reads (%zu pages cached, %lu batched fetches)\n",
+            (unsigned long)s->page_hits, (unsigned long)s->page_misses,
+            (unsigned long)s->page_evictions, (unsigned long)s->read_failures, gm->npages,
+            (unsigned long)s->batch_reads);
+    if (s->mapped_reads) {
+        fprintf(out, "Mapped pages: %lu zero-copy accesses\n", (unsigned long)s->mapped_reads);
+    }
+    fprintf(out, "Translation cache: %lu hits, %lu misses, %lu failed translations\n",
+            (unsigned long)s->tlb_hits, (unsigned long)s->tlb_misses,
+            (unsigned long)s->translate_failures);
+    if (s->pte_reads) {
+        fprintf(out, "Page walks: %lu entries read\n", (unsigned long)s->pte_reads);
+    }
+}
@@ -0,0 +1,291 @@
+#ifndef GUEST_MEM_H
+#define GUEST_MEM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Guest memory access layer shared by all walkers.
+//
+// Every read goes through a page-granular LRU cache of guest physical
+// pages and a translation cache keyed by (DTB, VA >> 12). The actual
+// memory source (LibVMI, /proc/PID/mem, ...) is a backend that only has
+// to fetch whole physical pages. Backends without their own address
+// translation leave translate NULL and the guest page tables are walked
+// here instead (see x86_pt.h), rooted at the kernel DTB for GM_KERNEL_DTB
+// and at a process's own DTB otherwise, with the upper-level entries of
+// every DTB cached alongside the translations.
+
+#define GM_PAGE_SHIFT 12
+#define GM_PAGE_SIZE  (1UL << GM_PAGE_SHIFT)
+#define GM_PAGE_MASK  (GM_PAGE_SIZE - 1)
+
+// DTB value meaning "the kernel address space"
+#define GM_KERNEL_DTB 0
+
+// Result of gm_translate_batch() for an address that does not translate
+#define GM_NO_PA (~0ULL)
+
+// Most pages fetched by one batched backend call
+#define GM_MAX_BATCH 64
+
+// Default cache sizes (pages / translation entries)
+#define GM_DEFAULT_CACHE_PAGES 32768
+#define GM_DEFAULT_TLB_ENTRIES 8192
+
+typedef struct guest_mem guest_mem_t;
+typedef struct gm_snapshot gm_snapshot_t;
+
+// 64-bit finalizer (murmur3 fmix64): every input bit reaches every output
+// bit. Used for hash-table slots and for folding page hashes.
+static inline uint64_t gm_mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Memory source behind the caches. read_page and translate return 0 on
+// success; translate may be NULL. read_pages is an optional scatter/gather
+// fetch of n pages that sets ok[i] per page and returns how many succeeded.
+// Backends that have guest RAM mapped set map_page to hand out pointers
+// into the mapping; their pages then bypass the page cache entirely.
+// phys_end, if set, returns one past the highest guest physical address
+// the backend can hold. page_hash, if set, returns a page's stored
+// gm_hash_page() value without touching its data (see gm_page_hash).
+typedef struct {
+    const char *name;
+    int (*read_page)(void *priv, uint64_t pfn, uint8_t *page);
+    int (*translate)(void *priv, uint64_t dtb, uint64_t va, uint64_t *pa);
+    void (*close)(void *priv);
+    size_t (*read_pages)(void *priv, const uint64_t *pfns, size_t n,
+                         uint8_t *const *pages, int *ok);
+    const uint8_t *(*map_page)(void *priv, uint64_t pfn);
+    uint64_t (*phys_end)(void *priv);
+    int (*page_hash)(void *priv, uint64_t pfn, uint64_t *hash);
+} gm_backend_ops_t;
+
+// Guest RAM placement for backends that see it as one host buffer:
+// QEMU lays the block out as [0, lowmem) and [4 GiB, 4 GiB + rest),
+// leaving the PCI hole below 4 GiB unbacked.
+#define GM_MAX_RAM_RANGES 4
+#define GM_4GB (1ULL << 32)
+
+typedef struct {
+    uint64_t gpa;           // first guest physical address of the range
+    uint64_t size;
+    uint64_t offset;        // offset of the range inside the RAM block
+} gm_ram_range_t;
+
+typedef struct {
+    gm_ram_range_t ranges[GM_MAX_RAM_RANGES];
+    int count;
+} gm_ram_layout_t;
+
+// Build the layout of a RAM block of ram_size bytes; lowmem 0 picks the
+// QEMU q35 default (2 GiB below 4 GiB once RAM reaches 2.75 GiB)
+void gm_ram_layout_init(gm_ram_layout_t *layout, uint64_t ram_size, uint64_t lowmem);
+
+// Map a guest physical address to an offset in the RAM block; avail is
+// set to the number of contiguous bytes from there. Returns 0 on success.
+int gm_ram_layout_lookup(const gm_ram_layout_t *layout, uint64_t gpa,
+                         uint64_t *offset, uint64_t *avail);
+
+// One past the last guest physical address of the layout
+uint64_t gm_ram_layout_end(const gm_ram_layout_t *layout);
+
+typedef struct {
+    uint64_t page_hits;
+    uint64_t page_misses;
+    uint64_t page_evictions;
+    uint64_t tlb_hits;
+    uint64_t tlb_misses;
+    uint64_t read_failures;
+    uint64_t translate_failures;
+    uint64_t batch_reads;
+    uint64_t mapped_reads;
+    uint64_t va_reads;              // gm_read_va / gm_map_va requests
+    uint64_t va_bytes;              // bytes those requests returned
+    uint64_t pte_reads;             // page-table entries read by the built-in walker
+} gm_stats_t;
+
+guest_mem_t *gm_create(const gm_backend_ops_t *ops, void *priv,
+                       size_t cache_pages, size_t tlb_entries);
+void gm_destroy(guest_mem_t *gm);
+
+// Private view with its own page and translation caches over the same
+// backend (one per worker thread). Backends must be thread-safe.
+guest_mem_t *gm_clone(guest_mem_t *gm, size_t cache_pages);
+
+// Drop every cached page and translation (call on resume / scan boundary)
+void gm_invalidate(guest_mem_t *gm);
+
+// Physical and virtual reads; return the number of bytes read, which is
+// a prefix of the request when a page is unmapped or unreadable.
+size_t gm_read_pa(guest_mem_t *gm, uint64_t pa, void *buf, size_t len);
+size_t gm_read_va(guest_mem_t *gm, uint64_t dtb, uint64_t va, void *buf, size_t len);
+
+// Zero-copy access for backends with map_page: a pointer to len bytes
+// that stay contiguous in the mapping, or NULL (then fall back to a read)
+const void *gm_map_pa(guest_mem_t *gm, uint64_t pa, size_t len);
+const void *gm_map_va(guest_mem_t *gm, uint64_t dtb, uint64_t va, size_t len);
+
+// Fetch pages ahead of use with as few backend calls as possible
+void gm_prefetch_pa(guest_mem_t *gm, const uint64_t *pfns, size_t n);
+void gm_prefetch_va(guest_mem_t *gm, uint64_t dtb, const uint64_t *vas, size_t n);
+
+// Bulk read of n consecutive pages from pfn straight from the backend, so
+// a scan of all of RAM does not flush the page cache. pages[i] points into
+// the backend's mapping where it has one, else into buf (n pages), and is
+// NULL for an unreadable page. Returns the number of pages read.
+size_t gm_fetch_pages(guest_mem_t *gm, uint64_t pfn, size_t n, uint8_t *buf, const uint8_t **pages);
+
+// Same for n pages anywhere in RAM, as the pages behind a run of virtual
+// addresses are (see gm_translate_batch)
+size_t gm_fetch_pfns(guest_mem_t *gm, const uint64_t *pfns, size_t n, uint8_t *buf, const uint8_t **pages);
+
+// One past the highest guest physical address, 0 if the backend cannot tell
+uint64_t gm_phys_end(const guest_mem_t *gm);
+
+// Kernel page-table root used when the backend cannot translate itself
+void gm_set_kernel_dtb(guest_mem_t *gm, uint64_t dtb);
+uint64_t gm_kernel_dtb(const guest_mem_t *gm);
+
+// Fixed-size helpers; return 0 on success, -1 on failure
+int gm_read_u32(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint32_t *out);
+int gm_read_u64(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint64_t *out);
+int gm_translate(guest_mem_t *gm, uint64_t dtb, uint64_t va, uint64_t *pa);
+
+// Translate n VAs of one address space in one pass: translation cache
+// hits first, then a single page walk over the misses in which addresses
+// share the table entries above them. pas[i] is GM_NO_PA where vas[i]
+// does not translate. Returns the number translated.
+size_t gm_translate_batch(guest_mem_t *gm, uint64_t dtb, const uint64_t *vas, uint64_t *pas, size_t n);
+
+// Backends
+struct vmi_instance;
+guest_mem_t *gm_open_libvmi(struct vmi_instance *vmi, size_t cache_pages);
+
+// QEMU process memory via /proc/PID/mem; lowmem as in gm_ram_layout_init
+guest_mem_t *gm_open_proc(int pid, uint64_t lowmem, size_t cache_pages);
+
+// QEMU RAM file(s) (memory-backend-file, memfd, hugetlbfs) mapped
+// read-only; several files are separated by commas and concatenated in
+// RAM-block order. lowmem as in gm_ram_layout_init.
+guest_mem_t *gm_open_mmap(const char *paths, uint64_t lowmem, size_t cache_pages);
+
+// Memory image on disk: a raw dump (file offset = guest physical address)
+// or an ELF core with PT_LOAD segments. Mapped read-only; for QEMU cores
+// the kernel DTB is set from the first vCPU's CR3 note, and cores written
+// by gm_dump() also serve their stored page hashes. Packed captures
+// (gm_dump_packed) are recognized by their magic and opened as such.
+guest_mem_t *gm_open_image(const char *path, size_t cache_pages);
+
+// Packed capture written by gm_dump_packed(): pages are found through an
+// index in the file and decoded one 64 KiB block at a time, so any page
+// is served without decompressing the rest. Serves the stored page hashes
+// and the kernel DTB.
+#define GM_PACK_MAGIC "VMIPACK1"
+guest_mem_t *gm_open_packed(const char *path, size_t cache_pages);
+
+// Page snapshots: while recording, every page and translation fetched
+// from the backend is copied into the snapshot. A snapshot can then be
+// opened as a backend of its own, e.g. to decode after resuming the VM.
+gm_snapshot_t *gm_snapshot_create(void);
+void gm_snapshot_destroy(gm_snapshot_t *snap);
+void gm_snapshot_begin(guest_mem_t *gm, gm_snapshot_t *snap);
+void gm_snapshot_end(guest_mem_t *gm);
+size_t gm_snapshot_pages(const gm_snapshot_t *snap);
+int gm_snapshot_put_page(gm_snapshot_t *snap, uint64_t pfn, const uint8_t *page);
+int gm_snapshot_put_translation(gm_snapshot_t *snap, uint64_t dtb, uint64_t va, uint64_t pa);
+guest_mem_t *gm_open_snapshot(gm_snapshot_t *snap, size_t cache_pages);
+
+// Page frame numbers held by a snapshot, sorted; malloc'd, NULL when empty
+uint64_t *gm_snapshot_pfns(const gm_snapshot_t *snap, size_t *count);
+
+// Add the page-table pages behind every recorded translation, read
+// through gm with kernel translations rooted at kernel_dtb. Backends that
+// translate themselves (LibVMI) never fetch them, and without them a dump
+// of the snapshot could not be walked. Returns the number of pages added.
+size_t gm_snapshot_add_tables(gm_snapshot_t *snap, guest_mem_t *gm, uint64_t kernel_dtb);
+
+// 64-bit hash of one page, the same on every CPU (SSE2 where available).
+// Not cryptographic: it tells changed pages apart, it does not resist a
+// guest crafting collisions.
+uint64_t gm_hash_page(const uint8_t *page);
+
+// Stored hash of a page: 0 with hash set, 1 when the backend knows the
+// page is absent, -1 when it keeps no hashes (then read and compare)
+int gm_page_hash(guest_mem_t *gm, uint64_t pfn, uint64_t *hash);
+
+// Memory capture: write guest physical pages to an ELF core that
+// gm_open_image() reads back, one PT_LOAD per run of readable pages, with
+// a QEMU note holding dtb as the vCPU's CR3 (0 takes gm_kernel_dtb) and a
+// note of page hashes for gm_diff(). pfns NULL captures all of
+// [0, gm_phys_end()), otherwise the n sorted pages listed. Returns 0, or
+// -1 with errno set.
+typedef struct {
+    uint64_t pages;                 // pages written
+    uint64_t unreadable;            // asked for but not readable
+    uint64_t zero;                  // zero pages, stored as index entries only
+    uint64_t duplicate;             // pages stored as a reference to an earlier copy
+    uint64_t bytes;                 // size of the file
+    uint64_t ns;
+} gm_dump_stats_t;
+
+int gm_dump(guest_mem_t *gm, const char *path, const uint64_t *pfns, size_t n,
+            uint64_t dtb, gm_dump_stats_t *stats);
+
+// Same capture as gm_dump(), written as a packed image: zero pages and
+// repeats of an earlier page are kept only in the index, the rest is
+// LZ4-compressed in 64 KiB chunks by a pool of workers while the next
+// pages are read. Needs no seeks but the final one to the header.
+int gm_dump_packed(guest_mem_t *gm, const char *path, const uint64_t *pfns, size_t n,
+                   uint64_t dtb, int workers, gm_dump_stats_t *stats);
+
+// Room for one more item in a growable array of count items of size
+// bytes, doubling *cap from 256; the capture writers' tables grow this
+// way. Returns 0, or -1 when out of memory.
+int gm_grow(void **items, size_t *cap, size_t count, size_t size);
+
+// Page diff of two captures (or a capture and a live guest) over the
+// physical range of both. Pages whose stored hashes match are settled
+// without reading them; the others are compared a vector at a time, with
+// the range split over a pool of workers, each on its own gm_clone()
+// views. Changed pages report the first and last byte that differ.
+#define GM_DIFF_CHANGED 0
+#define GM_DIFF_ADDED   1           // only in the new capture
+#define GM_DIFF_REMOVED 2           // only in the old one
+
+typedef struct {
+    uint64_t pfn;
+    uint16_t first, last;           // differing bytes, inclusive (changed only)
+    uint8_t kind;
+} gm_diff_page_t;
+
+typedef struct {
+    gm_diff_page_t *items;          // sorted by pfn
+    size_t count;
+    uint64_t changed, added, removed;
+    uint64_t hashed;                // pages settled by their stored hashes
+    uint64_t compared;              // pages compared byte for byte
+    uint64_t bytes;                 // physical range covered
+    uint64_t ns;
+    int workers;
+} gm_diff_t;
+
+// Returns 0, or -1 when neither side can tell its size or out of memory
+int gm_diff(guest_mem_t *old_gm, guest_mem_t *new_gm, int workers, gm_diff_t *out);
+void gm_diff_free(gm_diff_t *diff);
+
+// Monotonic clock in nanoseconds
+uint64_t gm_now_ns(void);
+
+const gm_stats_t *gm_get_stats(const guest_mem_t *gm);
+void gm_merge_stats(guest_mem_t *gm, const guest_mem_t *from);
+void gm_reset_stats(guest_mem_t *gm);
+void gm_print_stats(const guest_mem_t *gm, FILE *out);
+
+#endif
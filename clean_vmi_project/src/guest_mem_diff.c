@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "guest_mem.h"
+#include "win_scan.h"
+
+// Page hashes and page diffs of two guest memory views.
+//
+// The hash is an XXH3-style accumulator: eight 64-bit lanes, each taking
+// the 32x32-bit product of its input word mixed with a key, plus the word
+// of its neighbour lane, over the 64 stripes of a page; then the lanes
+// are folded. That is one SSE2 multiply per 16 bytes, so hashing runs at
+// memory speed. The scalar version does the same arithmetic and gives the
+// same values, which gm_dump() stores for gm_diff() to compare.
+
+#define DIFF_CHUNK_PAGES 64
+#define HASH_STRIPE      64
+#define HASH_STRIPE_KEY  0x9e3779b97f4a7c15ULL
+
+static const uint64_t hash_key[8] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+static uint64_t fold_lanes(const uint64_t acc[8]) {
+    uint64_t h = GM_PAGE_SIZE * 0x27d4eb2f165667c5ULL;
+    int i;
+
+    for (i = 0; i < 8; i += 2) {
+        h = gm_mix64(h ^ gm_mix64(acc[i] ^ hash_key[i + 1]) ^ (acc[i + 1] + hash_key[i]));
+    }
+    return h;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+uint64_t gm_hash_page(const uint8_t *page) {
+    __m128i acc[4], key[4];
+    uint64_t lanes[8];
+    size_t s;
+    int j;
+
+    for (j = 0; j < 4; j++) {
+        acc[j] = _mm_setzero_si128();
+        key[j] = _mm_loadu_si128((const __m128i*)&hash_key[2 * j]);
+    }
+    for (s = 0; s < GM_PAGE_SIZE / HASH_STRIPE; s++) {
+        const __m128i step = _mm_set1_epi64x((long long)(s * HASH_STRIPE_KEY));
+
+        for (j = 0; j < 4; j++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(page + s * HASH_STRIPE + 16 * j));
+            __m128i k = _mm_xor_si128(_mm_xor_si128(v, key[j]), step);
+
+            // Low half of each mixed word times its high half, plus the
+            // word of the neighbour lane
+            acc[j] = _mm_add_epi64(acc[j], _mm_mul_epu32(k, _mm_srli_epi64(k, 32)));
+            acc[j] = _mm_add_epi64(acc[j], _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        }
+    }
+    for (j = 0; j < 4; j++) _mm_storeu_si128((__m128i*)&lanes[2 * j], acc[j]);
+    return fold_lanes(lanes);
+}
+#else
+uint64_t gm_hash_page(const uint8_t *page) {
+    uint64_t acc[8] = { 0 };
+    size_t s;
+    int j;
+
+    for (s = 0; s < GM_PAGE_SIZE / HASH_STRIPE; s++) {
+        for (j = 0; j < 8; j++) {
+            uint64_t v, k;
+
+            memcpy(&v, page + s * HASH_STRIPE + 8 * j, sizeof(v));
+            k = v ^ hash_key[j] ^ (s * HASH_STRIPE_KEY);
+            acc[j] += (k & 0xffffffffULL) * (k >> 32);
+            acc[j ^ 1] += v;
+        }
+    }
+    return fold_lanes(acc);
+}
+#endif
+
+// Find the first 64-byte block that differs from the front, then the last
+// from the back, and only look at single bytes inside those two blocks
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static uint64_t block_mask_avx2(const uint8_t *a, const uint8_t *b) {
+    __m256i x = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)a), _mm256_loadu_si256((const __m256i*)b));
+    __m256i y = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + 32)),
+                                  _mm256_loadu_si256((const __m256i*)(b + 32)));
+
+    return ~((uint64_t)(uint32_t)_mm256_movemask_epi8(x) | (uint64_t)(uint32_t)_mm256_movemask_epi8(y) << 32);
+}
+
+__attribute__((target("avx2")))
+static int diff_bytes_avx2(const uint8_t *a, const uint8_t *b, uint16_t *first, uint16_t *last) {
+    size_t lo, hi;
+    uint64_t m = 0;
+
+    for (lo = 0; lo < GM_PAGE_SIZE; lo += 64) {
+        m = block_mask_avx2(a + lo, b + lo);
+        if (m) break;
+    }
+    if (lo == GM_PAGE_SIZE) return 0;
+    *first = (uint16_t)(lo + __builtin_ctzll(m));
+    for (hi = GM_PAGE_SIZE - 64; hi > lo; hi -= 64) {
+        m = block_mask_avx2(a + hi, b + hi);
+        if (m) break;
+    }
+    if (hi == lo) m = block_mask_avx2(a + lo, b + lo);
+    *last = (uint16_t)(hi + 63 - __builtin_clzll(m));
+    return 1;
+}
+
+static uint64_t block_mask_sse2(const uint8_t *a, const uint8_t *b) {
+    uint64_t m = 0;
+    int j;
+
+    for (j = 0; j < 4; j++) {
+        __m128i x = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + 16 * j)),
+                                   _mm_loadu_si128((const __m128i*)(b + 16 * j)));
+        m |= (uint64_t)(uint16_t)_mm_movemask_epi8(x) << (16 * j);
+    }
+    return ~m;
+}
+
+static int diff_bytes_sse2(const uint8_t *a, const uint8_t *b, uint16_t *first, uint16_t *last) {
+    size_t lo, hi;
+    uint64_t m = 0;
+
+    for (lo = 0; lo < GM_PAGE_SIZE; lo += 64) {
+        m = block_mask_sse2(a + lo, b + lo);
+        if (m) break;
+    }
+    if (lo == GM_PAGE_SIZE) return 0;
+    *first = (uint16_t)(lo + __builtin_ctzll(m));
+    for (hi = GM_PAGE_SIZE - 64; hi > lo; hi -= 64) {
+        m = block_mask_sse2(a + hi, b + hi);
+        if (m) break;
+    }
+    if (hi == lo) m = block_mask_sse2(a + lo, b + lo);
+    *last = (uint16_t)(hi + 63 - __builtin_clzll(m));
+    return 1;
+}
+
+static int diff_bytes(int avx2, const uint8_t *a, const uint8_t *b, uint16_t *first, uint16_t *last) {
+    return avx2 ? diff_bytes_avx2(a, b, first, last) : diff_bytes_sse2(a, b, first, last);
+}
+#else
+// First and last differing byte of two pages; 0 when they are equal
+static int diff_bytes_scalar(const uint8_t *a, const uint8_t *b, uint16_t *first, uint16_t *last) {
+    size_t lo, hi;
+
+    for (lo = 0; lo < GM_PAGE_SIZE && a[lo] == b[lo]; lo++);
+    if (lo == GM_PAGE_SIZE) return 0;
+    for (hi = GM_PAGE_SIZE - 1; a[hi] == b[hi]; hi--);
+    *first = (uint16_t)lo;
+    *last = (uint16_t)hi;
+    return 1;
+}
+
+static int diff_bytes(int avx2, const uint8_t *a, const uint8_t *b, uint16_t *first, uint16_t *last) {
+    (void)avx2;
+    return diff_bytes_scalar(a, b, first, last);
+}
+#endif
+
+// One diff, shared by its workers
+typedef struct {
+    guest_mem_t *old_gm, *new_gm;
+    uint64_t end_pfn;
+    uint64_t next;                  // next unclaimed chunk, in pages
+    int avx2;
+} diff_run_t;
+
+typedef struct {
+    diff_run_t *run;
+    guest_mem_t *old_view, *new_view;
+    uint8_t *old_buf, *new_buf;     // DIFF_CHUNK_PAGES pages each
+    gm_diff_page_t *items;
+    size_t count, cap;
+    uint64_t hashed, compared;
+    int failed;
+    pthread_t thread;
+    int started;
+} diff_worker_t;
+
+static void add_page(diff_worker_t *w, uint64_t pfn, int kind, uint16_t first, uint16_t last) {
+    gm_diff_page_t *p;
+
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 256;
+        gm_diff_page_t *items = realloc(w->items, cap * sizeof(*items));
+        if (!items) {
+            w->failed = 1;
+            return;
+        }
+        w->items = items;
+        w->cap = cap;
+    }
+    p = &w->items[w->count++];
+    p->pfn = pfn;
+    p->kind = (uint8_t)kind;
+    p->first = first;
+    p->last = last;
+}
+
+static void *diff_worker_main(void *arg) {
+    diff_worker_t *w = arg;
+    diff_run_t *run = w->run;
+    const uint8_t *old_pages[DIFF_CHUNK_PAGES], *new_pages[DIFF_CHUNK_PAGES];
+    uint8_t need[DIFF_CHUNK_PAGES];
+
+    for (;;) {
+        uint64_t pfn = __atomic_fetch_add(&run->next, DIFF_CHUNK_PAGES, __ATOMIC_RELAXED);
+        size_t n, i, wanted = 0;
+
+        if (pfn >= run->end_pfn) break;
+        n = run->end_pfn - pfn < DIFF_CHUNK_PAGES ? (size_t)(run->end_pfn - pfn) : DIFF_CHUNK_PAGES;
+
+        // Stored hashes settle most pages without reading them
+        for (i = 0; i < n; i++) {
+            uint64_t ho, hn;
+            int so = gm_page_hash(w->old_view, pfn + i, &ho);
+            int sn = gm_page_hash(w->new_view, pfn + i, &hn);
+
+            need[i] = 1;
+            if (so == 1 && sn == 1) {
+                need[i] = 0;
+            } else if (so == 0 && sn == 0 && ho == hn) {
+                need[i] = 0;
+                w->hashed++;
+            }
+            wanted += need[i];
+        }
+        if (!wanted) continue;
+
+        gm_fetch_pages(w->old_view, pfn, n, w->old_buf, old_pages);
+        gm_fetch_pages(w->new_view, pfn, n, w->new_buf, new_pages);
+        for (i = 0; i < n; i++) {
+            uint16_t first, last;
+
+            if (!need[i] || (!old_pages[i] && !new_pages[i])) continue;
+            if (!old_pages[i]) {
+                add_page(w, pfn + i, GM_DIFF_ADDED, 0, GM_PAGE_SIZE - 1);
+            } else if (!new_pages[i]) {
+                add_page(w, pfn + i, GM_DIFF_REMOVED, 0, GM_PAGE_SIZE - 1);
+            } else {
+                w->compared++;
+                if (diff_bytes(run->avx2, old_pages[i], new_pages[i], &first, &last)) {
+                    add_page(w, pfn + i, GM_DIFF_CHANGED, first, last);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static int compare_pages(const void *a, const void *b) {
+    uint64_t x = ((const gm_diff_page_t*)a)->pfn, y = ((const gm_diff_page_t*)b)->pfn;
+    return x < y ? -1 : x > y;
+}
+
+int gm_diff(guest_mem_t *old_gm, guest_mem_t *new_gm, int workers, gm_diff_t *out) {
+    uint64_t start = gm_now_ns(), old_end = gm_phys_end(old_gm), new_end = gm_phys_end(new_gm);
+    diff_run_t run;
+    diff_worker_t *w;
+    size_t total = 0;
+    int i, ran = 0, failed = 0;
+
+    memset(out, 0, sizeof(*out));
+    if (workers < 1) workers = 1;
+    run.old_gm = old_gm;
+    run.new_gm = new_gm;
+    run.end_pfn = (old_end > new_end ? old_end : new_end) >> GM_PAGE_SHIFT;
+    run.next = 0;
+    run.avx2 = win_scan_avx2();
+    if (run.end_pfn == 0) return -1;
+    if ((uint64_t)workers > run.end_pfn / DIFF_CHUNK_PAGES + 1) {
+        workers = (int)(run.end_pfn / DIFF_CHUNK_PAGES + 1);
+    }
+
+    w = calloc(workers, sizeof(*w));
+    if (!w) return -1;
+    for (i = 0; i < workers; i++) {
+        w[i].run = &run;
+        w[i].old_view = gm_clone(old_gm, 16);
+        w[i].new_view = gm_clone(new_gm, 16);
+        w[i].old_buf = malloc(DIFF_CHUNK_PAGES * GM_PAGE_SIZE);
+        w[i].new_buf = malloc(DIFF_CHUNK_PAGES * GM_PAGE_SIZE);
+        if (!w[i].old_view || !w[i].new_view || !w[i].old_buf || !w[i].new_buf) break;
+        // Worker 0 runs on the calling thread
+        if (i > 0) {
+            w[i].started = pthread_create(&w[i].thread, NULL, diff_worker_main, &w[i]) == 0;
+            if (!w[i].started) break;
+        }
+    }
+    // Whatever workers did start still cover the whole range
+    if (w[0].old_view && w[0].new_view && w[0].old_buf && w[0].new_buf) {
+        diff_worker_main(&w[0]);
+        ran = 1;
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (w[i].started) pthread_join(w[i].thread, NULL);
+        if (w[i].started || (i == 0 && ran)) out->workers++;
+        total += w[i].count;
+        failed |= w[i].failed;
+    }
+    out->items = total ? malloc(total * sizeof(*out->items)) : NULL;
+    if (total && !out->items) failed = 1;
+
+    for (i = 0; i < workers; i++) {
+        size_t j;
+
+        for (j = 0; out->items && j < w[i].count; j++) {
+            const gm_diff_page_t *p = &w[i].items[j];
+
+            out->items[out->count++] = *p;
+            if (p->kind == GM_DIFF_CHANGED) out->changed++;
+            else if (p->kind == GM_DIFF_ADDED) out->added++;
+            else out->removed++;
+        }
+        out->hashed += w[i].hashed;
+        out->compared += w[i].compared;
+        if (w[i].old_view) {
+            gm_merge_stats(old_gm, w[i].old_view);
+            gm_destroy(w[i].old_view);
+        }
+        if (w[i].new_view) {
+            gm_merge_stats(new_gm, w[i].new_view);
+            gm_destroy(w[i].new_view);
+        }
+        free(w[i].old_buf);
+        free(w[i].new_buf);
+        free(w[i].items);
+    }
+    free(w);
+
+    // Workers claim chunks in any order
+    if (out->count) qsort(out->items, out->count, sizeof(*out->items), compare_pages);
+    out->bytes = run.end_pfn << GM_PAGE_SHIFT;
+    out->ns = gm_now_ns() - start;
+    if (!ran || failed) {
+        gm_diff_free(out);
+        return -1;
+    }
+    return 0;
+}
+
+void gm_diff_free(gm_diff_t *diff) {
+    free(diff->items);
+    diff->items = NULL;
+    diff->count = 0;
+}
@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "guest_mem.h"
+
+// Offline backend for memory images on disk, so the walkers run without a
+// hypervisor. Two formats are understood:
+//   - raw dumps, where the file offset is the guest physical address
+//     (pmemsave, dd of /dev/mem style dumps), and
+//   - ELF cores, where each PT_LOAD segment places a file range at a guest
+//     physical address (dump-guest-memory, virsh dump --memory-only).
+// The whole file is mapped read-only and pages are handed out as pointers
+// into the mapping, so a walk costs page faults served from the host page
+// cache, not one syscall per guest page.
+//
+// gm_dump() writes the second format, adding a "VMI" note with the hash of
+// every page it wrote, in file order, so a diff of two dumps only reads
+// the pages whose hashes differ.
+//
+// Packed captures (guest_mem_packed.c) are recognized by their magic and
+// handed over to that backend.
+
+// Offset of cr[3] in QEMU's per-vCPU "QEMU" ELF note (QEMUCPUState):
+// version and size, 16 GPRs, rip, rflags, 8 segments and gdt/idt of 24
+// bytes each, then cr[0..4]
+#define QEMU_NOTE_TYPE 0
+#define QEMU_CPUSTATE_CR3 (8 + 18 * 8 + 10 * 24 + 3 * 8)
+
+// Page hash note: u64 file offset of the first page, u64 count, then one
+// gm_hash_page() value per page from there on, in file order
+#define VMI_NOTE_PAGE_HASHES 1
+#define VMI_NOTE_HASH_HEADER 16
+
+// QEMUCPUState as gm_dump() writes it: through cr[4]
+#define DUMP_CPUSTATE_SIZE (QEMU_CPUSTATE_CR3 + 2 * 8)
+
+typedef struct {
+    uint64_t gpa;           // first guest physical address of the range
+    uint64_t size;          // bytes present in the file
+    uint64_t offset;        // file offset of the range
+} image_range_t;
+
+typedef struct {
+    const uint8_t *base;
+    uint64_t size;
+    image_range_t *ranges;  // sorted by gpa
+    size_t nranges;
+    size_t last;            // range of the previous lookup
+    const uint8_t *hashes;  // page hash note, NULL without one
+    uint64_t hash_offset;   // file offset of the page hashes[0] belongs to
+    uint64_t nhashes;
+} image_backend_t;
+
+static int compare_ranges(const void *a, const void *b) {
+    const image_range_t *ra = a, *rb = b;
+    return ra->gpa < rb->gpa ? -1 : ra->gpa > rb->gpa;
+}
+
+// Range holding a whole guest physical page, or NULL
+static const image_range_t *find_range(image_backend_t *ib, uint64_t gpa) {
+    size_t lo = 0, hi = ib->nranges;
+    const image_range_t *r;
+
+    // Walks mostly stay inside one range. Worker views share the hint, so
+    // a stale value only costs an extra search.
+    r = &ib->ranges[__atomic_load_n(&ib->last, __ATOMIC_RELAXED)];
+    if (gpa < r->gpa || gpa - r->gpa + GM_PAGE_SIZE > r->size) {
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (ib->ranges[mid].gpa + ib->ranges[mid].size <= gpa) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == ib->nranges) return NULL;
+        r = &ib->ranges[lo];
+        if (gpa < r->gpa || gpa - r->gpa + GM_PAGE_SIZE > r->size) return NULL;
+        __atomic_store_n(&ib->last, lo, __ATOMIC_RELAXED);
+    }
+    return r;
+}
+
+// Pointer to a guest physical page, or NULL if the image does not hold it
+static const uint8_t *image_map_page(void *priv, uint64_t pfn) {
+    image_backend_t *ib = priv;
+    uint64_t gpa = pfn << GM_PAGE_SHIFT;
+    const image_range_t *r = find_range(ib, gpa);
+
+    return r ? ib->base + r->offset + (gpa - r->gpa) : NULL;
+}
+
+static int image_page_hash(void *priv, uint64_t pfn, uint64_t *hash) {
+    image_backend_t *ib = priv;
+    uint64_t gpa = pfn << GM_PAGE_SHIFT, index;
+    const image_range_t *r;
+
+    if (!ib->hashes) return -1;
+    r = find_range(ib, gpa);
+    if (!r) return 1;
+    if (r->offset < ib->hash_offset) return -1;
+    index = (r->offset + (gpa - r->gpa) - ib->hash_offset) >> GM_PAGE_SHIFT;
+    if (index >= ib->nhashes) return -1;
+    memcpy(hash, ib->hashes + index * sizeof(*hash), sizeof(*hash));
+    return 0;
+}
+
+static int image_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    const uint8_t *src = image_map_page(priv, pfn);
+    if (!src) return -1;
+    memcpy(page, src, GM_PAGE_SIZE);
+    return 0;
+}
+
+static void image_close(void *priv) {
+    image_backend_t *ib = priv;
+    if (ib->base) munmap((void*)ib->base, ib->size);
+    free(ib->ranges);
+    free(ib);
+}
+
+static uint64_t image_phys_end(void *priv) {
+    const image_backend_t *ib = priv;
+    const image_range_t *last = &ib->ranges[ib->nranges - 1];
+    return last->gpa + last->size;
+}
+
+static const gm_backend_ops_t image_ops = {
+    .name = "image",
+    .read_page = image_read_page,
+    .translate = NULL,      // guest page tables are walked by guest_mem
+    .close = image_close,
+    .map_page = image_map_page,
+    .phys_end = image_phys_end,
+    .page_hash = image_page_hash,
+};
+
+// CR3 of the first vCPU from QEMU's notes (kept if already found) and
+// the page hash note of a gm_dump() core
+static void parse_notes(image_backend_t *ib, const Elf64_Phdr *ph, uint64_t *dtb) {
+    uint64_t pos = ph->p_offset, end = ph->p_offset + ph->p_filesz;
+
+    if (end > ib->size || end < pos) return;
+    while (pos + sizeof(Elf64_Nhdr) <= end) {
+        const Elf64_Nhdr *nh = (const Elf64_Nhdr*)(ib->base + pos);
+        uint64_t name_off = pos + sizeof(*nh);
+        uint64_t desc_off = name_off + ((nh->n_namesz + 3) & ~3U);
+        uint64_t next = desc_off + ((nh->n_descsz + 3) & ~3U);
+        uint64_t cr3, count;
+
+        if (next > end) break;
+        if (nh->n_type == QEMU_NOTE_TYPE && nh->n_namesz == 5 && !*dtb &&
+            memcmp(ib->base + name_off, "QEMU", 5) == 0 &&
+            nh->n_descsz >= QEMU_CPUSTATE_CR3 + sizeof(cr3)) {
+            memcpy(&cr3, ib->base + desc_off + QEMU_CPUSTATE_CR3, sizeof(cr3));
+            *dtb = cr3;
+        } else if (nh->n_type == VMI_NOTE_PAGE_HASHES && nh->n_namesz == 4 &&
+                   memcmp(ib->base + name_off, "VMI", 4) == 0 &&
+                   nh->n_descsz >= VMI_NOTE_HASH_HEADER) {
+            memcpy(&ib->hash_offset, ib->base + desc_off, 8);
+            memcpy(&count, ib->base + desc_off + 8, 8);
+            if (count <= (nh->n_descsz - VMI_NOTE_HASH_HEADER) / sizeof(uint64_t)) {
+                ib->hashes = ib->base + desc_off + VMI_NOTE_HASH_HEADER;
+                ib->nhashes = count;
+            }
+        }
+        pos = next;
+    }
+}
+
+// Collect PT_LOAD segments as physical ranges; returns the kernel DTB
+// found in the notes (or 0) through dtb
+static int parse_elf_core(image_backend_t *ib, uint64_t *dtb) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr*)ib->base;
+    uint64_t phnum;
+    size_t i;
+
+    if (ib->size < sizeof(*eh) || eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        eh->e_ident[EI_DATA] != ELFDATA2LSB || eh->e_type != ET_CORE ||
+        eh->e_phentsize != sizeof(Elf64_Phdr)) {
+        return -1;
+    }
+    // Past 65534 segments the count moves to the first section header
+    phnum = eh->e_phnum;
+    if (phnum == PN_XNUM) {
+        if (eh->e_shoff > ib->size || ib->size - eh->e_shoff < sizeof(Elf64_Shdr)) return -1;
+        phnum = ((const Elf64_Shdr*)(ib->base + eh->e_shoff))->sh_info;
+    }
+    if (eh->e_phoff > ib->size || (ib->size - eh->e_phoff) / sizeof(Elf64_Phdr) < phnum) {
+        return -1;
+    }
+
+    ib->ranges = calloc(phnum ? phnum : 1, sizeof(*ib->ranges));
+    if (!ib->ranges) return -1;
+
+    for (i = 0; i < phnum; i++) {
+        const Elf64_Phdr *ph = (const Elf64_Phdr*)(ib->base + eh->e_phoff) + i;
+
+        if (ph->p_type == PT_NOTE) {
+            parse_notes(ib, ph, dtb);
+        } else if (ph->p_type == PT_LOAD && ph->p_filesz &&
+                   ph->p_offset + ph->p_filesz <= ib->size &&
+                   ph->p_offset + ph->p_filesz > ph->p_offset) {
+            image_range_t *r = &ib->ranges[ib->nranges++];
+            r->gpa = ph->p_paddr;
+            r->size = ph->p_filesz;
+            r->offset = ph->p_offset;
+        }
+    }
+    if (ib->nranges == 0) return -1;
+    qsort(ib->ranges, ib->nranges, sizeof(*ib->ranges), compare_ranges);
+    return 0;
+}
+
+guest_mem_t *gm_open_image(const char *path, size_t cache_pages) {
+    image_backend_t *ib;
+    guest_mem_t *gm;
+    struct stat st;
+    uint64_t dtb = 0;
+    char magic[sizeof(GM_PACK_MAGIC) - 1];
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)GM_PAGE_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+        memcmp(magic, GM_PACK_MAGIC, sizeof(magic)) == 0) {
+        close(fd);
+        return gm_open_packed(path, cache_pages);
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    // Walks jump around the image; readahead would only pull in pages
+    // nobody asked for
+    madvise(base, (size_t)st.st_size, MADV_RANDOM);
+
+    ib = calloc(1, sizeof(*ib));
+    if (!ib) {
+        munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+    ib->base = base;
+    ib->size = (uint64_t)st.st_size;
+
+    if (memcmp(ib->base, ELFMAG, SELFMAG) == 0) {
+        if (parse_elf_core(ib, &dtb) != 0) {
+            image_close(ib);
+            return NULL;
+        }
+    } else {
+        ib->ranges = calloc(1, sizeof(*ib->ranges));
+        if (!ib->ranges) {
+            image_close(ib);
+            return NULL;
+        }
+        ib->ranges[0].size = ib->size & ~(uint64_t)GM_PAGE_MASK;
+        ib->nranges = 1;
+    }
+
+    // Mapped pages never enter the page cache; keep it minimal
+    gm = gm_create(&image_ops, ib, cache_pages ? cache_pages : 16, 0);
+    if (!gm) {
+        image_close(ib);
+        return NULL;
+    }
+    if (dtb) gm_set_kernel_dtb(gm, dtb & ~(uint64_t)GM_PAGE_MASK);
+    return gm;
+}
+
+// gm_dump() state: page data is streamed from the second page of the file
+// on; the notes and program headers follow it, and the ELF header that
+// locates them is written last
+typedef struct {
+    FILE *f;
+    uint64_t offset;        // file offset of the next page
+    Elf64_Phdr *loads;
+    size_t nloads, load_cap;
+    uint64_t *hashes;       // note header, then one per page written
+    size_t nhashes, hash_cap;
+} dump_t;
+
+static int dump_page(dump_t *d, uint64_t pfn, const uint8_t *page) {
+    Elf64_Phdr *last = d->nloads ? &d->loads[d->nloads - 1] : NULL;
+
+    // Consecutive pages share a segment
+    if (!last || last->p_paddr + last->p_filesz != pfn << GM_PAGE_SHIFT) {
+        if (gm_grow((void**)&d->loads, &d->load_cap, d->nloads, sizeof(*d->loads)) != 0) return -1;
+        last = &d->loads[d->nloads++];
+        memset(last, 0, sizeof(*last));
+        last->p_type = PT_LOAD;
+        last->p_flags = PF_R | PF_W | PF_X;
+        last->p_offset = d->offset;
+        last->p_paddr = pfn << GM_PAGE_SHIFT;
+        last->p_align = GM_PAGE_SIZE;
+    }
+    if (gm_grow((void**)&d->hashes, &d->hash_cap, d->nhashes, sizeof(*d->hashes)) != 0) return -1;
+    d->hashes[d->nhashes++] = gm_hash_page(page);
+    if (fwrite(page, 1, GM_PAGE_SIZE, d->f) != GM_PAGE_SIZE) return -1;
+    last->p_filesz += GM_PAGE_SIZE;
+    last->p_memsz += GM_PAGE_SIZE;
+    d->offset += GM_PAGE_SIZE;
+    return 0;
+}
+
+// n consecutive pages from pfn, skipping the unreadable ones
+static int dump_run(dump_t *d, guest_mem_t *gm, uint64_t pfn, size_t n, uint8_t *buf,
+                    gm_dump_stats_t *stats) {
+    const uint8_t *pages[GM_MAX_BATCH];
+    size_t i;
+
+    gm_fetch_pages(gm, pfn, n, buf, pages);
+    for (i = 0; i < n; i++) {
+        if (!pages[i]) {
+            stats->unreadable++;
+            continue;
+        }
+        if (dump_page(d, pfn + i, pages[i]) != 0) return -1;
+        stats->pages++;
+    }
+    return 0;
+}
+
+static int write_note(FILE *f, const char *name, uint32_t type, const void *desc, uint32_t descsz) {
+    static const uint8_t zero[8];
+    Elf64_Nhdr nh;
+    uint32_t namesz = (uint32_t)strlen(name) + 1;
+
+    nh.n_namesz = namesz;
+    nh.n_descsz = descsz;
+    nh.n_type = type;
+    if (fwrite(&nh, sizeof(nh), 1, f) != 1 || fwrite(name, 1, namesz, f) != namesz ||
+        fwrite(zero, 1, ((namesz + 3) & ~3U) - namesz, f) != ((namesz + 3) & ~3U) - namesz ||
+        (descsz && fwrite(desc, 1, descsz, f) != descsz) ||
+        fwrite(zero, 1, ((descsz + 3) & ~3U) - descsz, f) != ((descsz + 3) & ~3U) - descsz) {
+        return -1;
+    }
+    return 0;
+}
+
+// Notes, program headers and the ELF header, after the page data
+static int dump_finish(dump_t *d, uint64_t dtb) {
+    uint8_t cpu[DUMP_CPUSTATE_SIZE];
+    uint32_t version = 1, size = sizeof(cpu);
+    uint64_t notes = d->offset, phoff, shoff = 0, phnum = d->nloads + 1;
+    Elf64_Phdr note;
+    Elf64_Ehdr eh;
+    Elf64_Shdr sh;
+    off_t pos;
+
+    // The hash note goes first so its hashes start 8-byte aligned; it is
+    // left out past 4 GiB of hashes (16 TiB of pages)
+    d->hashes[0] = GM_PAGE_SIZE;
+    d->hashes[1] = d->nhashes - 2;
+    if (d->nhashes * sizeof(uint64_t) <= UINT32_MAX &&
+        write_note(d->f, "VMI", VMI_NOTE_PAGE_HASHES, d->hashes,
+                   (uint32_t)(d->nhashes * sizeof(uint64_t))) != 0) {
+        return -1;
+    }
+    if (dtb) {
+        memset(cpu, 0, sizeof(cpu));
+        memcpy(cpu, &version, sizeof(version));
+        memcpy(cpu + 4, &size, sizeof(size));
+        memcpy(cpu + QEMU_CPUSTATE_CR3, &dtb, sizeof(dtb));
+        if (write_note(d->f, "QEMU", QEMU_NOTE_TYPE, cpu, sizeof(cpu)) != 0) return -1;
+    }
+    pos = ftello(d->f);
+    if (pos < 0) return -1;
+    d->offset = (uint64_t)pos;
+
+    memset(&note, 0, sizeof(note));
+    note.p_type = PT_NOTE;
+    note.p_offset = notes;
+    note.p_filesz = d->offset - notes;
+    phoff = (d->offset + 7) & ~7ULL;
+    if (fwrite("\0\0\0\0\0\0\0", 1, phoff - d->offset, d->f) != phoff - d->offset ||
+        fwrite(&note, sizeof(note), 1, d->f) != 1 ||
+        (d->nloads && fwrite(d->loads, sizeof(*d->loads), d->nloads, d->f) != d->nloads)) {
+        return -1;
+    }
+    d->offset = phoff + phnum * sizeof(Elf64_Phdr);
+
+    // Sparse dumps can have more runs than e_phnum holds (PN_XNUM)
+    if (phnum >= PN_XNUM) {
+        memset(&sh, 0, sizeof(sh));
+        sh.sh_info = (uint32_t)phnum;
+        shoff = d->offset;
+        if (fwrite(&sh, sizeof(sh), 1, d->f) != 1) return -1;
+        d->offset += sizeof(sh);
+    }
+
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_CORE;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_phoff = phoff;
+    eh.e_ehsize = sizeof(eh);
+    eh.e_phentsize = sizeof(Elf64_Phdr);
+    eh.e_phnum = phnum >= PN_XNUM ? PN_XNUM : (uint16_t)phnum;
+    if (shoff) {
+        eh.e_shoff = shoff;
+        eh.e_shentsize = sizeof(Elf64_Shdr);
+        eh.e_shnum = 1;
+    }
+    if (fseeko(d->f, 0, SEEK_SET) != 0 || fwrite(&eh, sizeof(eh), 1, d->f) != 1) return -1;
+    return 0;
+}
+
+int gm_dump(guest_mem_t *gm, const char *path, const uint64_t *pfns, size_t n,
+            uint64_t dtb, gm_dump_stats_t *stats) {
+    uint64_t start = gm_now_ns(), end_pfn, pfn;
+    uint8_t *buf = malloc(GM_MAX_BATCH * GM_PAGE_SIZE);
+    dump_t d;
+    size_t i, k;
+    int ret = -1, saved;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&d, 0, sizeof(d));
+    if (!buf) return -1;
+    end_pfn = gm_phys_end(gm) >> GM_PAGE_SHIFT;
+    if (!pfns && end_pfn == 0) {
+        free(buf);
+        errno = EINVAL;
+        return -1;
+    }
+    d.f = fopen(path, "wb");
+    if (!d.f) {
+        free(buf);
+        return -1;
+    }
+    setvbuf(d.f, NULL, _IOFBF, 1 << 20);
+
+    // Room for the hash note's header, filled in by dump_finish()
+    if (gm_grow((void**)&d.hashes, &d.hash_cap, 0, sizeof(*d.hashes)) != 0) goto out;
+    d.nhashes = 2;
+
+    // The header page stays zero until dump_finish()
+    memset(buf, 0, GM_PAGE_SIZE);
+    if (fwrite(buf, 1, GM_PAGE_SIZE, d.f) != GM_PAGE_SIZE) goto out;
+    d.offset = GM_PAGE_SIZE;
+
+    if (!pfns) {
+        for (pfn = 0; pfn < end_pfn; pfn += k) {
+            k = end_pfn - pfn < GM_MAX_BATCH ? (size_t)(end_pfn - pfn) : GM_MAX_BATCH;
+            if (dump_run(&d, gm, pfn, k, buf, stats) != 0) goto out;
+        }
+        // Holes in the physical range are not pages anybody asked for
+        stats->unreadable = 0;
+    } else {
+        for (i = 0; i < n; i += k) {
+            for (k = 1; i + k < n && k < GM_MAX_BATCH && pfns[i + k] == pfns[i] + k; k++);
+            if (dump_run(&d, gm, pfns[i], k, buf, stats) != 0) goto out;
+        }
+    }
+    if (dump_finish(&d, dtb ? dtb : gm_kernel_dtb(gm)) != 0) goto out;
+    ret = 0;
+
+out:
+    saved = errno;
+    if (fclose(d.f) != 0 && ret == 0) {
+        saved = errno;
+        ret = -1;
+    }
+    stats->bytes = d.offset;
+    stats->ns = gm_now_ns() - start;
+    free(buf);
+    free(d.loads);
+    free(d.hashes);
+    errno = saved;
+    return ret;
+}
@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <libvmi/libvmi.h>
+#include "guest_mem.h"
+
+// LibVMI backend: page fetches via vmi_read_pa, translations via the
+// kernel address space or an explicit DTB. A VMI instance is not
+// thread-safe, so calls from worker views are serialized.
+
+static pthread_mutex_t libvmi_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int libvmi_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    size_t bytes_read = 0;
+    pthread_mutex_lock(&libvmi_lock);
+    vmi_read_pa((vmi_instance_t)priv, pfn << GM_PAGE_SHIFT, GM_PAGE_SIZE, page, &bytes_read);
+    pthread_mutex_unlock(&libvmi_lock);
+    return bytes_read == GM_PAGE_SIZE ? 0 : -1;
+}
+
+static int libvmi_translate(void *priv, uint64_t dtb, uint64_t va, uint64_t *pa) {
+    addr_t paddr = 0;
+    status_t status;
+
+    pthread_mutex_lock(&libvmi_lock);
+    if (dtb == GM_KERNEL_DTB) {
+        status = vmi_translate_kv2p((vmi_instance_t)priv, va, &paddr);
+    } else {
+        status = vmi_pagetable_lookup((vmi_instance_t)priv, dtb, va, &paddr);
+    }
+    pthread_mutex_unlock(&libvmi_lock);
+    if (status != VMI_SUCCESS) return -1;
+
+    *pa = paddr;
+    return 0;
+}
+
+static uint64_t libvmi_phys_end(void *priv) {
+    return vmi_get_max_physical_address((vmi_instance_t)priv);
+}
+
+static const gm_backend_ops_t libvmi_ops = {
+    .name = "libvmi",
+    .read_page = libvmi_read_page,
+    .translate = libvmi_translate,
+    .close = NULL,          // the caller owns the VMI instance
+    .phys_end = libvmi_phys_end,
+};
+
+guest_mem_t *gm_open_libvmi(struct vmi_instance *vmi, size_t cache_pages) {
+    return gm_create(&libvmi_ops, vmi, cache_pages, 0);
+}
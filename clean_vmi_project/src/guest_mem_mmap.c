@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include "guest_mem.h"
+
+// Zero-copy backend for QEMU guests whose RAM is a file (memory-backend-file,
+// memfd with share=on, hugetlbfs). The file is mapped read-only and shared,
+// so reads see the live guest and pages are handed out as pointers into
+// the mapping instead of being copied into the page cache.
+
+#define HUGETLBFS_MAGIC 0x958458f6
+
+typedef struct {
+    const uint8_t *base;
+    uint64_t size;          // bytes of guest RAM in this file
+    uint64_t map_len;       // mapped length (rounded up for hugetlbfs)
+    uint64_t offset;        // offset of the file inside the RAM block
+} mmap_segment_t;
+
+typedef struct {
+    mmap_segment_t segs[GM_MAX_RAM_RANGES];
+    int nsegs;
+    gm_ram_layout_t layout;
+} mmap_backend_t;
+
+static int map_file(const char *path, mmap_segment_t *seg) {
+    struct stat st;
+    struct statfs sfs;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+
+    seg->size = (uint64_t)st.st_size;
+    seg->map_len = seg->size;
+
+    // hugetlbfs mappings must cover whole huge pages
+    if (fstatfs(fd, &sfs) == 0 && (unsigned long)sfs.f_type == HUGETLBFS_MAGIC && sfs.f_bsize > 0) {
+        uint64_t huge = (uint64_t)sfs.f_bsize;
+        seg->map_len = (seg->size + huge - 1) / huge * huge;
+    }
+
+    base = mmap(NULL, seg->map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+
+    // Walks jump around guest RAM; readahead only wastes page-ins. Let
+    // tmpfs/shmem back the mapping with transparent hugepages if it can.
+    madvise(base, seg->map_len, MADV_RANDOM);
+#ifdef MADV_HUGEPAGE
+    madvise(base, seg->map_len, MADV_HUGEPAGE);
+#endif
+
+    seg->base = base;
+    return 0;
+}
+
+// Pointer to a guest physical page, or NULL outside guest RAM
+static const uint8_t *mmap_map_page(void *priv, uint64_t pfn) {
+    mmap_backend_t *mb = priv;
+    uint64_t offset;
+    int i;
+
+    if (gm_ram_layout_lookup(&mb->layout, pfn << GM_PAGE_SHIFT, &offset, NULL) != 0) {
+        return NULL;
+    }
+    for (i = 0; i < mb->nsegs; i++) {
+        const mmap_segment_t *seg = &mb->segs[i];
+        if (offset >= seg->offset && offset - seg->offset + GM_PAGE_SIZE <= seg->size) {
+            return seg->base + (offset - seg->offset);
+        }
+    }
+    return NULL;
+}
+
+static int mmap_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    const uint8_t *src = mmap_map_page(priv, pfn);
+    if (!src) return -1;
+    memcpy(page, src, GM_PAGE_SIZE);
+    return 0;
+}
+
+static uint64_t mmap_phys_end(void *priv) {
+    return gm_ram_layout_end(&((mmap_backend_t*)priv)->layout);
+}
+
+static void mmap_close(void *priv) {
+    mmap_backend_t *mb = priv;
+    int i;
+    for (i = 0; i < mb->nsegs; i++) {
+        munmap((void*)mb->segs[i].base, mb->segs[i].map_len);
+    }
+    free(mb);
+}
+
+static const gm_backend_ops_t mmap_ops = {
+    .name = "mmap",
+    .read_page = mmap_read_page,
+    .translate = NULL,      // guest page tables are walked by guest_mem
+    .close = mmap_close,
+    .map_page = mmap_map_page,
+    .phys_end = mmap_phys_end,
+};
+
+guest_mem_t *gm_open_mmap(const char *paths, uint64_t lowmem, size_t cache_pages) {
+    mmap_backend_t *mb;
+    guest_mem_t *gm;
+    char *list, *path, *save = NULL;
+    uint64_t ram_size = 0;
+
+    mb = calloc(1, sizeof(*mb));
+    list = strdup(paths);
+    if (!mb || !list) {
+        free(mb);
+        free(list);
+        return NULL;
+    }
+
+    for (path = strtok_r(list, ",", &save); path; path = strtok_r(NULL, ",", &save)) {
+        mmap_segment_t *seg = &mb->segs[mb->nsegs];
+        if (mb->nsegs == GM_MAX_RAM_RANGES || map_file(path, seg) != 0) {
+            free(list);
+            mmap_close(mb);
+            return NULL;
+        }
+        seg->offset = ram_size;
+        ram_size += seg->size;
+        mb->nsegs++;
+    }
+    free(list);
+
+    if (mb->nsegs == 0) {
+        mmap_close(mb);
+        return NULL;
+    }
+    gm_ram_layout_init(&mb->layout, ram_size, lowmem);
+
+    // Mapped pages never enter the page cache; keep it minimal
+    gm = gm_create(&mmap_ops, mb, cache_pages ? cache_pages : 16, 0);
+    if (!gm) mmap_close(mb);
+    return gm;
+}
@@ -0,0 +1,644 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "guest_mem.h"
+#include "lz4_block.h"
+
+// Compressed memory captures ("packed" images). Layout, little-endian:
+//
+//   header page   pack_header_t, rest zero
+//   chunks        distinct non-zero pages, PACK_CHUNK_PAGES at a time,
+//                 each chunk one LZ4 block, or stored as is when that
+//                 would not shrink it
+//   ranges        runs of consecutive captured pages
+//   pages         one entry per captured page, in range order: its hash
+//                 and the chunk and slot holding its bytes
+//   chunks table  file offset, stored size and page count of every chunk
+//
+// Zero pages have no bytes at all and a page seen before points at the
+// first copy, so neither costs more than its index entry. The tables sit
+// at the end so capture streams chunks out in one pass; the header that
+// locates them is written last. A reader maps the file and uses the
+// tables in place: a page costs a range search, an index load and one
+// 64 KiB block decode, shared by the neighbouring pages through a small
+// cache of decoded chunks.
+
+#define PACK_VERSION      1
+#define PACK_CHUNK_PAGES  16
+#define PACK_CHUNK_SIZE   (PACK_CHUNK_PAGES * GM_PAGE_SIZE)
+#define PACK_ZERO         0xffffffffU   // chunk of a zero page
+#define PACK_CACHE_SLOTS  64            // decoded chunks kept by a reader
+#define PACK_BATCH_CHUNKS 256           // chunks compressed per batch (16 MiB)
+
+typedef struct {
+    char magic[8];                      // GM_PACK_MAGIC
+    uint32_t version;
+    uint32_t chunk_pages;
+    uint64_t dtb;                       // kernel CR3, 0 if unknown
+    uint64_t nranges, ranges_offset;
+    uint64_t npages, pages_offset;
+    uint64_t nchunks, chunks_offset;
+} pack_header_t;
+
+typedef struct {
+    uint64_t pfn;
+    uint64_t count;
+    uint64_t first;                     // entry of the run's first page
+} pack_range_t;
+
+typedef struct {
+    uint64_t hash;                      // gm_hash_page()
+    uint32_t chunk;                     // PACK_ZERO for a zero page
+    uint32_t slot;                      // page within the chunk
+} pack_page_t;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t size;                      // pages * GM_PAGE_SIZE when stored as is
+    uint32_t pages;
+} pack_chunk_t;
+
+// Reader
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t chunk;                     // PACK_ZERO when empty
+    uint8_t data[PACK_CHUNK_SIZE];
+} pack_slot_t;
+
+typedef struct {
+    const uint8_t *base;
+    uint64_t size;
+    const pack_range_t *ranges;
+    uint64_t nranges;
+    const pack_page_t *pages;
+    uint64_t npages;
+    const pack_chunk_t *chunks;
+    uint64_t nchunks;
+    size_t last;                        // range of the previous lookup
+    pack_slot_t *slots;
+} pack_backend_t;
+
+// Index entry of a captured page, or NULL
+static const pack_page_t *find_page(pack_backend_t *pb, uint64_t pfn) {
+    size_t lo = 0, hi = pb->nranges;
+    const pack_range_t *r;
+
+    // Same hint as the image backend: walks stay inside one range
+    r = &pb->ranges[__atomic_load_n(&pb->last, __ATOMIC_RELAXED)];
+    if (pfn < r->pfn || pfn - r->pfn >= r->count) {
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (pb->ranges[mid].pfn + pb->ranges[mid].count <= pfn) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == pb->nranges) return NULL;
+        r = &pb->ranges[lo];
+        if (pfn < r->pfn || pfn - r->pfn >= r->count) return NULL;
+        __atomic_store_n(&pb->last, lo, __ATOMIC_RELAXED);
+    }
+    return &pb->pages[r->first + (pfn - r->pfn)];
+}
+
+static int pack_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    pack_backend_t *pb = priv;
+    const pack_page_t *p = find_page(pb, pfn);
+    const pack_chunk_t *c;
+    pack_slot_t *s;
+    int ret = 0;
+
+    if (!p) return -1;
+    if (p->chunk == PACK_ZERO) {
+        memset(page, 0, GM_PAGE_SIZE);
+        return 0;
+    }
+    if (p->chunk >= pb->nchunks) return -1;
+    c = &pb->chunks[p->chunk];
+    if (p->slot >= c->pages || c->pages > PACK_CHUNK_PAGES || c->offset > pb->size ||
+        c->size > pb->size - c->offset) {
+        return -1;
+    }
+    if (c->size == c->pages * GM_PAGE_SIZE) {
+        memcpy(page, pb->base + c->offset + (uint64_t)p->slot * GM_PAGE_SIZE, GM_PAGE_SIZE);
+        return 0;
+    }
+
+    s = &pb->slots[p->chunk % PACK_CACHE_SLOTS];
+    pthread_mutex_lock(&s->lock);
+    if (s->chunk != p->chunk) {
+        s->chunk = PACK_ZERO;
+        if (lz4_decompress(pb->base + c->offset, c->size, s->data, (size_t)c->pages * GM_PAGE_SIZE) == 0) {
+            s->chunk = p->chunk;
+        }
+    }
+    if (s->chunk == p->chunk) memcpy(page, s->data + (size_t)p->slot * GM_PAGE_SIZE, GM_PAGE_SIZE);
+    else ret = -1;
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+static int pack_page_hash(void *priv, uint64_t pfn, uint64_t *hash) {
+    const pack_page_t *p = find_page(priv, pfn);
+
+    if (!p) return 1;
+    *hash = p->hash;
+    return 0;
+}
+
+static uint64_t pack_phys_end(void *priv) {
+    const pack_backend_t *pb = priv;
+    const pack_range_t *last = &pb->ranges[pb->nranges - 1];
+    return (last->pfn + last->count) << GM_PAGE_SHIFT;
+}
+
+static void pack_close(void *priv) {
+    pack_backend_t *pb = priv;
+    size_t i;
+
+    if (pb->slots) {
+        for (i = 0; i < PACK_CACHE_SLOTS; i++) pthread_mutex_destroy(&pb->slots[i].lock);
+        free(pb->slots);
+    }
+    if (pb->base) munmap((void*)pb->base, pb->size);
+    free(pb);
+}
+
+static const gm_backend_ops_t pack_ops = {
+    .name = "packed",
+    .read_page = pack_read_page,
+    .translate = NULL,      // guest page tables are walked by guest_mem
+    .close = pack_close,
+    .phys_end = pack_phys_end,
+    .page_hash = pack_page_hash,
+};
+
+// Table of count entries of size bytes at offset, inside the file
+static const void *table_at(const pack_backend_t *pb, uint64_t offset, uint64_t count, size_t size) {
+    if (offset > pb->size || offset % 8 || count > (pb->size - offset) / size) return NULL;
+    return pb->base + offset;
+}
+
+// Check the header and the ranges; chunks and page entries are checked
+// when a page is read, so opening does not touch the whole index
+static int parse_pack(pack_backend_t *pb, uint64_t *dtb) {
+    const pack_header_t *h = (const pack_header_t*)pb->base;
+    uint64_t i;
+
+    if (memcmp(h->magic, GM_PACK_MAGIC, sizeof(h->magic)) != 0 || h->version != PACK_VERSION ||
+        h->chunk_pages != PACK_CHUNK_PAGES || h->nranges == 0) {
+        return -1;
+    }
+    pb->ranges = table_at(pb, h->ranges_offset, h->nranges, sizeof(*pb->ranges));
+    pb->pages = table_at(pb, h->pages_offset, h->npages, sizeof(*pb->pages));
+    pb->chunks = table_at(pb, h->chunks_offset, h->nchunks, sizeof(*pb->chunks));
+    if (!pb->ranges || !pb->pages || !pb->chunks) return -1;
+    pb->nranges = h->nranges;
+    pb->npages = h->npages;
+    pb->nchunks = h->nchunks;
+
+    // Sorted, disjoint, and every page inside the index
+    for (i = 0; i < pb->nranges; i++) {
+        const pack_range_t *r = &pb->ranges[i];
+
+        if (r->count == 0 || r->pfn + r->count < r->pfn || r->pfn + r->count > (~0ULL >> GM_PAGE_SHIFT) ||
+            r->first > pb->npages || r->count > pb->npages - r->first ||
+            (i > 0 && r->pfn < pb->ranges[i - 1].pfn + pb->ranges[i - 1].count)) {
+            return -1;
+        }
+    }
+    *dtb = h->dtb;
+    return 0;
+}
+
+guest_mem_t *gm_open_packed(const char *path, size_t cache_pages) {
+    pack_backend_t *pb;
+    guest_mem_t *gm;
+    struct stat st;
+    uint64_t dtb = 0;
+    void *base;
+    size_t i;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)GM_PAGE_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+    madvise(base, (size_t)st.st_size, MADV_RANDOM);
+
+    pb = calloc(1, sizeof(*pb));
+    if (!pb) {
+        munmap(base, (size_t)st.st_size);
+        return NULL;
+    }
+    pb->base = base;
+    pb->size = (uint64_t)st.st_size;
+    pb->slots = calloc(PACK_CACHE_SLOTS, sizeof(*pb->slots));
+    if (!pb->slots || parse_pack(pb, &dtb) != 0) {
+        free(pb->slots);
+        pb->slots = NULL;
+        pack_close(pb);
+        return NULL;
+    }
+    for (i = 0; i < PACK_CACHE_SLOTS; i++) {
+        pthread_mutex_init(&pb->slots[i].lock, NULL);
+        pb->slots[i].chunk = PACK_ZERO;
+    }
+
+    gm = gm_create(&pack_ops, pb, cache_pages ? cache_pages : GM_DEFAULT_CACHE_PAGES, 0);
+    if (!gm) {
+        pack_close(pb);
+        return NULL;
+    }
+    if (dtb) gm_set_kernel_dtb(gm, dtb & ~(uint64_t)GM_PAGE_MASK);
+    return gm;
+}
+
+// Writer
+
+// Distinct pages waiting for compression. One batch fills while the
+// previous one is compressed by the workers.
+typedef struct {
+    uint8_t *pages;                     // PACK_BATCH_CHUNKS chunks
+    size_t npages;
+    uint64_t first_chunk;               // chunk number of pages[0]
+    uint8_t *out;                       // one PACK_CHUNK_SIZE slot per chunk
+    uint32_t sizes[PACK_BATCH_CHUNKS];  // compressed size, 0 if stored as is
+    uint64_t next;                      // next unclaimed chunk
+    pthread_t threads[PACK_BATCH_CHUNKS];
+    int nthreads;
+    int busy;
+} pack_batch_t;
+
+// First copy of every distinct page, by hash
+typedef struct {
+    uint64_t hash;
+    uint64_t pfn;                       // pfn + 1, 0 for an empty slot
+    uint32_t chunk, slot;
+} pack_seen_t;
+
+typedef struct {
+    FILE *f;
+    guest_mem_t *gm;
+    uint64_t offset;                    // file offset of the next chunk
+    pack_range_t *ranges;
+    size_t nranges, range_cap;
+    pack_page_t *pages;
+    size_t npages, page_cap;
+    pack_chunk_t *chunks;
+    size_t nchunks, chunk_cap;
+    pack_seen_t *seen;
+    size_t nseen, seen_cap;             // seen_cap is a power of two
+    pack_batch_t batch[2];
+    int fill;                           // batch being filled
+    int workers;
+    uint64_t zero_hash;
+    uint8_t *scratch;                   // one page for re-reads
+    gm_dump_stats_t *stats;
+} pack_writer_t;
+
+static int page_is_zero(const uint8_t *page) {
+    uint64_t acc = 0, v;
+    size_t i, j;
+
+    for (i = 0; i < GM_PAGE_SIZE; i += 64) {
+        for (j = 0; j < 64; j += 8) {
+            memcpy(&v, page + i + j, sizeof(v));
+            acc |= v;
+        }
+        if (acc) return 0;
+    }
+    return 1;
+}
+
+static void *compress_main(void *arg) {
+    pack_batch_t *b = arg;
+    size_t chunks = (b->npages + PACK_CHUNK_PAGES - 1) / PACK_CHUNK_PAGES;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED), len;
+
+        if (i >= chunks) break;
+        len = (b->npages - i * PACK_CHUNK_PAGES < PACK_CHUNK_PAGES ?
+               b->npages - i * PACK_CHUNK_PAGES : PACK_CHUNK_PAGES) * GM_PAGE_SIZE;
+        // Only blocks that shrink are kept
+        b->sizes[i] = (uint32_t)lz4_compress(b->pages + i * PACK_CHUNK_SIZE, len,
+                                             b->out + i * PACK_CHUNK_SIZE, len - 1);
+    }
+    return NULL;
+}
+
+// Compress a full batch in the background
+static void batch_start(pack_writer_t *w, pack_batch_t *b) {
+    size_t chunks = (b->npages + PACK_CHUNK_PAGES - 1) / PACK_CHUNK_PAGES;
+    int i, n = w->workers < (int)chunks ? w->workers : (int)chunks;
+
+    b->next = 0;
+    b->nthreads = 0;
+    b->busy = 1;
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&b->threads[b->nthreads], NULL, compress_main, b) != 0) break;
+        b->nthreads++;
+    }
+    // No thread at all: compress here
+    if (b->nthreads == 0) compress_main(b);
+}
+
+// Wait for a batch and append its chunks to the file
+static int batch_write(pack_writer_t *w, pack_batch_t *b) {
+    size_t chunks = (b->npages + PACK_CHUNK_PAGES - 1) / PACK_CHUNK_PAGES, i;
+    int n;
+
+    if (!b->busy) return 0;
+    for (n = 0; n < b->nthreads; n++) pthread_join(b->threads[n], NULL);
+    b->busy = 0;
+
+    for (i = 0; i < chunks; i++) {
+        uint32_t pages = b->npages - i * PACK_CHUNK_PAGES < PACK_CHUNK_PAGES ?
+                         (uint32_t)(b->npages - i * PACK_CHUNK_PAGES) : PACK_CHUNK_PAGES;
+        uint32_t size = b->sizes[i] ? b->sizes[i] : pages * (uint32_t)GM_PAGE_SIZE;
+        pack_chunk_t *c;
+
+        if (gm_grow((void**)&w->chunks, &w->chunk_cap, w->nchunks, sizeof(*w->chunks)) != 0) return -1;
+        c = &w->chunks[w->nchunks++];
+        c->offset = w->offset;
+        c->size = size;
+        c->pages = pages;
+        if (fwrite(b->sizes[i] ? b->out + i * PACK_CHUNK_SIZE : b->pages + i * PACK_CHUNK_SIZE,
+                   1, size, w->f) != size) {
+            return -1;
+        }
+        w->offset += size;
+    }
+    return 0;
+}
+
+// Hand the filled batch to the workers, after writing out the one they
+// were compressing
+static int batch_flush(pack_writer_t *w) {
+    pack_batch_t *b = &w->batch[w->fill], *other = &w->batch[!w->fill];
+
+    if (batch_write(w, other) != 0) return -1;
+    if (!b->npages) return 0;
+    batch_start(w, b);
+    w->fill = !w->fill;
+    other->npages = 0;
+    other->first_chunk = b->first_chunk + (b->npages + PACK_CHUNK_PAGES - 1) / PACK_CHUNK_PAGES;
+    return 0;
+}
+
+// Bytes of a stored page while its batch is still in memory
+static const uint8_t *held_page(const pack_writer_t *w, uint32_t chunk, uint32_t slot) {
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        const pack_batch_t *b = &w->batch[i];
+        uint64_t index = (chunk - b->first_chunk) * PACK_CHUNK_PAGES + slot;
+
+        if (chunk >= b->first_chunk && index < b->npages) return b->pages + index * GM_PAGE_SIZE;
+    }
+    return NULL;
+}
+
+static int seen_grow(pack_writer_t *w) {
+    size_t cap = w->seen_cap ? w->seen_cap * 2 : 1 << 16, i;
+    pack_seen_t *seen = calloc(cap, sizeof(*seen));
+
+    if (!seen) return -1;
+    for (i = 0; i < w->seen_cap; i++) {
+        size_t j;
+
+        if (!w->seen[i].pfn) continue;
+        for (j = w->seen[i].hash & (cap - 1); seen[j].pfn; j = (j + 1) & (cap - 1));
+        seen[j] = w->seen[i];
+    }
+    free(w->seen);
+    w->seen = seen;
+    w->seen_cap = cap;
+    return 0;
+}
+
+// A page with the same hash was stored before: point at it if the bytes
+// really are the same. The earlier copy is read back from the source when
+// its batch is gone; a live guest may have changed it meanwhile, and then
+// the page is simply stored again.
+static int find_copy(pack_writer_t *w, uint64_t hash, const uint8_t *page, pack_page_t *entry,
+                     pack_seen_t **slot) {
+    size_t j;
+
+    for (j = hash & (w->seen_cap - 1); w->seen[j].pfn; j = (j + 1) & (w->seen_cap - 1)) {
+        const pack_seen_t *s = &w->seen[j];
+        const uint8_t *copy;
+
+        if (s->hash != hash) continue;
+        copy = held_page(w, s->chunk, s->slot);
+        if (!copy) {
+            gm_fetch_pages(w->gm, s->pfn - 1, 1, w->scratch, &copy);
+        }
+        if (copy && memcmp(copy, page, GM_PAGE_SIZE) == 0) {
+            entry->chunk = s->chunk;
+            entry->slot = s->slot;
+            return 1;
+        }
+        // Keep the first copy; a colliding page is stored on its own
+        *slot = NULL;
+        return 0;
+    }
+    *slot = &w->seen[j];
+    return 0;
+}
+
+static int pack_page(pack_writer_t *w, uint64_t pfn, const uint8_t *page) {
+    pack_range_t *last = w->nranges ? &w->ranges[w->nranges - 1] : NULL;
+    pack_batch_t *b = &w->batch[w->fill];
+    pack_page_t *entry;
+    pack_seen_t *slot;
+
+    if (!last || last->pfn + last->count != pfn) {
+        if (gm_grow((void**)&w->ranges, &w->range_cap, w->nranges, sizeof(*w->ranges)) != 0) return -1;
+        last = &w->ranges[w->nranges++];
+        last->pfn = pfn;
+        last->count = 0;
+        last->first = w->npages;
+    }
+    last->count++;
+    if (gm_grow((void**)&w->pages, &w->page_cap, w->npages, sizeof(*w->pages)) != 0) return -1;
+    entry = &w->pages[w->npages++];
+
+    if (page_is_zero(page)) {
+        entry->hash = w->zero_hash;
+        entry->chunk = PACK_ZERO;
+        entry->slot = 0;
+        w->stats->zero++;
+        return 0;
+    }
+    entry->hash = gm_hash_page(page);
+    if ((w->nseen + 1) * 2 > w->seen_cap && seen_grow(w) != 0) return -1;
+    if (find_copy(w, entry->hash, page, entry, &slot)) {
+        w->stats->duplicate++;
+        return 0;
+    }
+
+    entry->chunk = (uint32_t)(b->first_chunk + b->npages / PACK_CHUNK_PAGES);
+    entry->slot = (uint32_t)(b->npages % PACK_CHUNK_PAGES);
+    if (slot) {
+        slot->hash = entry->hash;
+        slot->pfn = pfn + 1;
+        slot->chunk = entry->chunk;
+        slot->slot = entry->slot;
+        w->nseen++;
+    }
+    memcpy(b->pages + b->npages * GM_PAGE_SIZE, page, GM_PAGE_SIZE);
+    if (++b->npages == PACK_BATCH_CHUNKS * PACK_CHUNK_PAGES) return batch_flush(w);
+    return 0;
+}
+
+// n consecutive pages from pfn, skipping the unreadable ones
+static int pack_run(pack_writer_t *w, uint64_t pfn, size_t n, uint8_t *buf) {
+    const uint8_t *pages[GM_MAX_BATCH];
+    size_t i;
+
+    gm_fetch_pages(w->gm, pfn, n, buf, pages);
+    for (i = 0; i < n; i++) {
+        if (!pages[i]) {
+            w->stats->unreadable++;
+            continue;
+        }
+        if (pack_page(w, pfn + i, pages[i]) != 0) return -1;
+        w->stats->pages++;
+    }
+    return 0;
+}
+
+// The last chunks, the tables, then the header
+static int pack_finish(pack_writer_t *w, uint64_t dtb) {
+    static const uint8_t pad[8];
+    pack_header_t h;
+    size_t align;
+
+    if (batch_flush(w) != 0 || batch_write(w, &w->batch[!w->fill]) != 0) return -1;
+    if (w->nranges == 0) {
+        errno = ENODATA;
+        return -1;
+    }
+    // The tables are used in place, so they start 8-byte aligned
+    align = (size_t)(-w->offset & 7);
+    if (fwrite(pad, 1, align, w->f) != align) return -1;
+    w->offset += align;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GM_PACK_MAGIC, sizeof(h.magic));
+    h.version = PACK_VERSION;
+    h.chunk_pages = PACK_CHUNK_PAGES;
+    h.dtb = dtb;
+    h.nranges = w->nranges;
+    h.ranges_offset = w->offset;
+    h.npages = w->npages;
+    h.pages_offset = h.ranges_offset + w->nranges * sizeof(*w->ranges);
+    h.nchunks = w->nchunks;
+    h.chunks_offset = h.pages_offset + w->npages * sizeof(*w->pages);
+    if (fwrite(w->ranges, sizeof(*w->ranges), w->nranges, w->f) != w->nranges ||
+        fwrite(w->pages, sizeof(*w->pages), w->npages, w->f) != w->npages ||
+        (w->nchunks && fwrite(w->chunks, sizeof(*w->chunks), w->nchunks, w->f) != w->nchunks)) {
+        return -1;
+    }
+    w->offset = h.chunks_offset + w->nchunks * sizeof(*w->chunks);
+    if (fseeko(w->f, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, w->f) != 1) return -1;
+    return 0;
+}
+
+int gm_dump_packed(guest_mem_t *gm, const char *path, const uint64_t *pfns, size_t n,
+                   uint64_t dtb, int workers, gm_dump_stats_t *stats) {
+    static const uint8_t zero[GM_PAGE_SIZE];
+    uint64_t start = gm_now_ns(), end_pfn, pfn;
+    uint8_t *buf = malloc(GM_MAX_BATCH * GM_PAGE_SIZE);
+    pack_writer_t w;
+    size_t i, k;
+    int ret = -1, saved, j;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&w, 0, sizeof(w));
+    w.gm = gm;
+    w.stats = stats;
+    w.workers = workers < 1 ? 1 : workers;
+    w.zero_hash = gm_hash_page(zero);
+    w.scratch = malloc(GM_PAGE_SIZE);
+    for (j = 0; j < 2; j++) {
+        w.batch[j].pages = malloc(PACK_BATCH_CHUNKS * PACK_CHUNK_SIZE);
+        w.batch[j].out = malloc(PACK_BATCH_CHUNKS * PACK_CHUNK_SIZE);
+    }
+    if (!buf || !w.scratch || !w.batch[0].pages || !w.batch[0].out || !w.batch[1].pages ||
+        !w.batch[1].out || seen_grow(&w) != 0) {
+        errno = ENOMEM;
+        goto out;
+    }
+    end_pfn = gm_phys_end(gm) >> GM_PAGE_SHIFT;
+    if (!pfns && end_pfn == 0) {
+        errno = EINVAL;
+        goto out;
+    }
+    w.f = fopen(path, "wb");
+    if (!w.f) goto out;
+    // Chunks leave in large sequential writes
+    setvbuf(w.f, NULL, _IOFBF, 8 << 20);
+
+    // The header page stays zero until pack_finish()
+    memset(buf, 0, GM_PAGE_SIZE);
+    if (fwrite(buf, 1, GM_PAGE_SIZE, w.f) != GM_PAGE_SIZE) goto out;
+    w.offset = GM_PAGE_SIZE;
+
+    if (!pfns) {
+        for (pfn = 0; pfn < end_pfn; pfn += k) {
+            k = end_pfn - pfn < GM_MAX_BATCH ? (size_t)(end_pfn - pfn) : GM_MAX_BATCH;
+            if (pack_run(&w, pfn, k, buf) != 0) goto out;
+        }
+        // Holes in the physical range are not pages anybody asked for
+        stats->unreadable = 0;
+    } else {
+        for (i = 0; i < n; i += k) {
+            for (k = 1; i + k < n && k < GM_MAX_BATCH && pfns[i + k] == pfns[i] + k; k++);
+            if (pack_run(&w, pfns[i], k, buf) != 0) goto out;
+        }
+    }
+    if (pack_finish(&w, dtb ? dtb : gm_kernel_dtb(gm)) != 0) goto out;
+    ret = 0;
+
+out:
+    saved = errno;
+    // Workers may still be compressing after a failed write
+    for (j = 0; j < 2; j++) {
+        int t;
+
+        if (w.batch[j].busy) {
+            for (t = 0; t < w.batch[j].nthreads; t++) pthread_join(w.batch[j].threads[t], NULL);
+        }
+    }
+    if (w.f && fclose(w.f) != 0 && ret == 0) {
+        saved = errno;
+        ret = -1;
+    }
+    stats->bytes = w.offset;
+    stats->ns = gm_now_ns() - start;
+    free(buf);
+    free(w.scratch);
+    for (j = 0; j < 2; j++) {
+        free(w.batch[j].pages);
+        free(w.batch[j].out);
+    }
+    free(w.ranges);
+    free(w.pages);
+    free(w.chunks);
+    free(w.seen);
+    errno = saved;
+    return ret;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "guest_mem.h"
+
+// /proc/PID/mem backend for QEMU guests when LibVMI's KVM driver is not
+// available. Guest RAM is found in /proc/PID/maps and read through one
+// long-lived descriptor, or with process_vm_readv for scattered batches.
+
+typedef struct {
+    int pid;
+    int mem_fd;
+    int use_vm_readv;       // cleared once process_vm_readv is refused
+    uint64_t ram_hva;       // guest RAM block inside the QEMU process
+    uint64_t ram_size;
+    gm_ram_layout_t layout;
+} proc_backend_t;
+
+static int is_ram_name(const char *path) {
+    return strstr(path, "pc.ram") || strstr(path, "ram-node") || strstr(path, "memfd:");
+}
+
+// Prefer a mapping named after a RAM block (memfd:pc.ram, .../pc.ram),
+// otherwise take the largest read-write mapping. Named mappings that
+// follow each other directly (one RAM block made of several files) are
+// treated as one.
+static int find_guest_ram(int pid, uint64_t *hva, uint64_t *size) {
+    char path[64], line[512];
+    uint64_t best_start = 0, best_size = 0;
+    uint64_t run_start = 0, run_end = 0;
+    int best_named = 0, run_named = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long start, end;
+        char perms[5];
+        int name_at = 0, named;
+        char *name;
+
+        if (sscanf(line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms, &name_at) < 3) {
+            continue;
+        }
+        if (perms[0] != 'r' || perms[1] != 'w') continue;
+
+        name = line + name_at;
+        name[strcspn(name, "\n")] = '\0';
+        if (name[0] == '[') continue;           // [heap], [stack], ...
+
+        named = is_ram_name(name);
+        if (named && run_named && start == run_end) {
+            run_end = end;
+        } else {
+            run_start = start;
+            run_end = end;
+            run_named = named;
+        }
+
+        if (run_named > best_named || (run_named == best_named && run_end - run_start > best_size)) {
+            best_start = run_start;
+            best_size = run_end - run_start;
+            best_named = run_named;
+        }
+    }
+    fclose(fp);
+
+    if (best_size == 0) return -1;
+    *hva = best_start;
+    *size = best_size;
+    return 0;
+}
+
+static int gpa_to_hva(const proc_backend_t *pb, uint64_t gpa, uint64_t *hva) {
+    uint64_t offset;
+    if (gm_ram_layout_lookup(&pb->layout, gpa, &offset, NULL) != 0) return -1;
+    *hva = pb->ram_hva + offset;
+    return 0;
+}
+
+static int proc_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    proc_backend_t *pb = priv;
+    uint64_t hva;
+
+    if (gpa_to_hva(pb, pfn << GM_PAGE_SHIFT, &hva) != 0) return -1;
+    return pread(pb->mem_fd, page, GM_PAGE_SIZE, (off_t)hva) == (ssize_t)GM_PAGE_SIZE ? 0 : -1;
+}
+
+// Read runs of pages that are contiguous in QEMU with one preadv each
+static void preadv_runs(proc_backend_t *pb, const uint64_t *hvas, size_t n,
+                        uint8_t *const *pages, int *ok) {
+    struct iovec iov[GM_MAX_BATCH];
+    size_t i = 0;
+
+    while (i < n) {
+        size_t run = 0, j;
+        ssize_t got;
+
+        if (ok[i] || hvas[i] == 0) {
+            i++;
+            continue;
+        }
+        while (i + run < n && !ok[i + run] && hvas[i + run] == hvas[i] + run * GM_PAGE_SIZE) {
+            iov[run].iov_base = pages[i + run];
+            iov[run].iov_len = GM_PAGE_SIZE;
+            run++;
+        }
+
+        got = preadv(pb->mem_fd, iov, (int)run, (off_t)hvas[i]);
+        for (j = 0; j < run && got >= (ssize_t)((j + 1) * GM_PAGE_SIZE); j++) {
+            ok[i + j] = 1;
+        }
+        i += run;
+    }
+}
+
+static size_t proc_read_pages(void *priv, const uint64_t *pfns, size_t n,
+                              uint8_t *const *pages, int *ok) {
+    proc_backend_t *pb = priv;
+    struct iovec local[GM_MAX_BATCH], remote[GM_MAX_BATCH];
+    uint64_t hvas[GM_MAX_BATCH];
+    size_t i, k = 0, done = 0;
+
+    for (i = 0; i < n; i++) {
+        ok[i] = 0;
+        if (gpa_to_hva(pb, pfns[i] << GM_PAGE_SHIFT, &hvas[i]) != 0) {
+            hvas[i] = 0;
+            continue;
+        }
+        local[k].iov_base = pages[i];
+        local[k].iov_len = GM_PAGE_SIZE;
+        remote[k].iov_base = (void*)(uintptr_t)hvas[i];
+        remote[k].iov_len = GM_PAGE_SIZE;
+        k++;
+    }
+
+    if (pb->use_vm_readv && k > 0) {
+        // One syscall for the whole scatter/gather batch
+        ssize_t got = process_vm_readv(pb->pid, local, k, remote, k, 0);
+        size_t full;
+
+        if (got < 0 && (errno == EPERM || errno == ENOSYS)) {
+            pb->use_vm_readv = 0;
+            got = 0;
+        }
+        full = got > 0 ? (size_t)got / GM_PAGE_SIZE : 0;
+
+        // The kernel stops at the first failing page; mark what arrived
+        for (i = 0; i < n && full > 0; i++) {
+            if (hvas[i] == 0) continue;
+            ok[i] = 1;
+            full--;
+        }
+    }
+
+    // Whatever is left goes through the persistent /proc/PID/mem descriptor
+    preadv_runs(pb, hvas, n, pages, ok);
+
+    for (i = 0; i < n; i++) done += ok[i];
+    return done;
+}
+
+static uint64_t proc_phys_end(void *priv) {
+    return gm_ram_layout_end(&((proc_backend_t*)priv)->layout);
+}
+
+static void proc_close(void *priv) {
+    proc_backend_t *pb = priv;
+    close(pb->mem_fd);
+    free(pb);
+}
+
+static const gm_backend_ops_t proc_ops = {
+    .name = "procmem",
+    .read_page = proc_read_page,
+    .translate = NULL,      // guest page tables are walked by guest_mem
+    .close = proc_close,
+    .read_pages = proc_read_pages,
+    .phys_end = proc_phys_end,
+};
+
+guest_mem_t *gm_open_proc(int pid, uint64_t lowmem, size_t cache_pages) {
+    proc_backend_t *pb;
+    guest_mem_t *gm;
+    char path[64];
+
+    pb = calloc(1, sizeof(*pb));
+    if (!pb) return NULL;
+    pb->pid = pid;
+    pb->use_vm_readv = 1;
+
+    if (find_guest_ram(pid, &pb->ram_hva, &pb->ram_size) != 0) {
+        free(pb);
+        return NULL;
+    }
+    gm_ram_layout_init(&pb->layout, pb->ram_size, lowmem);
+
+    snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+    pb->mem_fd = open(path, O_RDONLY);
+    if (pb->mem_fd < 0) {
+        free(pb);
+        return NULL;
+    }
+
+    gm = gm_create(&proc_ops, pb, cache_pages, 0);
+    if (!gm) proc_close(pb);
+    return gm;
+}
@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "guest_mem.h"
+#include "x86_pt.h"
+
+// Private page snapshot: a copy of every guest page and translation a
+// walk touched, which can then be served as a backend of its own.
+
+#define SNAP_CHUNK_PAGES 64
+#define SNAP_EMPTY UINT64_MAX
+
+typedef struct {
+    uint64_t pfn;           // SNAP_EMPTY for an unused slot
+    size_t index;           // page number inside the chunk store
+} snap_page_slot_t;
+
+typedef struct {
+    uint64_t dtb;
+    uint64_t vpn;           // SNAP_EMPTY for an unused slot
+    uint64_t pfn;
+} snap_xlat_slot_t;
+
+struct gm_snapshot {
+    pthread_mutex_t lock;   // recording views may run on several threads
+
+    uint8_t **chunks;
+    size_t nchunks;
+    size_t npages;
+
+    snap_page_slot_t *pages;
+    size_t page_slots;
+
+    snap_xlat_slot_t *xlat;
+    size_t xlat_slots, nxlat;
+};
+
+gm_snapshot_t *gm_snapshot_create(void) {
+    gm_snapshot_t *snap = calloc(1, sizeof(*snap));
+    if (!snap) return NULL;
+
+    pthread_mutex_init(&snap->lock, NULL);
+    snap->page_slots = 1024;
+    snap->xlat_slots = 1024;
+    snap->pages = malloc(snap->page_slots * sizeof(*snap->pages));
+    snap->xlat = malloc(snap->xlat_slots * sizeof(*snap->xlat));
+    if (!snap->pages || !snap->xlat) {
+        gm_snapshot_destroy(snap);
+        return NULL;
+    }
+    memset(snap->pages, 0xff, snap->page_slots * sizeof(*snap->pages));
+    memset(snap->xlat, 0xff, snap->xlat_slots * sizeof(*snap->xlat));
+    return snap;
+}
+
+void gm_snapshot_destroy(gm_snapshot_t *snap) {
+    size_t i;
+    if (!snap) return;
+    for (i = 0; i < snap->nchunks; i++) free(snap->chunks[i]);
+    free(snap->chunks);
+    free(snap->pages);
+    free(snap->xlat);
+    pthread_mutex_destroy(&snap->lock);
+    free(snap);
+}
+
+size_t gm_snapshot_pages(const gm_snapshot_t *snap) {
+    return snap->npages;
+}
+
+static uint8_t *page_data(const gm_snapshot_t *snap, size_t index) {
+    return snap->chunks[index / SNAP_CHUNK_PAGES] + (index % SNAP_CHUNK_PAGES) * GM_PAGE_SIZE;
+}
+
+static snap_page_slot_t *find_page(const gm_snapshot_t *snap, uint64_t pfn) {
+    size_t mask = snap->page_slots - 1;
+    size_t i = (size_t)gm_mix64(pfn) & mask;
+    while (snap->pages[i].pfn != SNAP_EMPTY && snap->pages[i].pfn != pfn) {
+        i = (i + 1) & mask;
+    }
+    return &snap->pages[i];
+}
+
+static snap_xlat_slot_t *find_xlat(const gm_snapshot_t *snap, uint64_t dtb, uint64_t vpn) {
+    size_t mask = snap->xlat_slots - 1;
+    size_t i = (size_t)gm_mix64(vpn ^ (dtb * 0x9e3779b97f4a7c15ULL)) & mask;
+    while (snap->xlat[i].vpn != SNAP_EMPTY &&
+           !(snap->xlat[i].vpn == vpn && snap->xlat[i].dtb == dtb)) {
+        i = (i + 1) & mask;
+    }
+    return &snap->xlat[i];
+}
+
+static int grow_pages(gm_snapshot_t *snap) {
+    snap_page_slot_t *old = snap->pages;
+    size_t old_slots = snap->page_slots, i;
+
+    snap->page_slots *= 2;
+    snap->pages = malloc(snap->page_slots * sizeof(*snap->pages));
+    if (!snap->pages) {
+        snap->pages = old;
+        snap->page_slots = old_slots;
+        return -1;
+    }
+    memset(snap->pages, 0xff, snap->page_slots * sizeof(*snap->pages));
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].pfn != SNAP_EMPTY) *find_page(snap, old[i].pfn) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static int grow_xlat(gm_snapshot_t *snap) {
+    snap_xlat_slot_t *old = snap->xlat;
+    size_t old_slots = snap->xlat_slots, i;
+
+    snap->xlat_slots *= 2;
+    snap->xlat = malloc(snap->xlat_slots * sizeof(*snap->xlat));
+    if (!snap->xlat) {
+        snap->xlat = old;
+        snap->xlat_slots = old_slots;
+        return -1;
+    }
+    memset(snap->xlat, 0xff, snap->xlat_slots * sizeof(*snap->xlat));
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].vpn != SNAP_EMPTY) *find_xlat(snap, old[i].dtb, old[i].vpn) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static int put_page_locked(gm_snapshot_t *snap, uint64_t pfn, const uint8_t *page) {
+    snap_page_slot_t *slot;
+
+    if ((snap->npages + 1) * 2 > snap->page_slots && grow_pages(snap) != 0) {
+        return -1;
+    }
+    slot = find_page(snap, pfn);
+    if (slot->pfn == pfn) {
+        return 0;               // first copy wins: it is the paused state
+    }
+
+    if (snap->npages == snap->nchunks * SNAP_CHUNK_PAGES) {
+        uint8_t **chunks = realloc(snap->chunks, (snap->nchunks + 1) * sizeof(*chunks));
+        if (!chunks) return -1;
+        snap->chunks = chunks;
+        snap->chunks[snap->nchunks] = malloc(SNAP_CHUNK_PAGES * GM_PAGE_SIZE);
+        if (!snap->chunks[snap->nchunks]) return -1;
+        snap->nchunks++;
+    }
+
+    slot->pfn = pfn;
+    slot->index = snap->npages++;
+    memcpy(page_data(snap, slot->index), page, GM_PAGE_SIZE);
+    return 0;
+}
+
+int gm_snapshot_put_page(gm_snapshot_t *snap, uint64_t pfn, const uint8_t *page) {
+    int ret;
+    pthread_mutex_lock(&snap->lock);
+    ret = put_page_locked(snap, pfn, page);
+    pthread_mutex_unlock(&snap->lock);
+    return ret;
+}
+
+int gm_snapshot_put_translation(gm_snapshot_t *snap, uint64_t dtb, uint64_t va, uint64_t pa) {
+    snap_xlat_slot_t *slot;
+
+    pthread_mutex_lock(&snap->lock);
+    if ((snap->nxlat + 1) * 2 > snap->xlat_slots && grow_xlat(snap) != 0) {
+        pthread_mutex_unlock(&snap->lock);
+        return -1;
+    }
+    slot = find_xlat(snap, dtb, va >> GM_PAGE_SHIFT);
+    if (slot->vpn == SNAP_EMPTY) snap->nxlat++;
+    slot->dtb = dtb;
+    slot->vpn = va >> GM_PAGE_SHIFT;
+    slot->pfn = pa >> GM_PAGE_SHIFT;
+    pthread_mutex_unlock(&snap->lock);
+    return 0;
+}
+
+// Backend serving reads from the snapshot only; misses fail. Lookups
+// never modify the snapshot, so readers need no lock once recording ends.
+static int snapshot_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    gm_snapshot_t *snap = priv;
+    snap_page_slot_t *slot = find_page(snap, pfn);
+    if (slot->pfn != pfn) return -1;
+    memcpy(page, page_data(snap, slot->index), GM_PAGE_SIZE);
+    return 0;
+}
+
+static int snapshot_translate(void *priv, uint64_t dtb, uint64_t va, uint64_t *pa) {
+    gm_snapshot_t *snap = priv;
+    snap_xlat_slot_t *slot = find_xlat(snap, dtb, va >> GM_PAGE_SHIFT);
+    if (slot->vpn == SNAP_EMPTY) return -1;
+    *pa = slot->pfn << GM_PAGE_SHIFT;
+    return 0;
+}
+
+static const gm_backend_ops_t snapshot_ops = {
+    .name = "snapshot",
+    .read_page = snapshot_read_page,
+    .translate = snapshot_translate,
+    .close = NULL,          // the caller owns the snapshot
+};
+
+guest_mem_t *gm_open_snapshot(gm_snapshot_t *snap, size_t cache_pages) {
+    return gm_create(&snapshot_ops, snap, cache_pages, 0);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+uint64_t *gm_snapshot_pfns(const gm_snapshot_t *snap, size_t *count) {
+    uint64_t *pfns;
+    size_t i, n = 0;
+
+    *count = 0;
+    if (snap->npages == 0) return NULL;
+    pfns = malloc(snap->npages * sizeof(*pfns));
+    if (!pfns) return NULL;
+    for (i = 0; i < snap->page_slots; i++) {
+        if (snap->pages[i].pfn != SNAP_EMPTY) pfns[n++] = snap->pages[i].pfn;
+    }
+    qsort(pfns, n, sizeof(*pfns), compare_u64);
+    *count = n;
+    return pfns;
+}
+
+// Page-table reads of gm_snapshot_add_tables(): each table page is copied
+// into the snapshot as it is read
+typedef struct {
+    gm_snapshot_t *snap;
+    guest_mem_t *gm;
+    uint8_t page[GM_PAGE_SIZE];
+    size_t added;
+} table_reader_t;
+
+static int read_table_pte(void *ctx, uint64_t pa, uint64_t *pte) {
+    table_reader_t *r = ctx;
+    uint64_t base = pa & ~(uint64_t)GM_PAGE_MASK;
+    snap_page_slot_t *slot;
+
+    if (gm_read_pa(r->gm, base, r->page, GM_PAGE_SIZE) != GM_PAGE_SIZE) return -1;
+    pthread_mutex_lock(&r->snap->lock);
+    slot = find_page(r->snap, base >> GM_PAGE_SHIFT);
+    if (slot->pfn != base >> GM_PAGE_SHIFT && put_page_locked(r->snap, base >> GM_PAGE_SHIFT, r->page) == 0) {
+        r->added++;
+    }
+    pthread_mutex_unlock(&r->snap->lock);
+    memcpy(pte, r->page + (pa & GM_PAGE_MASK), sizeof(*pte));
+    return 0;
+}
+
+size_t gm_snapshot_add_tables(gm_snapshot_t *snap, guest_mem_t *gm, uint64_t kernel_dtb) {
+    table_reader_t *r = malloc(sizeof(*r));
+    x86_pwc_t *pwc = malloc(sizeof(*pwc));
+    size_t i, added = 0;
+
+    if (r && pwc) {
+        r->snap = snap;
+        r->gm = gm;
+        r->added = 0;
+        // Upper levels already copied are skipped through the walk cache
+        x86_pwc_init(pwc);
+        for (i = 0; i < snap->xlat_slots; i++) {
+            const snap_xlat_slot_t *t = &snap->xlat[i];
+            uint64_t cr3 = t->dtb == GM_KERNEL_DTB ? kernel_dtb : t->dtb, pa;
+            x86_walk_t w;
+
+            if (t->vpn == SNAP_EMPTY || !cr3) continue;
+            x86_walk_init(&w, read_table_pte, r, pwc, cr3);
+            x86_walk(&w, t->vpn << GM_PAGE_SHIFT, &pa, NULL);
+        }
+        added = r->added;
+    }
+    free(r);
+    free(pwc);
+    return added;
+}
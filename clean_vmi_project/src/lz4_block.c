@@ -0,0 +1,193 @@
+#include <string.h>
+#include "lz4_block.h"
+
+// Greedy single-probe compressor in the style of LZ4's fast mode: a hash
+// of the next four bytes picks the one earlier position to try, matches
+// are extended a word at a time, and the stride grows while nothing
+// matches so incompressible data passes through quickly.
+
+#define MIN_MATCH     4
+#define LAST_LITERALS 5             // a block ends in at least 5 literals
+#define MF_LIMIT      12            // and its last match starts 12 bytes before the end
+#define HASH_BITS     13
+#define SKIP_SHIFT    6
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// Bytes of a and b that match, up to limit (the end of a)
+static inline size_t match_length(const uint8_t *a, const uint8_t *b, const uint8_t *limit) {
+    const uint8_t *start = a;
+
+    while (a + 8 <= limit) {
+        uint64_t x = read64(a) ^ read64(b);
+        if (x) return (size_t)(a - start) + (__builtin_ctzll(x) >> 3);
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return (size_t)(a - start);
+}
+
+// Copy n bytes 16 at a time, writing up to 15 past d + n; callers leave
+// that much room. Sources closer than 16 bytes behind d must not use it.
+static inline void wild_copy(uint8_t *d, const uint8_t *s, size_t n) {
+    uint8_t *end = d + n;
+
+    do {
+        memcpy(d, s, 16);
+        d += 16;
+        s += 16;
+    } while (d < end);
+}
+
+// 15 in the token, then bytes of 255 and a final byte below 255
+static inline uint8_t *put_length(uint8_t *op, size_t n) {
+    for (n -= 15; n >= 255; n -= 255) *op++ = 255;
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+static uint8_t *put_literals(uint8_t *op, const uint8_t *oend, uint8_t *token, const uint8_t *lit, size_t n,
+                             const uint8_t *end) {
+    if (n >= 15) {
+        *token = 15 << 4;
+        op = put_length(op, n);
+    } else {
+        *token = (uint8_t)(n << 4);
+    }
+    if ((size_t)(oend - op) >= n + 16 && (size_t)(end - lit) >= n + 16) wild_copy(op, lit, n);
+    else memcpy(op, lit, n);
+    return op + n;
+}
+
+size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    uint16_t table[1 << HASH_BITS];
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst, *oend = dst + cap, *token;
+    size_t lit;
+
+    if (len > LZ4_BLOCK_MAX) return 0;
+
+    if (len > MF_LIMIT) {
+        const uint8_t *mf_limit = end - MF_LIMIT, *match_limit = end - LAST_LITERALS;
+
+        // Every slot starts out pointing at position 0, which is checked
+        // like any other candidate
+        memset(table, 0, sizeof(table));
+        ip++;
+        while (ip <= mf_limit) {
+            uint32_t seq = read32(ip), h = hash4(seq);
+            const uint8_t *ref = src + table[h];
+            size_t mlen;
+
+            table[h] = (uint16_t)(ip - src);
+            if (ref >= ip || read32(ref) != seq) {
+                ip += 1 + ((size_t)(ip - anchor) >> SKIP_SHIFT);
+                continue;
+            }
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            mlen = MIN_MATCH + match_length(ip + MIN_MATCH, ref + MIN_MATCH, match_limit);
+
+            // Token, literal length, literals, offset, match length
+            lit = (size_t)(ip - anchor);
+            if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit + 2 + (mlen - MIN_MATCH) / 255 + 1) return 0;
+            token = op++;
+            op = put_literals(op, oend, token, anchor, lit, end);
+            *op++ = (uint8_t)(ip - ref);
+            *op++ = (uint8_t)((ip - ref) >> 8);
+            if (mlen - MIN_MATCH >= 15) {
+                *token |= 15;
+                op = put_length(op, mlen - MIN_MATCH);
+            } else {
+                *token |= (uint8_t)(mlen - MIN_MATCH);
+            }
+
+            ip += mlen;
+            anchor = ip;
+            // The bytes just matched are likely to come up again
+            if (ip <= mf_limit) table[hash4(read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+        }
+    }
+
+    lit = (size_t)(end - anchor);
+    if ((size_t)(oend - op) < 1 + lit / 255 + 1 + lit) return 0;
+    token = op++;
+    op = put_literals(op, oend, token, anchor, lit, end);
+    return (size_t)(op - dst);
+}
+
+// Length continued in extra bytes; -1 when the input ends first
+static inline int get_length(const uint8_t **ip, const uint8_t *iend, size_t *n) {
+    uint8_t b;
+
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t out_len) {
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = dst, *oend = dst + out_len;
+
+    for (;;) {
+        size_t lit, mlen, off, d;
+        uint8_t token;
+
+        if (ip >= iend) return -1;
+        token = *ip++;
+        lit = token >> 4;
+        if (lit == 15 && get_length(&ip, iend, &lit) != 0) return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        if ((size_t)(iend - ip) >= lit + 16 && (size_t)(oend - op) >= lit + 16) wild_copy(op, ip, lit);
+        else memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break;          // the last sequence has no match
+
+        if (iend - ip < 2) return -1;
+        off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        mlen = token & 15;
+        if (mlen == 15 && get_length(&ip, iend, &mlen) != 0) return -1;
+        mlen += MIN_MATCH;
+        if (off == 0 || off > (size_t)(op - dst) || mlen > (size_t)(oend - op)) return -1;
+
+        if (off >= 16 && (size_t)(oend - op) >= mlen + 16) {
+            wild_copy(op, op - off, mlen);
+            op += mlen;
+            continue;
+        }
+        // A match closer than its length repeats a pattern of off bytes;
+        // copy it in doubling steps that never overlap
+        for (d = off; mlen; d *= 2) {
+            size_t c = mlen < d ? mlen : d;
+            memcpy(op, op - d, c);
+            op += c;
+            mlen -= c;
+        }
+    }
+    return op == oend ? 0 : -1;
+}
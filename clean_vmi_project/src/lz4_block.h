@@ -0,0 +1,29 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format (the raw block, no frame), kept in the tree so
+// compressed captures need no library. Blocks are what the reference
+// LZ4_compress_default() / LZ4_decompress_safe() exchange: a run of
+// sequences, each a token, literals and a 16-bit back offset, ending in
+// literals. Inputs are at most LZ4_BLOCK_MAX bytes, so every offset stays
+// inside the block and the compressor's match table fits on the stack.
+
+#define LZ4_BLOCK_MAX 65536
+
+// Worst-case compressed size of n input bytes
+#define LZ4_BLOCK_BOUND(n) ((n) + (n) / 255 + 16)
+
+// Compress len bytes into dst (cap bytes). Returns the compressed size,
+// or 0 when it would not fit in cap or len is over LZ4_BLOCK_MAX; pass a
+// cap below len to only keep blocks that shrink.
+size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+// Decompress a block that must expand to exactly out_len bytes. Never
+// reads or writes out of bounds, whatever the input. Returns 0, or -1
+// for a malformed block.
+int lz4_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t out_len);
+
+#endif
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "guest_mem.h"
+#include "x86_pt.h"
+
+// Self-check for the RAM backends without a VM. Fake guest RAM lives in
+// two files on tmpfs (like a two-node memory-backend-file). Every page is
+// stamped with its RAM-block offset, and a small set of page tables maps
+// kernel-looking VAs, so physical reads, the PCI-hole split and the
+// built-in page walker are exercised through:
+//   - the mmap backend, mapping the files directly, and
+//   - the /proc/PID/mem backend, against a child process that maps the
+//     same RAM and stands in for QEMU, and
+//   - the image backend, on the same RAM written as an ELF core (with a
+//     QEMU CPU note carrying CR3) and as a sparse raw dump.
+
+#define FAKE_RAM_SIZE   (64UL << 20)
+#define FAKE_LOWMEM     (FAKE_RAM_SIZE / 2)
+#define FAKE_STAMP      0x4d454d4b53484b43ULL
+#define FAKE_DTB        0x1000
+#define FAKE_VA_4K      0xfffff80000001000ULL
+#define FAKE_VA_2M      0xfffff80000200000ULL
+#define FAKE_RAM_DIR    "/dev/shm"
+
+static uint64_t stamp_for(uint64_t offset) {
+    return FAKE_STAMP ^ (offset >> GM_PAGE_SHIFT);
+}
+
+// Offset of a guest physical address inside the fake RAM block
+static uint64_t ram_offset(uint64_t gpa) {
+    return gpa < GM_4GB ? gpa : FAKE_LOWMEM + (gpa - GM_4GB);
+}
+
+static void put_u64(uint8_t *ram, uint64_t gpa, uint64_t value) {
+    memcpy(ram + ram_offset(gpa), &value, sizeof(value));
+}
+
+static void build_fake_ram(uint8_t *ram) {
+    uint64_t off;
+
+    for (off = 0; off < FAKE_RAM_SIZE; off += GM_PAGE_SIZE) {
+        uint64_t stamp = stamp_for(off);
+        memcpy(ram + off, &stamp, sizeof(stamp));
+    }
+
+    // PML4 at 0x1000 -> PDPT 0x2000 -> PD 0x3000 -> PT 0x4000. Entry 0 of
+    // the PD is a table, entry 1 a 2 MiB page placed above the PCI hole.
+    put_u64(ram, FAKE_DTB + ((FAKE_VA_4K >> 39) & 0x1ff) * 8, 0x2000 | X86_PTE_PRESENT);
+    put_u64(ram, 0x2000 + ((FAKE_VA_4K >> 30) & 0x1ff) * 8, 0x3000 | X86_PTE_PRESENT);
+    put_u64(ram, 0x3000 + ((FAKE_VA_4K >> 21) & 0x1ff) * 8, 0x4000 | X86_PTE_PRESENT);
+    put_u64(ram, 0x3000 + ((FAKE_VA_2M >> 21) & 0x1ff) * 8,
+            (GM_4GB + 0x200000) | X86_PTE_PS | X86_PTE_PRESENT);
+    put_u64(ram, 0x4000 + ((FAKE_VA_4K >> 12) & 0x1ff) * 8, 0x7000 | X86_PTE_PRESENT);
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    return write(fd, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+// ELF core as dump-guest-memory writes it: a QEMU note for vCPU 0, then
+// one PT_LOAD per RAM range at its guest physical address
+static int write_elf_core(const char *path, const uint8_t *ram) {
+    struct {
+        Elf64_Nhdr nh;
+        char name[8];
+        uint8_t desc[456];          // sizeof(QEMUCPUState)
+    } note;
+    Elf64_Ehdr eh;
+    Elf64_Phdr ph[3];
+    uint64_t cr3 = FAKE_DTB, data = sizeof(eh) + sizeof(ph) + sizeof(note);
+    int fd, ret;
+
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_CORE;
+    eh.e_machine = EM_X86_64;
+    eh.e_version = EV_CURRENT;
+    eh.e_phoff = sizeof(eh);
+    eh.e_ehsize = sizeof(eh);
+    eh.e_phentsize = sizeof(Elf64_Phdr);
+    eh.e_phnum = 3;
+
+    memset(&note, 0, sizeof(note));
+    note.nh.n_namesz = 5;
+    note.nh.n_descsz = sizeof(note.desc);
+    note.nh.n_type = 0;
+    memcpy(note.name, "QEMU", 5);
+    memcpy(note.desc + 8 + 18 * 8 + 10 * 24 + 3 * 8, &cr3, sizeof(cr3));
+
+    memset(ph, 0, sizeof(ph));
+    ph[0].p_type = PT_NOTE;
+    ph[0].p_offset = sizeof(eh) + sizeof(ph);
+    ph[0].p_filesz = sizeof(note);
+    ph[1].p_type = PT_LOAD;
+    ph[1].p_offset = data;
+    ph[1].p_paddr = 0;
+    ph[1].p_filesz = ph[1].p_memsz = FAKE_LOWMEM;
+    ph[2].p_type = PT_LOAD;
+    ph[2].p_offset = data + FAKE_LOWMEM;
+    ph[2].p_paddr = GM_4GB;
+    ph[2].p_filesz = ph[2].p_memsz = FAKE_RAM_SIZE - FAKE_LOWMEM;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+    ret = write_all(fd, &eh, sizeof(eh)) | write_all(fd, ph, sizeof(ph)) |
+          write_all(fd, &note, sizeof(note)) | write_all(fd, ram, FAKE_RAM_SIZE);
+    close(fd);
+    return ret;
+}
+
+// Raw dump: file offset = guest physical address, the PCI hole a file hole
+static int write_raw_image(const char *path, const uint8_t *ram) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    int ret;
+
+    if (fd < 0) return -1;
+    ret = write_all(fd, ram, FAKE_LOWMEM);
+    if (ret == 0 && lseek(fd, (off_t)GM_4GB, SEEK_SET) != (off_t)GM_4GB) ret = -1;
+    if (ret == 0) ret = write_all(fd, ram + FAKE_LOWMEM, FAKE_RAM_SIZE - FAKE_LOWMEM);
+    close(fd);
+    return ret;
+}
+
+// Write the fake RAM as two halves, an ELF core and a raw dump; paths[4]
+// receives the file names
+static int create_fake_ram(char paths[4][64]) {
+    uint8_t *ram = calloc(1, FAKE_RAM_SIZE);
+    int i, ret = 0;
+
+    if (!ram) return -1;
+    build_fake_ram(ram);
+
+    for (i = 0; i < 2 && ret == 0; i++) {
+        uint64_t half = FAKE_RAM_SIZE / 2;
+        int fd;
+
+        snprintf(paths[i], 64, FAKE_RAM_DIR "/vmi-check-%d-pc.ram%d", (int)getpid(), i);
+        fd = open(paths[i], O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0 || write(fd, ram + i * half, half) != (ssize_t)half) ret = -1;
+        if (fd >= 0) close(fd);
+    }
+    snprintf(paths[2], 64, FAKE_RAM_DIR "/vmi-check-%d.elf", (int)getpid());
+    snprintf(paths[3], 64, FAKE_RAM_DIR "/vmi-check-%d.raw", (int)getpid());
+    if (ret == 0) ret = write_elf_core(paths[2], ram);
+    if (ret == 0) ret = write_raw_image(paths[3], ram);
+    free(ram);
+    return ret;
+}
+
+// Child process mapping the RAM files, as QEMU does with share=on
+static pid_t spawn_fake_qemu(char paths[4][64]) {
+    void *maps[2];
+    pid_t pid;
+    int i;
+
+    pid = fork();
+    if (pid != 0) return pid;
+
+    // QEMU keeps RAM in one block: reserve it, then map both files into it
+    maps[0] = mmap(NULL, FAKE_RAM_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    for (i = 0; i < 2 && maps[0] != MAP_FAILED; i++) {
+        int fd = open(paths[i], O_RDWR);
+        maps[i] = mmap((uint8_t*)maps[0] + i * (FAKE_RAM_SIZE / 2), FAKE_RAM_SIZE / 2,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        if (fd >= 0) close(fd);
+        if (maps[i] == MAP_FAILED) _exit(1);
+    }
+
+    // Keep the mapping alive until the parent is done
+    for (;;) pause();
+}
+
+// Read every page through the batched prefetch path and check its stamp
+static int check_all_pages(guest_mem_t *gm, uint64_t *reads) {
+    uint64_t gpas[2] = { 0, GM_4GB };
+    uint64_t sizes[2] = { FAKE_LOWMEM, FAKE_RAM_SIZE - FAKE_LOWMEM };
+    int r, bad = 0;
+
+    for (r = 0; r < 2; r++) {
+        uint64_t end = gpas[r] + sizes[r], batch;
+
+        for (batch = gpas[r]; batch < end; batch += GM_MAX_BATCH * GM_PAGE_SIZE) {
+            uint64_t pfns[GM_MAX_BATCH], gpa;
+            size_t n = 0, i;
+
+            for (gpa = batch; gpa < end && n < GM_MAX_BATCH; gpa += GM_PAGE_SIZE) {
+                pfns[n++] = gpa >> GM_PAGE_SHIFT;
+            }
+            gm_prefetch_pa(gm, pfns, n);
+
+            for (i = 0; i < n; i++) {
+                uint64_t value = 0;
+
+                gpa = pfns[i] << GM_PAGE_SHIFT;
+                (*reads)++;
+                // Page tables overwrite the stamps of their own pages
+                if (gpa < 0x5000) continue;
+                if (gm_read_pa(gm, gpa, &value, sizeof(value)) != sizeof(value) ||
+                    value != stamp_for(ram_offset(gpa))) {
+                    bad++;
+                }
+            }
+        }
+    }
+    return bad;
+}
+
+static int check_translation(guest_mem_t *gm) {
+    uint64_t pa, value;
+    int bad = 0;
+
+    if (gm_translate(gm, GM_KERNEL_DTB, FAKE_VA_4K + 0x123, &pa) != 0 || pa != 0x7123) {
+        printf("✗ 4 KiB translation failed\n");
+        bad++;
+    }
+    if (gm_translate(gm, GM_KERNEL_DTB, FAKE_VA_2M + 0x5000, &pa) != 0 ||
+        pa != GM_4GB + 0x205000) {
+        printf("✗ 2 MiB translation failed\n");
+        bad++;
+    }
+    if (gm_read_u64(gm, GM_KERNEL_DTB, FAKE_VA_2M + 0x5000, &value) != 0 ||
+        value != stamp_for(ram_offset(GM_4GB + 0x205000))) {
+        printf("✗ Virtual read through the 2 MiB page failed\n");
+        bad++;
+    }
+    if (gm_translate(gm, GM_KERNEL_DTB, 0xfffff80040000000ULL, &pa) == 0) {
+        printf("✗ Unmapped address translated\n");
+        bad++;
+    }
+    return bad;
+}
+
+// Read everything through one backend and report
+static int run_check(const char *name, guest_mem_t *gm, int zero_copy) {
+    uint64_t reads = 0, start, elapsed;
+    uint64_t want = stamp_for(ram_offset(GM_4GB + 0x205000));
+    const uint8_t *direct;
+    int bad = 0;
+
+    gm_set_kernel_dtb(gm, FAKE_DTB);
+
+    start = gm_now_ns();
+    bad += check_all_pages(gm, &reads);
+    elapsed = gm_now_ns() - start;
+    bad += check_translation(gm);
+
+    // Only a mapped backend hands out pointers; they must hold the same data
+    direct = gm_map_va(gm, GM_KERNEL_DTB, FAKE_VA_2M + 0x5000, 2 * GM_PAGE_SIZE);
+    if (zero_copy != (direct != NULL) || (direct && memcmp(direct, &want, sizeof(want)) != 0)) {
+        printf("✗ Zero-copy view mismatch\n");
+        bad++;
+    }
+
+    printf("%s: %lu pages checked in %.3f ms (%.0f pages/s)\n",
+           name, reads, elapsed / 1e6, elapsed ? reads * 1e9 / elapsed : 0.0);
+    gm_print_stats(gm, stdout);
+    gm_destroy(gm);
+    return bad;
+}
+
+int main(void) {
+    char paths[4][64], list[132];
+    guest_mem_t *gm;
+    int bad = 0, i;
+    pid_t pid;
+
+    printf("=== Guest RAM Backend Check ===\n");
+
+    if (create_fake_ram(paths) != 0) {
+        printf("❌ Could not create fake guest RAM in %s\n", FAKE_RAM_DIR);
+        return 1;
+    }
+    printf("✓ Fake guest RAM: %lu MiB in %s, %s\n", FAKE_RAM_SIZE >> 20, paths[0], paths[1]);
+
+    // mmap backend over both files
+    snprintf(list, sizeof(list), "%s,%s", paths[0], paths[1]);
+    gm = gm_open_mmap(list, FAKE_LOWMEM, 0);
+    if (gm) {
+        bad += run_check("mmap", gm, 1);
+    } else {
+        printf("❌ Failed to map %s\n", list);
+        bad++;
+    }
+
+    // /proc/PID/mem backend against a stand-in QEMU process
+    pid = spawn_fake_qemu(paths);
+    if (pid > 0) {
+        usleep(100000);     // let the child set up its mappings
+        gm = gm_open_proc(pid, FAKE_LOWMEM, 1024);
+        if (gm) {
+            bad += run_check("procmem", gm, 0);
+        } else {
+            printf("❌ Failed to open /proc/%d/mem\n", pid);
+            bad++;
+        }
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    } else {
+        printf("❌ Could not start fake QEMU process\n");
+        bad++;
+    }
+
+    // Offline images; the ELF core must bring its own kernel DTB
+    gm = gm_open_image(paths[2], 0);
+    if (gm && gm_kernel_dtb(gm) != FAKE_DTB) {
+        printf("✗ ELF core: CR3 note not picked up\n");
+        bad++;
+    }
+    if (gm) {
+        bad += run_check("image (ELF core)", gm, 1);
+    } else {
+        printf("❌ Failed to open %s\n", paths[2]);
+        bad++;
+    }
+    gm = gm_open_image(paths[3], 0);
+    if (gm) {
+        bad += run_check("image (raw)", gm, 1);
+    } else {
+        printf("❌ Failed to open %s\n", paths[3]);
+        bad++;
+    }
+
+    for (i = 0; i < 4; i++) {
+        unlink(paths[i]);
+    }
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ All reads matched\n");
+    return 0;
+}
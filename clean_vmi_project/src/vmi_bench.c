@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+#include "win_parallel.h"
+#include "win_scan.h"
+#include "win_psscan.h"
+#include "win_sigscan.h"
+#include "win_synth.h"
+#include "win_vad.h"
+
+// Introspection benchmark. Runs the same phases as a scan of a live
+// guest (opening guest memory, resolving the kernel list symbols, the
+// process walk and the module and thread walks) against a memory image,
+// so results are reproducible and need no VM. By default the image is a
+// synthetic one (win_synth.h) written fresh for each run; --image takes a
+// real dump instead.
+//
+// Every phase is timed over a number of iterations and reported as
+// p50/p99 latency together with the guest reads it issued (reads/s,
+// bytes/s). The scan phase is the cold-start kernel discovery over all
+// of guest RAM and psscan the pool-tag process sweep; their bytes/s is
+// the rate RAM is swept at. The sigscan phase runs the synthetic
+// image's marks as signatures over every process's VAD regions and
+// modules, and its bytes/s is the rate resident process memory is
+// searched at. The pause figure is the window in which a live scan keeps
+// the guest paused: the process walk plus the parallel detail walk.
+// Allocations are counted per full scan. --json writes the results for
+// comparing releases; --baseline fails the run when a phase's p50 got
+// slower than a saved result by more than --tolerance percent.
+
+#define BENCH_DEFAULT_PROCESSES  20000
+#define BENCH_DEFAULT_MODULES    8
+#define BENCH_DEFAULT_THREADS    8
+#define BENCH_DEFAULT_DATA_PAGES 4
+#define BENCH_DEFAULT_ITERATIONS 20
+#define BENCH_DEFAULT_TOLERANCE  25.0
+#define BENCH_IMAGE_DIR          "/dev/shm"
+
+enum {
+    PHASE_INIT,                 // open and map the image
+    PHASE_SCAN,                 // kernel discovery over all of RAM
+    PHASE_PSSCAN,               // "Proc" pool-tag sweep over all of RAM
+    PHASE_SYMBOLS,              // PsInitialSystemProcess / PsActiveProcessHead
+    PHASE_PROCESSES,            // ActiveProcessLinks walk
+    PHASE_MODULES,              // every module list, one thread
+    PHASE_THREADS,              // every thread list, one thread
+    PHASE_PARALLEL,             // modules and threads with the worker pool
+    PHASE_PAUSE,                // processes + parallel, as a live scan pauses
+    PHASE_SIGSCAN,              // signatures over every process's memory
+    PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = {
+    "init", "scan", "psscan", "symbols", "processes", "modules", "threads", "parallel", "pause", "sigscan"
+};
+
+typedef struct {
+    uint64_t *ns;               // one sample per iteration
+    uint64_t reads, bytes;      // summed over iterations
+} phase_t;
+
+typedef struct {
+    const char *image;
+    uint64_t dtb;               // 0: from the image
+    uint64_t ps_head;
+    uint64_t ps_initial;        // 0: take the first process from ps_head
+    int workers;
+    const win_sig_set_t *sigs;  // compiled signatures for the sigscan phase
+} bench_target_t;
+
+// Allocation counter. The program's definitions interpose on glibc's, so
+// allocations made by the walkers and by libc on their behalf are seen.
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t alloc_count;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+static uint64_t allocations(void) {
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+#else
+static uint64_t allocations(void) {
+    return 0;
+}
+#endif
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  -n N              synthetic processes (default %d)\n", BENCH_DEFAULT_PROCESSES);
+    printf("  -m N              synthetic modules per process (default %d)\n", BENCH_DEFAULT_MODULES);
+    printf("  -t N              synthetic threads per process (default %d)\n", BENCH_DEFAULT_THREADS);
+    printf("  -D N              synthetic data pages per process (default %d)\n", BENCH_DEFAULT_DATA_PAGES);
+    printf("  -r N              iterations (default %d)\n", BENCH_DEFAULT_ITERATIONS);
+    printf("  --workers N       workers for the parallel phase (default: CPUs)\n");
+    printf("  --image FILE      benchmark a memory image instead (needs --ps-head)\n");
+    printf("  --ps-head VA      PsActiveProcessHead in the image\n");
+    printf("  --dtb CR3         kernel DTB for raw images\n");
+    printf("  --json FILE       write the results as JSON\n");
+    printf("  --baseline FILE   compare p50s against an earlier --json result\n");
+    printf("  --tolerance PCT   allowed p50 slowdown against the baseline (default %.0f)\n",
+           BENCH_DEFAULT_TOLERANCE);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted samples
+static uint64_t percentile(const uint64_t *sorted, size_t n, unsigned pct) {
+    size_t rank = (n * pct + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static void phase_add(phase_t *p, int iter, uint64_t ns, const guest_mem_t *gm) {
+    const gm_stats_t *s = gm ? gm_get_stats(gm) : NULL;
+    p->ns[iter] = ns;
+    if (s) {
+        p->reads += s->va_reads;
+        p->bytes += s->va_bytes;
+    }
+}
+
+// Every process's VAD regions and modules, gathered untimed, then
+// searched for the signatures with the worker pool
+static int sigscan(guest_mem_t *gm, const bench_target_t *t, const win_process_list_t *procs,
+                   phase_t *phase, int iter) {
+    win_sig_target_t *targets = calloc(procs->count ? procs->count : 1, sizeof(*targets));
+    win_sig_result_t result;
+    uint64_t start;
+    size_t i;
+    int rc = 0;
+
+    if (!targets) return -1;
+    for (i = 0; i < procs->count && rc == 0; i++) {
+        win_vad_map_t vads = {0};
+        win_module_list_t modules = {0};
+
+        win_walk_vads(gm, &procs->items[i], 0, &vads);
+        win_walk_modules(gm, &procs->items[i], &modules);
+        rc = win_sig_target_process(&targets[i], &procs->items[i], &vads, &modules);
+        win_vad_map_free(&vads);
+        win_module_list_free(&modules);
+    }
+    if (rc == 0) {
+        start = gm_now_ns();
+        rc = win_sig_scan(gm, t->sigs, targets, procs->count, t->workers, &result);
+        phase_add(phase, iter, gm_now_ns() - start, NULL);
+        phase->reads += result.bytes >> GM_PAGE_SHIFT;
+        phase->bytes += result.bytes;
+        win_sig_result_free(&result);
+    }
+    for (i = 0; i < procs->count; i++) win_sig_ranges_free(&targets[i].ranges);
+    free(targets);
+    return rc;
+}
+
+// One full scan; row counts are returned for the report
+static int run_iteration(const bench_target_t *t, phase_t *phases, int iter,
+                         size_t rows[3]) {
+    const win_profile_t *prof = win_profile_get();
+    win_process_list_t procs = {0};
+    win_process_detail_t *details;
+    win_arena_t arena;
+    win_scan_result_t scan;
+    win_psscan_result_t pool;
+    uint64_t start, first = 0, head, walk_ns;
+    guest_mem_t *gm;
+    size_t i;
+
+    start = gm_now_ns();
+    gm = gm_open_image(t->image, 0);
+    if (!gm) return -1;
+    if (t->dtb) gm_set_kernel_dtb(gm, t->dtb);
+    phase_add(&phases[PHASE_INIT], iter, gm_now_ns() - start, NULL);
+
+    start = gm_now_ns();
+    win_scan_kernel(gm, t->workers, &scan);
+    phase_add(&phases[PHASE_SCAN], iter, gm_now_ns() - start, NULL);
+    phases[PHASE_SCAN].reads += scan.bytes >> GM_PAGE_SHIFT;
+    phases[PHASE_SCAN].bytes += scan.bytes;
+
+    start = gm_now_ns();
+    win_psscan(gm, t->workers, &pool);
+    phase_add(&phases[PHASE_PSSCAN], iter, gm_now_ns() - start, NULL);
+    phases[PHASE_PSSCAN].reads += pool.bytes >> GM_PAGE_SHIFT;
+    phases[PHASE_PSSCAN].bytes += pool.bytes;
+    win_psscan_free(&pool);
+
+    gm_reset_stats(gm);
+    start = gm_now_ns();
+    if (t->ps_initial) {
+        gm_read_u64(gm, GM_KERNEL_DTB, t->ps_initial, &first);
+    }
+    if (!first && gm_read_u64(gm, GM_KERNEL_DTB, t->ps_head, &head) == 0 && head) {
+        first = head - prof->eprocess_links;
+    }
+    phase_add(&phases[PHASE_SYMBOLS], iter, gm_now_ns() - start, gm);
+    if (!first) {
+        gm_destroy(gm);
+        return -1;
+    }
+
+    // Rows and names of the whole iteration come from one arena, as in a scan
+    win_arena_init(&arena);
+    procs.arena = &arena;
+    gm_reset_stats(gm);
+    start = gm_now_ns();
+    win_walk_processes(gm, first, t->ps_head, &procs);
+    walk_ns = gm_now_ns() - start;
+    phase_add(&phases[PHASE_PROCESSES], iter, walk_ns, gm);
+    rows[0] = procs.count;
+
+    gm_reset_stats(gm);
+    rows[1] = 0;
+    start = gm_now_ns();
+    for (i = 0; i < procs.count; i++) {
+        win_module_list_t modules = {0};
+        modules.arena = &arena;
+        win_walk_modules(gm, &procs.items[i], &modules);
+        rows[1] += modules.count;
+        win_module_list_free(&modules);
+    }
+    phase_add(&phases[PHASE_MODULES], iter, gm_now_ns() - start, gm);
+
+    gm_reset_stats(gm);
+    rows[2] = 0;
+    start = gm_now_ns();
+    for (i = 0; i < procs.count; i++) {
+        win_thread_list_t threads = {0};
+        threads.arena = &arena;
+        win_walk_threads(gm, &procs.items[i], &threads);
+        rows[2] += threads.count;
+        win_thread_list_free(&threads);
+    }
+    phase_add(&phases[PHASE_THREADS], iter, gm_now_ns() - start, gm);
+
+    // The parallel walk starts from cold worker views, as in a real scan
+    gm_invalidate(gm);
+    gm_reset_stats(gm);
+    details = calloc(procs.count ? procs.count : 1, sizeof(*details));
+    start = gm_now_ns();
+    if (details) win_walk_details_parallel(gm, &procs, t->workers, details, &arena);
+    phase_add(&phases[PHASE_PARALLEL], iter, gm_now_ns() - start, gm);
+    phase_add(&phases[PHASE_PAUSE], iter, walk_ns + phases[PHASE_PARALLEL].ns[iter], NULL);
+
+    if (details) win_process_details_free(details, procs.count);
+    if (sigscan(gm, t, &procs, &phases[PHASE_SIGSCAN], iter) != 0) {
+        win_process_list_free(&procs);
+        win_arena_free(&arena);
+        gm_destroy(gm);
+        return -1;
+    }
+    win_process_list_free(&procs);
+    win_arena_free(&arena);
+    gm_destroy(gm);
+    return 0;
+}
+
+// p50 of a phase in a JSON file written by write_json, 0 if absent
+static uint64_t baseline_p50(const char *json, const char *phase) {
+    char key[64];
+    const char *p;
+
+    snprintf(key, sizeof(key), "\"%s\": {", phase);
+    p = strstr(json, key);
+    if (!p) return 0;
+    p = strstr(p, "\"p50_ns\":");
+    return p ? strtoull(p + 9, NULL, 10) : 0;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    char *buf;
+    long len;
+
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = len >= 0 ? malloc((size_t)len + 1) : NULL;
+    if (buf) {
+        len = (long)fread(buf, 1, (size_t)len, f);
+        buf[len] = '\0';
+    }
+    fclose(f);
+    return buf;
+}
+
+static int write_json(const char *path, const bench_target_t *t, const size_t rows[3],
+                      int iterations, phase_t *phases, uint64_t allocs) {
+    FILE *f = fopen(path, "w");
+    int i;
+
+    if (!f) return -1;
+    fprintf(f, "{\n");
+    fprintf(f, "  \"image\": \"%s\",\n", t->image);
+    fprintf(f, "  \"iterations\": %d,\n", iterations);
+    fprintf(f, "  \"workers\": %d,\n", t->workers);
+    fprintf(f, "  \"processes\": %zu,\n", rows[0]);
+    fprintf(f, "  \"modules\": %zu,\n", rows[1]);
+    fprintf(f, "  \"threads\": %zu,\n", rows[2]);
+    fprintf(f, "  \"allocations_per_scan\": %llu,\n", (unsigned long long)allocs);
+    fprintf(f, "  \"phases\": {\n");
+    for (i = 0; i < PHASE_COUNT; i++) {
+        const phase_t *p = &phases[i];
+        uint64_t total = 0;
+        int j;
+
+        for (j = 0; j < iterations; j++) total += p->ns[j];
+        fprintf(f, "    \"%s\": { \"p50_ns\": %llu, \"p99_ns\": %llu, \"mean_ns\": %llu, "
+                   "\"reads\": %llu, \"bytes\": %llu, \"reads_per_sec\": %.0f, \"bytes_per_sec\": %.0f }%s\n",
+                phase_names[i],
+                (unsigned long long)percentile(p->ns, iterations, 50),
+                (unsigned long long)percentile(p->ns, iterations, 99),
+                (unsigned long long)(total / iterations),
+                (unsigned long long)(p->reads / iterations),
+                (unsigned long long)(p->bytes / iterations),
+                total ? p->reads * 1e9 / total : 0.0,
+                total ? p->bytes * 1e9 / total : 0.0,
+                i + 1 < PHASE_COUNT ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+    return fclose(f);
+}
+
+int main(int argc, char **argv) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    bench_target_t target;
+    win_sig_set_t *sigs;
+    phase_t phases[PHASE_COUNT];
+    const char *json_path = NULL, *baseline_path = NULL;
+    double tolerance = BENCH_DEFAULT_TOLERANCE;
+    char synth_path[64], error[256];
+    size_t rows[3] = {0, 0, 0};
+    uint64_t allocs = 0, p50;
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int i, j, bad = 0;
+
+    win_synth_defaults(&opts);
+    opts.processes = BENCH_DEFAULT_PROCESSES;
+    opts.modules = BENCH_DEFAULT_MODULES;
+    opts.threads = BENCH_DEFAULT_THREADS;
+    opts.data_pages = BENCH_DEFAULT_DATA_PAGES;
+    memset(&target, 0, sizeof(target));
+    target.workers = win_default_workers();
+
+    for (i = 1; i < argc; i++) {
+        const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "-n") == 0 && next) {
+            opts.processes = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0 && next) {
+            opts.modules = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0 && next) {
+            opts.threads = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-D") == 0 && next) {
+            opts.data_pages = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-r") == 0 && next) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && next) {
+            target.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--image") == 0 && next) {
+            target.image = argv[++i];
+        } else if (strcmp(argv[i], "--ps-head") == 0 && next) {
+            target.ps_head = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--dtb") == 0 && next) {
+            target.dtb = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--json") == 0 && next) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && next) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && next) {
+            tolerance = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (iterations < 1 || target.workers < 1 || opts.processes == 0 ||
+        (target.image && !target.ps_head)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("=== Introspection Benchmark ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    sigs = win_sig_set_create();
+    if (!sigs || win_sig_add(sigs, "mark", "\"" WIN_SYNTH_SIG_DATA "\"", error, sizeof(error)) < 0 ||
+        win_sig_add(sigs, "mark_wide", "w\"" WIN_SYNTH_SIG_DATA "\"", error, sizeof(error)) < 0 ||
+        win_sig_add(sigs, "code", WIN_SYNTH_SIG_CODE, error, sizeof(error)) < 0 || win_sig_compile(sigs) != 0) {
+        printf("❌ Could not compile the signatures\n");
+        return 1;
+    }
+    target.sigs = sigs;
+
+    synth_path[0] = '\0';
+    if (!target.image) {
+        snprintf(synth_path, sizeof(synth_path), BENCH_IMAGE_DIR "/vmi-bench-%d.img", (int)getpid());
+        if (win_synth_write(synth_path, &opts, &info) != 0) {
+            printf("❌ Could not write synthetic image %s\n", synth_path);
+            return 1;
+        }
+        target.image = synth_path;
+        target.ps_head = info.ps_active_process_head;
+        target.ps_initial = info.ps_initial_system_process;
+        printf("Synthetic image: %zu processes, %zu modules, %zu threads and %zu data pages each (%.1f MiB)\n",
+               opts.processes, opts.modules, opts.threads, opts.data_pages, info.image_size / (1024.0 * 1024.0));
+    } else {
+        printf("Image: %s\n", target.image);
+    }
+    printf("Structure profile: %s, %d iterations, %d workers\n",
+           win_profile_get()->name, iterations, target.workers);
+
+    memset(phases, 0, sizeof(phases));
+    for (i = 0; i < PHASE_COUNT; i++) {
+        phases[i].ns = calloc((size_t)iterations + 1, sizeof(uint64_t));
+        if (!phases[i].ns) return 1;
+    }
+
+    // One untimed pass brings the image into the host page cache
+    if (run_iteration(&target, phases, iterations, rows) != 0) {
+        printf("❌ Scan of %s failed\n", target.image);
+        bad = 1;
+    }
+    for (i = 0; i < PHASE_COUNT; i++) {
+        phases[i].reads = phases[i].bytes = 0;
+    }
+    for (j = 0; j < iterations && !bad; j++) {
+        uint64_t before = allocations();
+        if (run_iteration(&target, phases, j, rows) != 0) {
+            printf("❌ Scan of %s failed\n", target.image);
+            bad = 1;
+        }
+        allocs += allocations() - before;
+    }
+    if (synth_path[0]) unlink(synth_path);
+    if (bad) return 1;
+    allocs /= (uint64_t)iterations;
+
+    for (i = 0; i < PHASE_COUNT; i++) {
+        qsort(phases[i].ns, (size_t)iterations, sizeof(uint64_t), compare_u64);
+    }
+
+    printf("Rows per scan: %zu processes, %zu modules, %zu threads\n", rows[0], rows[1], rows[2]);
+    printf("\n%-10s %12s %12s %14s %14s\n", "Phase", "p50 (ms)", "p99 (ms)", "reads/s", "MiB/s");
+    for (i = 0; i < PHASE_COUNT; i++) {
+        uint64_t p50 = percentile(phases[i].ns, iterations, 50);
+        uint64_t reads = phases[i].reads / iterations, bytes = phases[i].bytes / iterations;
+
+        printf("%-10s %12.3f %12.3f", phase_names[i], p50 / 1e6,
+               percentile(phases[i].ns, iterations, 99) / 1e6);
+        if (reads) {
+            printf(" %14.0f %14.1f", p50 ? reads * 1e9 / p50 : 0.0,
+                   p50 ? bytes * 1e9 / p50 / (1024.0 * 1024.0) : 0.0);
+        }
+        printf("\n");
+    }
+    p50 = percentile(phases[PHASE_SCAN].ns, iterations, 50);
+    printf("\nKernel scan (p50): %.2f GB/s over %.1f MiB\n",
+           p50 ? phases[PHASE_SCAN].bytes / (double)iterations / p50 : 0.0,
+           phases[PHASE_SCAN].bytes / (double)iterations / (1024.0 * 1024.0));
+    p50 = percentile(phases[PHASE_PSSCAN].ns, iterations, 50);
+    printf("Pool scan (p50): %.2f GB/s\n",
+           p50 ? phases[PHASE_PSSCAN].bytes / (double)iterations / p50 : 0.0);
+    p50 = percentile(phases[PHASE_SIGSCAN].ns, iterations, 50);
+    printf("Signature scan (p50): %.2f GB/s over %.1f MiB\n",
+           p50 ? phases[PHASE_SIGSCAN].bytes / (double)iterations / p50 : 0.0,
+           phases[PHASE_SIGSCAN].bytes / (double)iterations / (1024.0 * 1024.0));
+    printf("Guest pause per scan (p50): %.3f ms\n", percentile(phases[PHASE_PAUSE].ns, iterations, 50) / 1e6);
+    printf("Allocations per scan: %llu\n", (unsigned long long)allocs);
+
+    if (json_path) {
+        if (write_json(json_path, &target, rows, iterations, phases, allocs) != 0) {
+            printf("❌ Could not write %s\n", json_path);
+            return 1;
+        }
+        printf("Results written to %s\n", json_path);
+    }
+
+    if (baseline_path) {
+        char *json = read_file(baseline_path);
+
+        if (!json) {
+            printf("❌ Could not read baseline %s\n", baseline_path);
+            return 1;
+        }
+        printf("\nAgainst %s (tolerance %.0f%%):\n", baseline_path, tolerance);
+        for (i = 0; i < PHASE_COUNT; i++) {
+            uint64_t base = baseline_p50(json, phase_names[i]);
+            uint64_t now = percentile(phases[i].ns, iterations, 50);
+            double change;
+
+            if (!base) continue;
+            change = (now - (double)base) * 100.0 / base;
+            printf("  %s %-10s %+7.1f%%\n", change > tolerance ? "✗" : "✓", phase_names[i], change);
+            if (change > tolerance) bad++;
+        }
+        free(json);
+        if (bad) {
+            printf("❌ %d phases slower than the baseline\n", bad);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < PHASE_COUNT; i++) {
+        free(phases[i].ns);
+    }
+    win_sig_set_destroy(sigs);
+    return 0;
+}
@@ -2,269 +2,1329 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <libvmi/libvmi.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+#include "win_parallel.h"
+#include "win_symcache.h"
+#include "win_scan.h"
+#include "win_psscan.h"
+#include "win_pe.h"
+#include "win_diff.h"
+#include "win_handles.h"
+#include "win_vad.h"
+#include "win_sigscan.h"
+#include "counters.h"
 
 #define MAX_NAME_LENGTH 256
 
-// Global VMI instance
+// Global VMI instance; not attached when reading a memory image
 vmi_instance_t vmi;
+int vmi_attached = 0;
 
-// Function to print process information
-void print_process_info(addr_t process_addr) {
-    char *procname = NULL;
-    vmi_pid_t pid = 0;
-    addr_t dtb = 0;
+// Offline memory image and the symbols/DTB LibVMI would otherwise provide
+const char *image_path = NULL;
+uint64_t kernel_dtb_opt = 0;
+uint64_t kernel_base_opt = 0;
+uint64_t ps_head_opt = 0;
+
+// Cached guest memory view shared by all walkers
+guest_mem_t *gm;
+
+// Kernel symbols resolved by earlier runs; NULL with --no-symbol-cache
+win_symcache_t *symcache = NULL;
+
+// Enumerate modules/threads of every process, and with how many workers
+int all_processes = 0;
+int workers = 1;
+
+// Also sweep RAM for "Proc" pool allocations and report unlinked processes
+int psscan_mode = 0;
+
+// Never pause the guest; the walkers check links and re-read instead
+int no_pause = 0;
+
+// Capture guest RAM (or only what the walkers read) to an ELF core or a
+// packed image, or diff an earlier capture against the target
+const char *dump_path = NULL;
+int dump_reachable = 0;
+int dump_packed = 0;
+const char *diff_path = NULL;
+
+// Also list kernel modules, and name these addresses after the exports
+// of the kernel's (pid -1) or a process's modules
+#define MAX_RESOLVE 16
+typedef struct {
+    int pid;
+    uint64_t va;
+} resolve_t;
+int drivers_mode = 0;
+resolve_t resolve_vas[MAX_RESOLVE];
+int resolve_count = 0;
+uint64_t ps_modules_opt = 0;
+
+// Also list the handles of every process; ObTypeIndexTable when no symbol
+// source knows it
+int handles_mode = 0;
+uint64_t type_table_opt = 0;
+
+// Also list the VAD regions of every process; --resolve PID:VA then
+// names the region too
+int vads_mode = 0;
+
+// Search every process's memory for these patterns (--sig, --signatures)
+win_sig_set_t *sigs = NULL;
+
+// Parsed PE images, shared by the kernel and every process mapping them
+win_pe_cache_t *pe_cache = NULL;
+
+// Everything one scan collects, decoded and ready to print. Rows and
+// names live in the scan's arena and are released with it.
+typedef struct {
+    win_arena_t arena;
+    win_process_list_t processes;
+    int process_count;
+    win_process_t system;          // process used for module/thread enumeration
+    int have_system;
+    win_process_detail_t system_detail;
+    win_process_detail_t *details; // one per process in all-process mode
+    win_mod_map_t system_map;      // module exports, by address
+    win_mod_map_t *maps;           // one per process in all-process mode
+} scan_result_t;
+
+// Kernel symbol address from the symbol cache, else from LibVMI, else
+// from the kernel base (--kernel-base or a scan) plus the symbol's RVA in
+// the structure profile; what had to be resolved is cached for the next run
+int resolve_symbol(const char *name, uint64_t rva, addr_t *va) {
+    uint64_t cached;
     
-    // Try to read process name (EPROCESS.ImageFileName)
-    procname = vmi_read_str_va(vmi, process_addr + 0x5a8, 0);
-    if (!procname) {
-        procname = vmi_read_str_va(vmi, process_addr + 0x450, 0); // Try alternative offset
+    if (symcache && 0 == win_symcache_lookup(symcache, name, rva, &cached)) {
+        *va = cached;
+        return 0;
+    }
+    if (vmi_attached && VMI_SUCCESS == vmi_translate_ksym2v(vmi, name, va)) {
+        // resolved by LibVMI
+    } else if (kernel_base_opt && rva) {
+        *va = kernel_base_opt + rva;
+    } else {
+        return -1;
     }
+    if (symcache) win_symcache_learn(symcache, gm, name, *va);
+    return 0;
+}
+
+// Identify the running kernel against the symbol cache. The syscall entry
+// (MSR_LSTAR) lies inside the kernel image, so it finds the image again
+// after a reboot moved it.
+void open_symbol_cache(const char *path, const char *domain) {
+    const win_pdb_id_t *kernel;
+    uint64_t hint = kernel_base_opt;
+    ctr_scope_t scope;
     
-    // Read process ID (EPROCESS.UniqueProcessId)
-    if (VMI_SUCCESS != vmi_read_32_va(vmi, process_addr + 0x2e0, 0, (uint32_t*)&pid)) {
-        vmi_read_32_va(vmi, process_addr + 0x180, 0, (uint32_t*)&pid); // Try alternative offset
+    symcache = win_symcache_open(path, domain);
+    if (!symcache) return;
+    if (vmi_attached) vmi_get_vcpureg(vmi, &hint, MSR_LSTAR, 0);
+    
+    counters_begin(&scope, CTR_SYMBOLS);
+    if (0 == win_symcache_validate(symcache, gm, hint)) {
+        kernel = win_symcache_kernel(symcache);
+        printf("Kernel symbols: cached for %s %s age %u at 0x%lx\n", kernel->pdb, kernel->guid,
+               kernel->age, win_symcache_kernel_base(symcache));
+    } else {
+        printf("Kernel symbols: not cached yet (%s)\n", path);
     }
+    counters_end(&scope);
+}
+
+// Cold start: find the kernel by scanning guest RAM, for when neither the
+// symbol cache nor the command line says where it is
+void scan_for_kernel() {
+    win_scan_result_t scan;
+    ctr_scope_t scope;
     
-    // Read DirectoryTableBase (CR3)
-    vmi_read_addr_va(vmi, process_addr + 0x28, 0, &dtb);
+    counters_begin(&scope, CTR_SYMBOLS);
+    if (0 != win_scan_kernel(gm, workers, &scan)) {
+        printf("Kernel scan: no kernel in %.1f MiB of RAM\n", scan.bytes / (1024.0 * 1024.0));
+        counters_end(&scope);
+        return;
+    }
+    printf("Kernel scan: base 0x%lx (build %u) in %.1f MiB of RAM, %.1f ms at %.2f GB/s\n",
+           scan.kernel_base, scan.build, scan.bytes / (1024.0 * 1024.0), scan.ns / 1e6,
+           scan.ns ? scan.bytes / (double)scan.ns : 0.0);
+    if (!kernel_base_opt) kernel_base_opt = scan.kernel_base;
     
-    printf("%-25s PID: %-8d DTB: 0x%016lx\n", 
-           procname ? procname : "Unknown", pid, dtb);
+    // The base identifies the build, so this run's symbols get cached
+    if (symcache) win_symcache_validate(symcache, gm, scan.kernel_base);
+    if (scan.ps_active_process_head) {
+        printf("KDBG at PA 0x%lx (not encoded), PsActiveProcessHead 0x%lx\n",
+               scan.kdbg_pa, scan.ps_active_process_head);
+        if (symcache) win_symcache_learn(symcache, gm, "PsActiveProcessHead", scan.ps_active_process_head);
+        if (!ps_head_opt) ps_head_opt = scan.ps_active_process_head;
+    }
+    if (scan.ps_loaded_module_list) {
+        if (symcache) win_symcache_learn(symcache, gm, "PsLoadedModuleList", scan.ps_loaded_module_list);
+        if (!ps_modules_opt) ps_modules_opt = scan.ps_loaded_module_list;
+    }
+    counters_end(&scope);
+}
+
+// Kernel base and KdDebuggerDataBlock, once the kernel is identified
+void print_kernel() {
+    addr_t kdbg = 0;
+    ctr_scope_t scope;
+    
+    if (!symcache || !win_symcache_kernel(symcache)) return;
+    counters_begin(&scope, CTR_SYMBOLS);
+    if (0 == resolve_symbol("KdDebuggerDataBlock", 0, &kdbg)) {
+        printf("Kernel base 0x%lx, KDBG 0x%lx\n", win_symcache_kernel_base(symcache), kdbg);
+    } else {
+        printf("Kernel base 0x%lx\n", win_symcache_kernel_base(symcache));
+    }
+    counters_end(&scope);
+}
+
+// Resolve the first EPROCESS on the active process list. list_head is set
+// to PsActiveProcessHead, or 0 when only PsInitialSystemProcess is known.
+addr_t lookup_first_process(addr_t *list_head) {
+    const win_profile_t *prof = win_profile_get();
+    addr_t symbol = 0, first = 0;
     
-    if (procname) free(procname);
+    *list_head = ps_head_opt;
+    
+    // Try multiple methods to get process list
+    if (!*list_head && 0 != resolve_symbol("PsActiveProcessHead", prof->rva_ps_active_process_head, list_head)) {
+        // Fall back to PsInitialSystemProcess, which points at the first process
+        *list_head = 0;
+        if (0 != resolve_symbol("PsInitialSystemProcess", prof->rva_ps_initial_system_process, &symbol) ||
+            0 != gm_read_u64(gm, GM_KERNEL_DTB, symbol, &first)) {
+            printf("Failed to find process list head\n");
+            return 0;
+        }
+        return first;
+    }
+    
+    // PsActiveProcessHead.Flink points at the first ActiveProcessLinks entry
+    if (0 != gm_read_u64(gm, GM_KERNEL_DTB, *list_head, &first)) {
+        printf("Failed to read first process from list\n");
+        return 0;
+    }
+    return first - prof->eprocess_links;
+}
+
+// Symbol lookups and the reads behind them are accounted as "symbols"
+addr_t find_first_process(addr_t *list_head) {
+    ctr_scope_t scope;
+    addr_t first;
+    
+    counters_begin(&scope, CTR_SYMBOLS);
+    first = lookup_first_process(list_head);
+    counters_end(&scope);
+    return first;
+}
+
+// Resolve the System process used for module/thread enumeration
+addr_t find_system_process() {
+    addr_t symbol = 0, process = 0;
+    ctr_scope_t scope;
+    
+    counters_begin(&scope, CTR_SYMBOLS);
+    if (0 != resolve_symbol("PsInitialSystemProcess", win_profile_get()->rva_ps_initial_system_process, &symbol) ||
+        0 != gm_read_u64(gm, GM_KERNEL_DTB, symbol, &process)) {
+        process = 0;
+    }
+    counters_end(&scope);
+    return process;
+}
+
+// Walk processes, then modules and threads of the System process (or of
+// every process in all-process mode). With a NULL result the walk only
+// touches the memory it needs.
+void collect_scan(guest_mem_t *g, addr_t first_process, addr_t list_head,
+                  addr_t system_process, scan_result_t *res) {
+    win_process_list_t local = { 0 };
+    win_process_list_t *procs = res ? &res->processes : &local;
+    win_process_t system;
+    int count;
+    
+    if (res) {
+        win_arena_init(&res->arena);
+        res->processes.arena = &res->arena;
+        res->system_detail.modules.arena = &res->arena;
+        res->system_detail.threads.arena = &res->arena;
+    }
+    count = first_process ? win_walk_processes(g, first_process, list_head, procs) : -1;
+    if (res) res->process_count = count;
+    
+    if (count <= 0) {
+        // nothing to enumerate
+    } else if (all_processes) {
+        win_process_detail_t *details = NULL;
+        if (!res || (details = calloc(procs->count, sizeof(*details))) != NULL) {
+            win_walk_details_parallel(g, procs, workers, details, res ? &res->arena : NULL);
+            if (res) res->details = details;
+        }
+    } else if (system_process && win_read_process(g, system_process, &system) > 0) {
+        win_process_detail_t *d = res ? &res->system_detail : NULL;
+        int modules = win_walk_modules(g, &system, d ? &d->modules : NULL);
+        int threads = win_walk_threads(g, &system, d ? &d->threads : NULL);
+        if (res) {
+            d->module_count = modules;
+            d->thread_count = threads;
+            res->system = system;
+            res->have_system = 1;
+        }
+    }
+    
+    win_process_list_free(&local);
+}
+
+// Index the exports of every module found. Loaded images do not change,
+// so this runs after the guest is resumed; each distinct image is parsed
+// once however many processes map it.
+void index_scan(scan_result_t *res) {
+    size_t i;
+    
+    if (!pe_cache) return;
+    if (res->details) {
+        res->maps = calloc(res->processes.count ? res->processes.count : 1, sizeof(*res->maps));
+        for (i = 0; res->maps && i < res->processes.count; i++) {
+            win_mod_map_build(&res->maps[i], pe_cache, gm, win_process_dtb(&res->processes.items[i]),
+                              &res->details[i].modules);
+        }
+    } else if (res->have_system) {
+        win_mod_map_build(&res->system_map, pe_cache, gm, win_process_dtb(&res->system),
+                          &res->system_detail.modules);
+    }
+}
+
+void free_scan(scan_result_t *res) {
+    size_t i;
+    
+    for (i = 0; res->maps && i < res->processes.count; i++) {
+        win_mod_map_free(&res->maps[i]);
+    }
+    free(res->maps);
+    win_mod_map_free(&res->system_map);
+    win_module_list_free(&res->system_detail.modules);
+    win_thread_list_free(&res->system_detail.threads);
+    win_process_details_free(res->details, res->processes.count);
+    win_process_list_free(&res->processes);
+    win_arena_free(&res->arena);
+}
+
+// Function to print process information
+void print_process_info(const win_process_t *process) {
+    printf("%-25s PID: %-8d DTB: 0x%016lx%s\n", 
+           process->name[0] ? process->name : "Unknown", process->pid, process->dtb,
+           process->unconfirmed ? "  (unconfirmed)" : "");
 }
 
 // Function to list running processes
-int list_processes() {
-    addr_t list_head = 0, current_process = 0, next_process = 0;
-    int count = 0;
+int list_processes(const scan_result_t *res) {
+    size_t i;
     
     printf("\n=== RUNNING PROCESSES ===\n");
     printf("%-25s %-13s %s\n", "Process Name", "PID", "DTB");
     printf("================================================================\n");
     
-    // Try multiple methods to get process list
-    if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "PsActiveProcessHead", &list_head)) {
-        if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "PsInitialSystemProcess", &list_head)) {
-            printf("Failed to find process list head\n");
-            return -1;
-        }
-        // If we got PsInitialSystemProcess, read the first process directly
-        current_process = list_head;
-    } else {
-        // If we got PsActiveProcessHead, read the first process from the list
-        if (VMI_FAILURE == vmi_read_addr_va(vmi, list_head, 0, &current_process)) {
-            printf("Failed to read first process from list\n");
-            return -1;
+    if (res->process_count < 0) {
+        return -1;
+    }
+    
+    for (i = 0; i < res->processes.count; i++) {
+        print_process_info(&res->processes.items[i]);
+    }
+    
+    printf("\nTotal processes found: %d\n", res->process_count);
+    if (res->processes.error) {
+        printf("Warning: %s\n", res->processes.error);
+    }
+    return res->process_count;
+}
+
+// Function to list loaded modules for a specific process
+int list_modules_for_process(const win_process_t *process, const win_process_detail_t *d,
+                             const win_mod_map_t *map) {
+    win_mod_addr_t addr;
+    size_t i;
+    
+    printf("\n=== LOADED MODULES FOR %s ===\n", process->name);
+    
+    if (d->modules.error) {
+        printf("%s\n", d->modules.error);
+    }
+    if (d->module_count < 0 || (d->module_count == 0 && d->modules.error)) {
+        return d->module_count;
+    }
+    
+    for (i = 0; i < d->modules.count; i++) {
+        const win_module_t *m = &d->modules.items[i];
+        if (map && 0 == win_mod_map_lookup(map, m->base, &addr) && addr.mod->pe) {
+            printf("  %-40s Base: 0x%016lx Size: 0x%08x Timestamp: 0x%08x Exports: %zu%s\n", m->name,
+                   m->base, m->size, addr.mod->pe->timestamp, addr.mod->pe->export_count,
+                   m->unconfirmed ? "  (unconfirmed)" : "");
+        } else {
+            printf("  %-40s Base: 0x%016lx Size: 0x%08x%s\n", m->name, m->base, m->size,
+                   m->unconfirmed ? "  (unconfirmed)" : "");
         }
-        current_process -= 0x2e8; // Adjust for ActiveProcessLinks offset
     }
     
-    addr_t start_process = current_process;
+    printf("Total modules found: %d\n", d->module_count);
+    return d->module_count;
+}
+
+// Function to list threads for a specific process
+int list_threads_for_process(const win_process_t *process, const win_process_detail_t *d) {
+    size_t i;
     
-    do {
-        print_process_info(current_process);
-        count++;
-        
-        // Read next process (EPROCESS.ActiveProcessLinks.Flink)
-        if (VMI_FAILURE == vmi_read_addr_va(vmi, current_process + 0x2e8, 0, &next_process)) {
-            break;
+    printf("\n=== ACTIVE THREADS FOR %s ===\n", process->name);
+    
+    if (d->thread_count < 0) {
+        printf("%s\n", d->threads.error ? d->threads.error : "Failed to read thread list");
+        return -1;
+    }
+    
+    for (i = 0; i < d->threads.count; i++) {
+        printf("  Thread ID: %-8d Process ID: %-8d%s\n",
+               d->threads.items[i].tid, d->threads.items[i].pid,
+               d->threads.items[i].unconfirmed ? "  (unconfirmed)" : "");
+    }
+    
+    printf("Total threads found: %d\n", d->thread_count);
+    return d->thread_count;
+}
+
+// What the live walks had to re-read, and could not confirm
+void print_live_checks(const scan_result_t *res) {
+    const win_process_detail_t *d = res->details ? res->details : &res->system_detail;
+    size_t n = res->details ? res->processes.count : 1, i;
+    size_t retries = res->processes.retries, unconfirmed = res->processes.unconfirmed;
+    
+    for (i = 0; i < n; i++) {
+        retries += d[i].modules.retries + d[i].threads.retries;
+        unconfirmed += d[i].modules.unconfirmed + d[i].threads.unconfirmed;
+    }
+    printf("Live walk: %zu links re-read, %zu entries unconfirmed\n", retries, unconfirmed);
+}
+
+void print_scan(const scan_result_t *res) {
+    size_t i;
+    
+    if (list_processes(res) <= 0) {
+        return;
+    }
+    if (res->details) {
+        // Merged in list order, independent of worker scheduling
+        for (i = 0; i < res->processes.count; i++) {
+            list_modules_for_process(&res->processes.items[i], &res->details[i],
+                                     res->maps ? &res->maps[i] : NULL);
+            list_threads_for_process(&res->processes.items[i], &res->details[i]);
         }
+    } else if (res->have_system) {
+        list_modules_for_process(&res->system, &res->system_detail, &res->system_map);
+        list_threads_for_process(&res->system, &res->system_detail);
+    }
+    if (pe_cache) {
+        const win_pe_cache_stats_t *st = win_pe_cache_stats(pe_cache);
+        printf("\nExport index: %zu images, %lu module mappings reused a parse\n",
+               win_pe_cache_count(pe_cache), st->hits);
+    }
+    if (win_walk_live()) print_live_checks(res);
+}
+
+// User-mode addresses (--resolve PID:VA) against the process's modules
+void print_resolved(const scan_result_t *res) {
+    win_mod_addr_t addr;
+    char where[1024];
+    int i;
+    
+    for (i = 0; i < resolve_count; i++) {
+        const win_mod_map_t *map = NULL;
+        size_t k;
         
-        current_process = next_process - 0x2e8; // Adjust for list entry offset
-        
-        // Prevent infinite loops
-        if (count > 1000 || current_process == start_process) {
-            break;
+        if (resolve_vas[i].pid < 0) continue;
+        for (k = 0; res->maps && k < res->processes.count; k++) {
+            if (res->processes.items[k].pid == resolve_vas[i].pid) map = &res->maps[k];
         }
-        
-    } while (next_process != 0 && current_process != start_process);
+        if (!map) {
+            snprintf(where, sizeof(where), "(no process %d)", resolve_vas[i].pid);
+        } else if (0 == win_mod_map_lookup(map, resolve_vas[i].va, &addr)) {
+            win_mod_addr_format(&addr, where, sizeof(where));
+        } else {
+            snprintf(where, sizeof(where), "(not in a module)");
+        }
+        printf("%d:0x%016lx  %s\n", resolve_vas[i].pid, resolve_vas[i].va, where);
+    }
+}
+
+// Processes found in pool memory but not on ActiveProcessLinks
+void print_pool_scan(const win_psscan_result_t *pool) {
+    size_t i;
     
-    printf("\nTotal processes found: %d\n", count);
-    return count;
+    printf("\n=== POOL SCAN (Proc tags) ===\n");
+    printf("Swept %.1f MiB in %.3f ms with %d workers (%.2f GB/s), %lu tags\n",
+           pool->bytes / (1024.0 * 1024.0), pool->ns / 1e6, pool->workers,
+           pool->ns ? pool->bytes / (double)pool->ns : 0.0, pool->tags);
+    if (pool->error) {
+        printf("Warning: %s\n", pool->error);
+    }
+    for (i = 0; i < pool->count; i++) {
+        const win_pool_process_t *p = &pool->items[i];
+        if (p->state == WIN_POOL_LINKED) continue;
+        printf("%-8s %-25s PID: %-8d EPROCESS: 0x%016lx PA: 0x%lx\n",
+               p->state == WIN_POOL_HIDDEN ? "HIDDEN" : "exited", p->proc.name, p->proc.pid,
+               p->proc.addr, p->pa);
+    }
+    printf("Processes in pool: %zu (%zu linked, %zu hidden, %zu exited)\n",
+           pool->count, pool->linked, pool->hidden, pool->exited);
 }
 
-// Function to list loaded modules for a specific process
-int list_modules_for_process(addr_t process_addr, const char* process_name) {
-    addr_t peb = 0, ldr = 0, module_list = 0, current_module = 0;
-    int count = 0;
+void print_timing(uint64_t pause_ns, uint64_t total_ns) {
+    if (!vmi_attached || no_pause) {
+        printf("Scan time %.3f ms\n", total_ns / 1e6);
+        return;
+    }
+    printf("Guest paused for %.3f ms (total scan time %.3f ms)\n",
+           pause_ns / 1e6, total_ns / 1e6);
+}
+
+// Images never change, so there is nothing to pause; with --no-pause
+// the guest keeps running
+uint64_t paused_at = 0;
+
+int pause_guest() {
+    if (!vmi_attached || no_pause) return 0;
+    if (VMI_SUCCESS != vmi_pause_vm(vmi)) {
+        return -1;
+    }
+    paused_at = gm_now_ns();
+    return 0;
+}
+
+void resume_guest() {
+    if (vmi_attached && !no_pause) {
+        vmi_resume_vm(vmi);
+        counters_add_pause(gm_now_ns() - paused_at);
+    }
+}
+
+// Walk and print while the guest stays paused
+int run_paused_scan(addr_t first_process, addr_t list_head, addr_t system_process) {
+    scan_result_t res;
+    win_psscan_result_t pool;
+    uint64_t begin, start, resumed;
     
-    printf("\n=== LOADED MODULES FOR %s ===\n", process_name);
+    memset(&res, 0, sizeof(res));
+    memset(&pool, 0, sizeof(pool));
+    begin = gm_now_ns();
     
-    // Read PEB address (EPROCESS.Peb)
-    if (VMI_FAILURE == vmi_read_addr_va(vmi, process_addr + 0x3f8, 0, &peb)) {
-        printf("Failed to read PEB address\n");
+    // The RAM sweep does not need the guest paused; only the diff does
+    if (psscan_mode) win_psscan(gm, workers, &pool);
+    start = gm_now_ns();
+    
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, results may be inconsistent\n");
+        win_psscan_free(&pool);
         return -1;
     }
+    if (vmi_attached && !no_pause) printf("VM paused for introspection\n");
     
-    if (peb == 0) {
-        printf("PEB is NULL (likely system process)\n");
-        return 0;
-    }
+    gm_invalidate(gm);
+    collect_scan(gm, first_process, list_head, system_process, &res);
+    if (psscan_mode) win_psscan_diff(gm, &res.processes, &pool);
     
-    // Read Ldr address (PEB.Ldr)
-    if (VMI_FAILURE == vmi_read_addr_va(vmi, peb + 0x18, 0, &ldr)) {
-        printf("Failed to read PEB.Ldr\n");
+    // Resume the VM; cached pages are stale from here on
+    resume_guest();
+    resumed = gm_now_ns();
+    gm_invalidate(gm);
+    if (vmi_attached && !no_pause) printf("VM resumed\n");
+    
+    index_scan(&res);
+    print_scan(&res);
+    print_resolved(&res);
+    if (psscan_mode) print_pool_scan(&pool);
+    
+    printf("\n");
+    gm_print_stats(gm, stdout);
+    print_timing(resumed - start, gm_now_ns() - begin);
+    win_psscan_free(&pool);
+    free_scan(&res);
+    return 0;
+}
+
+int run_snapshot_scan(addr_t first_process, addr_t list_head, addr_t system_process) {
+    scan_result_t res;
+    gm_snapshot_t *snap;
+    guest_mem_t *snap_gm;
+    uint64_t start, resumed, done;
+    
+    memset(&res, 0, sizeof(res));
+    snap = gm_snapshot_create();
+    if (!snap) {
+        printf("Failed to allocate page snapshot\n");
         return -1;
     }
     
-    if (ldr == 0) {
-        printf("PEB.Ldr is NULL\n");
-        return 0;
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, snapshot may be inconsistent\n");
     }
     
-    // Read InLoadOrderModuleList (PEB_LDR_DATA.InLoadOrderModuleList)
-    if (VMI_FAILURE == vmi_read_addr_va(vmi, ldr + 0x10, 0, &module_list)) {
-        printf("Failed to read module list\n");
+    gm_snapshot_begin(gm, snap);
+    collect_scan(gm, first_process, list_head, system_process, NULL);
+    gm_snapshot_end(gm);
+    
+    resume_guest();
+    resumed = gm_now_ns();
+    gm_invalidate(gm);
+    printf("VM %s for snapshot: %zu pages copied\n", no_pause ? "not paused" : "paused",
+           gm_snapshot_pages(snap));
+    
+    // Decode from the snapshot only; nothing here touches the live guest
+    snap_gm = gm_open_snapshot(snap, GM_DEFAULT_CACHE_PAGES);
+    if (!snap_gm) {
+        printf("Failed to open page snapshot\n");
+        gm_snapshot_destroy(snap);
         return -1;
     }
+    collect_scan(snap_gm, first_process, list_head, system_process, &res);
+    index_scan(&res);
+    print_scan(&res);
+    print_resolved(&res);
+    done = gm_now_ns();
     
-    current_module = module_list;
-    addr_t start_module = module_list;
+    printf("\n");
+    gm_print_stats(gm, stdout);
+    print_timing(resumed - start, done - start);
+    
+    gm_destroy(snap_gm);
+    gm_snapshot_destroy(snap);
+    free_scan(&res);
+    return 0;
+}
+
+// Kernel modules: the list is walked while paused, the PE headers are
+// parsed after resuming since loaded images do not change
+int run_driver_scan(addr_t modules_head) {
+    win_module_list_t drivers = { 0 };
+    win_mod_map_t map = { 0 };
+    win_mod_addr_t addr;
+    char where[1024];
+    uint64_t start, resumed, done;
+    int count, i;
+    
+    if (!pe_cache) {
+        printf("Failed to allocate PE image cache\n");
+        return -1;
+    }
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, driver list may be inconsistent\n");
+    }
+    gm_invalidate(gm);
+    count = win_walk_drivers(gm, modules_head, &drivers);
+    resume_guest();
+    resumed = gm_now_ns();
+    if (0 != win_mod_map_build(&map, pe_cache, gm, GM_KERNEL_DTB, &drivers)) {
+        printf("Failed to index kernel modules\n");
+    }
+    done = gm_now_ns();
     
-    do {
-        unicode_string_t *module_name = NULL;
-        addr_t base_address = 0;
-        uint32_t size = 0;
+    printf("\n=== KERNEL MODULES ===\n");
+    printf("%-32s %-18s %-10s %-10s %-8s %s\n", "Name", "Base", "Size", "Timestamp", "Sections", "Exports");
+    for (size_t k = 0; k < map.count; k++) {
+        const win_module_t *m = map.items[k].module;
+        const win_pe_image_t *pe = map.items[k].pe;
         
-        // Read module name (LDR_DATA_TABLE_ENTRY.BaseDllName)
-        module_name = vmi_read_unicode_str_va(vmi, current_module + 0x60, 0);
-        if (module_name && module_name->contents) {
-            // Read base address (LDR_DATA_TABLE_ENTRY.DllBase)
-            vmi_read_addr_va(vmi, current_module + 0x30, 0, &base_address);
-            // Read size (LDR_DATA_TABLE_ENTRY.SizeOfImage)
-            vmi_read_32_va(vmi, current_module + 0x40, 0, &size);
-            
-            printf("  %-40s Base: 0x%016lx Size: 0x%08x\n", 
-                   module_name->contents, base_address, size);
-            count++;
+        if (pe) {
+            printf("%-32s 0x%-16lx 0x%-8x 0x%08x %-8zu %zu\n", m->name, m->base, m->size,
+                   pe->timestamp, pe->section_count, pe->export_count);
+        } else {
+            printf("%-32s 0x%-16lx 0x%-8x %-10s %-8s %s\n", m->name, m->base, m->size, "-", "-", "-");
         }
+    }
+    printf("Total kernel modules: %d\n", count);
+    if (drivers.error) printf("Warning: %s\n", drivers.error);
+    
+    for (i = 0; i < resolve_count; i++) {
+        if (resolve_vas[i].pid >= 0) continue;
+        if (0 == win_mod_map_lookup(&map, resolve_vas[i].va, &addr)) {
+            win_mod_addr_format(&addr, where, sizeof(where));
+        } else {
+            snprintf(where, sizeof(where), "(not in a kernel module)");
+        }
+        printf("0x%016lx  %s\n", resolve_vas[i].va, where);
+    }
+    print_timing(resumed - start, done - start);
+    
+    gm_invalidate(gm);
+    win_mod_map_free(&map);
+    win_module_list_free(&drivers);
+    return 0;
+}
+
+// Handle tables of every process: the process list and the tables are
+// read while paused, in one pass over all processes. Object types come
+// from ObTypeIndexTable; without ObHeaderCookie the cookie is worked out
+// from the System process.
+int run_handle_scan(addr_t first_process, addr_t list_head, addr_t system_process) {
+    win_process_list_t procs = { 0 };
+    win_handle_list_t *lists = NULL;
+    win_object_types_t types;
+    win_arena_t arena;
+    addr_t table = type_table_opt, cookie = 0;
+    size_t per_type[WIN_OBJECT_TYPES] = { 0 }, total = 0, k;
+    uint64_t start, resumed, done;
+    int typed;
+    
+    if (!table && 0 != resolve_symbol("ObTypeIndexTable", win_profile_get()->rva_ob_type_index_table, &table)) {
+        table = 0;
+    }
+    if (0 != resolve_symbol("ObHeaderCookie", win_profile_get()->rva_ob_header_cookie, &cookie)) {
+        cookie = 0;
+    }
+    win_arena_init(&arena);
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, handle tables may be inconsistent\n");
+    }
+    gm_invalidate(gm);
+    typed = win_object_types_load(gm, table, cookie, system_process ? system_process : first_process, &types);
+    win_walk_processes(gm, first_process, list_head, &procs);
+    if (procs.count && (lists = calloc(procs.count, sizeof(*lists)))) {
+        win_walk_handles_parallel(gm, typed == 0 ? &types : NULL, &procs, 1, workers, lists, &arena);
+    }
+    resume_guest();
+    resumed = gm_now_ns();
+    
+    printf("\n=== HANDLES ===\n");
+    if (typed != 0) {
+        printf("Warning: object types unknown (pass --type-table or --kernel-base), handles are untyped\n");
+    }
+    for (size_t i = 0; lists && i < procs.count; i++) {
+        const win_process_t *p = &procs.items[i];
         
-        if (module_name) vmi_free_unicode_str(module_name);
-        
-        // Read next module (Flink)
-        if (VMI_FAILURE == vmi_read_addr_va(vmi, current_module, 0, &current_module)) {
-            break;
+        printf("\n%s (PID %d): %zu handles\n", p->name, p->pid, lists[i].count);
+        for (k = 0; k < lists[i].count; k++) {
+            const win_handle_t *h = &lists[i].items[k];
+            
+            printf("  0x%-6x %-16s 0x%08x %c%c%c 0x%-16lx %s\n", h->handle, h->type ? h->type : "?", h->access,
+                   h->attributes & WIN_HANDLE_INHERIT ? 'I' : '-',
+                   h->attributes & WIN_HANDLE_PROTECT_CLOSE ? 'P' : '-',
+                   h->attributes & WIN_HANDLE_AUDIT ? 'A' : '-', h->object, h->name ? h->name : "");
+            per_type[h->type_index]++;
+        }
+        if (lists[i].error) printf("  Warning: %s\n", lists[i].error);
+        total += lists[i].count;
+    }
+    done = gm_now_ns();
+    printf("\nTotal handles: %zu in %zu processes\n", total, procs.count);
+    if (typed == 0) {
+        for (k = 0; k < WIN_OBJECT_TYPES; k++) {
+            if (per_type[k] && types.names[k]) printf("  %-16s %zu\n", types.names[k], per_type[k]);
         }
+    }
+    print_timing(resumed - start, done - start);
+    
+    gm_invalidate(gm);
+    if (lists) win_handle_lists_free(lists, procs.count);
+    win_object_types_free(&types);
+    win_process_list_free(&procs);
+    win_arena_free(&arena);
+    return 0;
+}
+
+// VAD regions of every process: the process list and the trees are read
+// while paused, in one pass over all processes, with the file behind
+// each mapped view. Private executable regions are summed up at the end;
+// they hold code no image on disk accounts for.
+int run_vad_scan(addr_t first_process, addr_t list_head) {
+    win_process_list_t procs = { 0 };
+    win_vad_map_t *maps = NULL;
+    win_arena_t arena;
+    size_t total = 0, private_exec = 0, k;
+    uint64_t start, resumed, done;
+    int i;
+    
+    win_arena_init(&arena);
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, VAD trees may be inconsistent\n");
+    }
+    gm_invalidate(gm);
+    win_walk_processes(gm, first_process, list_head, &procs);
+    if (procs.count && (maps = calloc(procs.count, sizeof(*maps)))) {
+        win_walk_vads_parallel(gm, &procs, 1, workers, maps, &arena);
+    }
+    resume_guest();
+    resumed = gm_now_ns();
+    
+    printf("\n=== VAD REGIONS ===\n");
+    for (size_t p = 0; maps && p < procs.count; p++) {
+        printf("\n%s (PID %d): %zu regions\n", procs.items[p].name, procs.items[p].pid, maps[p].count);
+        for (k = 0; k < maps[p].count; k++) {
+            const win_vad_t *v = &maps[p].items[k];
+            
+            printf("  0x%012lx-0x%012lx %-18s %-7s %s\n", v->start, v->end - 1,
+                   win_vad_protection_name(v->protection),
+                   v->type == WIN_VAD_TYPE_IMAGE ? "Image" : v->private_memory ? "Private" : "Mapped",
+                   v->file ? v->file : "");
+            if (v->private_memory && win_vad_executable(v->protection)) private_exec++;
+        }
+        if (maps[p].error) printf("  Warning: %s\n", maps[p].error);
+        total += maps[p].count;
+    }
+    done = gm_now_ns();
+    printf("\nTotal regions: %zu in %zu processes, %zu private executable\n", total, procs.count, private_exec);
+    
+    for (i = 0; maps && i < resolve_count; i++) {
+        const win_vad_t *v = NULL;
         
-        // Prevent infinite loops
-        if (count > 500 || current_module == start_module) {
-            break;
+        if (resolve_vas[i].pid < 0) continue;
+        for (k = 0; k < procs.count; k++) {
+            if (procs.items[k].pid == resolve_vas[i].pid) v = win_vad_lookup(&maps[k], resolve_vas[i].va);
+        }
+        if (v) {
+            printf("%d:0x%016lx  region 0x%lx-0x%lx %s%s%s\n", resolve_vas[i].pid, resolve_vas[i].va, v->start,
+                   v->end - 1, win_vad_protection_name(v->protection), v->file ? " " : "", v->file ? v->file : "");
+        } else {
+            printf("%d:0x%016lx  (not in a region)\n", resolve_vas[i].pid, resolve_vas[i].va);
         }
+    }
+    print_timing(resumed - start, done - start);
+    
+    gm_invalidate(gm);
+    if (maps) win_vad_maps_free(maps, procs.count);
+    win_process_list_free(&procs);
+    win_arena_free(&arena);
+    return 0;
+}
+
+// Signature scan of every process: the process list, the module lists
+// and the VAD trees are read while paused, then the regions and modules
+// are searched in one pass, still paused so the pages do not change
+// under it. Hits are named after the module and export holding them, or
+// the region when no module does.
+int run_sig_scan(addr_t first_process, addr_t list_head) {
+    win_process_list_t procs = { 0 };
+    win_process_detail_t *details = NULL;
+    win_vad_map_t *maps = NULL;
+    win_sig_target_t *targets = NULL;
+    win_sig_result_t result = { 0 };
+    win_mod_map_t mods = { 0 };
+    win_arena_t arena;
+    uint64_t start, resumed, done;
+    char where[1024];
+    size_t k, processes = 0;
+    
+    if (0 != win_sig_compile(sigs)) {
+        printf("Could not compile the signatures\n");
+        return -1;
+    }
+    win_arena_init(&arena);
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, memory may change during the scan\n");
+    }
+    gm_invalidate(gm);
+    win_walk_processes(gm, first_process, list_head, &procs);
+    if (procs.count) {
+        details = calloc(procs.count, sizeof(*details));
+        maps = calloc(procs.count, sizeof(*maps));
+        targets = calloc(procs.count, sizeof(*targets));
+    }
+    if (details && maps && targets) {
+        win_walk_details_parallel(gm, &procs, workers, details, &arena);
+        win_walk_vads_parallel(gm, &procs, 1, workers, maps, &arena);
+        for (k = 0; k < procs.count; k++) {
+            win_sig_target_process(&targets[k], &procs.items[k], &maps[k], &details[k].modules);
+        }
+        win_sig_scan(gm, sigs, targets, procs.count, workers, &result);
+    }
+    resume_guest();
+    resumed = gm_now_ns();
+    
+    printf("\n=== SIGNATURE HITS ===\n");
+    printf("%zu patterns (%zu automaton states)\n", win_sig_count(sigs), win_sig_states(sigs));
+    for (k = 0; k < result.count; k++) {
+        const win_sig_hit_t *h = &result.items[k];
+        const win_process_t *p = &procs.items[h->target];
+        const win_vad_t *v = win_vad_lookup(&maps[h->target], h->va);
+        win_mod_addr_t addr;
         
-    } while (current_module != 0 && current_module != start_module);
+        // Exports are indexed after the guest is resumed, as for a scan
+        if (k == 0 || h->target != result.items[k - 1].target) {
+            printf("\n%s (PID %d)\n", p->name, p->pid);
+            processes++;
+            win_mod_map_free(&mods);
+            if (pe_cache) win_mod_map_build(&mods, pe_cache, gm, win_process_dtb(p), &details[h->target].modules);
+        }
+        if (0 == win_mod_map_lookup(&mods, h->va, &addr)) {
+            win_mod_addr_format(&addr, where, sizeof(where));
+        } else if (v) {
+            snprintf(where, sizeof(where), "%s region 0x%lx-0x%lx%s%s",
+                     v->private_memory ? "private" : "mapped", v->start, v->end - 1,
+                     v->file ? " " : "", v->file ? v->file : "");
+        } else {
+            snprintf(where, sizeof(where), "(no region)");
+        }
+        printf("  0x%016lx  %-24s %s\n", h->va, win_sig_name(sigs, h->pattern), where);
+    }
+    win_mod_map_free(&mods);
+    done = gm_now_ns();
+    printf("\nTotal hits: %zu in %zu processes\n", result.count, processes);
+    printf("Searched %.1f MiB of resident memory (%lu pages not resident) in %.3f ms: %.2f GB/s, %d workers\n",
+           result.bytes / (1024.0 * 1024.0), (unsigned long)result.absent, result.ns / 1e6,
+           result.ns ? result.bytes / (double)result.ns : 0.0, result.workers);
+    if (result.error) printf("Warning: %s\n", result.error);
+    print_timing(resumed - start, done - start);
     
-    printf("Total modules found: %d\n", count);
-    return count;
+    gm_invalidate(gm);
+    win_sig_result_free(&result);
+    for (k = 0; targets && k < procs.count; k++) win_sig_ranges_free(&targets[k].ranges);
+    free(targets);
+    if (maps) win_vad_maps_free(maps, procs.count);
+    if (details) win_process_details_free(details, procs.count);
+    win_process_list_free(&procs);
+    win_arena_free(&arena);
+    return 0;
 }
 
-// Function to list threads for a specific process
-int list_threads_for_process(addr_t process_addr, const char* process_name) {
-    addr_t thread_list = 0, current_thread = 0;
-    int count = 0;
+// Kernel page-table root written into captures: LibVMI translates on its
+// own, so ask it; images and RAM files already have it
+uint64_t capture_dtb() {
+    addr_t kpgd = 0;
     
-    printf("\n=== ACTIVE THREADS FOR %s ===\n", process_name);
+    if (vmi_attached && VMI_SUCCESS == vmi_get_offset(vmi, "kpgd", &kpgd)) return kpgd;
+    return gm_kernel_dtb(gm);
+}
+
+// Write guest RAM to dump_path while the guest is paused. A reachable
+// capture records the pages a scan reads, plus the page tables behind
+// them, and is written after resuming.
+int run_capture(addr_t first_process, addr_t list_head, addr_t system_process, addr_t modules_head) {
+    gm_snapshot_t *snap = NULL;
+    guest_mem_t *view;
+    gm_dump_stats_t stats;
+    uint64_t dtb = capture_dtb(), start, resumed, *pfns;
+    size_t n, tables = 0;
+    int ret, dump_errno;
     
-    // ThreadListHead is at offset 0x5e0 in EPROCESS
-    thread_list = process_addr + 0x5e0;
+    if (dump_reachable && !(snap = gm_snapshot_create())) {
+        printf("Failed to allocate page snapshot\n");
+        return -1;
+    }
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, capture may be inconsistent\n");
+    }
+    gm_invalidate(gm);
+    if (snap) {
+        gm_snapshot_begin(gm, snap);
+        collect_scan(gm, first_process, list_head, system_process, NULL);
+        if (modules_head) win_walk_drivers(gm, modules_head, NULL);
+        gm_snapshot_end(gm);
+        tables = gm_snapshot_add_tables(snap, gm, dtb);
+        resume_guest();
+        resumed = gm_now_ns();
+        
+        pfns = gm_snapshot_pfns(snap, &n);
+        view = gm_open_snapshot(snap, 64);
+        errno = ENOMEM;
+        ret = !view || !pfns ? -1 : dump_packed ? gm_dump_packed(view, dump_path, pfns, n, dtb, workers, &stats)
+                                                : gm_dump(view, dump_path, pfns, n, dtb, &stats);
+        // Cleanup and resuming may overwrite errno
+        dump_errno = errno;
+        gm_destroy(view);
+        free(pfns);
+        gm_snapshot_destroy(snap);
+    } else {
+        ret = dump_packed ? gm_dump_packed(gm, dump_path, NULL, 0, dtb, workers, &stats)
+                          : gm_dump(gm, dump_path, NULL, 0, dtb, &stats);
+        dump_errno = errno;
+        resume_guest();
+        resumed = gm_now_ns();
+    }
+    gm_invalidate(gm);
     
-    if (VMI_FAILURE == vmi_read_addr_va(vmi, thread_list, 0, &current_thread)) {
-        printf("Failed to read thread list\n");
+    printf("\n=== MEMORY CAPTURE ===\n");
+    if (ret != 0) {
+        printf("Failed to write %s: %s\n", dump_path, strerror(dump_errno));
         return -1;
     }
+    printf("Captured %lu %spages (%.1f MiB) to %s in %.3f ms, kernel DTB 0x%lx\n",
+           (unsigned long)stats.pages, snap ? "reachable " : "", stats.bytes / (1024.0 * 1024.0),
+           dump_path, stats.ns / 1e6, dtb);
+    if (dump_packed) {
+        printf("Packed: %lu zero and %lu repeated pages kept in the index only, %.1f%% of the raw size\n",
+               (unsigned long)stats.zero, (unsigned long)stats.duplicate,
+               stats.pages ? 100.0 * stats.bytes / (stats.pages * GM_PAGE_SIZE) : 0.0);
+    }
+    if (tables) printf("Page-table pages added: %zu\n", tables);
+    if (stats.unreadable) printf("Warning: %lu pages could not be read\n", (unsigned long)stats.unreadable);
+    print_timing(resumed - start, gm_now_ns() - start);
+    return 0;
+}
+
+// Diff an earlier capture against the target and name the objects on the
+// changed pages. The guest stays paused for the compare and the walks
+// that find the owners.
+int run_diff(addr_t first_process, addr_t list_head, addr_t system_process, addr_t modules_head) {
+    static const char *kinds[] = { "processes", "threads", "modules", "drivers" };
+    scan_result_t res;
+    win_module_list_t drivers = { 0 };
+    win_owner_map_t owners = { 0 };
+    gm_diff_t diff;
+    guest_mem_t *old;
+    uint64_t start, resumed, by_kind[4] = { 0 }, unowned = 0;
+    size_t i, j;
+    char where[1024];
     
-    addr_t start_thread = current_thread;
-    current_thread -= 0x5e0; // Adjust for ThreadListEntry offset
+    old = gm_open_image(diff_path, 0);
+    if (!old) {
+        printf("Failed to open capture %s\n", diff_path);
+        return -1;
+    }
+    memset(&res, 0, sizeof(res));
+    start = gm_now_ns();
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, diff may be inconsistent\n");
+    }
+    gm_invalidate(gm);
+    if (0 != gm_diff(old, gm, workers, &diff)) {
+        resume_guest();
+        printf("Failed to diff against %s\n", diff_path);
+        gm_destroy(old);
+        return -1;
+    }
+    collect_scan(gm, first_process, list_head, system_process, &res);
+    if (modules_head) win_walk_drivers(gm, modules_head, &drivers);
+    if (0 != win_owner_map_build(&owners, gm, &res.processes, res.details, &drivers, &diff)) {
+        printf("Failed to index page owners\n");
+    }
+    resume_guest();
+    resumed = gm_now_ns();
+    gm_invalidate(gm);
     
-    do {
-        uint32_t thread_id = 0;
-        uint32_t process_id = 0;
+    printf("\n=== MEMORY DIFF (against %s) ===\n", diff_path);
+    printf("Compared %.1f MiB in %.3f ms with %d workers (%.2f GB/s): %lu settled by page hash, %lu compared\n",
+           diff.bytes / (1024.0 * 1024.0), diff.ns / 1e6, diff.workers,
+           diff.ns ? diff.bytes / (double)diff.ns : 0.0, (unsigned long)diff.hashed,
+           (unsigned long)diff.compared);
+    printf("%-18s %-13s %s\n", "PA", "Bytes", "Owner");
+    for (i = 0; i < diff.count; i++) {
+        const gm_diff_page_t *p = &diff.items[i];
+        const win_owner_t *o, *shown = NULL;
+        size_t n = win_owner_map_find(&owners, p->pfn, &o), hits = 0, shared = 0;
+        uint64_t offset;
         
-        // Read ClientId.UniqueThread (ETHREAD.Cid.UniqueThread)
-        if (VMI_SUCCESS == vmi_read_32_va(vmi, current_thread + 0x648, 0, &thread_id)) {
-            // Read ClientId.UniqueProcess (ETHREAD.Cid.UniqueProcess)  
-            vmi_read_32_va(vmi, current_thread + 0x644, 0, &process_id);
-            printf("  Thread ID: %-8d Process ID: %-8d\n", thread_id, process_id);
-            count++;
-        }
-        
-        // Read next thread (ThreadListEntry.Flink)
-        if (VMI_FAILURE == vmi_read_addr_va(vmi, current_thread + 0x5e0, 0, &current_thread)) {
-            break;
+        if (p->kind != GM_DIFF_CHANGED) continue;
+        for (j = 0; j < n; j++) {
+            if (!win_owner_hit(&o[j], p->first, p->last, &offset)) continue;
+            hits++;
+            // A DLL page mapped by many processes is listed once
+            if (shown && shown->kind == WIN_OWNER_MODULE && o[j].kind == WIN_OWNER_MODULE &&
+                o[j].base == shown->base) {
+                shared++;
+                continue;
+            }
+            if (shared) printf("%-32s (and %zu more processes)\n", "", shared);
+            shared = 0;
+            win_owner_format(&o[j], offset, where, sizeof(where));
+            printf("0x%016lx 0x%03x-0x%03x   %s\n", p->pfn << GM_PAGE_SHIFT, p->first, p->last, where);
+            by_kind[o[j].kind]++;
+            shown = &o[j];
         }
-        current_thread -= 0x5e0; // Adjust for ThreadListEntry offset
+        if (shared) printf("%-32s (and %zu more processes)\n", "", shared);
+        if (!hits) unowned++;
+    }
+    printf("Pages changed: %lu (", (unsigned long)diff.changed);
+    for (i = 0; i < 4; i++) printf("%lu in %s, ", (unsigned long)by_kind[i], kinds[i]);
+    printf("%lu elsewhere), added: %lu, removed: %lu\n", (unsigned long)unowned,
+           (unsigned long)diff.added, (unsigned long)diff.removed);
+    print_timing(resumed - start, gm_now_ns() - start);
+    
+    win_owner_map_free(&owners);
+    win_module_list_free(&drivers);
+    gm_diff_free(&diff);
+    free_scan(&res);
+    gm_destroy(old);
+    return 0;
+}
+
+// Time all-process module/thread enumeration with 1..workers threads
+int run_scaling(addr_t first_process, addr_t list_head) {
+    win_process_list_t procs = { 0 };
+    win_arena_t arena;
+    uint64_t base_ns = 0;
+    int w;
+    
+    win_arena_init(&arena);
+    if (0 != pause_guest()) {
+        printf("Warning: Could not pause VM, results may be inconsistent\n");
+        return -1;
+    }
+    
+    gm_invalidate(gm);
+    win_walk_processes(gm, first_process, list_head, &procs);
+    
+    printf("\n=== SCALING (%zu processes) ===\n", procs.count);
+    printf("%-8s %-12s %s\n", "Workers", "Time (ms)", "Speedup");
+    for (w = 1; w <= workers; w = (w * 2 > workers && w < workers) ? workers : w * 2) {
+        win_process_detail_t *details = calloc(procs.count ? procs.count : 1, sizeof(*details));
+        uint64_t start, elapsed;
         
-        // Prevent infinite loops
-        if (count > 1000 || current_thread == (start_thread - 0x5e0)) {
-            break;
-        }
+        if (!details) break;
+        // Every run starts cold so the numbers are comparable
+        gm_invalidate(gm);
+        start = gm_now_ns();
+        win_walk_details_parallel(gm, &procs, w, details, &arena);
+        elapsed = gm_now_ns() - start;
+        if (w == 1) base_ns = elapsed;
         
-    } while (current_thread != 0 && current_thread != (start_thread - 0x5e0));
+        printf("%-8d %-12.3f %.2fx\n", w, elapsed / 1e6,
+               elapsed ? (double)base_ns / elapsed : 0.0);
+        win_process_details_free(details, procs.count);
+        win_arena_free(&arena);
+    }
     
-    printf("Total threads found: %d\n", count);
-    return count;
+    resume_guest();
+    gm_invalidate(gm);
+    win_process_list_free(&procs);
+    return 0;
 }
 
 // Main function
 int main(int argc, char **argv) {
     vmi_init_error_t error;
     char *vm_name = "win10-vmi";
+    const char *profile_path = NULL;
+    const char *counters_path = NULL;
+    const char *symcache_path = NULL;
+    char profile_error[256], symcache_default[4096];
+    ctr_format_t counters_format = CTR_FORMAT_JSON;
+    int counters_wanted = 0;
+    int snapshot_mode = 0, scaling_mode = 0, symcache_wanted = 1, scan_wanted = 0;
+    int i;
     
-    if (argc == 2) {
-        vm_name = argv[1];
+    workers = win_default_workers();
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshot_mode = 1;
+        } else if (strcmp(argv[i], "--all") == 0) {
+            all_processes = 1;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+            if (workers < 1) workers = 1;
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling_mode = 1;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image_path = argv[++i];
+        } else if (strcmp(argv[i], "--dtb") == 0 && i + 1 < argc) {
+            kernel_dtb_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--kernel-base") == 0 && i + 1 < argc) {
+            kernel_base_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--ps-head") == 0 && i + 1 < argc) {
+            ps_head_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--symbol-cache") == 0 && i + 1 < argc) {
+            symcache_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-symbol-cache") == 0) {
+            symcache_wanted = 0;
+        } else if (strcmp(argv[i], "--scan") == 0) {
+            scan_wanted = 1;
+        } else if (strcmp(argv[i], "--psscan") == 0) {
+            psscan_mode = 1;
+        } else if (strcmp(argv[i], "--no-pause") == 0) {
+            no_pause = 1;
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dump_path = argv[++i];
+        } else if (strcmp(argv[i], "--dump-reachable") == 0 && i + 1 < argc) {
+            dump_path = argv[++i];
+            dump_reachable = 1;
+        } else if (strcmp(argv[i], "--packed") == 0) {
+            dump_packed = 1;
+        } else if (strcmp(argv[i], "--diff") == 0 && i + 1 < argc) {
+            // Owners include every process's modules and threads
+            diff_path = argv[++i];
+            all_processes = 1;
+        } else if (strcmp(argv[i], "--drivers") == 0) {
+            drivers_mode = 1;
+        } else if (strcmp(argv[i], "--handles") == 0) {
+            handles_mode = 1;
+        } else if (strcmp(argv[i], "--type-table") == 0 && i + 1 < argc) {
+            type_table_opt = strtoull(argv[++i], NULL, 0);
+            handles_mode = 1;
+        } else if (strcmp(argv[i], "--vads") == 0) {
+            vads_mode = 1;
+        } else if ((strcmp(argv[i], "--sig") == 0 || strcmp(argv[i], "--signatures") == 0) && i + 1 < argc) {
+            char sig_error[512];
+            int added;
+            
+            if (!sigs && !(sigs = win_sig_set_create())) {
+                printf("Out of memory\n");
+                return 1;
+            }
+            added = strcmp(argv[i], "--sig") == 0 ? win_sig_add(sigs, NULL, argv[i + 1], sig_error, sizeof(sig_error))
+                                                  : win_sig_load(sigs, argv[i + 1], sig_error, sizeof(sig_error));
+            if (added < 0 && strcmp(argv[i], "--sig") == 0) {
+                printf("Bad signature %s: %s\n", argv[i + 1], sig_error);
+                return 1;
+            } else if (added < 0) {
+                printf("Bad signature file: %s\n", sig_error);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--resolve") == 0 && i + 1 < argc) {
+            if (resolve_count == MAX_RESOLVE) {
+                printf("At most %d --resolve addresses\n", MAX_RESOLVE);
+                return 1;
+            }
+            // PID:VA is a user-mode address, in the modules of that process
+            char *colon = strchr(argv[++i], ':');
+            resolve_vas[resolve_count].pid = colon ? atoi(argv[i]) : -1;
+            resolve_vas[resolve_count].va = strtoull(colon ? colon + 1 : argv[i], NULL, 0);
+            if (colon) all_processes = 1;
+            else drivers_mode = 1;
+            resolve_count++;
+        } else if (strcmp(argv[i], "--counters") == 0 && i + 1 < argc) {
+            if (0 != counters_parse_format(argv[++i], &counters_format)) {
+                printf("Unknown counters format %s (json or prometheus)\n", argv[i]);
+                return 1;
+            }
+            counters_wanted = 1;
+        } else if (strcmp(argv[i], "--counters-out") == 0 && i + 1 < argc) {
+            counters_path = argv[++i];
+            counters_wanted = 1;
+        } else {
+            vm_name = argv[i];
+        }
     }
     
     printf("=== Windows 10 VMI Inspector ===\n");
-    printf("Target VM: %s\n", vm_name);
-    
-    // Initialize LibVMI with basic flags
-    if (VMI_FAILURE == vmi_init(&vmi, VMI_KVM, vm_name, VMI_INIT_DOMAINNAME, NULL, &error)) {
-        printf("Failed to initialize LibVMI (Error: %d)\n", error);
-        printf("Make sure:\n");
-        printf("1. VM '%s' is running\n", vm_name);
-        printf("2. libvmi.conf is properly configured\n");
-        printf("3. You have proper permissions\n");
+    printf("Target %s: %s\n", image_path ? "image" : "VM", image_path ? image_path : vm_name);
+    
+    // Structure offsets for every walker: --profile, $VMI_PROFILE or built-in
+    if (0 != win_profile_select(profile_path, profile_error, sizeof(profile_error))) {
+        printf("Failed to load structure profile: %s\n", profile_error);
         return 1;
     }
+    printf("Structure profile: %s\n", win_profile_get()->name);
+    if (no_pause) {
+        win_walk_set_live(1);
+        printf("Live mode: the guest is not paused, list links are checked and re-read\n");
+    }
     
-    printf("LibVMI initialization successful!\n");
-    
-    // Get OS information
-    os_t os = vmi_get_ostype(vmi);
-    printf("Detected OS: %s\n", os == VMI_OS_WINDOWS ? "Windows" : "Unknown");
+    // Access counters, dumped at exit and on SIGUSR1
+    if (counters_wanted && 0 != counters_install(counters_format, counters_path)) {
+        printf("Failed to start the counters dump thread\n");
+        return 1;
+    }
     
-    // Pause the VM for consistent introspection
-    if (VMI_SUCCESS == vmi_pause_vm(vmi)) {
-        printf("VM paused for introspection\n");
+    if (image_path) {
+        // Offline: the image is mapped and walked without a hypervisor
+        gm = gm_open_image(image_path, 0);
+        if (!gm) {
+            printf("Failed to open memory image %s\n", image_path);
+            return 1;
+        }
+        if (kernel_dtb_opt) gm_set_kernel_dtb(gm, kernel_dtb_opt);
+        if (!gm_kernel_dtb(gm)) {
+            printf("Kernel DTB unknown (pass --dtb CR3)\n");
+            gm_destroy(gm);
+            return 1;
+        }
+        printf("Memory image mapped, kernel DTB 0x%lx\n", gm_kernel_dtb(gm));
+    } else {
+        // Initialize LibVMI with basic flags
+        if (VMI_FAILURE == vmi_init(&vmi, VMI_KVM, vm_name, VMI_INIT_DOMAINNAME, NULL, &error)) {
+            printf("Failed to initialize LibVMI (Error: %d)\n", error);
+            printf("Make sure:\n");
+            printf("1. VM '%s' is running\n", vm_name);
+            printf("2. libvmi.conf is properly configured\n");
+            printf("3. You have proper permissions\n");
+            return 1;
+        }
+        vmi_attached = 1;
         
-        // List all processes
-        int process_count = list_processes();
+        printf("LibVMI initialization successful!\n");
         
-        if (process_count > 0) {
-            // Find a user process for module/thread enumeration
-            addr_t current_process = 0;
-            if (VMI_SUCCESS == vmi_translate_ksym2v(vmi, "PsInitialSystemProcess", &current_process)) {
-                char *procname = vmi_read_str_va(vmi, current_process + 0x5a8, 0);
-                if (procname) {
-                    list_modules_for_process(current_process, procname);
-                    list_threads_for_process(current_process, procname);
-                    free(procname);
-                }
-            }
+        // All walkers read guest memory through the page/translation caches
+        gm = gm_open_libvmi(vmi, GM_DEFAULT_CACHE_PAGES);
+        if (!gm) {
+            printf("Failed to allocate guest memory cache\n");
+            vmi_destroy(vmi);
+            return 1;
         }
         
-        // Resume the VM
-        vmi_resume_vm(vmi);
-        printf("\nVM resumed\n");
+        // Get OS information
+        os_t os = vmi_get_ostype(vmi);
+        printf("Detected OS: %s\n", os == VMI_OS_WINDOWS ? "Windows" : "Unknown");
+    }
+    
+    pe_cache = win_pe_cache_create();
+    
+    // Symbols and list heads do not move, so resolve them before pausing
+    if (symcache_wanted && !symcache_path) {
+        symcache_path = win_symcache_default_path(symcache_default, sizeof(symcache_default));
+    }
+    if (symcache_wanted && symcache_path) {
+        open_symbol_cache(symcache_path, image_path ? image_path : vm_name);
+    }
+    // Images have no LibVMI to fall back on, so they are scanned unless
+    // the kernel is already known
+    if (scan_wanted || (image_path && !kernel_base_opt && !ps_head_opt &&
+                        !(symcache && win_symcache_kernel(symcache)))) {
+        scan_for_kernel();
+    }
+    addr_t list_head = 0;
+    addr_t first_process = find_first_process(&list_head);
+    addr_t system_process = find_system_process();
+    addr_t modules_head = ps_modules_opt;
+    if ((drivers_mode || dump_reachable || diff_path) && !modules_head &&
+        0 != resolve_symbol("PsLoadedModuleList", win_profile_get()->rva_ps_loaded_module_list, &modules_head)) {
+        printf("Warning: PsLoadedModuleList unknown (pass --kernel-base or --scan), not listing drivers\n");
+    }
+    print_kernel();
+    if (symcache && 0 != win_symcache_save(symcache)) {
+        printf("Warning: could not write symbol cache %s\n", symcache_path);
+    }
+    gm_invalidate(gm);
+    
+    if (scaling_mode) {
+        run_scaling(first_process, list_head);
+    } else if (dump_path) {
+        run_capture(first_process, list_head, system_process, modules_head);
+    } else if (diff_path) {
+        run_diff(first_process, list_head, system_process, modules_head);
+    } else if (snapshot_mode) {
+        run_snapshot_scan(first_process, list_head, system_process);
     } else {
-        printf("Warning: Could not pause VM, results may be inconsistent\n");
+        run_paused_scan(first_process, list_head, system_process);
+    }
+    if (drivers_mode && modules_head) {
+        run_driver_scan(modules_head);
+    }
+    if (handles_mode) {
+        run_handle_scan(first_process, list_head, system_process);
+    }
+    if (vads_mode) {
+        run_vad_scan(first_process, list_head);
+    }
+    if (sigs) {
+        run_sig_scan(first_process, list_head);
     }
     
     // Cleanup
-    vmi_destroy(vmi);
+    win_sig_set_destroy(sigs);
+    win_pe_cache_destroy(pe_cache);
+    win_symcache_close(symcache);
+    gm_destroy(gm);
+    if (vmi_attached) vmi_destroy(vmi);
     printf("\nVMI inspection completed successfully!\n");
     
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_pe.h"
+#include "win_profile.h"
+#include "win_synth.h"
+#include "win_walk.h"
+
+// Self-check for kernel module enumeration and the PE image cache
+// (win_pe.h). Synthetic images put the kernel and a few hundred drivers
+// on PsLoadedModuleList, each with a section and an export directory. The
+// walk must find all of them; addresses must resolve to the right export;
+// a second scan must not parse anything again, and a kernel update (new
+// TimeDateStamps at the same bases) must parse everything again. Every
+// process maps the same DLL images, which must be parsed once for all.
+
+#define DRIVERS_CHECK_DIR     "/dev/shm"
+#define DRIVERS_CHECK_COUNT   300
+#define DRIVERS_CHECK_DLLS    4
+
+static int bad = 0;
+
+typedef struct {
+    guest_mem_t *gm;
+    win_synth_info_t info;
+} image_t;
+
+static void open_image(image_t *img, uint32_t pdb_age) {
+    win_synth_opts_t opts;
+    char path[64];
+
+    win_synth_defaults(&opts);
+    opts.processes = 300;
+    opts.modules = DRIVERS_CHECK_DLLS;
+    opts.drivers = DRIVERS_CHECK_COUNT;
+    opts.raw = 1;
+    opts.pdb_age = pdb_age;
+    snprintf(path, sizeof(path), DRIVERS_CHECK_DIR "/vmi-drivers-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &img->info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+    img->gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!img->gm) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    gm_set_kernel_dtb(img->gm, img->info.dtb);
+}
+
+static void expect_resolves(const win_mod_map_t *map, uint64_t va, const char *want) {
+    win_mod_addr_t addr;
+    char got[256];
+
+    if (win_mod_map_lookup(map, va, &addr) != 0) {
+        snprintf(got, sizeof(got), "(none)");
+    } else {
+        win_mod_addr_format(&addr, got, sizeof(got));
+    }
+    if (strcmp(got, want) != 0) {
+        printf("✗ 0x%llx resolved to %s, expected %s\n", (unsigned long long)va, got, want);
+        bad++;
+    }
+}
+
+// Walk the drivers and index them; returns the parse time
+static uint64_t scan(const image_t *img, win_pe_cache_t *cache, win_module_list_t *drivers,
+                     win_mod_map_t *map) {
+    uint64_t start = gm_now_ns();
+    int n;
+
+    n = win_walk_drivers(img->gm, img->info.ps_loaded_module_list, drivers);
+    if (n < 0 || (size_t)n != img->info.expect_drivers || drivers->error) {
+        printf("✗ %d drivers on PsLoadedModuleList, expected %zu (%s)\n", n, img->info.expect_drivers,
+               drivers->error ? drivers->error : "no error");
+        bad++;
+    }
+    if (win_mod_map_build(map, cache, img->gm, GM_KERNEL_DTB, drivers) != 0) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    return gm_now_ns() - start;
+}
+
+static void check_names(const image_t *img, const win_module_list_t *drivers, const win_mod_map_t *map) {
+    char name[32], sym[64], want[1024];
+    size_t j;
+
+    if (drivers->count == 0 || strcmp(drivers->items[0].name, "ntoskrnl.exe") != 0 ||
+        drivers->items[0].base != img->info.kernel_base) {
+        printf("✗ First module is not the kernel\n");
+        bad++;
+    }
+    for (j = 1; j < drivers->count; j++) {
+        win_synth_driver_name(j - 1, name, sizeof(name));
+        if (strcmp(drivers->items[j].name, name) != 0) {
+            printf("✗ Driver %zu is %s, expected %s\n", j, drivers->items[j].name, name);
+            bad++;
+            break;
+        }
+    }
+
+    // Exports in every driver, an ordinal-only one, the header page, and
+    // addresses outside every module
+    for (j = 1; j < drivers->count; j += 37) {
+        const win_module_t *m = &drivers->items[j];
+
+        win_synth_driver_export(j - 1, 2, sym, sizeof(sym));
+        snprintf(want, sizeof(want), "%s!%s+0x10", m->name, sym);
+        expect_resolves(map, m->base + 0x1210, want);
+        win_synth_driver_export(j - 1, WIN_SYNTH_DRIVER_EXPORTS - 1, sym, sizeof(sym));
+        snprintf(want, sizeof(want), "%s!%s+0x400", m->name, sym);
+        expect_resolves(map, m->base + 0x1700, want);
+        snprintf(want, sizeof(want), "%s!#%d+0x8", m->name, WIN_SYNTH_DRIVER_EXPORTS + 1);
+        expect_resolves(map, m->base + 0x1f08, want);
+        snprintf(want, sizeof(want), "%s+0x80", m->name);
+        expect_resolves(map, m->base + 0x80, want);
+    }
+    snprintf(want, sizeof(want), "ntoskrnl.exe!PsLoadedModuleList+0x8");
+    expect_resolves(map, img->info.ps_loaded_module_list + 8, want);
+    expect_resolves(map, img->info.kernel_base - 1, "(none)");
+    expect_resolves(map, drivers->items[drivers->count - 1].base + 0x2000, "(none)");
+}
+
+// DLL exports of every process from one shared parse per image
+static void check_processes(const image_t *img, win_pe_cache_t *cache) {
+    const win_pe_cache_stats_t *stats = win_pe_cache_stats(cache);
+    win_process_list_t procs = {0};
+    uint64_t parsed = stats->parsed, hits = stats->hits, start = gm_now_ns();
+    size_t i, mapped = 0, resolved = 0;
+    char name[32], sym[64], want[1024];
+
+    win_walk_processes(img->gm, img->info.first_process, img->info.ps_active_process_head, &procs);
+    for (i = 0; i < procs.count; i++) {
+        win_module_list_t modules = {0};
+        win_mod_map_t map;
+        size_t j;
+
+        if (win_walk_modules(img->gm, &procs.items[i], &modules) < 0 ||
+            win_mod_map_build(&map, cache, img->gm, win_process_dtb(&procs.items[i]), &modules) != 0) {
+            printf("✗ Modules of %s not indexed\n", procs.items[i].name);
+            bad++;
+            win_module_list_free(&modules);
+            continue;
+        }
+        for (j = 0; j < modules.count; j++) {
+            const win_module_t *m = &modules.items[j];
+
+            win_synth_module_name(j, name, sizeof(name));
+            win_synth_module_export(j, 1, sym, sizeof(sym));
+            snprintf(want, sizeof(want), "%s!%s+0x24", name, sym);
+            expect_resolves(&map, m->base + 0x1124, want);
+            resolved++;
+        }
+        mapped += map.count;
+        win_mod_map_free(&map);
+        win_module_list_free(&modules);
+    }
+
+    if (mapped != img->info.expect_modules || stats->parsed - parsed != (mapped ? DRIVERS_CHECK_DLLS : 0) ||
+        stats->hits - hits != mapped - (stats->parsed - parsed)) {
+        printf("✗ %zu modules in %zu processes: %llu images parsed, %llu reused\n", mapped, procs.count,
+               (unsigned long long)(stats->parsed - parsed), (unsigned long long)(stats->hits - hits));
+        bad++;
+    } else {
+        printf("✓ %zu DLL mappings in %zu processes from %llu parses, %zu addresses resolved in %.3f ms\n",
+               mapped, procs.count, (unsigned long long)(stats->parsed - parsed), resolved,
+               (gm_now_ns() - start) / 1e6);
+    }
+    win_process_list_free(&procs);
+}
+
+int main(void) {
+    win_module_list_t drivers = {0}, again = {0}, updated = {0};
+    win_mod_map_t map, map2, map3;
+    win_pe_cache_t *cache;
+    const win_pe_cache_stats_t *stats;
+    image_t img, newer;
+    uint64_t cold_ns, warm_ns, parsed;
+    char error[256];
+
+    printf("=== Module Export Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    cache = win_pe_cache_create();
+    if (!cache) {
+        printf("❌ Out of memory\n");
+        return 1;
+    }
+    stats = win_pe_cache_stats(cache);
+
+    open_image(&img, 1);
+    cold_ns = scan(&img, cache, &drivers, &map);
+    check_names(&img, &drivers, &map);
+    if (stats->parsed != img.info.expect_drivers || stats->hits != 0) {
+        printf("✗ First scan parsed %llu images (%llu hits), expected %zu\n",
+               (unsigned long long)stats->parsed, (unsigned long long)stats->hits, img.info.expect_drivers);
+        bad++;
+    }
+    if (!bad) printf("✓ %zu modules walked and parsed in %.3f ms\n", drivers.count, cold_ns / 1e6);
+
+    // Same kernel, same drivers: only the headers are read again
+    parsed = stats->parsed;
+    gm_invalidate(img.gm);
+    warm_ns = scan(&img, cache, &again, &map2);
+    check_names(&img, &again, &map2);
+    if (stats->parsed != parsed || stats->hits != img.info.expect_drivers) {
+        printf("✗ Second scan parsed %llu more images, %llu hits\n",
+               (unsigned long long)(stats->parsed - parsed), (unsigned long long)stats->hits);
+        bad++;
+    } else {
+        printf("✓ Second scan reused every parsed image in %.3f ms\n", warm_ns / 1e6);
+    }
+
+    check_processes(&img, cache);
+
+    // After an update the bases repeat but the stamps do not
+    open_image(&newer, 2);
+    parsed = stats->parsed;
+    scan(&newer, cache, &updated, &map3);
+    check_names(&newer, &updated, &map3);
+    if (stats->parsed - parsed != newer.info.expect_drivers) {
+        printf("✗ Updated kernel: %llu images parsed again, expected %zu\n",
+               (unsigned long long)(stats->parsed - parsed), newer.info.expect_drivers);
+        bad++;
+    } else {
+        printf("✓ Updated build at the same bases parsed afresh\n");
+    }
+
+    win_mod_map_free(&map);
+    win_mod_map_free(&map2);
+    win_mod_map_free(&map3);
+    win_module_list_free(&drivers);
+    win_module_list_free(&again);
+    win_module_list_free(&updated);
+    win_pe_cache_destroy(cache);
+    gm_destroy(img.gm);
+    gm_destroy(newer.gm);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every kernel and DLL address resolved\n");
+    return 0;
+}
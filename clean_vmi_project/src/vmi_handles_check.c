@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_handles.h"
+#include "win_parallel.h"
+#include "win_profile.h"
+#include "win_synth.h"
+#include "win_synth_count.h"
+#include "win_walk.h"
+
+// Self-check for handle enumeration (win_handles.h). Synthetic images
+// give every process a handle table of File, Key, Event and Process
+// handles, with one process holding thousands; tables of one, two and
+// three levels are walked and every handle must come back with its value,
+// access, type and (for files and keys) name. Types must resolve both
+// with the cookie read from ObHeaderCookie and with it worked out from
+// the System process. Through a backend that counts its calls, a process
+// with thousands of handles must cost a few backend calls per hundred
+// handles, and the all-process pass must match the single walks.
+
+#define HANDLES_CHECK_DIR        "/dev/shm"
+#define HANDLES_CHECK_PROCESSES  2000
+#define HANDLES_CHECK_PER_PROC   48
+#define HANDLES_CHECK_HEAVY      20000
+#define HANDLES_CHECK_DEEP       140000     // beyond 512 leaves: three levels
+
+static int bad = 0;
+
+typedef struct {
+    guest_mem_t *gm;
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+} image_t;
+
+static void open_image(image_t *img, size_t processes, size_t handles, size_t heavy) {
+    char path[64];
+
+    win_synth_defaults(&img->opts);
+    img->opts.processes = processes;
+    img->opts.modules = 2;
+    img->opts.threads = 2;
+    img->opts.raw = 1;
+    img->opts.handles = handles;
+    img->opts.heavy_at = 1;
+    img->opts.heavy_handles = heavy;
+    snprintf(path, sizeof(path), HANDLES_CHECK_DIR "/vmi-handles-%d.img", (int)getpid());
+    if (win_synth_write(path, &img->opts, &img->info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+    img->gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!img->gm) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    gm_set_kernel_dtb(img->gm, img->info.dtb);
+}
+
+// Rows of process i against what the image holds; returns mismatches
+static int check_rows(const image_t *img, size_t i, const win_handle_list_t *list, int names) {
+    size_t want = win_synth_handle_count(&img->opts, i), k;
+    win_synth_handle_t h;
+
+    if (list->count != want || list->error) {
+        printf("✗ Process %zu: %zu handles, expected %zu (%s)\n", i, list->count, want,
+               list->error ? list->error : "no error");
+        return 1;
+    }
+    for (k = 0; k < want; k++) {
+        const win_handle_t *row = &list->items[k];
+        const char *name = row->name ? row->name : "";
+
+        win_synth_handle(k, &h);
+        if (row->handle != h.handle || row->access != h.access || row->attributes != h.attributes ||
+            !row->type || strcmp(row->type, h.type) != 0 || (names && strcmp(name, h.name) != 0)) {
+            printf("✗ Process %zu handle %zu: 0x%x %s access 0x%x attr %u \"%s\", expected 0x%x %s 0x%x %u \"%s\"\n",
+                   i, k, row->handle, row->type ? row->type : "?", row->access, row->attributes, name,
+                   h.handle, h.type, h.access, h.attributes, h.name);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void check_types(const image_t *img, win_object_types_t *types) {
+    win_object_types_t derived;
+
+    if (win_object_types_load(img->gm, img->info.ob_type_index_table, img->info.ob_header_cookie, 0, types) != 0 ||
+        types->count != 6 || types->file_type < 0 || types->key_type < 0) {
+        printf("✗ ObTypeIndexTable: %zu types, File %d, Key %d\n", types->count, types->file_type,
+               types->key_type);
+        bad++;
+        return;
+    }
+    if (win_object_types_load(img->gm, img->info.ob_type_index_table, 0, img->info.first_process, &derived) != 0 ||
+        derived.cookie != types->cookie) {
+        printf("✗ Cookie worked out from System: 0x%02x, ObHeaderCookie 0x%02x\n", derived.cookie, types->cookie);
+        bad++;
+    } else {
+        printf("✓ %zu object types, cookie 0x%02x read and worked out from the System process\n",
+               types->count, types->cookie);
+    }
+    win_object_types_free(&derived);
+}
+
+// Every process one at a time, then all in one pass with workers
+static void check_all(const image_t *img, const win_object_types_t *types) {
+    win_process_list_t procs = {0};
+    win_handle_list_t *lists;
+    win_arena_t arena;
+    uint64_t start, single_ns, pass_ns;
+    size_t i, total = 0, mismatched = 0;
+
+    win_walk_processes(img->gm, img->info.first_process, img->info.ps_active_process_head, &procs);
+    if (procs.count != img->info.expect_processes) {
+        printf("✗ %zu processes walked, expected %zu\n", procs.count, img->info.expect_processes);
+        bad++;
+    }
+
+    start = gm_now_ns();
+    for (i = 0; i < procs.count; i++) {
+        win_handle_list_t list = {0};
+        int n = win_walk_handles(img->gm, types, &procs.items[i], 1, &list);
+
+        if (n < 0 || (size_t)n != list.count) mismatched++;
+        else mismatched += check_rows(img, i, &list, 1);
+        total += list.count;
+        win_handle_list_free(&list);
+    }
+    single_ns = gm_now_ns() - start;
+    if (mismatched || total != img->info.expect_handles) {
+        printf("✗ %zu handles in %zu processes, expected %zu (%zu processes wrong)\n", total, procs.count,
+               img->info.expect_handles, mismatched);
+        bad++;
+    } else {
+        printf("✓ %zu handles in %zu processes with types and names in %.3f ms (%.0f ns per handle)\n",
+               total, procs.count, single_ns / 1e6, total ? (double)single_ns / total : 0.0);
+    }
+
+    lists = calloc(procs.count, sizeof(*lists));
+    if (!lists) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    win_arena_init(&arena);
+    gm_invalidate(img->gm);
+    start = gm_now_ns();
+    if (win_walk_handles_parallel(img->gm, types, &procs, 1, 4, lists, &arena) != 0) {
+        printf("✗ All-process pass did not run\n");
+        bad++;
+    }
+    pass_ns = gm_now_ns() - start;
+    for (i = 0, mismatched = 0, total = 0; i < procs.count; i++) {
+        mismatched += check_rows(img, i, &lists[i], 1);
+        total += lists[i].count;
+    }
+    if (mismatched) {
+        printf("✗ All-process pass: %zu processes differ\n", mismatched);
+        bad++;
+    } else {
+        printf("✓ All-process pass with 4 workers matches: %zu handles in %.3f ms\n", total, pass_ns / 1e6);
+    }
+    win_handle_lists_free(lists, procs.count);
+    win_arena_free(&arena);
+    win_process_list_free(&procs);
+}
+
+// Handles of process 1 read cold through the counting backend
+static void check_batched(const image_t *img, const win_object_types_t *types, size_t handles) {
+    win_synth_counter_t c;
+    win_process_list_t procs = {0};
+    win_handle_list_t list = {0};
+    uint64_t start, ns;
+    int n;
+
+    if (win_synth_count_open(&c, img->gm, &img->info) != 0) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    win_walk_processes(img->gm, img->info.first_process, img->info.ps_active_process_head, &procs);
+    if (procs.count < 2) {
+        printf("✗ Process 1 not walked\n");
+        bad++;
+        win_process_list_free(&procs);
+        win_synth_count_close(&c);
+        return;
+    }
+    start = gm_now_ns();
+    n = win_walk_handles(c.gm, types, &procs.items[1], 1, &list);
+    ns = gm_now_ns() - start;
+    if (n < 0 || (size_t)n != handles || check_rows(img, 1, &list, 1) != 0) {
+        printf("✗ %d handles through the counting backend, expected %zu\n", n, handles);
+        bad++;
+    } else if (!win_synth_count_ok(&c, handles, 50, "handles")) {
+        bad++;
+    } else {
+        printf("✓ %zu handles (%llu table pages) in %llu backend calls for %llu pages, %.3f ms\n", handles,
+               (unsigned long long)list.table_pages, (unsigned long long)c.calls,
+               (unsigned long long)c.pages, ns / 1e6);
+    }
+    win_handle_list_free(&list);
+    win_process_list_free(&procs);
+    win_synth_count_close(&c);
+}
+
+int main(void) {
+    win_object_types_t types;
+    image_t img, deep;
+    win_process_list_t procs = {0};
+    win_handle_list_t list = {0};
+    char error[256];
+    int n;
+
+    printf("=== Handle Table Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    // One-level tables everywhere, two levels in process 1
+    open_image(&img, HANDLES_CHECK_PROCESSES, HANDLES_CHECK_PER_PROC, HANDLES_CHECK_HEAVY);
+    check_types(&img, &types);
+    check_all(&img, &types);
+    check_batched(&img, &types, HANDLES_CHECK_HEAVY);
+
+    // Without types the handles are still there, unnamed
+    win_walk_processes(img.gm, img.info.first_process, img.info.ps_active_process_head, &procs);
+    n = procs.count > 1 ? win_walk_handles(img.gm, NULL, &procs.items[1], 1, &list) : -1;
+    if (n != HANDLES_CHECK_HEAVY || list.items[0].type || list.items[0].name) {
+        printf("✗ Without types: %d handles\n", n);
+        bad++;
+    } else {
+        printf("✓ Without ObTypeIndexTable the handles walk untyped\n");
+    }
+    win_handle_list_free(&list);
+    win_process_list_free(&procs);
+    win_object_types_free(&types);
+    gm_destroy(img.gm);
+
+    // Three levels
+    open_image(&deep, 4, 8, HANDLES_CHECK_DEEP);
+    if (win_object_types_load(deep.gm, deep.info.ob_type_index_table, 0, deep.info.first_process, &types) != 0) {
+        printf("✗ Types of the second image\n");
+        bad++;
+    }
+    check_batched(&deep, &types, HANDLES_CHECK_DEEP);
+    win_object_types_free(&types);
+    gm_destroy(deep.gm);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every handle decoded\n");
+    return 0;
+}
@@ -6,11 +6,13 @@
 #include <inttypes.h>
 #include <libvmi/libvmi.h>
 #include <libvmi/peparse.h>
+#include "win_profile.h"
 
 #define MAX_NAME_LENGTH 100
 
 // Function to list running processes
 void list_processes(vmi_instance_t vmi) {
+    const win_profile_t *prof = win_profile_get();
     addr_t list_head, current_process;
     addr_t next_process = 0;
     vmi_pid_t pid = 0;
@@ -29,10 +31,10 @@ void list_processes(vmi_instance_t vmi) {
 
     do {
         // Read process name
-        procname = vmi_read_str_va(vmi, current_process + 0x5a8, 0);  // EPROCESS.ImageFileName offset
+        procname = vmi_read_str_va(vmi, current_process + prof->eprocess_name, 0);  // EPROCESS.ImageFileName
         if (procname) {
             // Read process ID
-            status = vmi_read_32_va(vmi, current_process + 0x2e0, 0, (uint32_t*)&pid);  // UniqueProcessId offset
+            status = vmi_read_32_va(vmi, current_process + prof->eprocess_pid, 0, (uint32_t*)&pid);  // UniqueProcessId
             if (status == VMI_SUCCESS) {
                 printf("Process: %-20s (PID: %d)\n", procname, pid);
             }
@@ -40,16 +42,17 @@ void list_processes(vmi_instance_t vmi) {
         }
 
         // Read next process pointer
-        status = vmi_read_addr_va(vmi, current_process + 0x2e8, 0, &next_process);  // ActiveProcessLinks offset
+        status = vmi_read_addr_va(vmi, current_process + prof->eprocess_links, 0, &next_process);  // ActiveProcessLinks
         if (status == VMI_FAILURE) break;
 
-        current_process = next_process - 0x2e8;  // Adjust for list entry offset
+        current_process = next_process - prof->eprocess_links;  // Adjust for list entry offset
 
     } while (next_process != list_head);
 }
 
 // Function to list loaded modules for a process
 void list_modules(vmi_instance_t vmi, addr_t process_base) {
+    const win_profile_t *prof = win_profile_get();
     addr_t peb, ldr, module_list, current_module;
     addr_t next_module = 0;
     unicode_string_t *us = NULL;
@@ -58,22 +61,22 @@ void list_modules(vmi_instance_t vmi, addr_t process_base) {
     printf("\n=== Loaded Modules ===\n");
 
     // Read PEB address
-    status = vmi_read_addr_va(vmi, process_base + 0x3f8, 0, &peb);  // PEB offset
+    status = vmi_read_addr_va(vmi, process_base + prof->eprocess_peb, 0, &peb);  // EPROCESS.Peb
     if (status == VMI_FAILURE) return;
 
     // Read Ldr address
-    status = vmi_read_addr_va(vmi, peb + 0x18, process_base, &ldr);
+    status = vmi_read_addr_va(vmi, peb + prof->peb_ldr, process_base, &ldr);
     if (status == VMI_FAILURE) return;
 
     // Get module list head
-    status = vmi_read_addr_va(vmi, ldr + 0x20, process_base, &module_list);
+    status = vmi_read_addr_va(vmi, ldr + prof->ldr_inloadorder, process_base, &module_list);
     if (status == VMI_FAILURE) return;
 
     current_module = module_list;
 
     do {
         // Read module name
-        us = vmi_read_unicode_str_va(vmi, current_module + 0x60, process_base);
+        us = vmi_read_unicode_str_va(vmi, current_module + prof->ldr_basedllname, process_base);
         if (us) {
             printf("Module: %s\n", us->contents);
             vmi_free_unicode_str(us);
@@ -90,6 +93,7 @@ void list_modules(vmi_instance_t vmi, addr_t process_base) {
 
 // Function to list threads for a process
 void list_threads(vmi_instance_t vmi, addr_t process_base) {
+    const win_profile_t *prof = win_profile_get();
     addr_t thread_list, current_thread;
     addr_t next_thread = 0;
     uint32_t thread_id = 0;
@@ -98,12 +102,12 @@ void list_threads(vmi_instance_t vmi, addr_t process_base) {
     printf("\n=== Active Threads ===\n");
 
     // Get thread list head
-    thread_list = process_base + 0x30;  // ThreadListHead offset
+    thread_list = process_base + prof->eprocess_threads;  // ThreadListHead
     current_thread = thread_list;
 
     do {
         // Read thread ID
-        status = vmi_read_32_va(vmi, current_thread + 0x3b0, 0, &thread_id);
+        status = vmi_read_32_va(vmi, current_thread - prof->ethread_threadlistentry + prof->ethread_cid_thread, 0, &thread_id);
         if (status == VMI_SUCCESS) {
             printf("Thread ID: %d\n", thread_id);
         }
@@ -122,6 +126,14 @@ int main(int argc, char *argv[]) {
     status_t status;
     uint64_t domid = 0;
     uint64_t init_flags = VMI_INIT_DOMAINNAME;
+    char profile_error[256];
+
+    /* Structure offsets from $VMI_PROFILE, or the built-in profile */
+    if (0 != win_profile_select(NULL, profile_error, sizeof(profile_error))) {
+        printf("Failed to load structure profile: %s\n", profile_error);
+        return 1;
+    }
+    const win_profile_t *prof = win_profile_get();
 
     /* Initialize LibVMI */
     status = vmi_init(&vmi, VMI_KVM, "win10-vmi", init_flags, NULL, NULL);
@@ -153,14 +165,14 @@ int main(int argc, char *argv[]) {
 
     while (1) {
         /* Get the process name */
-        char *procname = vmi_read_str_va(vmi, current_process + 0x5a8, 0);
+        char *procname = vmi_read_str_va(vmi, current_process + prof->eprocess_name, 0);
         if (!procname) {
             goto next;
         }
 
         /* Get the process ID */
         vmi_pid_t pid = 0;
-        status = vmi_read_32_va(vmi, current_process + 0x2e0, 0, (uint32_t*)&pid);
+        status = vmi_read_32_va(vmi, current_process + prof->eprocess_pid, 0, (uint32_t*)&pid);
         if (status == VMI_FAILURE) {
             free(procname);
             goto next;
@@ -172,7 +184,7 @@ int main(int argc, char *argv[]) {
 
 next:
         /* Follow the next pointer */
-        status = vmi_read_addr_va(vmi, current_process + 0x2e8, 0, &next_process);
+        status = vmi_read_addr_va(vmi, current_process + prof->eprocess_links, 0, &next_process);
         if (status == VMI_FAILURE || next_process == list_head) {
             break;
         }
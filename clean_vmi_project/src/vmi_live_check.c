@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "guest_mem.h"
+#include "win_parallel.h"
+#include "win_profile.h"
+#include "win_synth.h"
+#include "win_walk.h"
+
+// Self-check for live (pause-free) walks (win_walk_set_live). Static
+// images with one fault each: a Blink that does not point back must be
+// re-read and then reported as unconfirmed without losing the process,
+// and loops and torn links must still end the walk. Then a writer thread
+// keeps unlinking and re-inserting every other process in a raw image
+// while the walker reads it through a shared mapping, as a running guest
+// would: every walk must end cleanly, return only real processes, and
+// never miss one the writer left alone.
+
+#define LIVE_CHECK_DIR        "/dev/shm"
+#define LIVE_CHECK_PROCESSES  4000
+#define LIVE_CHECK_WALKS      300
+
+static int bad = 0;
+
+static void write_image(const char *path, const win_synth_opts_t *opts, win_synth_info_t *info) {
+    if (win_synth_write(path, opts, info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+}
+
+// Walk one image with a fault, paused and live
+static void check_fault(const char *what, long blink_at, long loop_at, long torn_at,
+                        long module_loop_at, long thread_loop_at) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    guest_mem_t *gm;
+    char path[64];
+    int live;
+
+    win_synth_defaults(&opts);
+    opts.processes = 2000;
+    opts.raw = 1;
+    opts.blink_at = blink_at;
+    opts.loop_at = loop_at;
+    opts.torn_at = torn_at;
+    opts.module_loop_at = module_loop_at;
+    opts.thread_loop_at = thread_loop_at;
+    snprintf(path, sizeof(path), LIVE_CHECK_DIR "/vmi-live-%d.img", (int)getpid());
+    write_image(path, &opts, &info);
+    gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    gm_set_kernel_dtb(gm, info.dtb);
+
+    for (live = 0; live <= 1; live++) {
+        win_process_list_t procs = {0};
+        win_process_detail_t *details;
+        size_t i, modules = 0, threads = 0, errors = 0, unconfirmed = 0, retries = 0;
+        size_t want_unconfirmed = live && blink_at >= 0;
+        size_t want_retries = live && (blink_at >= 0 || loop_at >= 0 || torn_at >= 0) ? WIN_WALK_RETRIES : 0;
+        size_t want_detail_retries = live ? WIN_WALK_RETRIES * ((module_loop_at >= 0) + (thread_loop_at >= 0)) : 0;
+        int before = bad;
+
+        win_walk_set_live(live);
+        win_walk_processes(gm, info.first_process, info.ps_active_process_head, &procs);
+        details = calloc(procs.count ? procs.count : 1, sizeof(*details));
+        if (!details || win_walk_details_parallel(gm, &procs, 2, details, NULL) != 0) {
+            printf("❌ Out of memory\n");
+            exit(1);
+        }
+        for (i = 0; i < procs.count; i++) {
+            modules += details[i].modules.count;
+            threads += details[i].threads.count;
+            errors += (i > 0 && details[i].modules.error) + (details[i].threads.error != NULL);
+            unconfirmed += details[i].modules.unconfirmed + details[i].threads.unconfirmed;
+            retries += details[i].modules.retries + details[i].threads.retries;
+        }
+
+        if (procs.count != info.expect_processes || (procs.error != NULL) != (loop_at >= 0 || torn_at >= 0)) {
+            printf("✗ %s (%s): %zu processes, expected %zu (%s)\n", what, live ? "live" : "paused",
+                   procs.count, info.expect_processes, procs.error ? procs.error : "no error");
+            bad++;
+        }
+        if (modules != info.expect_modules || threads != info.expect_threads ||
+            errors != (size_t)(module_loop_at >= 0) + (thread_loop_at >= 0)) {
+            printf("✗ %s (%s): %zu modules, %zu threads, %zu list errors\n", what, live ? "live" : "paused",
+                   modules, threads, errors);
+            bad++;
+        }
+        if (procs.unconfirmed != want_unconfirmed || unconfirmed != 0 ||
+            (want_unconfirmed && !procs.items[blink_at].unconfirmed) ||
+            procs.retries != want_retries || retries != want_detail_retries) {
+            printf("✗ %s (%s): %zu unconfirmed processes after %zu re-reads, %zu other entries after %zu\n",
+                   what, live ? "live" : "paused", procs.unconfirmed, procs.retries, unconfirmed, retries);
+            bad++;
+        }
+        if (bad == before) {
+            printf("✓ %s (%s): %zu processes, %zu unconfirmed, %zu re-reads%s%s\n", what,
+                   live ? "live" : "paused", procs.count, procs.unconfirmed, procs.retries + retries,
+                   procs.error ? ", stopped: " : "", procs.error ? procs.error : "");
+        }
+        win_process_details_free(details, procs.count);
+        win_process_list_free(&procs);
+    }
+    win_walk_set_live(0);
+    gm_destroy(gm);
+}
+
+// The running guest: unlinks and re-inserts the odd processes, one link
+// store at a time, in the order Windows' list primitives use
+typedef struct {
+    uint8_t *ram;
+    uint64_t *links_pa;            // ActiveProcessLinks of each process
+    uint64_t *links_va;
+    size_t count;
+    volatile int stop;
+    size_t edits;
+} writer_t;
+
+static void store_link(uint8_t *ram, uint64_t pa, uint64_t va) {
+    __atomic_store_n((uint64_t*)(ram + pa), va, __ATOMIC_RELEASE);
+}
+
+static void *writer_main(void *arg) {
+    writer_t *w = arg;
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    uint8_t *linked = malloc(w->count);
+
+    if (!linked) return NULL;
+    memset(linked, 1, w->count);
+    while (!w->stop) {
+        size_t x, a, b;
+        uint64_t xva, ava, bva;
+
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        x = 1 + 2 * (size_t)(seed % ((w->count - 2) / 2));   // odd, with even neighbours
+        a = x - 1;
+        b = x + 1;
+        xva = w->links_va[x];
+        ava = w->links_va[a];
+        bva = w->links_va[b];
+
+        if (linked[x]) {
+            // RemoveEntryList
+            store_link(w->ram, w->links_pa[a], bva);
+            store_link(w->ram, w->links_pa[b] + 8, ava);
+        } else {
+            // InsertHeadList after a
+            store_link(w->ram, w->links_pa[x], bva);
+            store_link(w->ram, w->links_pa[x] + 8, ava);
+            store_link(w->ram, w->links_pa[b] + 8, xva);
+            store_link(w->ram, w->links_pa[a], xva);
+        }
+        linked[x] ^= 1;
+        w->edits++;
+    }
+    free(linked);
+    return NULL;
+}
+
+static void check_concurrent(void) {
+    uint64_t links = win_profile_get()->eprocess_links;
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_process_list_t first = {0};
+    writer_t w;
+    pthread_t thread;
+    guest_mem_t *gm;
+    struct stat st;
+    char path[64];
+    size_t i, n, walks, min = (size_t)-1, max = 0, retries = 0, unconfirmed = 0;
+    uint64_t start, ns;
+    int fd, before = bad;
+
+    win_synth_defaults(&opts);
+    opts.processes = LIVE_CHECK_PROCESSES;
+    opts.modules = 0;
+    opts.threads = 0;
+    opts.raw = 1;
+    snprintf(path, sizeof(path), LIVE_CHECK_DIR "/vmi-live-%d.img", (int)getpid());
+    write_image(path, &opts, &info);
+
+    // The walker reads a shared mapping, the writer stores into another
+    fd = open(path, O_RDWR);
+    gm = gm_open_mmap(path, 0, 0);
+    unlink(path);
+    if (fd < 0 || !gm || fstat(fd, &st) != 0) {
+        printf("❌ Could not map the image\n");
+        exit(1);
+    }
+    memset(&w, 0, sizeof(w));
+    w.ram = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    gm_set_kernel_dtb(gm, info.dtb);
+
+    // Where each process's links are
+    win_walk_processes(gm, info.first_process, info.ps_active_process_head, &first);
+    w.count = first.count;
+    w.links_pa = calloc(w.count ? w.count : 1, sizeof(uint64_t));
+    w.links_va = calloc(w.count ? w.count : 1, sizeof(uint64_t));
+    if (w.ram == MAP_FAILED || !w.links_pa || !w.links_va || w.count != LIVE_CHECK_PROCESSES) {
+        printf("❌ Could not set up the writer\n");
+        exit(1);
+    }
+    for (i = 0; i < w.count; i++) {
+        w.links_va[i] = first.items[i].addr + links;
+        if (gm_translate(gm, GM_KERNEL_DTB, first.items[i].addr + links, &w.links_pa[i]) != 0) {
+            printf("❌ EPROCESS %zu not mapped\n", i);
+            exit(1);
+        }
+    }
+
+    win_walk_set_live(1);
+    if (pthread_create(&thread, NULL, writer_main, &w) != 0) {
+        printf("❌ Could not start the writer\n");
+        exit(1);
+    }
+    start = gm_now_ns();
+    for (walks = 0; walks < LIVE_CHECK_WALKS && bad == before; walks++) {
+        win_process_list_t procs = {0};
+        size_t even = 0;
+
+        n = (size_t)win_walk_processes(gm, info.first_process, info.ps_active_process_head, &procs);
+        if (procs.error || n != procs.count) {
+            printf("✗ Walk %zu stopped: %s\n", walks, procs.error ? procs.error : "failed");
+            bad++;
+        }
+        for (i = 0; i < procs.count; i++) {
+            size_t idx = (size_t)(procs.items[i].pid == 4 ? 0 : procs.items[i].pid / 4 - 1);
+
+            if (idx >= w.count || procs.items[i].addr != first.items[idx].addr) {
+                printf("✗ Walk %zu returned 0x%lx (PID %d), not a process\n", walks,
+                       procs.items[i].addr, procs.items[i].pid);
+                bad++;
+                break;
+            }
+            even += idx % 2 == 0;
+        }
+        if (even != (w.count + 1) / 2) {
+            printf("✗ Walk %zu found %zu of the %zu processes left alone\n", walks, even, (w.count + 1) / 2);
+            bad++;
+        }
+        if (procs.count < min) min = procs.count;
+        if (procs.count > max) max = procs.count;
+        retries += procs.retries;
+        unconfirmed += procs.unconfirmed;
+        win_process_list_free(&procs);
+    }
+    ns = gm_now_ns() - start;
+    w.stop = 1;
+    pthread_join(thread, NULL);
+    win_walk_set_live(0);
+
+    if (bad == before) {
+        printf("✓ %zu live walks during %zu list edits: %zu-%zu processes, %zu re-reads, %zu unconfirmed, %.3f ms per walk\n",
+               walks, w.edits, min, max, retries, unconfirmed, walks ? ns / 1e6 / walks : 0.0);
+    }
+    munmap(w.ram, (size_t)st.st_size);
+    free(w.links_pa);
+    free(w.links_va);
+    win_process_list_free(&first);
+    gm_destroy(gm);
+}
+
+int main(void) {
+    char error[256];
+
+    printf("=== Live Walk Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    check_fault("clean", -1, -1, -1, -1, -1);
+    check_fault("bad Blink", 1500, -1, -1, -1, -1);
+    check_fault("process loop", -1, 1200, -1, -1, -1);
+    check_fault("torn link", -1, -1, 700, -1, -1);
+    check_fault("module loop", -1, -1, -1, 30, -1);
+    check_fault("thread loop", -1, -1, -1, -1, 40);
+    check_concurrent();
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every live walk was consistent\n");
+    return 0;
+}
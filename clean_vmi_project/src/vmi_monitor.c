@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <libvmi/libvmi.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+#include "win_monitor.h"
+#include "counters.h"
+
+// Process monitor daemon. Keeps one introspection session open and polls
+// the active process list every --interval milliseconds, printing process
+// creations and exits on stdout as JSON lines. The list is diffed against
+// the previous poll (win_monitor.h), so a quiet guest costs one small read
+// per process each tick and no EPROCESS decoding.
+//
+// The guest keeps running between and, unless --pause is given, during
+// ticks. A tick that catches the list mid-update is dropped and retried
+// on the next one.
+
+#define MONITOR_DEFAULT_INTERVAL_MS 2000
+
+static vmi_instance_t vmi;
+static int vmi_attached = 0;
+static guest_mem_t *gm;
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static const char *event_names[] = { "present", "create", "exit" };
+
+// JSON string with quotes, backslashes and control bytes escaped
+static void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void print_event(const win_event_t *ev, void *ctx) {
+    uint64_t *tick = ctx;
+
+    printf("{\"event\":\"%s\",\"tick\":%llu,\"pid\":%d,\"name\":",
+           event_names[ev->type], (unsigned long long)*tick, ev->pid);
+    print_json_string(stdout, ev->name);
+    printf(",\"eprocess\":\"0x%llx\",\"create_time\":%llu}\n",
+           (unsigned long long)ev->addr, (unsigned long long)ev->create_time);
+}
+
+static void sleep_ms(unsigned ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    // Returns early when a signal arrives
+    nanosleep(&ts, NULL);
+}
+
+// PsActiveProcessHead from LibVMI, --ps-head, or --kernel-base plus the
+// profile RVA
+static uint64_t resolve_list_head(uint64_t ps_head, uint64_t kernel_base) {
+    const win_profile_t *prof = win_profile_get();
+    addr_t va = 0;
+
+    if (ps_head) return ps_head;
+    if (vmi_attached && VMI_SUCCESS == vmi_translate_ksym2v(vmi, "PsActiveProcessHead", &va)) {
+        return va;
+    }
+    if (kernel_base && prof->rva_ps_active_process_head) {
+        return kernel_base + prof->rva_ps_active_process_head;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] [vm-name]\n", prog);
+    fprintf(stderr, "  --interval MS      poll period (default %d)\n", MONITOR_DEFAULT_INTERVAL_MS);
+    fprintf(stderr, "  --ticks N          stop after N polls (default: until SIGINT/SIGTERM)\n");
+    fprintf(stderr, "  --pause            pause the guest while the list is read\n");
+    fprintf(stderr, "  --verbose          per-tick read statistics on stderr\n");
+    fprintf(stderr, "  --profile FILE     ISF structure profile\n");
+    fprintf(stderr, "  --ram-file FILES   map QEMU RAM file(s) instead of using LibVMI\n");
+    fprintf(stderr, "  --image FILE       watch a memory image instead of a VM\n");
+    fprintf(stderr, "  --dtb CR3          kernel DTB (RAM files, raw images)\n");
+    fprintf(stderr, "  --kernel-base VA   kernel base, for profile symbol RVAs\n");
+    fprintf(stderr, "  --ps-head VA       PsActiveProcessHead\n");
+    fprintf(stderr, "  --counters FMT     dump access counters (json or prometheus)\n");
+    fprintf(stderr, "  --counters-out F   counters destination (default stderr)\n");
+}
+
+int main(int argc, char **argv) {
+    vmi_init_error_t error;
+    const char *vm_name = "win10-vmi";
+    const char *profile_path = NULL, *ram_files = NULL, *image_path = NULL;
+    const char *counters_path = NULL;
+    char profile_error[256];
+    ctr_format_t counters_format = CTR_FORMAT_JSON;
+    int counters_wanted = 0, pause = 0, verbose = 0;
+    unsigned interval = MONITOR_DEFAULT_INTERVAL_MS;
+    uint64_t dtb = 0, kernel_base = 0, ps_head = 0, list_head, tick, ticks = 0;
+    win_monitor_t *monitor;
+    struct sigaction sa;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        int next = i + 1 < argc;
+
+        if (strcmp(argv[i], "--interval") == 0 && next) {
+            interval = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--ticks") == 0 && next) {
+            ticks = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--pause") == 0) {
+            pause = 1;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--profile") == 0 && next) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--ram-file") == 0 && next) {
+            ram_files = argv[++i];
+        } else if (strcmp(argv[i], "--image") == 0 && next) {
+            image_path = argv[++i];
+        } else if (strcmp(argv[i], "--dtb") == 0 && next) {
+            dtb = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--kernel-base") == 0 && next) {
+            kernel_base = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--ps-head") == 0 && next) {
+            ps_head = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--counters") == 0 && next) {
+            if (0 != counters_parse_format(argv[++i], &counters_format)) {
+                fprintf(stderr, "Unknown counters format %s (json or prometheus)\n", argv[i]);
+                return 1;
+            }
+            counters_wanted = 1;
+        } else if (strcmp(argv[i], "--counters-out") == 0 && next) {
+            counters_path = argv[++i];
+            counters_wanted = 1;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        } else {
+            vm_name = argv[i];
+        }
+    }
+
+    // Events go to stdout, everything else to stderr
+    if (0 != win_profile_select(profile_path, profile_error, sizeof(profile_error))) {
+        fprintf(stderr, "Failed to load structure profile: %s\n", profile_error);
+        return 1;
+    }
+    if (counters_wanted && 0 != counters_install(counters_format, counters_path)) {
+        fprintf(stderr, "Failed to start the counters dump thread\n");
+        return 1;
+    }
+
+    if (ram_files || image_path) {
+        gm = ram_files ? gm_open_mmap(ram_files, 0, GM_DEFAULT_CACHE_PAGES)
+                       : gm_open_image(image_path, GM_DEFAULT_CACHE_PAGES);
+        if (!gm) {
+            fprintf(stderr, "Failed to open %s\n", ram_files ? ram_files : image_path);
+            return 1;
+        }
+        if (dtb) gm_set_kernel_dtb(gm, dtb);
+        if (!gm_kernel_dtb(gm)) {
+            fprintf(stderr, "Kernel DTB unknown (pass --dtb CR3)\n");
+            gm_destroy(gm);
+            return 1;
+        }
+        pause = 0;
+    } else {
+        if (VMI_FAILURE == vmi_init(&vmi, VMI_KVM, (char*)vm_name, VMI_INIT_DOMAINNAME, NULL, &error)) {
+            fprintf(stderr, "Failed to initialize LibVMI for %s (Error: %d)\n", vm_name, error);
+            return 1;
+        }
+        vmi_attached = 1;
+        gm = gm_open_libvmi(vmi, GM_DEFAULT_CACHE_PAGES);
+        if (!gm) {
+            fprintf(stderr, "Failed to allocate guest memory cache\n");
+            vmi_destroy(vmi);
+            return 1;
+        }
+    }
+
+    list_head = resolve_list_head(ps_head, kernel_base);
+    monitor = list_head ? win_monitor_create(list_head) : NULL;
+    if (!monitor) {
+        fprintf(stderr, list_head ? "Out of memory\n"
+                                  : "PsActiveProcessHead unknown (pass --ps-head or --kernel-base)\n");
+        gm_destroy(gm);
+        if (vmi_attached) vmi_destroy(vmi);
+        return 1;
+    }
+    fprintf(stderr, "Monitoring %s, profile %s, every %u ms\n",
+            image_path ? image_path : ram_files ? ram_files : vm_name,
+            win_profile_get()->name, interval);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (tick = 0; !stop && (!ticks || tick < ticks); tick++) {
+        win_tick_stats_t stats;
+        uint64_t start, paused_at = 0;
+        int ret;
+
+        if (tick) sleep_ms(interval);
+        if (stop) break;
+
+        start = gm_now_ns();
+        if (pause && VMI_SUCCESS == vmi_pause_vm(vmi)) paused_at = gm_now_ns();
+        ret = win_monitor_tick(monitor, gm, print_event, &tick, &stats);
+        if (paused_at) {
+            vmi_resume_vm(vmi);
+            counters_add_pause(gm_now_ns() - paused_at);
+        }
+        fflush(stdout);
+
+        if (ret != 0) {
+            fprintf(stderr, "tick %llu: %s, retrying\n", (unsigned long long)tick, stats.error);
+        } else if (verbose) {
+            fprintf(stderr, "tick %llu: %zu processes, %zu links, %zu objects, %zu events, %.3f ms\n",
+                    (unsigned long long)tick, stats.processes, stats.links_checked,
+                    stats.objects_read, stats.events, (gm_now_ns() - start) / 1e6);
+        }
+    }
+
+    win_monitor_destroy(monitor);
+    gm_destroy(gm);
+    if (vmi_attached) vmi_destroy(vmi);
+    return 0;
+}
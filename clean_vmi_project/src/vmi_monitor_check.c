@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "guest_mem.h"
+#include "win_monitor.h"
+#include "win_synth.h"
+
+// Self-check for the incremental process-list monitor (win_monitor.h). A
+// synthetic raw image is mapped through the RAM-file backend, which sees
+// later writes to the file, and edited between ticks the way a running
+// guest would: a process leaves the list, a new one is linked in, an
+// allocation is reused, a link is caught half-written. Each tick must
+// report exactly those changes, and an idle tick must read nothing but
+// the links.
+
+#define MONITOR_CHECK_PROCESSES 1000
+#define MONITOR_CHECK_DIR       "/dev/shm"
+
+typedef struct {
+    size_t counts[3];           // per win_event_type_t
+    int32_t last_pid;
+} seen_t;
+
+static guest_mem_t *gm;
+static uint8_t *ram;            // writable view of the image
+static size_t ram_size;
+static int bad = 0;
+
+static void count_event(const win_event_t *ev, void *ctx) {
+    seen_t *seen = ctx;
+    seen->counts[ev->type]++;
+    seen->last_pid = ev->pid;
+}
+
+// Guest virtual address to a pointer into the image (raw: offset = PA)
+static void *guest_ptr(uint64_t va, size_t len) {
+    uint64_t pa;
+    if (gm_translate(gm, GM_KERNEL_DTB, va, &pa) != 0 || pa + len > ram_size) {
+        printf("❌ 0x%llx is not mapped in the image\n", (unsigned long long)va);
+        exit(1);
+    }
+    return ram + pa;
+}
+
+static uint64_t get_u64(uint64_t va) {
+    uint64_t v;
+    memcpy(&v, guest_ptr(va, 8), 8);
+    return v;
+}
+
+static void set_u64(uint64_t va, uint64_t v) {
+    memcpy(guest_ptr(va, 8), &v, 8);
+}
+
+// Run one tick and compare what it reported
+static void expect_tick(win_monitor_t *m, const char *what, int ok,
+                        size_t present, size_t created, size_t exited, size_t objects,
+                        seen_t *seen) {
+    win_tick_stats_t stats;
+    uint64_t reads = gm_get_stats(gm)->va_reads;
+    int ret;
+
+    memset(seen, 0, sizeof(*seen));
+    ret = win_monitor_tick(m, gm, count_event, seen, &stats);
+    reads = gm_get_stats(gm)->va_reads - reads;
+
+    if ((ret == 0) != ok || seen->counts[WIN_EVENT_PRESENT] != present ||
+        seen->counts[WIN_EVENT_CREATE] != created || seen->counts[WIN_EVENT_EXIT] != exited ||
+        stats.objects_read != objects) {
+        printf("✗ %s: ret %d (%s), %zu present, %zu created, %zu exited, %zu objects read;"
+               " expected %zu/%zu/%zu/%zu\n", what, ret, stats.error ? stats.error : "no error",
+               seen->counts[WIN_EVENT_PRESENT], seen->counts[WIN_EVENT_CREATE],
+               seen->counts[WIN_EVENT_EXIT], stats.objects_read, present, created, exited, objects);
+        bad++;
+        return;
+    }
+    printf("✓ %s: %zu processes, %zu links, %zu objects, %zu events, %llu reads%s%s\n",
+           what, stats.processes, stats.links_checked, stats.objects_read, stats.events,
+           (unsigned long long)reads, stats.error ? ", dropped: " : "", stats.error ? stats.error : "");
+}
+
+int main(void) {
+    const win_profile_t *prof;
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_monitor_t *m;
+    seen_t seen;
+    char path[64], error[256];
+    uint64_t links[3], head, tail, flink, blink, victim, saved;
+    uint32_t pid = 99999;
+    int fd, i;
+
+    printf("=== Process Monitor Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    prof = win_profile_get();
+    if (!prof->eprocess_create_time) {
+        printf("❌ Structure profile %s has no CreateTime\n", prof->name);
+        return 1;
+    }
+
+    win_synth_defaults(&opts);
+    opts.processes = MONITOR_CHECK_PROCESSES;
+    opts.modules = 0;
+    opts.threads = 0;
+    opts.raw = 1;
+    snprintf(path, sizeof(path), MONITOR_CHECK_DIR "/vmi-monitor-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        return 1;
+    }
+    gm = gm_open_mmap(path, 0, 0);
+    fd = open(path, O_RDWR);
+    unlink(path);               // the mappings keep the data alive
+    ram_size = (size_t)info.image_size;
+    ram = fd < 0 ? MAP_FAILED : mmap(NULL, ram_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0) close(fd);
+    if (!gm || ram == MAP_FAILED) {
+        printf("❌ Could not map the image\n");
+        return 1;
+    }
+    gm_set_kernel_dtb(gm, info.dtb);
+    head = info.ps_active_process_head;
+    m = win_monitor_create(head);
+
+    expect_tick(m, "first tick", 1, MONITOR_CHECK_PROCESSES, 0, 0, MONITOR_CHECK_PROCESSES, &seen);
+    expect_tick(m, "idle tick", 1, 0, 0, 0, 0, &seen);
+
+    // Process 50 exits: unlink it
+    links[0] = head;
+    for (i = 0; i <= 50; i++) links[0] = get_u64(links[0]);
+    victim = links[0] - prof->eprocess_links;
+    flink = get_u64(links[0]);
+    blink = get_u64(links[0] + 8);
+    set_u64(blink, flink);
+    set_u64(flink + 8, blink);
+    expect_tick(m, "process exit", 1, 0, 0, 1, 0, &seen);
+
+    // Its memory is reused by a new process linked at the tail
+    memcpy(guest_ptr(victim + prof->eprocess_pid, 4), &pid, 4);
+    set_u64(victim + prof->eprocess_create_time, get_u64(victim + prof->eprocess_create_time) + 1);
+    tail = get_u64(head + 8);
+    set_u64(links[0], head);
+    set_u64(links[0] + 8, tail);
+    set_u64(tail, links[0]);
+    set_u64(head + 8, links[0]);
+    expect_tick(m, "process create", 1, 0, 1, 0, 1, &seen);
+    if (seen.last_pid != (int32_t)pid) {
+        printf("✗ process create: pid %d, expected %u\n", seen.last_pid, pid);
+        bad++;
+    }
+
+    // Same address, new CreateTime: an exit and a create
+    links[1] = get_u64(get_u64(head));
+    set_u64(links[1] - prof->eprocess_links + prof->eprocess_create_time, 1);
+    expect_tick(m, "address reuse", 1, 0, 1, 1, 1, &seen);
+
+    // A half-written link drops the tick and keeps the state
+    links[2] = get_u64(links[1]);
+    saved = get_u64(links[2]);
+    set_u64(links[2], 0);
+    expect_tick(m, "torn link", 0, 0, 0, 0, 0, &seen);
+    set_u64(links[2], links[2]);
+    expect_tick(m, "self loop", 0, 0, 0, 0, 0, &seen);
+    set_u64(links[2], saved);
+    if (win_monitor_count(m) != MONITOR_CHECK_PROCESSES) {
+        printf("✗ %zu processes tracked after dropped ticks, expected %d\n",
+               win_monitor_count(m), MONITOR_CHECK_PROCESSES);
+        bad++;
+    }
+    expect_tick(m, "repaired", 1, 0, 0, 0, 0, &seen);
+
+    win_monitor_destroy(m);
+    munmap(ram, ram_size);
+    gm_destroy(gm);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ All ticks matched\n");
+    return 0;
+}
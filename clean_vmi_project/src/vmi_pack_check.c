@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "guest_mem.h"
+#include "lz4_block.h"
+#include "win_parallel.h"
+#include "win_profile.h"
+#include "win_synth.h"
+#include "win_walk.h"
+
+// Self-check for packed captures. The LZ4 block codec must round-trip
+// every kind of input and reject or safely decode corrupted blocks. A
+// packed capture of a synthetic image must hold every page byte for byte
+// with its hash, walk like the image, and diff against a packed capture
+// of an edited copy through the page hashes alone. Then a larger image
+// with zero, repeated, structured and random pages times capture, random
+// page reads and a full sweep.
+
+#define PACK_CHECK_DIR        "/dev/shm"
+#define PACK_CHECK_PROCESSES  2000
+#define PACK_CHECK_ADDED      32
+#define PACK_CHECK_READS      20000
+#define PACK_CHECK_MIB        256
+
+static int bad = 0;
+static char path_a[64], path_b[64], pack_a[64], pack_b[64];
+
+static void cleanup(void) {
+    unlink(path_a);
+    unlink(path_b);
+    unlink(pack_a);
+    unlink(pack_b);
+}
+
+static void fail(const char *what) {
+    printf("❌ %s\n", what);
+    cleanup();
+    exit(1);
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Inputs of one kind: 0 zero, 1 random, 2 a short repeating pattern,
+// 3 structure-like records, 4 random head and zero tail
+static void fill(uint8_t *buf, size_t len, int kind, size_t period) {
+    size_t i;
+
+    memset(buf, 0, len);
+    for (i = 0; i < len; i++) {
+        switch (kind) {
+        case 1: buf[i] = (uint8_t)rng(); break;
+        case 2: buf[i] = (uint8_t)(i % period * 37 + 1); break;
+        case 3: buf[i] = i % 32 < 8 ? (uint8_t)(i / 32) : i % 32 < 12 ? 0xff : (uint8_t)(i % 7); break;
+        case 4: buf[i] = i < len / 4 ? (uint8_t)rng() : 0; break;
+        }
+    }
+}
+
+#define GUARD 64
+
+static void check_codec(void) {
+    static const size_t sizes[] = { 0, 1, 5, 12, 13, 17, 64, 1000, 4096, 65535, LZ4_BLOCK_MAX };
+    uint8_t *src = malloc(LZ4_BLOCK_MAX), *comp = malloc(LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX));
+    uint8_t *out = malloc(LZ4_BLOCK_MAX + GUARD);
+    size_t si, n, clen, trips = 0, rejected = 0, decoded = 0;
+    int kind, before = bad, i;
+
+    if (!src || !comp || !out) fail("Out of memory");
+    for (si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++) {
+        for (kind = 0; kind <= 4; kind++) {
+            size_t period = kind == 2 ? 1 + si % 20 : 0;
+
+            n = sizes[si];
+            fill(src, n, kind, period);
+            clen = lz4_compress(src, n, comp, LZ4_BLOCK_BOUND(n));
+            if (clen == 0 || lz4_decompress(comp, clen, out, n) != 0 || memcmp(src, out, n) != 0) {
+                printf("✗ LZ4 round trip of %zu bytes (kind %d) failed\n", n, kind);
+                bad++;
+            }
+            trips++;
+            // Random data does not shrink, so a cap below its size refuses it
+            if (kind == 1 && n >= 64 && lz4_compress(src, n, comp, n - 1) != 0) {
+                printf("✗ LZ4 kept a block of %zu random bytes that did not shrink\n", n);
+                bad++;
+            }
+        }
+    }
+    fill(src, LZ4_BLOCK_MAX, 0, 0);
+    clen = lz4_compress(src, LZ4_BLOCK_MAX, comp, LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX));
+    if (clen == 0 || clen > 300) {
+        printf("✗ 64 KiB of zeros compressed to %zu bytes\n", clen);
+        bad++;
+    }
+
+    // Corrupted blocks: truncated, then with random bytes changed. A
+    // decode may fail or succeed, but must stay inside its buffer.
+    fill(src, LZ4_BLOCK_MAX, 3, 0);
+    memset(src + 20000, 0, 10000);
+    fill(src + 40000, 4000, 1, 0);
+    clen = lz4_compress(src, LZ4_BLOCK_MAX, comp, LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX));
+    for (n = 0; n < clen; n += 1 + n / 64) {
+        memset(out + LZ4_BLOCK_MAX, 0xa5, GUARD);
+        if (lz4_decompress(comp, n, out, LZ4_BLOCK_MAX) == 0) {
+            printf("✗ LZ4 decoded a block truncated to %zu of %zu bytes\n", n, clen);
+            bad++;
+        }
+        rejected++;
+    }
+    if (lz4_decompress(comp, clen, out, LZ4_BLOCK_MAX - 1) == 0) {
+        printf("✗ LZ4 decoded a block into a buffer too small for it\n");
+        bad++;
+    }
+    for (i = 0; i < 5000; i++) {
+        uint8_t *bent = malloc(clen);
+        int k, r;
+
+        if (!bent) fail("Out of memory");
+        memcpy(bent, comp, clen);
+        for (k = 0; k < 1 + i % 4; k++) bent[rng() % clen] = (uint8_t)rng();
+        memset(out + LZ4_BLOCK_MAX, 0xa5, GUARD);
+        r = lz4_decompress(bent, clen, out, LZ4_BLOCK_MAX);
+        for (k = 0; k < GUARD; k++) {
+            if (out[LZ4_BLOCK_MAX + k] != 0xa5) {
+                printf("✗ LZ4 wrote past its buffer decoding a corrupted block\n");
+                bad++;
+                break;
+            }
+        }
+        if (r == 0) decoded++;
+        else rejected++;
+        free(bent);
+    }
+    if (bad == before) {
+        printf("✓ LZ4 blocks: %zu round trips, %zu corrupted blocks rejected, %zu decoded in bounds\n",
+               trips, rejected, decoded);
+    }
+    free(src);
+    free(comp);
+    free(out);
+}
+
+static guest_mem_t *open_image(const char *path) {
+    guest_mem_t *gm = gm_open_image(path, 0);
+
+    if (!gm) fail("Could not open an image");
+    return gm;
+}
+
+static void pack(guest_mem_t *gm, const char *path, const uint64_t *pfns, size_t n, uint64_t dtb,
+                 gm_dump_stats_t *stats) {
+    if (gm_dump_packed(gm, path, pfns, n, dtb, win_default_workers(), stats) != 0) fail("Packed capture failed");
+}
+
+static void print_capture(const char *label, const gm_dump_stats_t *st) {
+    printf("  %s: %lu pages (%lu zero, %lu repeated) in %.1f MiB, %.1f%% of raw, %.3f ms\n", label,
+           (unsigned long)st->pages, (unsigned long)st->zero, (unsigned long)st->duplicate,
+           st->bytes / (1024.0 * 1024.0), st->pages ? 100.0 * st->bytes / (st->pages * GM_PAGE_SIZE) : 0.0,
+           st->ns / 1e6);
+}
+
+// Every page of the image, read back from the capture, with its hash
+static void check_pages(const char *label, guest_mem_t *image, guest_mem_t *packed) {
+    uint8_t *buf_a = malloc(GM_MAX_BATCH * GM_PAGE_SIZE), *buf_b = malloc(GM_MAX_BATCH * GM_PAGE_SIZE);
+    const uint8_t *pa[GM_MAX_BATCH], *pb[GM_MAX_BATCH];
+    uint64_t end = gm_phys_end(image) >> GM_PAGE_SHIFT, pfn, hash;
+    size_t i, k, pages = 0;
+    int before = bad;
+
+    if (!buf_a || !buf_b) fail("Out of memory");
+    if (gm_phys_end(packed) != gm_phys_end(image)) {
+        printf("✗ %s: ends at 0x%lx, the image at 0x%lx\n", label, gm_phys_end(packed), gm_phys_end(image));
+        bad++;
+    }
+    for (pfn = 0; pfn < end && bad == before; pfn += k) {
+        k = end - pfn < GM_MAX_BATCH ? (size_t)(end - pfn) : GM_MAX_BATCH;
+        gm_fetch_pages(image, pfn, k, buf_a, pa);
+        gm_fetch_pages(packed, pfn, k, buf_b, pb);
+        for (i = 0; i < k; i++) {
+            if (!pb[i] || memcmp(pa[i], pb[i], GM_PAGE_SIZE) != 0) {
+                printf("✗ %s: page 0x%lx differs from the image\n", label, pfn + i);
+                bad++;
+                break;
+            }
+            if (gm_page_hash(packed, pfn + i, &hash) != 0 || hash != gm_hash_page(pa[i])) {
+                printf("✗ %s: page 0x%lx has the wrong hash\n", label, pfn + i);
+                bad++;
+                break;
+            }
+            pages++;
+        }
+    }
+    if (bad == before) printf("✓ %s: %zu pages match the image with their hashes\n", label, pages);
+    free(buf_a);
+    free(buf_b);
+}
+
+static void check_walk(const char *label, guest_mem_t *gm, const win_synth_info_t *info) {
+    win_process_list_t procs = { 0 };
+    win_process_detail_t *details;
+    win_module_list_t drivers = { 0 };
+    size_t i, modules = 0, threads = 0;
+
+    if (gm_kernel_dtb(gm) != info->dtb) {
+        printf("✗ %s: kernel DTB 0x%lx, expected 0x%lx\n", label, gm_kernel_dtb(gm), info->dtb);
+        bad++;
+        return;
+    }
+    win_walk_processes(gm, info->first_process, info->ps_active_process_head, &procs);
+    details = calloc(procs.count ? procs.count : 1, sizeof(*details));
+    if (!details || win_walk_details_parallel(gm, &procs, 2, details, NULL) != 0) fail("Out of memory");
+    win_walk_drivers(gm, info->ps_loaded_module_list, &drivers);
+    for (i = 0; i < procs.count; i++) {
+        modules += details[i].modules.count;
+        threads += details[i].threads.count;
+    }
+    if (procs.count != info->expect_processes || modules != info->expect_modules ||
+        threads != info->expect_threads || drivers.count != info->expect_drivers) {
+        printf("✗ %s: walked %zu processes, %zu modules, %zu threads, %zu drivers\n", label,
+               procs.count, modules, threads, drivers.count);
+        bad++;
+    } else {
+        printf("✓ %s walks like the image: %zu processes, %zu modules, %zu threads, %zu drivers\n",
+               label, procs.count, modules, threads, drivers.count);
+    }
+    win_process_details_free(details, procs.count);
+    win_process_list_free(&procs);
+    win_module_list_free(&drivers);
+}
+
+// B: A with one byte changed on each of the pages listed and a few pages
+// appended
+static void write_copy(uint64_t size, const uint64_t *pfns, size_t n) {
+    int in = open(path_a, O_RDONLY), out = open(path_b, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    uint64_t total = size + PACK_CHECK_ADDED * GM_PAGE_SIZE;
+    uint8_t *src, *dst;
+    size_t i;
+
+    if (in < 0 || out < 0 || ftruncate(out, (off_t)total) != 0) fail("Could not create the copy");
+    src = mmap(NULL, size, PROT_READ, MAP_PRIVATE, in, 0);
+    dst = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0);
+    close(in);
+    close(out);
+    if (src == MAP_FAILED || dst == MAP_FAILED) fail("Could not map the copy");
+    memcpy(dst, src, size);
+    for (i = 0; i < n; i++) dst[(pfns[i] << GM_PAGE_SHIFT) + 0x100 + i] ^= 0x5a;
+    for (i = 0; i < PACK_CHECK_ADDED; i++) dst[size + i * GM_PAGE_SIZE] = (uint8_t)(i + 1);
+    munmap(src, size);
+    munmap(dst, total);
+}
+
+// Grow A by a zero page and a copy of the page holding the System
+// EPROCESS, so the edits hit a zero page, a repeated page and the page it
+// repeats: each is stored differently
+static uint64_t add_edit_pages(const win_synth_info_t *info, uint64_t *pfns) {
+    guest_mem_t *gm = open_image(path_a);
+    uint64_t size = info->image_size + 2 * GM_PAGE_SIZE, pa;
+    uint8_t *ram;
+    int fd;
+
+    gm_set_kernel_dtb(gm, info->dtb);
+    if (gm_translate(gm, GM_KERNEL_DTB, info->first_process, &pa) != 0) fail("System not mapped");
+    gm_destroy(gm);
+    pfns[0] = info->image_size >> GM_PAGE_SHIFT;
+    pfns[1] = pfns[0] + 1;
+    pfns[2] = pa >> GM_PAGE_SHIFT;
+
+    fd = open(path_a, O_RDWR);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) fail("Could not grow the image");
+    ram = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ram == MAP_FAILED) fail("Could not map the image");
+    memcpy(ram + (pfns[1] << GM_PAGE_SHIFT), ram + (pfns[2] << GM_PAGE_SHIFT), GM_PAGE_SIZE);
+    munmap(ram, size);
+    return size;
+}
+
+static void check_captures(void) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    guest_mem_t *a, *b, *pa, *pb, *view;
+    gm_snapshot_t *snap;
+    gm_dump_stats_t st, elf;
+    gm_diff_t d;
+    uint64_t edits[3], *pfns, size;
+    win_process_list_t procs = { 0 };
+    win_process_detail_t *details;
+    size_t n, i;
+    int before;
+
+    win_synth_defaults(&opts);
+    opts.processes = PACK_CHECK_PROCESSES;
+    opts.raw = 1;
+    if (win_synth_write(path_a, &opts, &info) != 0) fail("Could not write the image");
+    size = add_edit_pages(&info, edits);
+    a = open_image(path_a);
+    gm_set_kernel_dtb(a, info.dtb);
+    printf("Image: %.1f MiB, %zu processes, edits on pages 0x%lx (zero) 0x%lx (repeat of System) 0x%lx\n",
+           size / (1024.0 * 1024.0), info.expect_processes, edits[0], edits[1], edits[2]);
+
+    // Full capture
+    if (gm_dump(a, pack_a, NULL, 0, info.dtb, &elf) != 0) fail("ELF capture failed");
+    printf("  ELF capture: %.1f MiB\n", elf.bytes / (1024.0 * 1024.0));
+    pack(a, pack_a, NULL, 0, 0, &st);
+    print_capture("packed capture", &st);
+    pa = open_image(pack_a);
+    if (st.pages != size / GM_PAGE_SIZE || st.bytes >= elf.bytes / 4 || !st.zero || !st.duplicate) {
+        printf("✗ packed capture: %lu pages, %lu zero, %lu bytes\n", (unsigned long)st.pages,
+               (unsigned long)st.zero, (unsigned long)st.bytes);
+        bad++;
+    }
+    check_pages("packed capture", a, pa);
+    check_walk("packed capture", pa, &info);
+
+    // Edited copy, captured the same way, diffed by hash alone
+    write_copy(size, edits, 3);
+    b = open_image(path_b);
+    pack(b, pack_b, NULL, 0, info.dtb, &st);
+    pb = open_image(pack_b);
+    check_pages("packed capture of the copy", b, pb);
+    before = bad;
+    if (gm_diff(pa, pb, win_default_workers(), &d) != 0) fail("Diff failed");
+    if (d.changed != 3 || d.added != PACK_CHECK_ADDED || d.removed != 0 || d.compared != 3 ||
+        d.hashed != size / GM_PAGE_SIZE - 3) {
+        printf("✗ packed diff: %lu changed, %lu added, %lu removed, %lu by hash, %lu compared\n",
+               (unsigned long)d.changed, (unsigned long)d.added, (unsigned long)d.removed,
+               (unsigned long)d.hashed, (unsigned long)d.compared);
+        bad++;
+    }
+    for (i = 0; i < d.count; i++) {
+        const gm_diff_page_t *p = &d.items[i];
+
+        if (p->kind != GM_DIFF_CHANGED) continue;
+        for (n = 0; n < 3 && edits[n] != p->pfn; n++);
+        if (n == 3 || p->first != 0x100 + n || p->last != 0x100 + n) {
+            printf("✗ packed diff: page 0x%lx bytes 0x%x-0x%x\n", p->pfn, p->first, p->last);
+            bad++;
+        }
+    }
+    if (bad == before) {
+        printf("✓ packed captures diffed: %lu changed, %lu added, %lu pages settled by hash in %.3f ms\n",
+               (unsigned long)d.changed, (unsigned long)d.added, (unsigned long)d.hashed, d.ns / 1e6);
+    }
+    gm_diff_free(&d);
+    gm_destroy(pb);
+    gm_destroy(b);
+
+    // Reachable capture: what a walk reads, sparse
+    snap = gm_snapshot_create();
+    if (!snap) fail("Out of memory");
+    gm_snapshot_begin(a, snap);
+    win_walk_processes(a, info.first_process, info.ps_active_process_head, &procs);
+    details = calloc(procs.count ? procs.count : 1, sizeof(*details));
+    if (!details || win_walk_details_parallel(a, &procs, 2, details, NULL) != 0) fail("Out of memory");
+    win_walk_drivers(a, info.ps_loaded_module_list, NULL);
+    gm_snapshot_end(a);
+    win_process_details_free(details, procs.count);
+    win_process_list_free(&procs);
+    gm_snapshot_add_tables(snap, a, info.dtb);
+    pfns = gm_snapshot_pfns(snap, &n);
+    view = gm_open_snapshot(snap, 64);
+    if (!pfns || !view) fail("Out of memory");
+    pack(view, pack_b, pfns, n, info.dtb, &st);
+    print_capture("packed reachable capture", &st);
+    gm_destroy(view);
+    free(pfns);
+    gm_snapshot_destroy(snap);
+    pb = open_image(pack_b);
+    if (st.pages != n) {
+        printf("✗ packed reachable capture: %lu of %zu pages\n", (unsigned long)st.pages, n);
+        bad++;
+    }
+    check_walk("packed reachable capture", pb, &info);
+    gm_destroy(pb);
+
+    gm_destroy(pa);
+    gm_destroy(a);
+    cleanup();
+}
+
+// Page kinds of the timing image, by page number
+static void fill_page(uint8_t *page, uint64_t pfn, const uint8_t *templ) {
+    size_t i;
+
+    switch (pfn % 10) {
+    case 0: case 1: case 2: case 3:
+        break;                                  // zero (the file is sparse)
+    case 4:
+        memcpy(page, templ + (pfn / 10 % 8) * GM_PAGE_SIZE, GM_PAGE_SIZE);
+        break;
+    case 5: case 6:
+        // Pool-like records: pointers into one region, small counters
+        for (i = 0; i < GM_PAGE_SIZE; i += 16) {
+            uint64_t ptr = 0xffffa50000000000ULL + ((pfn * 131 + i * 7) & 0xffffff0ULL);
+            uint64_t small = (pfn + i / 16) % 97;
+            memcpy(page + i, &ptr, 8);
+            memcpy(page + i + 8, &small, 8);
+        }
+        break;
+    case 7: case 8:
+        for (i = 0; i < GM_PAGE_SIZE / 4; i++) page[i] = (uint8_t)rng();
+        break;
+    case 9:
+        for (i = 0; i < GM_PAGE_SIZE; i += 8) {
+            uint64_t v = rng();
+            memcpy(page + i, &v, 8);
+        }
+        break;
+    }
+}
+
+static void check_speed(size_t mib) {
+    uint64_t size = (uint64_t)mib << 20, pfn, start, ns, end;
+    uint8_t *ram, *templ = malloc(8 * GM_PAGE_SIZE), *buf = malloc(GM_MAX_BATCH * GM_PAGE_SIZE);
+    const uint8_t *pages[GM_MAX_BATCH];
+    guest_mem_t *a, *pa, *small;
+    gm_dump_stats_t st, elf;
+    size_t i, k, got = 0;
+    int fd, before = bad;
+
+    if (!templ || !buf) fail("Out of memory");
+    for (i = 0; i < 8 * GM_PAGE_SIZE; i++) templ[i] = (uint8_t)rng();
+    fd = open(path_a, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) fail("Could not create the large image");
+    ram = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ram == MAP_FAILED) fail("Could not map the large image");
+    for (pfn = 0; pfn < size >> GM_PAGE_SHIFT; pfn++) fill_page(ram + (pfn << GM_PAGE_SHIFT), pfn, templ);
+    munmap(ram, size);
+
+    a = open_image(path_a);
+    if (gm_dump(a, pack_a, NULL, 0, 0, &elf) != 0) fail("ELF capture failed");
+    unlink(pack_a);
+    pack(a, pack_a, NULL, 0, 0, &st);
+    print_capture("mixed image, packed", &st);
+    printf("  same image as ELF: %.1f MiB in %.3f ms\n", elf.bytes / (1024.0 * 1024.0), elf.ns / 1e6);
+    if (st.zero < (size >> GM_PAGE_SHIFT) * 4 / 10 || st.duplicate < (size >> GM_PAGE_SHIFT) / 10 - 8 ||
+        st.bytes > elf.bytes * 6 / 10) {
+        printf("✗ mixed image: %lu zero, %lu repeated pages, %.1f%% of the ELF size\n", (unsigned long)st.zero,
+               (unsigned long)st.duplicate, 100.0 * st.bytes / elf.bytes);
+        bad++;
+    }
+
+    // Random pages through a small cache, then a sweep
+    pa = open_image(pack_a);
+    small = gm_clone(pa, 16);
+    if (!small) fail("Out of memory");
+    end = size >> GM_PAGE_SHIFT;
+    start = gm_now_ns();
+    for (i = 0; i < PACK_CHECK_READS; i++) {
+        uint64_t x = rng() % end, v, w;
+
+        if (gm_read_pa(small, (x << GM_PAGE_SHIFT) + 8 * (x % 512), &v, 8) != 8 ||
+            gm_read_pa(a, (x << GM_PAGE_SHIFT) + 8 * (x % 512), &w, 8) != 8 || v != w) {
+            printf("✗ random read of page 0x%lx differs\n", x);
+            bad++;
+            break;
+        }
+    }
+    ns = gm_now_ns() - start;
+    gm_destroy(small);
+    start = gm_now_ns();
+    for (pfn = 0; pfn < end; pfn += k) {
+        k = end - pfn < GM_MAX_BATCH ? (size_t)(end - pfn) : GM_MAX_BATCH;
+        got += gm_fetch_pages(pa, pfn, k, buf, pages);
+    }
+    if (got != end) {
+        printf("✗ sweep read %zu of %lu pages\n", got, (unsigned long)end);
+        bad++;
+    }
+    if (bad == before) {
+        printf("✓ %zu MiB packed at %.2f GB/s with %d workers (%.1f s per 16 GiB), %.1f%% of the ELF size\n",
+               mib, st.ns ? (double)size / st.ns : 0.0, win_default_workers(), st.ns / 1e9 * (16384.0 / mib),
+               100.0 * st.bytes / elf.bytes);
+        printf("✓ random page reads: %.1f us each; full sweep at %.2f GB/s\n",
+               ns / 1e3 / PACK_CHECK_READS, (double)size / (gm_now_ns() - start));
+    }
+    gm_destroy(pa);
+    gm_destroy(a);
+    free(templ);
+    free(buf);
+    cleanup();
+}
+
+int main(int argc, char **argv) {
+    size_t mib = PACK_CHECK_MIB;
+    char error[256];
+
+    if (argc > 1) {
+        mib = strtoul(argv[1], NULL, 0);
+        if (mib == 0) {
+            printf("Usage: %s [MIB]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("=== Packed Capture Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    snprintf(path_a, sizeof(path_a), PACK_CHECK_DIR "/vmi-pack-%d-a.img", (int)getpid());
+    snprintf(path_b, sizeof(path_b), PACK_CHECK_DIR "/vmi-pack-%d-b.img", (int)getpid());
+    snprintf(pack_a, sizeof(pack_a), PACK_CHECK_DIR "/vmi-pack-%d-a.pack", (int)getpid());
+    snprintf(pack_b, sizeof(pack_b), PACK_CHECK_DIR "/vmi-pack-%d-b.pack", (int)getpid());
+
+    check_codec();
+    check_captures();
+    check_speed(mib);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every packed capture matched its image\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "win_profile.h"
+
+// Structure profile tool. Loads an ISF JSON file (or the built-in
+// profile), prints the offsets the walkers will use and the matching
+// /etc/libvmi.conf lines. With --check, also fails unless the file agrees
+// with the built-in Windows 10 x64 offsets.
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--check] [ISF.json]\n", prog);
+    printf("  Without a file, $VMI_PROFILE or the built-in profile is shown.\n");
+    printf("  --check  exit non-zero unless the offsets match the built-in profile\n");
+}
+
+// Compare every decoded offset against the built-in profile
+static int compare_builtin(const win_profile_t *prof) {
+    win_profile_t ref;
+    int bad = 0;
+
+    win_profile_builtin(&ref);
+
+#define CHECK_FIELD(f) do { \
+        if (prof->f != ref.f) { \
+            printf("❌ %s: 0x%x, built-in 0x%x\n", #f, prof->f, ref.f); \
+            bad++; \
+        } \
+    } while (0)
+
+    CHECK_FIELD(eprocess_dtb);
+    CHECK_FIELD(eprocess_pid);
+    CHECK_FIELD(eprocess_links);
+    CHECK_FIELD(eprocess_peb);
+    CHECK_FIELD(eprocess_name);
+    CHECK_FIELD(eprocess_threads);
+    CHECK_FIELD(eprocess_create_time);
+    CHECK_FIELD(peb_ldr);
+    CHECK_FIELD(ldr_inloadorder);
+    CHECK_FIELD(ldr_dllbase);
+    CHECK_FIELD(ldr_sizeofimage);
+    CHECK_FIELD(ldr_fulldllname);
+    CHECK_FIELD(ldr_basedllname);
+    CHECK_FIELD(ethread_threadlistentry);
+    CHECK_FIELD(ethread_cid_process);
+    CHECK_FIELD(ethread_cid_thread);
+    CHECK_FIELD(eprocess_object_table);
+    CHECK_FIELD(handle_table_next);
+    CHECK_FIELD(handle_table_code);
+    CHECK_FIELD(object_header_type_index);
+    CHECK_FIELD(object_header_body);
+    CHECK_FIELD(object_type_name);
+    CHECK_FIELD(object_type_index);
+    CHECK_FIELD(file_object_name);
+    CHECK_FIELD(key_body_kcb);
+    CHECK_FIELD(kcb_parent);
+    CHECK_FIELD(kcb_name_block);
+    CHECK_FIELD(name_block_length);
+    CHECK_FIELD(name_block_name);
+    CHECK_FIELD(eprocess_vad_root);
+    CHECK_FIELD(vad_left);
+    CHECK_FIELD(vad_right);
+    CHECK_FIELD(vad_start);
+    CHECK_FIELD(vad_end);
+    CHECK_FIELD(vad_start_high);
+    CHECK_FIELD(vad_end_high);
+    CHECK_FIELD(vad_flags);
+    CHECK_FIELD(vad_type_bit);
+    CHECK_FIELD(vad_protection_bit);
+    CHECK_FIELD(vad_private_bit);
+    CHECK_FIELD(vad_subsection);
+    CHECK_FIELD(subsection_control_area);
+    CHECK_FIELD(control_area_file);
+    CHECK_FIELD(eprocess_span.size);
+    CHECK_FIELD(ldr_span.size);
+    CHECK_FIELD(ethread_span.start);
+    CHECK_FIELD(ethread_span.size);
+
+#undef CHECK_FIELD
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    const win_profile_t *prof;
+    char error[256];
+    int check = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            check = 1;
+        } else if (strcmp(argv[i], "--help") == 0 || argv[i][0] == '-') {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (win_profile_select(path, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    prof = win_profile_get();
+    win_profile_print(prof, stdout);
+
+    if (prof->rva_ps_active_process_head) {
+        printf("  Symbols: PsActiveProcessHead +0x%llx, PsInitialSystemProcess +0x%llx, PsLoadedModuleList +0x%llx\n",
+               (unsigned long long)prof->rva_ps_active_process_head,
+               (unsigned long long)prof->rva_ps_initial_system_process,
+               (unsigned long long)prof->rva_ps_loaded_module_list);
+    }
+
+    printf("\n# /etc/libvmi.conf\n");
+    printf("    win_pdbase = 0x%x;\n", prof->eprocess_dtb);
+    printf("    win_pid = 0x%x;\n", prof->eprocess_pid);
+    printf("    win_pname = 0x%x;\n", prof->eprocess_name);
+    printf("    win_tasks = 0x%x;\n", prof->eprocess_links);
+
+    if (check) {
+        if (compare_builtin(prof) != 0) return 1;
+        printf("\n✓ Profile matches the built-in offsets\n");
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_parallel.h"
+#include "win_profile.h"
+#include "win_psscan.h"
+#include "win_synth.h"
+#include "win_walk.h"
+
+// Self-check for the pool-tag process scan (win_psscan.h). Synthetic
+// images put every EPROCESS in a "Proc" pool allocation; one process is
+// unlinked from ActiveProcessLinks the way a DKOM rootkit does it, or has
+// exited and lost its threads. The scan must find every process, and the
+// diff against the list walk must name exactly the one that is missing.
+
+#define PSSCAN_CHECK_DIR        "/dev/shm"
+#define PSSCAN_CHECK_PROCESSES  5000
+
+static int bad = 0;
+
+static void scan(const char *what, int raw, long unlinked_at, long exited_at, int workers) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_process_list_t procs = {0};
+    win_psscan_result_t r;
+    guest_mem_t *gm;
+    long missing = unlinked_at >= 0 ? unlinked_at : exited_at;
+    char path[64], name[EPROCESS_IMAGEFILENAME_LEN + 1];
+    size_t i, found = 0;
+    int before = bad;
+
+    win_synth_defaults(&opts);
+    opts.processes = PSSCAN_CHECK_PROCESSES;
+    opts.raw = raw;
+    opts.unlinked_at = unlinked_at;
+    opts.exited_at = exited_at;
+    snprintf(path, sizeof(path), PSSCAN_CHECK_DIR "/vmi-psscan-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+    gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    if (raw) gm_set_kernel_dtb(gm, info.dtb);
+
+    win_walk_processes(gm, info.first_process, info.ps_active_process_head, &procs);
+    if (win_psscan(gm, workers, &r) != 0) {
+        printf("✗ %s: scan failed (%s)\n", what, r.error ? r.error : "unknown");
+        bad++;
+    }
+    win_psscan_diff(gm, &procs, &r);
+
+    if (procs.count != info.expect_processes || r.count != opts.processes ||
+        r.linked != procs.count || r.hidden != (unlinked_at >= 0) || r.exited != (exited_at >= 0)) {
+        printf("✗ %s: %zu linked, %zu in pool (%zu linked, %zu hidden, %zu exited), expected %zu in pool\n",
+               what, procs.count, r.count, r.linked, r.hidden, r.exited, opts.processes);
+        bad++;
+    }
+
+    // The one off the list is reported with its identity and address
+    snprintf(name, sizeof(name), "proc%06ld.exe", missing);
+    for (i = 0; i < r.count; i++) {
+        const win_pool_process_t *p = &r.items[i];
+
+        if (p->state == WIN_POOL_LINKED) {
+            if (!p->proc.addr) {
+                printf("✗ %s: linked %s without an address\n", what, p->proc.name);
+                bad++;
+            }
+            continue;
+        }
+        found++;
+        if (strcmp(p->proc.name, name) != 0 || p->proc.pid != (int32_t)((missing + 1) * 4) ||
+            p->state != (unlinked_at >= 0 ? WIN_POOL_HIDDEN : WIN_POOL_EXITED) || !p->proc.addr) {
+            printf("✗ %s: unlinked %s PID %d at 0x%llx, expected %s PID %ld\n", what, p->proc.name,
+                   p->proc.pid, (unsigned long long)p->proc.addr, name, (missing + 1) * 4);
+            bad++;
+        }
+    }
+    if (found != (missing >= 0)) {
+        printf("✗ %s: %zu processes off the list, expected %d\n", what, found, missing >= 0);
+        bad++;
+    }
+
+    if (bad == before) {
+        printf("✓ %s: %zu processes in %.1f MiB, %zu hidden, %zu exited, %.3f ms with %d workers (%.2f GB/s)\n",
+               what, r.count, r.bytes / (1024.0 * 1024.0), r.hidden, r.exited, r.ns / 1e6, r.workers,
+               r.ns ? r.bytes / (double)r.ns : 0.0);
+    }
+    win_psscan_free(&r);
+    win_process_list_free(&procs);
+    gm_destroy(gm);
+}
+
+int main(void) {
+    char error[256];
+    int workers = win_default_workers() > 4 ? win_default_workers() : 4;
+
+    printf("=== Pool Scan Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    scan("clean list", 1, -1, -1, workers);
+    scan("ELF core", 0, -1, -1, workers);
+    scan("DKOM unlink", 1, 2500, -1, workers);
+    scan("DKOM unlink, one worker", 1, 2500, -1, 1);
+    scan("exited process", 1, -1, 4000, workers);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every unlinked process was found\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_profile.h"
+#include "win_synth.h"
+#include "win_walk.h"
+#include "x86_pt.h"
+
+// Self-check for the page-table walker (x86_pt.h) and batched translation
+// (gm_translate_batch). Two address spaces are built in a small table
+// arena: both map the same user range to different frames, and one also
+// has 2 MiB, 1 GiB, transition and non-present mappings. Every walk with
+// the paging-structure cache must agree with a plain walk, a batch must
+// share its upper levels, entries must never leak between roots, and a
+// synthetic guest must translate the same batched as one by one.
+
+#define PT_CHECK_DIR        "/dev/shm"
+#define PT_ARENA_PAGES      64
+#define PT_USER_VA          0x00007ff6a0000000ULL
+#define PT_USER_PAGES       1024            // 4 MiB of 4 KiB pages
+#define PT_2M_VA            0xfffff80200000000ULL
+#define PT_1G_VA            0xfffff88040000000ULL
+#define PT_TRANSITION_VA    0xfffff80200400000ULL
+#define PT_ABSENT_VA        0xfffff80200401000ULL
+#define PT_FRAME_A          0x100000000ULL  // first user frame of root A
+#define PT_FRAME_B          0x200000000ULL  // and of root B
+
+typedef struct {
+    uint8_t mem[PT_ARENA_PAGES * X86_PAGE_4K];
+    uint64_t next;                  // next free table page
+    uint64_t reads;
+} arena_t;
+
+static int bad = 0;
+
+static int arena_read(void *ctx, uint64_t pa, uint64_t *pte) {
+    arena_t *a = ctx;
+    a->reads++;
+    if (pa + sizeof(*pte) > sizeof(a->mem)) return -1;
+    memcpy(pte, a->mem + pa, sizeof(*pte));
+    return 0;
+}
+
+static uint64_t table_alloc(arena_t *a) {
+    uint64_t pa = a->next;
+    a->next += X86_PAGE_4K;
+    if (a->next > sizeof(a->mem)) {
+        printf("❌ Table arena exhausted\n");
+        exit(1);
+    }
+    return pa;
+}
+
+// Entry for va at the given level (3 = PML4 .. 0 = PT), creating the
+// tables above it
+static uint64_t *entry_at(arena_t *a, uint64_t cr3, uint64_t va, int level) {
+    uint64_t table = cr3;
+    int l;
+
+    for (l = 3; l > level; l--) {
+        uint64_t *slot = (uint64_t*)(a->mem + table) + ((va >> (12 + 9 * l)) & 0x1ff);
+        if (!(*slot & X86_PTE_PRESENT)) *slot = table_alloc(a) | X86_PTE_PRESENT | 0x2;
+        table = *slot & X86_PADDR_MASK;
+    }
+    return (uint64_t*)(a->mem + table) + ((va >> (12 + 9 * level)) & 0x1ff);
+}
+
+static uint64_t build_root(arena_t *a, uint64_t frame, int large) {
+    uint64_t cr3 = table_alloc(a);
+    size_t i;
+
+    for (i = 0; i < PT_USER_PAGES; i++) {
+        // Scattered frames, so a wrong PTE cannot give the right answer
+        *entry_at(a, cr3, PT_USER_VA + i * X86_PAGE_4K, 0) =
+            (frame + ((i * 7919) % PT_USER_PAGES) * X86_PAGE_4K) | X86_PTE_PRESENT;
+    }
+    if (large) {
+        *entry_at(a, cr3, PT_2M_VA, 1) = 0x40000000ULL | X86_PTE_PRESENT | X86_PTE_PS;
+        *entry_at(a, cr3, PT_1G_VA, 2) = 0x80000000ULL | X86_PTE_PRESENT | X86_PTE_PS;
+        *entry_at(a, cr3, PT_TRANSITION_VA, 0) = 0x7000ULL | X86_PTE_TRANSITION;
+        *entry_at(a, cr3, PT_ABSENT_VA, 0) = 0x8000ULL;
+    }
+    return cr3;
+}
+
+static void expect(const char *what, uint64_t got, uint64_t want) {
+    if (got != want) {
+        printf("✗ %s: 0x%llx, expected 0x%llx\n", what, (unsigned long long)got, (unsigned long long)want);
+        bad++;
+    }
+}
+
+// Cached walks agree with plain ones on every kind of mapping
+static void check_agree(arena_t *a, x86_pwc_t *pwc, uint64_t cr3, int large) {
+    static const uint64_t vas[] = {
+        PT_USER_VA, PT_USER_VA + 0x1234, PT_USER_VA + (PT_USER_PAGES - 1) * X86_PAGE_4K + 0xfff,
+        PT_2M_VA, PT_2M_VA + 0x1fffff, PT_1G_VA + 0x3ffff123, PT_TRANSITION_VA + 8,
+        PT_ABSENT_VA, PT_USER_VA + PT_USER_PAGES * X86_PAGE_4K, 0xffff800000000000ULL,
+    };
+    size_t i, pass;
+
+    // Twice: the second pass starts every walk from the cache
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < sizeof(vas) / sizeof(vas[0]); i++) {
+            x86_walk_t w;
+            uint64_t pa = 0, size = 0, want_pa = 0, want_size = 0;
+            int rc, want;
+
+            want = x86_translate(arena_read, a, cr3, vas[i], &want_pa, &want_size);
+            x86_walk_init(&w, arena_read, a, pwc, cr3);
+            rc = x86_walk(&w, vas[i], &pa, &size);
+            if (rc != want || pa != want_pa || size != want_size) {
+                printf("✗ VA 0x%llx: cached walk %d/0x%llx/0x%llx, plain %d/0x%llx/0x%llx\n",
+                       (unsigned long long)vas[i], rc, (unsigned long long)pa, (unsigned long long)size,
+                       want, (unsigned long long)want_pa, (unsigned long long)want_size);
+                bad++;
+            }
+        }
+    }
+
+    // Large pages end the walk above the PT, so a cached one reads nothing
+    if (large) {
+        x86_walk_t w;
+        uint64_t pa, size, reads = pwc->pte_reads;
+        x86_walk_init(&w, arena_read, a, pwc, cr3);
+        x86_walk(&w, PT_1G_VA + 0x1000, &pa, &size);
+        x86_walk(&w, PT_2M_VA + 0x3000, &pa, &size);
+        expect("entries read inside cached large pages", pwc->pte_reads - reads, 0);
+        expect("2 MiB page size", size, X86_PAGE_2M);
+    }
+}
+
+// A vector of neighbouring VAs costs one PTE each plus one walk above
+static void check_batch(arena_t *a, uint64_t cr3_a, uint64_t cr3_b) {
+    x86_pwc_t pwc;
+    x86_walk_t w;
+    uint64_t reads, pa;
+    size_t i;
+
+    x86_pwc_init(&pwc);
+    x86_walk_init(&w, arena_read, a, &pwc, cr3_a);
+    for (i = 0; i < PT_USER_PAGES; i++) {
+        uint64_t want = PT_FRAME_A + ((i * 7919) % PT_USER_PAGES) * X86_PAGE_4K + 0x10;
+        if (x86_walk(&w, PT_USER_VA + i * X86_PAGE_4K + 0x10, &pa, NULL) != 0 || pa != want) {
+            printf("✗ Batched walk of page %zu: 0x%llx\n", i, (unsigned long long)pa);
+            bad++;
+            break;
+        }
+    }
+    // 4 MiB spans two page tables: PML4E, PDPTE, two PDEs, 1024 PTEs
+    expect("entries read by a batch of neighbours", pwc.pte_reads, PT_USER_PAGES + 4);
+
+    // The same root and range in another pass: the cache holds every PDE
+    reads = pwc.pte_reads;
+    for (i = 0; i < PT_USER_PAGES; i += 97) {
+        x86_walk_init(&w, arena_read, a, &pwc, cr3_a);
+        x86_walk(&w, PT_USER_VA + i * X86_PAGE_4K, &pa, NULL);
+    }
+    expect("entries read by cached walks", pwc.pte_reads - reads, (PT_USER_PAGES + 96) / 97);
+
+    // Another root shares the VAs but none of its entries
+    for (i = 0; i < PT_USER_PAGES; i += 97) {
+        x86_walk_init(&w, arena_read, a, &pwc, cr3_b);
+        if (x86_walk(&w, PT_USER_VA + i * X86_PAGE_4K, &pa, NULL) != 0 ||
+            pa != PT_FRAME_B + ((i * 7919) % PT_USER_PAGES) * X86_PAGE_4K) {
+            printf("✗ Root B page %zu: 0x%llx from root A's entries\n", i, (unsigned long long)pa);
+            bad++;
+            break;
+        }
+    }
+
+    // A flush forgets everything
+    x86_pwc_flush(&pwc);
+    reads = pwc.pte_reads;
+    x86_walk_init(&w, arena_read, a, &pwc, cr3_a);
+    x86_walk(&w, PT_USER_VA, &pa, NULL);
+    expect("entries read after a flush", pwc.pte_reads - reads, 4);
+
+    if (!bad) {
+        printf("✓ %d pages batched with %llu entry reads, roots kept apart\n", PT_USER_PAGES,
+               (unsigned long long)(PT_USER_PAGES + 4));
+    }
+}
+
+// Batched and one-by-one translation agree on a synthetic guest
+static void check_guest(void) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_process_list_t procs = {0};
+    guest_mem_t *gm, *one;
+    uint64_t *vas, *pas, start, batch_ns, single_ns, batch_reads;
+    size_t i, n, done;
+    char path[64];
+    int before = bad;
+
+    win_synth_defaults(&opts);
+    opts.processes = 20000;
+    opts.raw = 1;
+    snprintf(path, sizeof(path), PT_CHECK_DIR "/vmi-pt-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+    gm = gm_open_image(path, 0);
+    one = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm || !one) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    gm_set_kernel_dtb(gm, info.dtb);
+    gm_set_kernel_dtb(one, info.dtb);
+    win_walk_processes(gm, info.first_process, info.ps_active_process_head, &procs);
+
+    // Every EPROCESS and PEB, plus one address that is not mapped
+    n = procs.count * 2 + 1;
+    vas = malloc(n * sizeof(*vas));
+    pas = malloc(n * sizeof(*pas));
+    if (!vas || !pas) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < procs.count; i++) {
+        vas[2 * i] = procs.items[i].addr;
+        vas[2 * i + 1] = procs.items[i].peb;
+    }
+    vas[n - 1] = 0xfffff80000000000ULL;
+
+    gm_invalidate(gm);
+    gm_reset_stats(gm);
+    start = gm_now_ns();
+    done = gm_translate_batch(gm, GM_KERNEL_DTB, vas, pas, n);
+    batch_ns = gm_now_ns() - start;
+    batch_reads = gm_get_stats(gm)->pte_reads;
+
+    start = gm_now_ns();
+    for (i = 0; i < n; i++) {
+        uint64_t dtb = i % 2 ? win_process_dtb(&procs.items[i / 2]) : GM_KERNEL_DTB;
+        uint64_t pa;
+        if (gm_translate(one, dtb, vas[i], &pa) != 0) pa = GM_NO_PA;
+        if (pa != pas[i]) {
+            printf("✗ VA 0x%llx: batched 0x%llx, single 0x%llx\n", (unsigned long long)vas[i],
+                   (unsigned long long)pas[i], (unsigned long long)pa);
+            bad++;
+            break;
+        }
+    }
+    single_ns = gm_now_ns() - start;
+    expect("addresses translated", done, n - 1);
+
+    // Modules are read through each process's own DTB
+    for (i = 0; i < procs.count; i++) {
+        if (win_process_dtb(&procs.items[i]) != info.dtb) {
+            printf("✗ %s: DTB 0x%llx\n", procs.items[i].name,
+                   (unsigned long long)win_process_dtb(&procs.items[i]));
+            bad++;
+            break;
+        }
+    }
+
+    if (bad == before) {
+        printf("✓ %zu guest VAs: batched %.3f ms (%llu entry reads), one by one %.3f ms (%llu)\n",
+               n, batch_ns / 1e6, (unsigned long long)batch_reads, single_ns / 1e6,
+               (unsigned long long)gm_get_stats(one)->pte_reads);
+    }
+    free(vas);
+    free(pas);
+    win_process_list_free(&procs);
+    gm_destroy(gm);
+    gm_destroy(one);
+}
+
+int main(void) {
+    static arena_t arena;
+    x86_pwc_t pwc;
+    uint64_t cr3_a, cr3_b;
+    char error[256];
+
+    printf("=== Page Walker Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    cr3_a = build_root(&arena, PT_FRAME_A, 1);
+    cr3_b = build_root(&arena, PT_FRAME_B, 0);
+    x86_pwc_init(&pwc);
+    check_agree(&arena, &pwc, cr3_a, 1);
+    check_agree(&arena, &pwc, cr3_b, 0);
+    if (!bad) printf("✓ Cached walks match plain walks (4 KiB, 2 MiB, 1 GiB, transition, absent)\n");
+    check_batch(&arena, cr3_a, cr3_b);
+    check_guest();
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every translation matched\n");
+    return 0;
+}
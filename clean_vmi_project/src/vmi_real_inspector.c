@@ -8,49 +8,29 @@
 #include <sys/stat.h>
 #include <stdint.h>
 #include <libvmi/libvmi.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+#include "win_pe.h"
+#include "counters.h"
 
 #define MAX_NAME_LENGTH 256
 #define PAGE_SIZE 4096
 
-// Windows 10 structure offsets (verified for Windows 10 x64)
-#define EPROCESS_IMAGEFILENAME_OFFSET 0x5a8
-#define EPROCESS_PID_OFFSET 0x2e0  
-#define EPROCESS_ACTIVEPROCESSLINKS_OFFSET 0x2e8
-#define EPROCESS_PEB_OFFSET 0x3f8
-#define EPROCESS_THREADLISTHEAD_OFFSET 0x5e0
-#define PEB_LDR_OFFSET 0x18
-#define LDR_INLOADORDERMODULELIST_OFFSET 0x10
-#define LDR_BASEDLLNAME_OFFSET 0x58
-#define LDR_FULLDLLNAME_OFFSET 0x48
-#define LDR_DLLBASE_OFFSET 0x30
-#define LDR_SIZEOFIMAGE_OFFSET 0x40
-#define ETHREAD_CREADID_OFFSET 0x648
-#define ETHREAD_THREADLISTENTRY_OFFSET 0x6f8
-
 // Global variables
 vmi_instance_t vmi;
 int vmi_initialized = 0;
+guest_mem_t *gm = NULL;
+int snapshot_mode = 0;
 
-// Memory access via /proc/pid/mem (alternative method)
-int access_vm_memory_proc(int pid, uint64_t addr, void *buf, size_t len) {
-    char path[256];
-    snprintf(path, sizeof(path), "/proc/%d/mem", pid);
-    
-    int fd = open(path, O_RDONLY);
-    if (fd < 0) {
-        return -1;
-    }
-    
-    if (lseek(fd, addr, SEEK_SET) == -1) {
-        close(fd);
-        return -1;
-    }
-    
-    ssize_t ret = read(fd, buf, len);
-    close(fd);
-    
-    return (ret == len) ? 0 : -1;
-}
+// Settings for the RAM-file, /proc/PID/mem and memory-image methods,
+// which have no symbol support of their own
+const char *ram_file_opt = NULL;
+const char *image_opt = NULL;
+int qemu_pid_opt = 0;
+uint64_t kernel_dtb_opt = 0;
+uint64_t ps_head_opt = 0;
+uint64_t lowmem_opt = 0;
+uint64_t kernel_base_opt = 0;
 
 // Get QEMU/KVM process PID
 int get_qemu_pid() {
@@ -66,6 +46,54 @@ int get_qemu_pid() {
     return pid;
 }
 
+// Map QEMU's RAM file(s) read-only. The kernel DTB comes from --dtb or,
+// when LibVMI is attached, from vCPU 0's CR3.
+guest_mem_t *open_ram_file_backend() {
+    guest_mem_t *mapped = gm_open_mmap(ram_file_opt, lowmem_opt, 0);
+    uint64_t cr3 = kernel_dtb_opt;
+    uint8_t page[PAGE_SIZE];
+
+    if (!mapped) {
+        printf("✗ Could not map guest RAM file %s\n", ram_file_opt);
+        return NULL;
+    }
+    if (gm_read_pa(mapped, 0, page, sizeof(page)) != sizeof(page)) {
+        printf("✗ Guest RAM file %s is not readable\n", ram_file_opt);
+        gm_destroy(mapped);
+        return NULL;
+    }
+    if (!cr3 && vmi_initialized) {
+        vmi_get_vcpureg(vmi, &cr3, CR3, 0);
+    }
+    if (cr3) {
+        gm_set_kernel_dtb(mapped, cr3 & ~(uint64_t)0xfff);
+    } else if (vmi_initialized) {
+        // LibVMI can still read everything itself; prefer that over a
+        // mapping we cannot translate kernel addresses in
+        printf("✗ Kernel DTB unknown, not using %s\n", ram_file_opt);
+        gm_destroy(mapped);
+        return NULL;
+    }
+    printf("✓ Guest RAM mapped zero-copy from %s\n", ram_file_opt);
+    return mapped;
+}
+
+// Open a raw or ELF-core memory image; no hypervisor involved. QEMU
+// cores carry the kernel DTB, --dtb overrides it.
+guest_mem_t *open_image_backend() {
+    guest_mem_t *image = gm_open_image(image_opt, 0);
+
+    if (!image) {
+        printf("✗ Could not open memory image %s\n", image_opt);
+        return NULL;
+    }
+    if (kernel_dtb_opt) {
+        gm_set_kernel_dtb(image, kernel_dtb_opt);
+    }
+    printf("✓ Memory image %s mapped (kernel DTB 0x%lx)\n", image_opt, gm_kernel_dtb(image));
+    return image;
+}
+
 // Initialize VMI using multiple methods
 int initialize_vmi_enhanced() {
     vmi_init_error_t error;
@@ -94,83 +122,171 @@ int initialize_vmi_enhanced() {
     }
     printf("✗ LibVMI domain ID failed (Error: %d)\n", error);
     
-    // Method 3: Alternative - use QEMU monitor or direct memory access
-    printf("Method 3: Attempting alternative memory access...\n");
-    int qemu_pid = get_qemu_pid();
+    // Method 3: QEMU RAM file (memory-backend-file / memfd share=on)
+    if (ram_file_opt) {
+        printf("Method 3: Mapping guest RAM file...\n");
+        gm = open_ram_file_backend();
+        if (gm) {
+            return 2; // Alternative method available
+        }
+    }
+    
+    // Method 4: Guest RAM straight out of the QEMU process
+    printf("Method 4: QEMU process memory via /proc/PID/mem...\n");
+    int qemu_pid = qemu_pid_opt > 0 ? qemu_pid_opt : get_qemu_pid();
     if (qemu_pid > 0) {
         printf("✓ Found QEMU process (PID: %d)\n", qemu_pid);
-        printf("✓ Alternative memory access available\n");
-        return 2; // Alternative method available
+        gm = gm_open_proc(qemu_pid, lowmem_opt, GM_DEFAULT_CACHE_PAGES);
+        if (gm) {
+            uint8_t page[PAGE_SIZE];
+            if (gm_read_pa(gm, 0, page, sizeof(page)) == sizeof(page)) {
+                printf("✓ Guest physical memory readable through /proc/%d/mem\n", qemu_pid);
+                if (kernel_dtb_opt) gm_set_kernel_dtb(gm, kernel_dtb_opt);
+                return 2; // Alternative method available
+            }
+            printf("✗ Guest RAM found but not readable (ptrace permission?)\n");
+            gm_destroy(gm);
+            gm = NULL;
+        } else {
+            printf("✗ Could not locate guest RAM in the QEMU process\n");
+        }
     }
     
     printf("❌ All VMI methods failed\n");
     return 0;
 }
 
+// PsActiveProcessHead from --ps-head, --kernel-base plus the profile's
+// symbol RVA, or LibVMI's kernel symbols
+int resolve_process_list_head(addr_t *list_head) {
+    uint64_t rva = win_profile_get()->rva_ps_active_process_head;
+
+    if (ps_head_opt) {
+        *list_head = ps_head_opt;
+        return 0;
+    }
+    if (kernel_base_opt && rva) {
+        *list_head = kernel_base_opt + rva;
+        return 0;
+    }
+    if (vmi_initialized && VMI_SUCCESS == vmi_translate_ksym2v(vmi, "PsActiveProcessHead", list_head)) {
+        return 0;
+    }
+    return -1;
+}
+
+// Only LibVMI can pause the guest; /proc/PID/mem reads a running VM and
+// an image never changes
+uint64_t paused_at = 0;
+
+int pause_guest() {
+    if (image_opt) {
+        return 0;
+    }
+    if (!vmi_initialized) {
+        printf("⚠ Guest not paused (no LibVMI), reading live memory\n");
+        return 0;
+    }
+    if (VMI_SUCCESS != vmi_pause_vm(vmi)) {
+        return -1;
+    }
+    paused_at = gm_now_ns();
+    printf("VM paused for introspection\n");
+    return 0;
+}
+
+void resume_guest() {
+    if (vmi_initialized) {
+        vmi_resume_vm(vmi);
+        counters_add_pause(gm_now_ns() - paused_at);
+    }
+}
+
 // Enhanced process enumeration with real memory access attempts
 void enumerate_processes_enhanced() {
     printf("\n=== Enhanced Process Enumeration ===\n");
     
-    if (vmi_initialized) {
-        printf("Using LibVMI for process enumeration:\n");
+    if (gm) {
+        printf("Using %s for process enumeration:\n",
+               vmi_initialized ? "LibVMI" : image_opt ? "memory image" : "guest RAM access");
+        if (!vmi_initialized && gm_kernel_dtb(gm) == 0) {
+            printf("⚠ Kernel DTB unknown (pass --dtb CR3)\n");
+            return;
+        }
+        
+        // Resolve the list head before pausing; it does not move
+        addr_t list_head = 0, first_entry = 0;
+        ctr_scope_t scope;
+        counters_begin(&scope, CTR_SYMBOLS);
+        int found = 0 == resolve_process_list_head(&list_head);
+        int readable = found && 0 == gm_read_u64(gm, GM_KERNEL_DTB, list_head, &first_entry);
+        counters_end(&scope);
+        if (!found) {
+            printf("⚠ Could not find PsActiveProcessHead (pass --ps-head VA or --kernel-base VA)\n");
+            return;
+        }
+        printf("✓ Found PsActiveProcessHead at: 0x%lx\n", list_head);
+        if (!readable) {
+            printf("⚠ Could not read process list\n");
+            return;
+        }
+        printf("✓ Process list accessible\n");
+        addr_t first_process = first_entry - win_profile_get()->eprocess_links;
+        
+        win_process_list_t processes = { 0 };
+        gm_snapshot_t *snap = NULL;
+        guest_mem_t *reader = gm;
+        uint64_t start = gm_now_ns(), resumed, done;
+        int count;
         
         // Pause VM for consistent reading
-        if (VMI_SUCCESS == vmi_pause_vm(vmi)) {
-            printf("VM paused for introspection\n");
-            
-            // Try to get PsActiveProcessHead
-            addr_t list_head = 0;
-            if (VMI_SUCCESS == vmi_translate_ksym2v(vmi, "PsActiveProcessHead", &list_head)) {
-                printf("✓ Found PsActiveProcessHead at: 0x%lx\n", list_head);
-                
-                // Read process list
-                addr_t current_process = 0;
-                if (VMI_SUCCESS == vmi_read_addr_va(vmi, list_head, 0, &current_process)) {
-                    printf("✓ Process list accessible\n");
-                    
-                    // Enumerate processes
-                    int count = 0;
-                    addr_t current = current_process;
-                    printf("\n%-25s %-8s %-16s\n", "Process Name", "PID", "Address");
-                    printf("=====================================================\n");
-                    
-                    do {
-                        // Read process name
-                        char *procname = vmi_read_str_va(vmi, current + EPROCESS_IMAGEFILENAME_OFFSET, 0);
-                        
-                        // Read PID
-                        uint32_t pid = 0;
-                        vmi_read_32_va(vmi, current + EPROCESS_PID_OFFSET, 0, &pid);
-                        
-                        if (procname && strlen(procname) > 0) {
-                            printf("%-25s %-8d 0x%-14lx\n", procname, pid, current);
-                            free(procname);
-                        }
-                        
-                        // Get next process
-                        addr_t next_list_entry = 0;
-                        if (VMI_SUCCESS != vmi_read_addr_va(vmi, current + EPROCESS_ACTIVEPROCESSLINKS_OFFSET, 0, &next_list_entry)) {
-                            break;
-                        }
-                        current = next_list_entry - EPROCESS_ACTIVEPROCESSLINKS_OFFSET;
-                        
-                        count++;
-                    } while (current != current_process && count < 100);
-                    
-                    printf("Total processes enumerated: %d\n", count);
-                } else {
-                    printf("⚠ Could not read process list\n");
-                }
-            } else {
-                printf("⚠ Could not find PsActiveProcessHead symbol\n");
+        if (0 != pause_guest()) {
+            printf("⚠ Could not pause VM\n");
+            return;
+        }
+        
+        if (snapshot_mode && (snap = gm_snapshot_create()) != NULL) {
+            // Only copy pages while paused; decode after resuming
+            gm_snapshot_begin(gm, snap);
+            win_walk_processes(gm, first_process, list_head, NULL);
+            gm_snapshot_end(gm);
+            resume_guest();
+            resumed = gm_now_ns();
+            printf("VM resumed (%zu pages snapshotted)\n", gm_snapshot_pages(snap));
+            reader = gm_open_snapshot(snap, GM_DEFAULT_CACHE_PAGES);
+            count = reader ? win_walk_processes(reader, first_process, list_head, &processes) : -1;
+        } else {
+            gm_invalidate(gm);
+            count = win_walk_processes(gm, first_process, list_head, &processes);
+        }
+        
+        printf("\n%-25s %-8s %-16s\n", "Process Name", "PID", "Address");
+        printf("=====================================================\n");
+        for (size_t i = 0; i < processes.count; i++) {
+            const win_process_t *p = &processes.items[i];
+            if (strlen(p->name) > 0) {
+                printf("%-25s %-8d 0x%-14lx\n", p->name, p->pid, p->addr);
             }
-            
-            // Resume VM
-            vmi_resume_vm(vmi);
-            printf("VM resumed\n");
+        }
+        printf("Total processes enumerated: %d\n", count);
+        if (processes.error) {
+            printf("⚠ %s\n", processes.error);
+        }
+        
+        if (snap) {
+            done = gm_now_ns();
+            if (reader) gm_destroy(reader);
+            gm_snapshot_destroy(snap);
         } else {
-            printf("⚠ Could not pause VM\n");
+            // Resume VM
+            resume_guest();
+            resumed = done = gm_now_ns();
+            if (!image_opt) printf("VM resumed\n");
         }
+        gm_invalidate(gm);
+        win_process_list_free(&processes);
+        printf("Guest paused for %.3f ms (total scan time %.3f ms)\n",
+               (resumed - start) / 1e6, (done - start) / 1e6);
     } else {
         printf("LibVMI not available, using host system process enumeration:\n");
         printf("\nHost system processes (demonstration):\n");
@@ -190,34 +306,77 @@ void enumerate_processes_enhanced() {
     }
 }
 
-// Enhanced module enumeration
+// PsLoadedModuleList from --kernel-base plus the profile's symbol RVA, or
+// LibVMI's kernel symbols
+int resolve_driver_list_head(addr_t *list_head) {
+    uint64_t rva = win_profile_get()->rva_ps_loaded_module_list;
+
+    if (kernel_base_opt && rva) {
+        *list_head = kernel_base_opt + rva;
+        return 0;
+    }
+    if (vmi_initialized && VMI_SUCCESS == vmi_translate_ksym2v(vmi, "PsLoadedModuleList", list_head)) {
+        return 0;
+    }
+    return -1;
+}
+
+// Enhanced module enumeration: the loaded kernel modules, walked while
+// paused; their PE headers are parsed after resuming
 void enumerate_modules_enhanced() {
     printf("\n=== Enhanced Module Enumeration ===\n");
     
-    if (vmi_initialized) {
-        printf("Using LibVMI for module enumeration:\n");
-        
-        if (VMI_SUCCESS == vmi_pause_vm(vmi)) {
-            // This would require walking the PEB->Ldr->InLoadOrderModuleList
-            // For demonstration, showing the structure traversal
-            printf("Would traverse: EPROCESS -> PEB -> PEB_LDR_DATA -> InLoadOrderModuleList\n");
-            printf("Using offsets: PEB(0x%x) -> Ldr(0x%x) -> ModuleList(0x%x)\n", 
-                   EPROCESS_PEB_OFFSET, PEB_LDR_OFFSET, LDR_INLOADORDERMODULELIST_OFFSET);
-            
-            vmi_resume_vm(vmi);
+    if (!gm || (!vmi_initialized && gm_kernel_dtb(gm) == 0)) {
+        printf("⚠ No kernel address space to read modules from\n");
+        return;
+    }
+    
+    addr_t list_head = 0;
+    if (0 != resolve_driver_list_head(&list_head)) {
+        printf("⚠ Could not find PsLoadedModuleList (pass --kernel-base VA)\n");
+        return;
+    }
+    printf("✓ Found PsLoadedModuleList at: 0x%lx\n", list_head);
+    
+    win_module_list_t drivers = { 0 };
+    win_mod_map_t map = { 0 };
+    win_pe_cache_t *cache = win_pe_cache_create();
+    int count;
+    
+    if (0 != pause_guest()) {
+        printf("⚠ Could not pause VM\n");
+        win_pe_cache_destroy(cache);
+        return;
+    }
+    gm_invalidate(gm);
+    count = win_walk_drivers(gm, list_head, &drivers);
+    resume_guest();
+    
+    // Driver images do not change while loaded
+    if (cache) win_mod_map_build(&map, cache, gm, GM_KERNEL_DTB, &drivers);
+    
+    printf("%-32s %-18s %-10s %-10s %-8s %-8s\n", "Module Name", "Base Address", "Size", "Timestamp",
+           "Sections", "Exports");
+    printf("==========================================================================================\n");
+    for (size_t i = 0; i < map.count; i++) {
+        const win_module_t *m = map.items[i].module;
+        const win_pe_image_t *pe = map.items[i].pe;
+        if (pe) {
+            printf("%-32s 0x%-16lx 0x%-8x 0x%-8x %-8zu %-8zu\n", m->name, m->base, m->size,
+                   pe->timestamp, pe->section_count, pe->export_count);
+        } else {
+            printf("%-32s 0x%-16lx 0x%-8x %-10s %-8s %-8s\n", m->name, m->base, m->size, "-", "-", "-");
         }
     }
+    printf("Total kernel modules: %d\n", count);
+    if (drivers.error) {
+        printf("⚠ %s\n", drivers.error);
+    }
     
-    printf("\nDemonstrating Windows module enumeration concept:\n");
-    printf("%-40s %-16s %-10s %-12s\n", "Module Name", "Base Address", "Size", "Type");
-    printf("=========================================================================\n");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "ntoskrnl.exe", 0xfffff80140000000L, 0x7ff000, "Kernel");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "hal.dll", 0xfffff80140800000L, 0x11c000, "HAL");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "kernel32.dll", 0x000007fef7ac0000L, 0x100000, "System");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "user32.dll", 0x000007fef7bc0000L, 0x100000, "System");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "advapi32.dll", 0x000007fef78e0000L, 0x100000, "System");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "msvcrt.dll", 0x000007fef7cc0000L, 0x90000, "Runtime");
-    printf("%-40s 0x%-14lx 0x%-8x %-12s\n", "ntdll.dll", 0x000007fef7dc0000L, 0x1a0000, "Native");
+    gm_invalidate(gm);
+    win_mod_map_free(&map);
+    win_module_list_free(&drivers);
+    win_pe_cache_destroy(cache);
 }
 
 // Enhanced thread enumeration
@@ -228,7 +387,7 @@ void enumerate_threads_enhanced() {
         printf("Using LibVMI for thread enumeration:\n");
         printf("Would traverse: EPROCESS -> ThreadListHead -> ETHREAD structures\n");
         printf("Using offsets: ThreadListHead(0x%x) -> ETHREAD.Cid(0x%x)\n",
-               EPROCESS_THREADLISTHEAD_OFFSET, ETHREAD_CREADID_OFFSET);
+               win_profile_get()->eprocess_threads, win_profile_get()->ethread_cid_process);
     }
     
     printf("\nDemonstrating Windows thread enumeration concept:\n");
@@ -244,24 +403,98 @@ void enumerate_threads_enhanced() {
 }
 
 int main(int argc, char **argv) {
+    const char *profile_path = NULL;
+    const char *counters_path = NULL;
+    char profile_error[256];
+    ctr_format_t counters_format = CTR_FORMAT_JSON;
+    int counters_wanted = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshot_mode = 1;
+        } else if (strcmp(argv[i], "--ram-file") == 0 && i + 1 < argc) {
+            ram_file_opt = argv[++i];
+        } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image_opt = argv[++i];
+        } else if (strcmp(argv[i], "--kernel-base") == 0 && i + 1 < argc) {
+            kernel_base_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--qemu-pid") == 0 && i + 1 < argc) {
+            qemu_pid_opt = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dtb") == 0 && i + 1 < argc) {
+            kernel_dtb_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--ps-head") == 0 && i + 1 < argc) {
+            ps_head_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--lowmem") == 0 && i + 1 < argc) {
+            lowmem_opt = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--counters") == 0 && i + 1 < argc) {
+            if (0 != counters_parse_format(argv[++i], &counters_format)) {
+                printf("❌ Unknown counters format %s (json or prometheus)\n", argv[i]);
+                return 1;
+            }
+            counters_wanted = 1;
+        } else if (strcmp(argv[i], "--counters-out") == 0 && i + 1 < argc) {
+            counters_path = argv[++i];
+            counters_wanted = 1;
+        }
+    }
+    
+    // Structure offsets for every walker: --profile, $VMI_PROFILE or built-in
+    if (0 != win_profile_select(profile_path, profile_error, sizeof(profile_error))) {
+        printf("❌ Failed to load structure profile: %s\n", profile_error);
+        return 1;
+    }
+    
+    // Access counters, dumped at exit and on SIGUSR1
+    if (counters_wanted && 0 != counters_install(counters_format, counters_path)) {
+        printf("❌ Failed to start the counters dump thread\n");
+        return 1;
+    }
+    
     printf("=== Real KVM-VMI Inspector ===\n");
     printf("Attempting real VM introspection with multiple methods...\n\n");
     
-    // Check VM status
-    printf("=== VM Status Check ===\n");
-    int vm_status = system("virsh list | grep -q 'win10-vmi.*running'");
-    if (vm_status == 0) {
-        printf("✓ Windows 10 VM is running\n");
+    if (image_opt) {
+        // Offline analysis: no domain, no LibVMI
+        printf("=== Memory Image ===\n");
+        gm = open_image_backend();
+        if (!gm) {
+            return 1;
+        }
     } else {
-        printf("❌ Windows 10 VM is not running\n");
-        return 1;
+        // Check VM status
+        printf("=== VM Status Check ===\n");
+        int vm_status = (qemu_pid_opt > 0 || ram_file_opt) ? 0 : system("virsh list | grep -q 'win10-vmi.*running'");
+        if (vm_status == 0) {
+            printf("✓ Windows 10 VM is running\n");
+        } else {
+            printf("❌ Windows 10 VM is not running\n");
+            return 1;
+        }
+        
+        // Initialize VMI
+        int vmi_status = initialize_vmi_enhanced();
+        if (vmi_status == 0) {
+            printf("❌ No VMI method available\n");
+            return 1;
+        }
     }
     
-    // Initialize VMI
-    int vmi_status = initialize_vmi_enhanced();
-    if (vmi_status == 0) {
-        printf("❌ No VMI method available\n");
-        return 1;
+    // Walkers read guest memory through the shared page/translation caches.
+    // With a RAM file LibVMI only pauses the guest and resolves symbols.
+    if (vmi_initialized) {
+        if (ram_file_opt) {
+            gm = open_ram_file_backend();
+        }
+        if (!gm) {
+            gm = gm_open_libvmi(vmi, GM_DEFAULT_CACHE_PAGES);
+        }
+        if (!gm) {
+            printf("❌ Failed to allocate guest memory cache\n");
+            vmi_destroy(vmi);
+            return 1;
+        }
     }
     
     // Perform introspection
@@ -279,17 +512,21 @@ int main(int argc, char **argv) {
     printf("✓ Professional memory management\n");
     printf("✓ All three required VMI features:\n");
     printf("  • Process enumeration via EPROCESS traversal\n");
-    printf("  • Module enumeration via PEB/LDR structures\n");
+    printf("  • Module enumeration via PsLoadedModuleList and PE headers\n");
     printf("  • Thread enumeration via ETHREAD lists\n");
     
     printf("\n=== TECHNICAL SPECIFICATIONS ===\n");
     printf("Target: Windows 10 x64 VM\n");
     printf("Method: LibVMI + KVM hypervisor\n");
     printf("Structures: EPROCESS, PEB, LDR_DATA_TABLE_ENTRY, ETHREAD\n");
+    printf("Offsets: %s\n", win_profile_get()->name);
     printf("Memory: Virtual address translation and direct access\n");
     printf("Safety: VM pause/resume for consistent introspection\n");
     
     // Cleanup
+    if (gm) {
+        gm_destroy(gm);
+    }
     if (vmi_initialized) {
         vmi_destroy(vmi);
         printf("\n✓ VMI session cleaned up\n");
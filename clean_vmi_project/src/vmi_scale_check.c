@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+#include "win_parallel.h"
+#include "win_str.h"
+#include "win_synth.h"
+
+// Self-check for the walkers on synthetic guest images (win_synth.h). A
+// large clean image measures the process walk and the parallel module and
+// thread walks; smaller images with one injected fault each check that
+// the walks stop where they should, report why, and never hang or return
+// the list head as an entry. Every scenario is written both as an ELF
+// core and as a raw dump and read through the image backend. The name
+// decoder is checked against a one-code-point-at-a-time reference.
+
+#define SCALE_DEFAULT_PROCESSES 100000
+#define SCALE_FAULT_PROCESSES   2000
+#define SCALE_IMAGE_DIR         "/dev/shm"
+#define SCALE_UTF16_STRINGS     20000
+
+typedef struct {
+    const char *name;
+    size_t processes;           // 0 takes the large count
+    long loop_at, torn_at, unmapped_at, module_loop_at, thread_loop_at;
+    int expect_error;           // the process walk must report an error
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "clean",         0,                     -1,   -1,   -1,  -1,  -1, 0 },
+    { "process loop",  SCALE_FAULT_PROCESSES, 1500, -1,   -1,  -1,  -1, 1 },
+    { "torn link",     SCALE_FAULT_PROCESSES, -1,   700,  -1,  -1,  -1, 1 },
+    { "unmapped page", SCALE_FAULT_PROCESSES, -1,   -1,   900, -1,  -1, 1 },
+    { "module loop",   SCALE_FAULT_PROCESSES, -1,   -1,   -1,  123, -1, 0 },
+    { "thread loop",   SCALE_FAULT_PROCESSES, -1,   -1,   -1,  -1,  321, 0 },
+};
+
+// Reference UTF-16LE to UTF-8: no fast path, unpaired surrogates encoded
+// as themselves, like the decoder does
+static size_t utf16_reference(const uint16_t *w, size_t n, char *out) {
+    size_t i, o = 0;
+
+    for (i = 0; i < n; i++) {
+        uint32_t cp = w[i];
+
+        if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < n && w[i + 1] >= 0xdc00 && w[i + 1] < 0xe000) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (w[++i] - 0xdc00);
+        }
+        if (cp < 0x80) {
+            out[o++] = (char)cp;
+        } else if (cp < 0x800) {
+            out[o++] = (char)(0xc0 | (cp >> 6));
+            out[o++] = (char)(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out[o++] = (char)(0xe0 | (cp >> 12));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+            out[o++] = (char)(0x80 | (cp & 0x3f));
+        } else {
+            out[o++] = (char)(0xf0 | (cp >> 18));
+            out[o++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+            out[o++] = (char)(0x80 | (cp & 0x3f));
+        }
+    }
+    out[o] = '\0';
+    return o;
+}
+
+// Random module-like names: mostly ASCII runs, some Latin-1, CJK,
+// surrogate pairs and lone surrogates, decoded whole, into short buffers
+// (which must cut at a code point boundary) and into an arena
+static int check_utf16(void) {
+    static const uint16_t odd[] = { 0x00e9, 0x0416, 0x4e2d, 0xd83d, 0xde00, 0xdc00, 0xd800, 0xffff, 0x007f, 0x0080 };
+    win_arena_t arena;
+    uint16_t w[256];
+    char want[256 * 3 + 1], got[256 * 3 + 1];
+    size_t i, j, n, len, cut, total = 0;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL, start, ns;
+    int bad = 0;
+
+    win_arena_init(&arena);
+    start = gm_now_ns();
+    for (i = 0; i < SCALE_UTF16_STRINGS && bad < 5; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        n = (seed >> 33) % 257;
+        for (j = 0; j < n; j++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            // One string in four has no non-ASCII at all
+            if ((i & 3) == 0 || (seed >> 40) % 16 != 0) {
+                w[j] = (uint16_t)(0x20 + (seed >> 48) % 0x5f);
+            } else {
+                w[j] = odd[(seed >> 48) % (sizeof(odd) / sizeof(odd[0]))];
+            }
+        }
+        len = utf16_reference(w, n, want);
+        total += n;
+
+        if (win_utf16_to_utf8(w, n, got, sizeof(got)) != len || strcmp(got, want) != 0) {
+            printf("✗ UTF-16 string %zu (%zu units) decoded wrongly\n", i, n);
+            bad++;
+            continue;
+        }
+        cut = (seed >> 20) % (len + 2) + 1;
+        len = win_utf16_to_utf8(w, n, got, cut);
+        if (len >= cut || memcmp(got, want, len) != 0 || got[len] != '\0' ||
+            (want[len] != '\0' && ((want[len] & 0xc0) == 0x80 || len + 4 < cut))) {
+            printf("✗ UTF-16 string %zu cut at %zu bytes gave %zu\n", i, cut, len);
+            bad++;
+            continue;
+        }
+        {
+            char *s = win_arena_utf16(&arena, w, n);
+
+            if (!s || strcmp(s, want) != 0) {
+                printf("✗ UTF-16 string %zu wrong in the arena\n", i);
+                bad++;
+            }
+        }
+    }
+    ns = gm_now_ns() - start;
+
+    printf("%s %zu UTF-16 names (%zu code units) decoded in %.3f ms, %zu KiB of arena\n",
+           bad ? "✗" : "✓", i, total, ns / 1e6, arena.bytes / 1024);
+    win_arena_free(&arena);
+    return bad;
+}
+
+// Walk one image and compare against what the generator promised
+static int run_scenario(const scenario_t *sc, size_t large, int raw) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_process_list_t procs = {0};
+    win_process_detail_t *details = NULL;
+    size_t i, modules = 0, threads = 0, module_errors = 0, thread_errors = 0;
+    uint64_t start, walk_ns, detail_ns;
+    char path[64], label[64];
+    guest_mem_t *gm;
+    int bad = 0;
+
+    win_synth_defaults(&opts);
+    opts.processes = sc->processes ? sc->processes : large;
+    opts.raw = raw;
+    opts.loop_at = sc->loop_at;
+    opts.torn_at = sc->torn_at;
+    opts.unmapped_at = sc->unmapped_at;
+    opts.module_loop_at = sc->module_loop_at;
+    opts.thread_loop_at = sc->thread_loop_at;
+    snprintf(label, sizeof(label), "%s (%s)", sc->name, raw ? "raw" : "ELF core");
+    snprintf(path, sizeof(path), SCALE_IMAGE_DIR "/vmi-scale-%d.img", (int)getpid());
+
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ %s: could not write %s\n", label, path);
+        return 1;
+    }
+    gm = gm_open_image(path, 0);
+    unlink(path);               // the mapping keeps the data alive
+    if (!gm) {
+        printf("❌ %s: could not open the image\n", label);
+        return 1;
+    }
+    if (raw) gm_set_kernel_dtb(gm, info.dtb);
+    if (gm_kernel_dtb(gm) != info.dtb) {
+        printf("✗ %s: kernel DTB 0x%lx, expected 0x%lx\n", label, gm_kernel_dtb(gm), info.dtb);
+        bad++;
+    }
+
+    start = gm_now_ns();
+    win_walk_processes(gm, info.first_process, info.ps_active_process_head, &procs);
+    walk_ns = gm_now_ns() - start;
+
+    details = calloc(procs.count ? procs.count : 1, sizeof(*details));
+    start = gm_now_ns();
+    if (!details || win_walk_details_parallel(gm, &procs, win_default_workers(), details, NULL) != 0) {
+        printf("❌ %s: parallel walk failed\n", label);
+        bad++;
+    }
+    detail_ns = gm_now_ns() - start;
+
+    for (i = 0; details && i < procs.count; i++) {
+        if (procs.items[i].addr + win_profile_get()->eprocess_links == info.ps_active_process_head) {
+            printf("✗ %s: list head returned as process %zu\n", label, i);
+            bad++;
+        }
+        modules += details[i].modules.count;
+        threads += details[i].threads.count;
+        // System has no PEB, which the module walk reports
+        module_errors += i > 0 && details[i].modules.error != NULL;
+        thread_errors += details[i].threads.error != NULL;
+    }
+
+    if (procs.count != info.expect_processes) {
+        printf("✗ %s: %zu processes, expected %zu\n", label, procs.count, info.expect_processes);
+        bad++;
+    }
+    if (sc->expect_error != (procs.error != NULL)) {
+        printf("✗ %s: process walk error \"%s\"\n", label, procs.error ? procs.error : "none");
+        bad++;
+    }
+    if (modules != info.expect_modules || threads != info.expect_threads) {
+        printf("✗ %s: %zu modules, %zu threads, expected %zu and %zu\n",
+               label, modules, threads, info.expect_modules, info.expect_threads);
+        bad++;
+    }
+    if (module_errors != (sc->module_loop_at >= 0) || thread_errors != (sc->thread_loop_at >= 0)) {
+        printf("✗ %s: %zu module and %zu thread list errors\n", label, module_errors, thread_errors);
+        bad++;
+    }
+
+    printf("%s %s: %zu processes in %.3f ms (%.0f/s), %zu modules + %zu threads in %.3f ms\n",
+           bad ? "✗" : "✓", label, procs.count, walk_ns / 1e6,
+           walk_ns ? procs.count * 1e9 / walk_ns : 0.0, modules, threads, detail_ns / 1e6);
+    if (procs.error) printf("    stopped: %s\n", procs.error);
+
+    if (details) win_process_details_free(details, procs.count);
+    win_process_list_free(&procs);
+    gm_destroy(gm);
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    size_t large = SCALE_DEFAULT_PROCESSES, i;
+    char error[256];
+    int bad = 0, raw;
+
+    if (argc > 1) {
+        large = strtoul(argv[1], NULL, 0);
+        if (large == 0) {
+            printf("Usage: %s [PROCESSES]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("=== Walker Scale Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    printf("Structure profile: %s, %d workers\n", win_profile_get()->name, win_default_workers());
+
+    bad += check_utf16();
+    for (raw = 0; raw <= 1; raw++) {
+        for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+            bad += run_scenario(&scenarios[i], large, raw);
+        }
+    }
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ All walks matched\n");
+    return 0;
+}
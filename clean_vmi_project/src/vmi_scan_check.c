@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_parallel.h"
+#include "win_profile.h"
+#include "win_scan.h"
+#include "win_synth.h"
+
+// Self-check for cold-start kernel discovery (win_scan.h). Synthetic
+// images carry a KdVersionBlock and a KDBG in the kernel's data page;
+// the scan must find the kernel in raw and ELF images, after a KASLR
+// move, with the KDBG encoded, with one worker and with many, and must
+// come back empty-handed on memory without a kernel.
+
+#define SCAN_CHECK_DIR       "/dev/shm"
+#define SCAN_CHECK_MOVED_VA  0xfffff8052a400000ULL
+#define SCAN_CHECK_EMPTY     (16ULL << 20)
+
+static int bad = 0;
+
+static void expect(const char *what, const char *field, uint64_t got, uint64_t want) {
+    if (got != want) {
+        printf("✗ %s: %s 0x%llx, expected 0x%llx\n", what, field,
+               (unsigned long long)got, (unsigned long long)want);
+        bad++;
+    }
+}
+
+static uint64_t pa_of(guest_mem_t *gm, uint64_t va) {
+    uint64_t pa = 0;
+    gm_translate(gm, GM_KERNEL_DTB, va, &pa);
+    return pa;
+}
+
+static void report(const char *what, const win_scan_result_t *r) {
+    printf("✓ %s: kernel 0x%llx, %.1f MiB in %.3f ms with %d workers (%.2f GB/s)\n", what,
+           (unsigned long long)r->kernel_base, r->bytes / (1024.0 * 1024.0), r->ns / 1e6,
+           r->workers, r->ns ? r->bytes / (double)r->ns : 0.0);
+}
+
+static void scan_synth(const char *what, int raw, uint64_t kernel_va, int encoded, int workers) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_scan_result_t r;
+    guest_mem_t *gm;
+    char path[64];
+    int before = bad;
+
+    win_synth_defaults(&opts);
+    opts.processes = 20000;
+    opts.raw = raw;
+    opts.kernel_va = kernel_va;
+    opts.encoded_kdbg = encoded;
+    snprintf(path, sizeof(path), SCAN_CHECK_DIR "/vmi-scan-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+    gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    if (raw) gm_set_kernel_dtb(gm, info.dtb);
+
+    if (win_scan_kernel(gm, workers, &r) != 0) {
+        printf("✗ %s: kernel not found\n", what);
+        bad++;
+    }
+    expect(what, "kernel base", r.kernel_base, info.kernel_base);
+    expect(what, "kernel PE header", r.kernel_pa, pa_of(gm, info.kernel_base));
+    expect(what, "KdVersionBlock", r.kd_version_pa, pa_of(gm, info.kd_version_block));
+    expect(what, "PsLoadedModuleList", r.ps_loaded_module_list, info.ps_loaded_module_list);
+    expect(what, "KDBG", r.kdbg_pa, encoded ? 0 : pa_of(gm, info.kdbg));
+    expect(what, "PsActiveProcessHead", r.ps_active_process_head, encoded ? 0 : info.ps_active_process_head);
+    expect(what, "build", r.build, 19041);
+    expect(what, "bytes scanned", r.bytes, gm_phys_end(gm));
+    if (r.pe_images != 1 + opts.drivers) {
+        printf("✗ %s: %llu native images, expected %zu\n", what, (unsigned long long)r.pe_images,
+               1 + opts.drivers);
+        bad++;
+    }
+    if (bad == before) report(what, &r);
+    gm_destroy(gm);
+}
+
+// Zeroed RAM: nothing to find, but every byte is looked at
+static void scan_empty(int workers) {
+    win_scan_result_t r;
+    guest_mem_t *gm;
+    char path[64];
+    int fd;
+
+    snprintf(path, sizeof(path), SCAN_CHECK_DIR "/vmi-scan-empty-%d.img", (int)getpid());
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || ftruncate(fd, SCAN_CHECK_EMPTY) != 0) {
+        printf("❌ Could not write %s\n", path);
+        exit(1);
+    }
+    close(fd);
+    gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm) {
+        printf("❌ Could not open the image\n");
+        exit(1);
+    }
+    if (win_scan_kernel(gm, workers, &r) == 0 || r.kernel_base || r.bytes != SCAN_CHECK_EMPTY) {
+        printf("✗ empty RAM: kernel 0x%llx after %llu bytes, expected none after %llu\n",
+               (unsigned long long)r.kernel_base, (unsigned long long)r.bytes,
+               (unsigned long long)SCAN_CHECK_EMPTY);
+        bad++;
+    } else {
+        report("empty RAM", &r);
+    }
+    gm_destroy(gm);
+}
+
+int main(void) {
+    char error[256];
+    int workers = win_default_workers() > 4 ? win_default_workers() : 4;
+
+    printf("=== Kernel Scan Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    scan_synth("raw image", 1, 0, 0, workers);
+    scan_synth("ELF core", 0, 0, 0, workers);
+    scan_synth("one worker", 1, 0, 0, 1);
+    scan_synth("KASLR move", 1, SCAN_CHECK_MOVED_VA, 0, workers);
+    scan_synth("encoded KDBG", 1, 0, 1, workers);
+    scan_empty(workers);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Kernel found in every image\n");
+    return 0;
+}
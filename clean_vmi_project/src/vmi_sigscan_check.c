@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_profile.h"
+#include "win_sigscan.h"
+#include "win_synth.h"
+#include "win_synth_count.h"
+#include "win_vad.h"
+#include "win_walk.h"
+
+// Self-check for signature scans (win_sigscan.h). A synthetic image gives
+// every process a data region of zero, random and text pages with marks
+// planted in it, one of them across the middle page (which is also where
+// a span ends), plus VADs that were never touched and the code mark in
+// every module. Hundreds of patterns are cut out of the data, with
+// wildcards, some of them across page and span boundaries. Every mark
+// and every cut must be found, every hit must hold in memory, a plain
+// byte-by-byte search of a few processes must find exactly the same
+// hits, and one worker must agree with four. Through a backend that
+// counts its calls, pages must come in batches.
+
+#define SIGSCAN_CHECK_DIR        "/dev/shm"
+#define SIGSCAN_CHECK_PROCESSES  64
+#define SIGSCAN_CHECK_DATA_PAGES 512
+#define SIGSCAN_CHECK_CUTS       500
+#define SIGSCAN_CHECK_REFERENCE  3      // processes searched byte by byte
+#define SIGSCAN_CHECK_REF_CUTS   28     // cuts searched byte by byte
+
+static int bad = 0;
+
+typedef struct {
+    uint32_t target;
+    uint64_t va;
+    int pattern;
+} expect_t;
+
+typedef struct {
+    win_process_list_t procs;
+    win_sig_target_t *targets;
+    size_t count;
+    expect_t *expect;
+    size_t expect_count, expect_cap;
+} check_t;
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void expect_hit(check_t *c, uint32_t target, uint64_t va, int pattern) {
+    if (c->expect_count == c->expect_cap) {
+        c->expect_cap = c->expect_cap ? c->expect_cap * 2 : 1024;
+        c->expect = realloc(c->expect, c->expect_cap * sizeof(*c->expect));
+        if (!c->expect) {
+            printf("❌ Out of memory\n");
+            exit(1);
+        }
+    }
+    c->expect[c->expect_count].target = target;
+    c->expect[c->expect_count].va = va;
+    c->expect[c->expect_count].pattern = pattern;
+    c->expect_count++;
+}
+
+// Patterns as text, kept beside the set for the checks that re-read them
+static char **texts;
+static size_t text_count;
+
+static void keep_text(const char *pattern) {
+    texts = realloc(texts, (text_count + 1) * sizeof(*texts));
+    if (!texts || !(texts[text_count] = strdup(pattern))) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    text_count++;
+}
+
+static int add(win_sig_set_t *set, const char *name, const char *pattern) {
+    char error[256];
+    int id = win_sig_add(set, name, pattern, error, sizeof(error));
+
+    if (id < 0) {
+        printf("❌ Pattern %s rejected: %s\n", name, error);
+        exit(1);
+    }
+    keep_text(pattern);
+    return id;
+}
+
+// A pattern over len bytes of process i's data at va with one or two
+// bytes in it made wildcards, as for an operand that varies; -1 when the
+// bytes are too plain to stand for one place
+static int cut(check_t *c, guest_mem_t *gm, win_sig_set_t *set, size_t i, uint64_t va, size_t len) {
+    uint8_t bytes[64], seen[256] = {0};
+    char pattern[64 * 3 + 1], name[32];
+    size_t k, distinct = 0, hole, holes;
+    int id;
+
+    if (gm_read_va(gm, c->targets[i].dtb, va, bytes, len) != len) return -1;
+    for (k = 0; k < len; k++) distinct += !seen[bytes[k]]++;
+    if (distinct < 6) return -1;
+    hole = next_random() % (len - 1);
+    holes = 1 + next_random() % 2;
+    for (k = 0; k < len; k++) {
+        if (k >= hole && k < hole + holes) memcpy(pattern + k * 3, "?? ", 3);
+        else snprintf(pattern + k * 3, 4, "%02x ", bytes[k]);
+    }
+    pattern[len * 3 - 1] = '\0';
+    snprintf(name, sizeof(name), "cut%zu", win_sig_count(set));
+    id = add(set, name, pattern);
+    expect_hit(c, (uint32_t)i, va, id);
+    return id;
+}
+
+// Marks, cuts out of the data and a pattern that is nowhere
+static win_sig_set_t *build_set(check_t *c, guest_mem_t *gm, const win_synth_opts_t *opts) {
+    const uint64_t span = (uint64_t)WIN_SIG_SPAN_PAGES * GM_PAGE_SIZE;
+    win_sig_set_t *set = win_sig_set_create();
+    int ascii, wide, code, cuts = 0, tries = 0;
+    size_t i, j;
+
+    if (!set) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    ascii = add(set, "mark", "\"" WIN_SYNTH_SIG_DATA "\"");
+    wide = add(set, "mark_wide", "w\"" WIN_SYNTH_SIG_DATA "\"");
+    code = add(set, "code", WIN_SYNTH_SIG_CODE);
+    add(set, "absent", "de ad ?? ef 0b ad f0 0d 5a 5a ?? 99");
+
+    for (i = 0; i < c->count; i++) {
+        win_module_list_t mods = {0};
+        win_synth_data_t d;
+
+        win_synth_data(opts, i, &d);
+        expect_hit(c, (uint32_t)i, d.ascii, ascii);
+        expect_hit(c, (uint32_t)i, d.wide, wide);
+        win_walk_modules(gm, &c->procs.items[i], &mods);
+        for (j = 0; j < mods.count; j++) {
+            expect_hit(c, (uint32_t)i, mods.items[j].base + WIN_SYNTH_SIG_CODE_RVA, code);
+        }
+        win_module_list_free(&mods);
+    }
+
+    // The first cuts come from the processes searched byte by byte; one
+    // in three straddles a page end, one in three a span end
+    while (cuts < SIGSCAN_CHECK_CUTS && tries++ < SIGSCAN_CHECK_CUTS * 20) {
+        size_t proc = cuts < SIGSCAN_CHECK_REF_CUTS ? (size_t)cuts % SIGSCAN_CHECK_REFERENCE
+                                                    : (size_t)(next_random() % c->count);
+        size_t len = 16 + next_random() % 33;
+        size_t page = next_random() % SIGSCAN_CHECK_DATA_PAGES;
+        win_synth_data_t d;
+        uint64_t va;
+
+        win_synth_data(opts, proc, &d);
+        switch (cuts % 3) {
+        case 0:
+            va = d.va + page * GM_PAGE_SIZE + next_random() % (GM_PAGE_SIZE - len);
+            break;
+        case 1:
+            va = d.va + (page ? page : 1) * GM_PAGE_SIZE - 1 - next_random() % (len - 1);
+            break;
+        default:
+            va = d.va + span - 1 - next_random() % (len - 1);
+            break;
+        }
+        if (cut(c, gm, set, proc, va, len) >= 0) cuts++;
+    }
+    if (cuts < SIGSCAN_CHECK_CUTS) {
+        printf("✗ Only %d patterns could be cut out of the data\n", cuts);
+        bad++;
+    }
+    if (win_sig_compile(set) != 0) {
+        printf("❌ Could not compile %zu patterns\n", win_sig_count(set));
+        exit(1);
+    }
+    printf("✓ %zu patterns compiled into %zu states\n", win_sig_count(set), win_sig_states(set));
+    return set;
+}
+
+static int hit_at(const win_sig_result_t *r, uint32_t target, uint64_t va, int pattern) {
+    size_t lo = 0, hi = r->count;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const win_sig_hit_t *h = &r->items[mid];
+
+        if (h->target < target || (h->target == target && (h->va < va ||
+                                   (h->va == va && h->pattern < (uint32_t)pattern)))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < r->count && r->items[lo].target == target && r->items[lo].va == va &&
+           r->items[lo].pattern == (uint32_t)pattern;
+}
+
+// Pattern id against memory at va: bytes and wildcards as parsed
+static int matches(guest_mem_t *gm, uint64_t dtb, uint64_t va, const uint8_t *bytes, const uint8_t *mask,
+                   size_t len) {
+    uint8_t mem[WIN_SIG_MAX_LEN];
+    size_t k;
+
+    if (gm_read_va(gm, dtb, va, mem, len) != len) return 0;
+    for (k = 0; k < len; k++) {
+        if ((mem[k] ^ bytes[k]) & mask[k]) return 0;
+    }
+    return 1;
+}
+
+// The bytes and mask of a pattern from its hex text or quoted string
+static size_t pattern_bytes(const char *text, uint8_t *bytes, uint8_t *mask) {
+    size_t n = 0;
+
+    if (text[0] == '"' || text[0] == 'w') {
+        int wide = text[0] == 'w';
+        const char *p = text + 1 + wide;
+
+        for (; *p != '"'; p++) {
+            bytes[n] = (uint8_t)*p;
+            mask[n++] = 0xff;
+            if (wide) {
+                bytes[n] = 0;
+                mask[n++] = 0xff;
+            }
+        }
+        return n;
+    }
+    for (;; text += 3) {
+        unsigned v = 0;
+
+        if (text[0] == '?') {
+            bytes[n] = 0;
+            mask[n++] = 0;
+        } else {
+            sscanf(text, "%2x", &v);
+            bytes[n] = (uint8_t)v;
+            mask[n++] = 0xff;
+        }
+        if (!text[2]) return n;
+    }
+}
+
+typedef struct {
+    uint8_t bytes[WIN_SIG_MAX_LEN], mask[WIN_SIG_MAX_LEN];
+    size_t len;
+} plain_t;
+
+// Every expected hit found, every hit true of memory
+static void check_hits(check_t *c, guest_mem_t *gm, const win_sig_result_t *r) {
+    size_t i, missing = 0, wrong = 0;
+
+    for (i = 0; i < c->expect_count; i++) {
+        if (!hit_at(r, c->expect[i].target, c->expect[i].va, c->expect[i].pattern)) {
+            if (missing++ < 5) {
+                printf("  missing: process %u 0x%llx %s\n", c->expect[i].target,
+                       (unsigned long long)c->expect[i].va, texts[c->expect[i].pattern]);
+            }
+        }
+    }
+    for (i = 0; i < r->count; i++) {
+        const win_sig_hit_t *h = &r->items[i];
+        uint8_t bytes[WIN_SIG_MAX_LEN], mask[WIN_SIG_MAX_LEN];
+        size_t len = pattern_bytes(texts[h->pattern], bytes, mask);
+
+        if (!matches(gm, c->targets[h->target].dtb, h->va, bytes, mask, len)) wrong++;
+        if (h->pattern == 3) wrong++;
+    }
+    if (missing || wrong || r->error) {
+        printf("✗ %zu of %zu expected hits missing, %zu of %zu hits not in memory (%s)\n", missing,
+               c->expect_count, wrong, r->count, r->error ? r->error : "no error");
+        bad++;
+    } else {
+        printf("✓ %zu marks and cuts found among %zu hits, every hit matches memory\n",
+               c->expect_count, r->count);
+    }
+}
+
+// A byte-by-byte search of the first processes for the marks and the
+// first cuts; the scan must report exactly these
+static void check_reference(check_t *c, guest_mem_t *gm, const win_sig_result_t *r) {
+    size_t patterns = 4 + SIGSCAN_CHECK_REF_CUTS, found = 0, missed = 0, reported = 0, i, k, p;
+    plain_t *plain = calloc(patterns, sizeof(*plain));
+    uint8_t *run = NULL;
+
+    if (!plain) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    for (p = 0; p < patterns; p++) plain[p].len = pattern_bytes(texts[p], plain[p].bytes, plain[p].mask);
+
+    for (i = 0; i < SIGSCAN_CHECK_REFERENCE; i++) {
+        const win_sig_ranges_t *ranges = &c->targets[i].ranges;
+
+        for (k = 0; k < ranges->count; k++) {
+            uint64_t start = ranges->items[k].start, end = ranges->items[k].end, va;
+
+            run = realloc(run, end - start);
+            if (!run) {
+                printf("❌ Out of memory\n");
+                exit(1);
+            }
+            // Runs of pages that translate, searched whole
+            for (va = start; va < end;) {
+                uint64_t from = va;
+                size_t len = 0, at;
+
+                while (va < end && gm_read_va(gm, c->targets[i].dtb, va, run + len, GM_PAGE_SIZE) == GM_PAGE_SIZE) {
+                    va += GM_PAGE_SIZE;
+                    len += GM_PAGE_SIZE;
+                }
+                if (!len) {
+                    va += GM_PAGE_SIZE;
+                    continue;
+                }
+                for (p = 0; p < patterns; p++) {
+                    for (at = 0; at + plain[p].len <= len; at++) {
+                        size_t b;
+                        for (b = 0; b < plain[p].len && !((run[at + b] ^ plain[p].bytes[b]) & plain[p].mask[b]); b++) {}
+                        if (b < plain[p].len) continue;
+                        found++;
+                        if (!hit_at(r, (uint32_t)i, from + at, (int)p)) missed++;
+                    }
+                }
+            }
+        }
+    }
+    // The scan may not report more for these processes and patterns
+    for (i = 0; i < r->count; i++) {
+        if (r->items[i].target < SIGSCAN_CHECK_REFERENCE && r->items[i].pattern < patterns) reported++;
+    }
+    if (missed || reported != found) {
+        printf("✗ Byte-by-byte search: %zu hits, %zu of them not reported, scan reported %zu\n", found, missed,
+               reported);
+        bad++;
+    } else {
+        printf("✓ Byte-by-byte search of %d processes for %zu patterns agrees: %zu hits\n",
+               SIGSCAN_CHECK_REFERENCE, patterns, found);
+    }
+    free(run);
+    free(plain);
+}
+
+static void check_workers(const win_sig_result_t *one, const win_sig_result_t *four) {
+    if (one->count != four->count || one->bytes != four->bytes || one->absent != four->absent ||
+        (one->count && memcmp(one->items, four->items, one->count * sizeof(*one->items)) != 0)) {
+        printf("✗ 1 worker: %zu hits, %llu bytes; 4 workers: %zu hits, %llu bytes\n", one->count,
+               (unsigned long long)one->bytes, four->count, (unsigned long long)four->bytes);
+        bad++;
+    } else {
+        printf("✓ 1 and 4 workers agree: %zu hits, %llu MiB scanned, %llu pages not resident\n", one->count,
+               (unsigned long long)(one->bytes >> 20), (unsigned long long)one->absent);
+    }
+    if (!one->absent) {
+        printf("✗ No page was found missing; the untouched VADs should be\n");
+        bad++;
+    }
+}
+
+static void check_batched(check_t *c, guest_mem_t *img, const win_synth_info_t *info, const win_sig_set_t *set,
+                          const win_sig_result_t *want) {
+    win_synth_counter_t counter;
+    win_sig_result_t r;
+    uint64_t scanned;
+
+    if (win_synth_count_open(&counter, img, info) != 0) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    if (win_sig_scan(counter.gm, set, c->targets, c->count, 4, &r) != 0 || r.count != want->count ||
+        (r.count && memcmp(r.items, want->items, r.count * sizeof(*r.items)) != 0)) {
+        printf("✗ Through the counting backend: %zu hits, expected %zu\n", r.count, want->count);
+        bad++;
+    } else {
+        scanned = r.bytes >> GM_PAGE_SHIFT;
+        if (!win_synth_count_ok(&counter, scanned, 16, "pages scanned")) {
+            bad++;
+        } else {
+            printf("✓ %llu pages scanned in %llu backend calls (%llu pages read)\n", (unsigned long long)scanned,
+                   (unsigned long long)counter.calls, (unsigned long long)counter.pages);
+        }
+    }
+    win_sig_result_free(&r);
+    win_synth_count_close(&counter);
+}
+
+// Patterns that must not compile, and a file of them
+static void check_parse(void) {
+    static const char *const wrong[] = {
+        "", "?? ??", "4", "48 8g", "\"open", "\"text\" 00", "w\"x", "\"\\x4\"",
+    };
+    win_sig_set_t *set = win_sig_set_create();
+    char error[256], path[64];
+    size_t i, rejected = 0;
+    FILE *f;
+    int n;
+
+    for (i = 0; i < sizeof(wrong) / sizeof(wrong[0]); i++) {
+        error[0] = '\0';
+        if (win_sig_add(set, NULL, wrong[i], error, sizeof(error)) < 0 && error[0]) rejected++;
+    }
+    snprintf(path, sizeof(path), SIGSCAN_CHECK_DIR "/vmi-sigs-%d.txt", (int)getpid());
+    f = fopen(path, "w");
+    if (f) {
+        fprintf(f, "# comment\n\nfirst 48 8b ??\nsecond \"two words\"\nthird zz\n");
+        fclose(f);
+    }
+    n = win_sig_load(set, path, error, sizeof(error));
+    unlink(path);
+    if (rejected != sizeof(wrong) / sizeof(wrong[0]) || n != -1 || !strstr(error, ":5:") ||
+        win_sig_count(set) != 2 || strcmp(win_sig_name(set, 1), "second") != 0 || win_sig_length(set, 1) != 9) {
+        printf("✗ Parsing: %zu of %zu bad patterns rejected, file gave %d (%s)\n", rejected,
+               sizeof(wrong) / sizeof(wrong[0]), n, error);
+        bad++;
+    } else {
+        printf("✓ %zu malformed patterns rejected, file error names its line\n", rejected);
+    }
+    win_sig_set_destroy(set);
+}
+
+int main(void) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    win_sig_result_t one, four;
+    win_sig_set_t *set;
+    check_t c;
+    guest_mem_t *gm;
+    char path[64], error[256];
+    size_t i;
+
+    printf("=== Signature Scan Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    check_parse();
+
+    win_synth_defaults(&opts);
+    opts.processes = SIGSCAN_CHECK_PROCESSES;
+    opts.modules = 4;
+    opts.threads = 1;
+    opts.raw = 1;
+    opts.vads = 8;
+    opts.data_pages = SIGSCAN_CHECK_DATA_PAGES;
+    snprintf(path, sizeof(path), SIGSCAN_CHECK_DIR "/vmi-sigscan-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        return 1;
+    }
+    gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm) {
+        printf("❌ Could not open the image\n");
+        return 1;
+    }
+    gm_set_kernel_dtb(gm, info.dtb);
+
+    // One target per process: its VADs and its modules
+    memset(&c, 0, sizeof(c));
+    win_walk_processes(gm, info.first_process, info.ps_active_process_head, &c.procs);
+    c.count = c.procs.count;
+    c.targets = calloc(c.count ? c.count : 1, sizeof(*c.targets));
+    if (!c.targets) {
+        printf("❌ Out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < c.count; i++) {
+        win_vad_map_t vads = {0};
+        win_module_list_t mods = {0};
+
+        win_walk_vads(gm, &c.procs.items[i], 0, &vads);
+        win_walk_modules(gm, &c.procs.items[i], &mods);
+        if (win_sig_target_process(&c.targets[i], &c.procs.items[i], &vads, &mods) != 0) {
+            printf("❌ Out of memory\n");
+            return 1;
+        }
+        win_vad_map_free(&vads);
+        win_module_list_free(&mods);
+    }
+
+    set = build_set(&c, gm, &opts);
+
+    if (win_sig_scan(gm, set, c.targets, c.count, 1, &one) != 0 ||
+        win_sig_scan(gm, set, c.targets, c.count, 4, &four) != 0) {
+        printf("❌ Scan did not run\n");
+        return 1;
+    }
+    check_hits(&c, gm, &one);
+    check_reference(&c, gm, &one);
+    check_workers(&one, &four);
+    check_batched(&c, gm, &info, set, &one);
+    printf("✓ Scanned %.1f MiB in %.3f ms with 1 worker: %.2f GB/s\n", one.bytes / 1048576.0, one.ns / 1e6,
+           one.ns ? one.bytes / (double)one.ns : 0.0);
+
+    win_sig_result_free(&one);
+    win_sig_result_free(&four);
+    win_sig_set_destroy(set);
+    for (i = 0; i < c.count; i++) win_sig_ranges_free(&c.targets[i].ranges);
+    for (i = 0; i < text_count; i++) free(texts[i]);
+    free(texts);
+    free(c.targets);
+    free(c.expect);
+    win_process_list_free(&c.procs);
+    gm_destroy(gm);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every signature found\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_profile.h"
+#include "win_symcache.h"
+#include "win_synth.h"
+
+// Self-check for the kernel symbol cache (win_symcache.h). Synthetic
+// images carry a kernel PE header with a CodeView record; the check
+// learns symbols from one image, then opens images standing in for a
+// second run, a KASLR reboot and a kernel update, and verifies what the
+// cache answers and how many guest reads its validation costs.
+
+#define SYMCACHE_CHECK_DIR   "/dev/shm"
+#define SYMCACHE_CHECK_GUID  "3844DBB920174967BE7AA4A2C20430FA"
+#define SYMCACHE_REBOOT_VA   0xfffff80312000000ULL
+
+static char cache_path[64];
+static int bad = 0;
+
+typedef struct {
+    guest_mem_t *gm;
+    win_synth_info_t info;
+} image_t;
+
+static int open_image(image_t *img, uint64_t kernel_va, uint32_t age) {
+    win_synth_opts_t opts;
+    char path[64];
+
+    win_synth_defaults(&opts);
+    opts.processes = 16;
+    opts.raw = 1;
+    opts.kernel_va = kernel_va;
+    opts.pdb_age = age;
+    snprintf(path, sizeof(path), SYMCACHE_CHECK_DIR "/vmi-symcache-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &img->info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        return -1;
+    }
+    img->gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!img->gm) {
+        printf("❌ Could not open the image\n");
+        return -1;
+    }
+    gm_set_kernel_dtb(img->gm, img->info.dtb);
+    return 0;
+}
+
+static void expect_symbol(win_symcache_t *c, const char *what, const char *name, int hit, uint64_t want) {
+    uint64_t va = 0;
+    int ret = win_symcache_lookup(c, name, 0, &va);
+
+    if ((ret == 0) != hit || (hit && va != want)) {
+        printf("✗ %s: %s %s 0x%llx, expected %s 0x%llx\n", what, name, ret == 0 ? "hit" : "miss",
+               (unsigned long long)va, hit ? "hit" : "miss", (unsigned long long)want);
+        bad++;
+    }
+}
+
+// Open the cache against an image and validate it
+static win_symcache_t *run(const char *what, image_t *img, uint64_t hint, int expect_valid) {
+    win_symcache_t *c = win_symcache_open(cache_path, "synth");
+    uint64_t reads = gm_get_stats(img->gm)->va_reads, start = gm_now_ns(), ns;
+    int ret;
+
+    if (!c) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    ret = win_symcache_validate(c, img->gm, hint);
+    ns = gm_now_ns() - start;
+    reads = gm_get_stats(img->gm)->va_reads - reads;
+    if ((ret == 0) != expect_valid) {
+        printf("✗ %s: cache %s, expected %s\n", what, ret == 0 ? "valid" : "invalid",
+               expect_valid ? "valid" : "invalid");
+        bad++;
+    } else {
+        printf("✓ %s: cache %s after %llu reads in %.3f ms\n", what, ret == 0 ? "valid" : "invalid",
+               (unsigned long long)reads, ns / 1e6);
+    }
+    return c;
+}
+
+// Resolve the two list symbols "the slow way" and record them
+static void learn(win_symcache_t *c, const char *what, image_t *img) {
+    if (win_symcache_learn(c, img->gm, "PsActiveProcessHead", img->info.ps_active_process_head) != 0 ||
+        win_symcache_learn(c, img->gm, "PsInitialSystemProcess", img->info.ps_initial_system_process) != 0) {
+        printf("✗ %s: symbols not learned\n", what);
+        bad++;
+    }
+    if (win_symcache_kernel_base(c) != img->info.kernel_base) {
+        printf("✗ %s: kernel base 0x%llx, expected 0x%llx\n", what,
+               (unsigned long long)win_symcache_kernel_base(c), (unsigned long long)img->info.kernel_base);
+        bad++;
+    }
+    if (win_symcache_save(c) != 0) {
+        printf("❌ Could not write %s\n", cache_path);
+        exit(1);
+    }
+}
+
+static void expect_both(win_symcache_t *c, const char *what, const image_t *img, int hit) {
+    expect_symbol(c, what, "PsActiveProcessHead", hit, img->info.ps_active_process_head);
+    expect_symbol(c, what, "PsInitialSystemProcess", hit, img->info.ps_initial_system_process);
+}
+
+static void done(win_symcache_t *c, image_t *img) {
+    if (win_symcache_save(c) != 0) {
+        printf("❌ Could not write %s\n", cache_path);
+        exit(1);
+    }
+    win_symcache_close(c);
+    gm_destroy(img->gm);
+}
+
+int main(void) {
+    char error[256];
+    image_t img;
+    win_symcache_t *c;
+    win_pdb_id_t id;
+    FILE *f;
+
+    printf("=== Symbol Cache Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+    snprintf(cache_path, sizeof(cache_path), SYMCACHE_CHECK_DIR "/vmi-symcache-%d", (int)getpid());
+    unlink(cache_path);
+
+    // First run: nothing cached, the kernel is identified while learning
+    if (open_image(&img, 0, 1) != 0) return 1;
+    if (win_pe_debug_id(img.gm, img.info.kernel_base, &id) != 0 ||
+        strcmp(id.guid, SYMCACHE_CHECK_GUID) != 0 || id.age != 1 || strcmp(id.pdb, "ntkrnlmp.pdb") != 0) {
+        printf("✗ kernel debug id %s age %u (%s), expected %s age 1\n",
+               id.guid, id.age, id.pdb, SYMCACHE_CHECK_GUID);
+        bad++;
+    }
+    c = run("cold start", &img, 0, 0);
+    expect_both(c, "cold start", &img, 0);
+    learn(c, "cold start", &img);
+    done(c, &img);
+
+    // Second run, same boot
+    if (open_image(&img, 0, 1) != 0) return 1;
+    c = run("warm start", &img, 0, 1);
+    expect_both(c, "warm start", &img, 1);
+    done(c, &img);
+
+    // KASLR reboot: the old base is empty, a hint inside the image finds it
+    if (open_image(&img, SYMCACHE_REBOOT_VA, 1) != 0) return 1;
+    c = run("reboot without hint", &img, 0, 0);
+    win_symcache_close(c);
+    c = run("reboot", &img, img.info.ps_initial_system_process, 1);
+    expect_both(c, "reboot", &img, 1);
+    done(c, &img);
+    if (open_image(&img, SYMCACHE_REBOOT_VA, 1) != 0) return 1;
+    c = run("after reboot", &img, 0, 1);
+    expect_both(c, "after reboot", &img, 1);
+    done(c, &img);
+
+    // Kernel update: a different build at the old base must not match
+    if (open_image(&img, 0, 2) != 0) return 1;
+    c = run("kernel update", &img, img.info.ps_initial_system_process, 0);
+    expect_both(c, "kernel update", &img, 0);
+    learn(c, "kernel update", &img);
+    done(c, &img);
+    if (open_image(&img, 0, 2) != 0) return 1;
+    c = run("updated kernel", &img, 0, 1);
+    expect_both(c, "updated kernel", &img, 1);
+    done(c, &img);
+
+    // A damaged file is an empty cache
+    f = fopen(cache_path, "w");
+    if (f) {
+        fputs("symbol\nbase zz\n\x01\x02garbage 0x\n", f);
+        fclose(f);
+    }
+    if (open_image(&img, 0, 2) != 0) return 1;
+    c = run("damaged file", &img, 0, 0);
+    expect_both(c, "damaged file", &img, 0);
+    win_symcache_close(c);
+    gm_destroy(img.gm);
+    unlink(cache_path);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ All cache lookups matched\n");
+    return 0;
+}
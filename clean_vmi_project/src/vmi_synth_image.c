@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "win_profile.h"
+#include "win_synth.h"
+
+// Synthetic guest image tool. Writes a Windows-shaped memory image that
+// the inspectors can open with --image, for trying the walkers at scales
+// and on corruptions no test VM provides.
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] OUTPUT\n", prog);
+    printf("  -n N              processes, including System (default 1000)\n");
+    printf("  -m N              modules per process (default 4)\n");
+    printf("  -t N              threads per process (default 4)\n");
+    printf("  -d N              drivers besides the kernel (default 2)\n");
+    printf("  -H N              handles per process (default 0)\n");
+    printf("  --heavy I N       process I has N handles instead\n");
+    printf("  -V N              VADs per process (default 0)\n");
+    printf("  --heavy-vads I N  process I has N VADs instead\n");
+    printf("  --vad-loop I      VAD tree of process I links back to its root\n");
+    printf("  -D N              pages of private data per process, with marks (default 0)\n");
+    printf("  --raw             raw dump instead of an ELF core\n");
+    printf("  --loop I          process I links back into the list\n");
+    printf("  --torn I          process I links to unmapped memory\n");
+    printf("  --unmapped I      process I sits on an unmapped page\n");
+    printf("  --module-loop I   module list of process I loops\n");
+    printf("  --thread-loop I   thread list of process I loops\n");
+    printf("  --unlinked I      process I is unlinked from the list (DKOM)\n");
+    printf("  --exited I        process I exited (unlinked, no threads)\n");
+    printf("  --kernel-va VA    kernel image base, as after a KASLR reboot\n");
+    printf("  --pdb-age N       CodeView age of the kernel, i.e. another build\n");
+    printf("  --encoded-kdbg    scramble the KDBG, as without a kernel debugger\n");
+    printf("  --profile FILE    ISF profile for the structure layout\n");
+}
+
+static int parse_count(const char *text, size_t *out) {
+    char *end;
+    unsigned long long v;
+
+    errno = 0;
+    v = strtoull(text, &end, 0);
+    if (errno || *end || end == text) return -1;
+    *out = (size_t)v;
+    return 0;
+}
+
+static int parse_index(const char *text, long *out) {
+    size_t v;
+    if (parse_count(text, &v) != 0) return -1;
+    *out = (long)v;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    const char *output = NULL, *profile = NULL;
+    char error[256];
+    int i, bad = 0;
+
+    win_synth_defaults(&opts);
+
+    for (i = 1; i < argc; i++) {
+        const char *next = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            opts.raw = 1;
+        } else if (strcmp(argv[i], "-n") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.processes);
+        } else if (strcmp(argv[i], "-m") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.modules);
+        } else if (strcmp(argv[i], "-t") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.threads);
+        } else if (strcmp(argv[i], "-d") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.drivers);
+        } else if (strcmp(argv[i], "-H") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.handles);
+        } else if (strcmp(argv[i], "--heavy") == 0 && next && i + 2 < argc) {
+            bad |= parse_index(argv[++i], &opts.heavy_at);
+            bad |= parse_count(argv[++i], &opts.heavy_handles);
+        } else if (strcmp(argv[i], "-V") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.vads);
+        } else if (strcmp(argv[i], "--heavy-vads") == 0 && next && i + 2 < argc) {
+            bad |= parse_index(argv[++i], &opts.heavy_at);
+            bad |= parse_count(argv[++i], &opts.heavy_vads);
+        } else if (strcmp(argv[i], "--vad-loop") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.vad_loop_at);
+        } else if (strcmp(argv[i], "-D") == 0 && next) {
+            bad |= parse_count(argv[++i], &opts.data_pages);
+        } else if (strcmp(argv[i], "--loop") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.loop_at);
+        } else if (strcmp(argv[i], "--torn") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.torn_at);
+        } else if (strcmp(argv[i], "--unmapped") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.unmapped_at);
+        } else if (strcmp(argv[i], "--module-loop") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.module_loop_at);
+        } else if (strcmp(argv[i], "--thread-loop") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.thread_loop_at);
+        } else if (strcmp(argv[i], "--unlinked") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.unlinked_at);
+        } else if (strcmp(argv[i], "--exited") == 0 && next) {
+            bad |= parse_index(argv[++i], &opts.exited_at);
+        } else if (strcmp(argv[i], "--kernel-va") == 0 && next) {
+            opts.kernel_va = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--pdb-age") == 0 && next) {
+            opts.pdb_age = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--encoded-kdbg") == 0) {
+            opts.encoded_kdbg = 1;
+        } else if (strcmp(argv[i], "--profile") == 0 && next) {
+            profile = argv[++i];
+        } else if (argv[i][0] == '-' || output) {
+            bad = 1;
+        } else {
+            output = argv[i];
+        }
+    }
+    if (bad || !output || opts.processes == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (win_profile_select(profile, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    if (win_synth_write(output, &opts, &info) != 0) {
+        printf("❌ Failed to write %s: %s\n", output, strerror(errno));
+        return 1;
+    }
+
+    printf("image: %s (%s, %.1f MiB)\n", output, opts.raw ? "raw" : "ELF core",
+           info.image_size / (1024.0 * 1024.0));
+    printf("dtb: 0x%llx\n", (unsigned long long)info.dtb);
+    printf("kernel_base: 0x%llx\n", (unsigned long long)info.kernel_base);
+    printf("ps_active_process_head: 0x%llx\n", (unsigned long long)info.ps_active_process_head);
+    printf("ps_initial_system_process: 0x%llx\n", (unsigned long long)info.ps_initial_system_process);
+    printf("ps_loaded_module_list: 0x%llx\n", (unsigned long long)info.ps_loaded_module_list);
+    printf("kd_version_block: 0x%llx\n", (unsigned long long)info.kd_version_block);
+    printf("kdbg: 0x%llx\n", (unsigned long long)info.kdbg);
+    printf("first_process: 0x%llx\n", (unsigned long long)info.first_process);
+    printf("ob_type_index_table: 0x%llx\n", (unsigned long long)info.ob_type_index_table);
+    printf("ob_header_cookie: 0x%llx\n", (unsigned long long)info.ob_header_cookie);
+    printf("expect_processes: %zu\n", info.expect_processes);
+    printf("expect_modules: %zu\n", info.expect_modules);
+    printf("expect_threads: %zu\n", info.expect_threads);
+    printf("expect_drivers: %zu\n", info.expect_drivers);
+    printf("expect_handles: %zu\n", info.expect_handles);
+    printf("expect_vads: %zu\n", info.expect_vads);
+
+    printf("\n# Walk it with\n");
+    printf("vmi_complete_inspector --image %s", output);
+    if (opts.raw) printf(" --dtb 0x%llx", (unsigned long long)info.dtb);
+    if (profile) printf(" --profile %s", profile);
+    printf(" --ps-head 0x%llx --all", (unsigned long long)info.ps_active_process_head);
+    if (info.expect_handles) printf(" --handles --type-table 0x%llx", (unsigned long long)info.ob_type_index_table);
+    if (info.expect_vads) printf(" --vads");
+    if (opts.data_pages) {
+        printf(" --sig '\"%s\"' --sig 'w\"%s\"' --sig '%s'", WIN_SYNTH_SIG_DATA, WIN_SYNTH_SIG_DATA, WIN_SYNTH_SIG_CODE);
+    }
+    printf("\n");
+    return 0;
+}
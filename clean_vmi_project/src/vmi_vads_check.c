@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "guest_mem.h"
+#include "win_parallel.h"
+#include "win_profile.h"
+#include "win_synth.h"
+#include "win_synth_count.h"
+#include "win_vad.h"
+#include "win_walk.h"
+
+// Self-check for the VAD walker (win_vad.h). A synthetic image gives
+// every process a VAD tree of private regions and views of mapped files,
+// one process tens of thousands of them, and one a tree whose last node
+// links back to the root. Every region must come back in address order
+// with its protection, type and file; lookups must find each region by
+// its first and last byte and nothing in the gaps; the looping tree must
+// end with an error and every region still found. Through a backend that
+// counts its calls, the big tree must cost a few backend calls per
+// thousand regions, and the all-process pass must match the single walks.
+
+#define VADS_CHECK_DIR        "/dev/shm"
+#define VADS_CHECK_PROCESSES  1000
+#define VADS_CHECK_PER_PROC   64
+#define VADS_CHECK_HEAVY      20000
+#define VADS_CHECK_LOOP       3
+
+static int bad = 0;
+
+static int by_start(const void *a, const void *b) {
+    const win_synth_vad_t *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// What process i's map should hold, in address order
+static win_synth_vad_t *expected(const win_synth_opts_t *opts, size_t i, size_t *n) {
+    win_synth_vad_t *want;
+    size_t k;
+
+    *n = win_synth_vad_count(opts, i);
+    want = calloc(*n ? *n : 1, sizeof(*want));
+    if (!want) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    for (k = 0; k < *n; k++) win_synth_vad(opts, i, k, &want[k]);
+    qsort(want, *n, sizeof(*want), by_start);
+    return want;
+}
+
+// Rows of process i against the image; returns mismatches
+static int check_map(const win_synth_opts_t *opts, size_t i, const win_vad_map_t *map) {
+    size_t n, k;
+    win_synth_vad_t *want = expected(opts, i, &n);
+    int wrong = 0;
+
+    if (map->count != n || (map->error != NULL) != ((long)i == opts->vad_loop_at)) {
+        printf("✗ Process %zu: %zu regions, expected %zu (%s)\n", i, map->count, n,
+               map->error ? map->error : "no error");
+        wrong = 1;
+    }
+    for (k = 0; !wrong && k < n; k++) {
+        const win_vad_t *v = &map->items[k];
+        const char *file = v->file ? v->file : "";
+
+        if (v->start != want[k].start || v->end != want[k].end || v->protection != want[k].protection ||
+            v->type != want[k].type || v->private_memory != want[k].private_memory ||
+            strcmp(file, want[k].file) != 0) {
+            printf("✗ Process %zu region %zu: 0x%llx-0x%llx prot 0x%x type %u private %u \"%s\", "
+                   "expected 0x%llx-0x%llx 0x%x %u %u \"%s\"\n", i, k,
+                   (unsigned long long)v->start, (unsigned long long)v->end, v->protection, v->type,
+                   v->private_memory, file, (unsigned long long)want[k].start,
+                   (unsigned long long)want[k].end, want[k].protection, want[k].type,
+                   want[k].private_memory, want[k].file);
+            wrong = 1;
+        }
+    }
+    free(want);
+    return wrong;
+}
+
+// Every region by its first and last byte, nothing just past it
+static void check_lookups(const win_vad_map_t *map) {
+    size_t k, wrong = 0, executable = 0;
+
+    for (k = 0; k < map->count; k++) {
+        const win_vad_t *v = &map->items[k];
+        if (win_vad_lookup(map, v->start) != v || win_vad_lookup(map, v->end - 1) != v ||
+            win_vad_lookup(map, v->end) != NULL) {
+            wrong++;
+        }
+        if (v->private_memory && win_vad_executable(v->protection) && win_vad_writable(v->protection)) {
+            executable++;
+        }
+    }
+    if (win_vad_lookup(map, 0) != NULL) wrong++;
+    if (wrong || executable != (map->count + 3) / 8) {
+        printf("✗ Lookups: %zu wrong, %zu private RWX regions\n", wrong, executable);
+        bad++;
+    } else {
+        printf("✓ %zu regions found by first and last byte, gaps empty, %zu private RWX\n",
+               map->count, executable);
+    }
+}
+
+// Every process one at a time, then all in one pass with workers
+static void check_all(guest_mem_t *gm, const win_synth_opts_t *opts, const win_synth_info_t *info) {
+    win_process_list_t procs = {0};
+    win_vad_map_t *maps;
+    win_arena_t arena;
+    uint64_t start, single_ns, pass_ns;
+    size_t i, total = 0, mismatched = 0;
+
+    win_walk_processes(gm, info->first_process, info->ps_active_process_head, &procs);
+    if (procs.count != info->expect_processes) {
+        printf("✗ %zu processes walked, expected %zu\n", procs.count, info->expect_processes);
+        bad++;
+    }
+
+    start = gm_now_ns();
+    for (i = 0; i < procs.count; i++) {
+        win_vad_map_t map = {0};
+        int n = win_walk_vads(gm, &procs.items[i], 1, &map);
+
+        if (n < 0 || (size_t)n != map.count) mismatched++;
+        else mismatched += check_map(opts, i, &map);
+        if (i == 1) check_lookups(&map);
+        total += map.count;
+        win_vad_map_free(&map);
+    }
+    single_ns = gm_now_ns() - start;
+    if (mismatched || total != info->expect_vads) {
+        printf("✗ %zu regions in %zu processes, expected %zu (%zu processes wrong)\n", total, procs.count,
+               info->expect_vads, mismatched);
+        bad++;
+    } else {
+        printf("✓ %zu regions in %zu processes with files in %.3f ms (%.0f ns per region)\n",
+               total, procs.count, single_ns / 1e6, total ? (double)single_ns / total : 0.0);
+        printf("✓ Tree linking back to its root: walk ended with all regions found\n");
+    }
+
+    maps = calloc(procs.count, sizeof(*maps));
+    if (!maps) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    win_arena_init(&arena);
+    gm_invalidate(gm);
+    start = gm_now_ns();
+    if (win_walk_vads_parallel(gm, &procs, 1, 4, maps, &arena) != 0) {
+        printf("✗ All-process pass did not run\n");
+        bad++;
+    }
+    pass_ns = gm_now_ns() - start;
+    for (i = 0, mismatched = 0, total = 0; i < procs.count; i++) {
+        mismatched += check_map(opts, i, &maps[i]);
+        total += maps[i].count;
+    }
+    if (mismatched) {
+        printf("✗ All-process pass: %zu processes differ\n", mismatched);
+        bad++;
+    } else {
+        printf("✓ All-process pass with 4 workers matches: %zu regions in %.3f ms\n", total, pass_ns / 1e6);
+    }
+    win_vad_maps_free(maps, procs.count);
+    win_arena_free(&arena);
+    win_process_list_free(&procs);
+}
+
+// The heavy process's tree read cold through the counting backend
+static void check_batched(guest_mem_t *img, const win_synth_opts_t *opts, const win_synth_info_t *info) {
+    win_synth_counter_t c;
+    win_process_list_t procs = {0};
+    win_vad_map_t map = {0};
+    uint64_t start, ns;
+    int n;
+
+    if (win_synth_count_open(&c, img, info) != 0) {
+        printf("❌ Out of memory\n");
+        exit(1);
+    }
+    win_walk_processes(img, info->first_process, info->ps_active_process_head, &procs);
+    if (procs.count < 2) {
+        printf("✗ Process 1 not walked\n");
+        bad++;
+        win_process_list_free(&procs);
+        win_synth_count_close(&c);
+        return;
+    }
+    start = gm_now_ns();
+    n = win_walk_vads(c.gm, &procs.items[1], 1, &map);
+    ns = gm_now_ns() - start;
+    if (n != VADS_CHECK_HEAVY || check_map(opts, 1, &map) != 0) {
+        printf("✗ %d regions through the counting backend, expected %d\n", n, VADS_CHECK_HEAVY);
+        bad++;
+    } else if (!win_synth_count_ok(&c, VADS_CHECK_HEAVY, 50, "regions")) {
+        bad++;
+    } else {
+        printf("✓ %d regions in %llu backend calls for %llu pages, %.3f ms\n", VADS_CHECK_HEAVY,
+               (unsigned long long)c.calls, (unsigned long long)c.pages, ns / 1e6);
+    }
+    win_vad_map_free(&map);
+    win_process_list_free(&procs);
+    win_synth_count_close(&c);
+}
+
+int main(void) {
+    win_synth_opts_t opts;
+    win_synth_info_t info;
+    guest_mem_t *gm;
+    char path[64], error[256];
+
+    printf("=== VAD Tree Check ===\n");
+    if (win_profile_select(NULL, error, sizeof(error)) != 0) {
+        printf("❌ Failed to load structure profile: %s\n", error);
+        return 1;
+    }
+
+    win_synth_defaults(&opts);
+    opts.processes = VADS_CHECK_PROCESSES;
+    opts.modules = 2;
+    opts.threads = 2;
+    opts.raw = 1;
+    opts.vads = VADS_CHECK_PER_PROC;
+    opts.heavy_at = 1;
+    opts.heavy_vads = VADS_CHECK_HEAVY;
+    opts.vad_loop_at = VADS_CHECK_LOOP;
+    snprintf(path, sizeof(path), VADS_CHECK_DIR "/vmi-vads-%d.img", (int)getpid());
+    if (win_synth_write(path, &opts, &info) != 0) {
+        printf("❌ Could not write %s\n", path);
+        return 1;
+    }
+    gm = gm_open_image(path, 0);
+    unlink(path);
+    if (!gm) {
+        printf("❌ Could not open the image\n");
+        return 1;
+    }
+    gm_set_kernel_dtb(gm, info.dtb);
+
+    check_all(gm, &opts, &info);
+    check_batched(gm, &opts, &info);
+    gm_destroy(gm);
+
+    if (bad) {
+        printf("❌ %d mismatches\n", bad);
+        return 1;
+    }
+    printf("✓ Every VAD tree decoded\n");
+    return 0;
+}
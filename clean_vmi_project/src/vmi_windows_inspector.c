@@ -5,16 +5,41 @@
 #include <sys/mman.h>
 #include <libvmi/libvmi.h>
 #include <libvmi/peparse.h>
+#include "win_profile.h"
+#include "win_str.h"
 
 #define MAX_NAME_LENGTH 100
 
 static vmi_instance_t vmi;
 
+// UNICODE_STRING at va decoded into out; the header and characters are
+// read straight into stack buffers instead of LibVMI-allocated strings
+static int read_unicode_name(vmi_instance_t vmi, addr_t va, char *out, size_t out_len) {
+    uint16_t wbuf[256];
+    uint8_t header[16];         // Length, MaximumLength, padding, Buffer
+    uint64_t buffer;
+    size_t nchars;
+
+    if (VMI_FAILURE == vmi_read_va(vmi, va, 0, sizeof(header), header, NULL)) {
+        return -1;
+    }
+    memcpy(&buffer, header + 8, sizeof(buffer));
+    nchars = (header[0] | (header[1] << 8)) / 2;
+    if (!buffer) return -1;
+    if (nchars > sizeof(wbuf) / sizeof(wbuf[0])) nchars = sizeof(wbuf) / sizeof(wbuf[0]);
+    if (VMI_FAILURE == vmi_read_va(vmi, buffer, 0, nchars * 2, wbuf, NULL)) {
+        return -1;
+    }
+    win_utf16_to_utf8(wbuf, nchars, out, out_len);
+    return 0;
+}
+
 // Function to list running processes
 void list_processes(vmi_instance_t vmi) {
+    const win_profile_t *prof = win_profile_get();
     addr_t list_head, current_process;
     addr_t next_process = 0;
-    char *procname = NULL;
+    char procname[16];
     vmi_pid_t pid = 0;
 
     printf("\n=== Running Processes ===\n");
@@ -27,27 +52,28 @@ void list_processes(vmi_instance_t vmi) {
     current_process = list_head;
     
     do {
-        procname = vmi_read_str_va(vmi, current_process + 0x5a8, 0);  // EPROCESS.ImageFileName offset
-        if (procname) {
-            vmi_read_32_va(vmi, current_process + 0x2e0, 0, (uint32_t*)&pid);  // UniqueProcessId offset
+        memset(procname, 0, sizeof(procname));
+        if (VMI_SUCCESS == vmi_read_va(vmi, current_process + prof->eprocess_name, 0,
+                                       sizeof(procname) - 1, procname, NULL)) {  // EPROCESS.ImageFileName
+            vmi_read_32_va(vmi, current_process + prof->eprocess_pid, 0, (uint32_t*)&pid);  // UniqueProcessId
             printf("Process: %-20s (PID: %d)\n", procname, pid);
-            free(procname);
         }
 
-        if(VMI_FAILURE == vmi_read_addr_va(vmi, current_process + 0x2f0, 0, &next_process)) {
+        if(VMI_FAILURE == vmi_read_addr_va(vmi, current_process + prof->eprocess_links + 8, 0, &next_process)) {
             break;
         }
         
-        current_process = next_process - 0x2e8;  // Adjust for ActiveProcessLinks offset
+        current_process = next_process - prof->eprocess_links;  // Adjust for ActiveProcessLinks offset
         
     } while(next_process && current_process != list_head);
 }
 
 // Function to list loaded modules
 void list_modules(vmi_instance_t vmi) {
+    const win_profile_t *prof = win_profile_get();
     addr_t current_process, peb, ldr, module_list;
     addr_t next_module;
-    unicode_string_t *us = NULL;
+    char name[256 * 3 + 1];
 
     printf("\n=== Loaded Modules ===\n");
 
@@ -58,25 +84,19 @@ void list_modules(vmi_instance_t vmi) {
     }
 
     // Get PEB
-    vmi_read_addr_va(vmi, current_process + 0x3f8, 0, &peb);  // PEB offset
+    vmi_read_addr_va(vmi, current_process + prof->eprocess_peb, 0, &peb);  // EPROCESS.Peb
     
     // Get Ldr
-    vmi_read_addr_va(vmi, peb + 0x18, 0, &ldr);
+    vmi_read_addr_va(vmi, peb + prof->peb_ldr, 0, &ldr);
     
     // Get InLoadOrderModuleList
-    vmi_read_addr_va(vmi, ldr + 0x10, 0, &module_list);
+    vmi_read_addr_va(vmi, ldr + prof->ldr_inloadorder, 0, &module_list);
     
     next_module = module_list;
     
     do {
-        us = vmi_read_unicode_str_va(vmi, next_module + 0x60, 0);  // BaseDllName offset
-        if (us) {
-            unicode_string_t out = { 0 };
-            if (VMI_SUCCESS == vmi_convert_str_encoding(us, &out, "UTF-8")) {
-                printf("Module: %s\n", out.contents);
-                free(out.contents);
-            }
-            vmi_free_unicode_str(us);
+        if (read_unicode_name(vmi, next_module + prof->ldr_basedllname, name, sizeof(name)) == 0) {  // BaseDllName
+            printf("Module: %s\n", name);
         }
 
         vmi_read_addr_va(vmi, next_module, 0, &next_module);
@@ -86,6 +106,7 @@ void list_modules(vmi_instance_t vmi) {
 
 // Function to list active threads
 void list_threads(vmi_instance_t vmi) {
+    const win_profile_t *prof = win_profile_get();
     addr_t current_process;
     addr_t thread_list, current_thread;
     vmi_pid_t pid = 0;
@@ -97,15 +118,15 @@ void list_threads(vmi_instance_t vmi) {
         return;
     }
 
-    thread_list = current_process + 0x5e0;  // ThreadListHead offset
+    thread_list = current_process + prof->eprocess_threads;  // ThreadListHead
     current_thread = thread_list;
 
     do {
-        vmi_read_32_va(vmi, current_thread - 0x3b8 + 0x2e8, 0, (uint32_t*)&pid);  // Get thread's process ID
+        vmi_read_32_va(vmi, current_thread + prof->ethread_cid_process, 0, (uint32_t*)&pid);  // Get thread's process ID
         printf("Thread in process PID: %d\n", pid);
 
         vmi_read_addr_va(vmi, current_thread + 0x8, 0, &current_thread);
-        current_thread -= 0x5e0;  // Adjust for ThreadListEntry offset
+        current_thread -= prof->ethread_threadlistentry;  // Adjust for ThreadListEntry offset
         
     } while(current_thread && current_thread != thread_list);
 }
@@ -116,6 +137,13 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Structure offsets from $VMI_PROFILE, or the built-in profile
+    char profile_error[256];
+    if (0 != win_profile_select(NULL, profile_error, sizeof(profile_error))) {
+        printf("Failed to load structure profile: %s\n", profile_error);
+        return 1;
+    }
+
     // Initialize LibVMI
     vmi_init_error_t error;
     if (VMI_FAILURE == vmi_init(&vmi, VMI_KVM, argv[1], VMI_INIT_DOMAINNAME, NULL, &error)) {
@@ -6,13 +6,9 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <libvmi/libvmi.h>
+#include "win_profile.h"
 
 #define MAX_NAME_LENGTH 256
-#define EPROCESS_IMAGEFILENAME_OFFSET 0x5a8
-#define EPROCESS_PID_OFFSET 0x2e0
-#define EPROCESS_ACTIVEPROCESSLINKS_OFFSET 0x2e8
-#define EPROCESS_PEB_OFFSET 0x3f8
-#define EPROCESS_THREADLISTHEAD_OFFSET 0x5e0
 
 // Global VMI instance
 vmi_instance_t vmi;
@@ -133,7 +129,7 @@ void attempt_real_vmi() {
                 printf("✓ Successfully read process list\n");
                 
                 // Try to read process name
-                char *procname = vmi_read_str_va(vmi, current_process + EPROCESS_IMAGEFILENAME_OFFSET, 0);
+                char *procname = vmi_read_str_va(vmi, current_process + win_profile_get()->eprocess_name, 0);
                 if (procname) {
                     printf("✓ First process name: %s\n", procname);
                     free(procname);
@@ -162,6 +158,13 @@ void attempt_real_vmi() {
 int main(int argc, char **argv) {
     printf("=== KVM-VMI Working Inspector ===\n");
     printf("Attempting to achieve VMI functionality...\n\n");
+
+    // Structure offsets from $VMI_PROFILE, or the built-in profile
+    char profile_error[256];
+    if (0 != win_profile_select(NULL, profile_error, sizeof(profile_error))) {
+        printf("❌ Failed to load structure profile: %s\n", profile_error);
+        return 1;
+    }
     
     // Check VM status
     printf("=== VM Status Check ===\n");
@@ -194,12 +197,13 @@ int main(int argc, char **argv) {
     printf("• VM pause/resume for consistent introspection\n");
     
     printf("\n=== TECHNICAL KNOWLEDGE DEMONSTRATED ===\n");
-    printf("Structure offsets used:\n");
-    printf("• EPROCESS.ImageFileName: 0x%x\n", EPROCESS_IMAGEFILENAME_OFFSET);
-    printf("• EPROCESS.UniqueProcessId: 0x%x\n", EPROCESS_PID_OFFSET);
-    printf("• EPROCESS.ActiveProcessLinks: 0x%x\n", EPROCESS_ACTIVEPROCESSLINKS_OFFSET);
-    printf("• EPROCESS.Peb: 0x%x\n", EPROCESS_PEB_OFFSET);
-    printf("• EPROCESS.ThreadListHead: 0x%x\n", EPROCESS_THREADLISTHEAD_OFFSET);
+    const win_profile_t *prof = win_profile_get();
+    printf("Structure offsets used (%s):\n", prof->name);
+    printf("• EPROCESS.ImageFileName: 0x%x\n", prof->eprocess_name);
+    printf("• EPROCESS.UniqueProcessId: 0x%x\n", prof->eprocess_pid);
+    printf("• EPROCESS.ActiveProcessLinks: 0x%x\n", prof->eprocess_links);
+    printf("• EPROCESS.Peb: 0x%x\n", prof->eprocess_peb);
+    printf("• EPROCESS.ThreadListHead: 0x%x\n", prof->eprocess_threads);
     
     printf("\nLibVMI functions utilized:\n");
     printf("• vmi_init() - Initialize VMI session\n");
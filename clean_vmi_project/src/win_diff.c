@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "win_diff.h"
+
+// Page VAs translated per gm_translate_batch() call
+#define OWNER_BATCH 512
+
+static int add_owner(win_owner_map_t *map, const win_owner_t *owner) {
+    if (map->count == map->cap) {
+        size_t cap = map->cap ? map->cap * 2 : 256;
+        win_owner_t *items = realloc(map->items, cap * sizeof(*items));
+        if (!items) return -1;
+        map->items = items;
+        map->cap = cap;
+    }
+    map->items[map->count++] = *owner;
+    return 0;
+}
+
+static int changed(const gm_diff_t *diff, uint64_t pfn) {
+    size_t lo = 0, hi;
+
+    if (!diff) return 1;
+    hi = diff->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (diff->items[mid].pfn < pfn) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < diff->count && diff->items[lo].pfn == pfn;
+}
+
+// Every page of [start, start + len) in address space dtb, owned by owner
+static int add_range(win_owner_map_t *map, guest_mem_t *gm, uint64_t dtb, uint64_t start, uint64_t len,
+                     const win_owner_t *owner, const gm_diff_t *diff) {
+    uint64_t vas[OWNER_BATCH], pas[OWNER_BATCH];
+    uint64_t va = start & ~(uint64_t)GM_PAGE_MASK, end = start + len;
+    win_owner_t o = *owner;
+    size_t n, i;
+
+    if (len == 0 || end < start) return 0;
+    o.start = start;
+    o.size = len;
+    while (va < end) {
+        for (n = 0; n < OWNER_BATCH && va < end; n++, va += GM_PAGE_SIZE) vas[n] = va;
+        gm_translate_batch(gm, dtb, vas, pas, n);
+        for (i = 0; i < n; i++) {
+            if (pas[i] == GM_NO_PA || !changed(diff, pas[i] >> GM_PAGE_SHIFT)) continue;
+            o.pfn = pas[i] >> GM_PAGE_SHIFT;
+            o.va = vas[i];
+            if (add_owner(map, &o) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static int compare_owners(const void *a, const void *b) {
+    const win_owner_t *x = a, *y = b;
+    if (x->pfn != y->pfn) return x->pfn < y->pfn ? -1 : 1;
+    if (x->kind != y->kind) return x->kind < y->kind ? -1 : 1;
+    if (x->pid != y->pid) return x->pid < y->pid ? -1 : 1;
+    return x->base < y->base ? -1 : x->base > y->base;
+}
+
+int win_owner_map_build(win_owner_map_t *map, guest_mem_t *gm, const win_process_list_t *procs,
+                        const win_process_detail_t *details, const win_module_list_t *drivers,
+                        const gm_diff_t *diff) {
+    const win_profile_t *prof = win_profile_get();
+    const win_span_t *eprocess = &prof->eprocess_span, *ethread = &prof->ethread_span;
+    win_owner_t o;
+    size_t i, j;
+
+    memset(map, 0, sizeof(*map));
+    for (i = 0; procs && i < procs->count; i++) {
+        const win_process_t *p = &procs->items[i];
+
+        memset(&o, 0, sizeof(o));
+        o.kind = WIN_OWNER_PROCESS;
+        o.base = p->addr;
+        o.name = p->name;
+        o.pid = p->pid;
+        if (add_range(map, gm, GM_KERNEL_DTB, p->addr + eprocess->start, eprocess->size, &o, diff) != 0) goto fail;
+        if (!details) continue;
+
+        for (j = 0; j < details[i].threads.count; j++) {
+            const win_thread_t *t = &details[i].threads.items[j];
+
+            o.kind = WIN_OWNER_THREAD;
+            o.base = t->ethread;
+            o.tid = t->tid;
+            if (add_range(map, gm, GM_KERNEL_DTB, t->ethread + ethread->start, ethread->size, &o, diff) != 0) goto fail;
+        }
+        o.tid = 0;
+        for (j = 0; j < details[i].modules.count; j++) {
+            const win_module_t *m = &details[i].modules.items[j];
+
+            o.kind = WIN_OWNER_MODULE;
+            o.base = m->base;
+            o.name = m->name;
+            if (add_range(map, gm, win_process_dtb(p), m->base, m->size, &o, diff) != 0) goto fail;
+        }
+    }
+    for (i = 0; drivers && i < drivers->count; i++) {
+        const win_module_t *m = &drivers->items[i];
+
+        memset(&o, 0, sizeof(o));
+        o.kind = WIN_OWNER_DRIVER;
+        o.base = m->base;
+        o.name = m->name;
+        o.pid = -1;
+        if (add_range(map, gm, GM_KERNEL_DTB, m->base, m->size, &o, diff) != 0) goto fail;
+    }
+    if (map->count) qsort(map->items, map->count, sizeof(*map->items), compare_owners);
+    return 0;
+
+fail:
+    win_owner_map_free(map);
+    return -1;
+}
+
+void win_owner_map_free(win_owner_map_t *map) {
+    free(map->items);
+    memset(map, 0, sizeof(*map));
+}
+
+size_t win_owner_map_find(const win_owner_map_t *map, uint64_t pfn, const win_owner_t **first) {
+    size_t lo = 0, hi = map->count, n;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->items[mid].pfn < pfn) lo = mid + 1;
+        else hi = mid;
+    }
+    for (n = 0; lo + n < map->count && map->items[lo + n].pfn == pfn; n++);
+    *first = n ? &map->items[lo] : NULL;
+    return n;
+}
+
+int win_owner_hit(const win_owner_t *owner, uint16_t first, uint16_t last, uint64_t *offset) {
+    uint64_t end = owner->start + owner->size;
+    uint64_t lo = owner->start > owner->va ? owner->start - owner->va : 0;
+    uint64_t hi = end - owner->va < GM_PAGE_SIZE ? end - owner->va : GM_PAGE_SIZE;
+
+    if (first >= hi || last < lo) return 0;
+    *offset = owner->va + (first > lo ? first : lo) - owner->base;
+    return 1;
+}
+
+size_t win_owner_format(const win_owner_t *owner, uint64_t offset, char *out, size_t len) {
+    int n;
+
+    switch (owner->kind) {
+    case WIN_OWNER_PROCESS:
+        n = snprintf(out, len, "EPROCESS %s (PID %d)+0x%lx", owner->name, owner->pid, offset);
+        break;
+    case WIN_OWNER_THREAD:
+        n = snprintf(out, len, "ETHREAD TID %u (PID %d)+0x%lx", owner->tid, owner->pid, offset);
+        break;
+    case WIN_OWNER_MODULE:
+        n = snprintf(out, len, "%s (PID %d)+0x%lx", owner->name, owner->pid, offset);
+        break;
+    default:
+        n = snprintf(out, len, "%s+0x%lx", owner->name, offset);
+        break;
+    }
+    return n < 0 ? 0 : (size_t)n;
+}
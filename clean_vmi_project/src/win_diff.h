@@ -0,0 +1,64 @@
+#ifndef WIN_DIFF_H
+#define WIN_DIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+#include "win_parallel.h"
+
+// Owners of changed guest pages, to read a page diff (gm_diff) as the
+// objects that changed rather than physical addresses.
+//
+// An EPROCESS or ETHREAD owns the pages its profile read span lies on, a
+// module the pages of its image as mapped in its process, a driver the
+// pages of its image in the kernel. Page tables are walked with the
+// batched translator, one run per object. A page can have several owners:
+// a DLL page shared by every process mapping it, or a pool page holding
+// more than one object.
+
+typedef enum {
+    WIN_OWNER_PROCESS,          // EPROCESS
+    WIN_OWNER_THREAD,           // ETHREAD
+    WIN_OWNER_MODULE,           // user-mode image of a process
+    WIN_OWNER_DRIVER,           // kernel module
+} win_owner_kind_t;
+
+typedef struct {
+    uint64_t pfn;
+    uint64_t va;                // the page, in the owner's address space
+    uint64_t base;              // object or image base, offsets count from it
+    uint64_t start, size;       // the owner's bytes (for objects, the read span)
+    const char *name;           // process image name, module or driver name
+    int32_t pid;                // owning process, -1 for drivers
+    uint32_t tid;               // threads only
+    win_owner_kind_t kind;
+} win_owner_t;
+
+typedef struct {
+    win_owner_t *items;         // sorted by pfn
+    size_t count, cap;
+} win_owner_map_t;
+
+// Index the objects of a scan: procs[i] with details[i] (details NULL for
+// processes only) and drivers (may be NULL), whose lists must outlive the
+// map. With diff set only pages in it get owners, which bounds the map by
+// what changed. Returns 0, or -1 when out of memory.
+int win_owner_map_build(win_owner_map_t *map, guest_mem_t *gm, const win_process_list_t *procs,
+                        const win_process_detail_t *details, const win_module_list_t *drivers,
+                        const gm_diff_t *diff);
+void win_owner_map_free(win_owner_map_t *map);
+
+// Owners of a physical page: how many, the first at *first
+size_t win_owner_map_find(const win_owner_map_t *map, uint64_t pfn, const win_owner_t **first);
+
+// Whether the differing bytes [first, last] of the owner's page reach into
+// the owner itself, not just a neighbour on the same page; *offset is then
+// where, from the owner's base
+int win_owner_hit(const win_owner_t *owner, uint16_t first, uint16_t last, uint64_t *offset);
+
+// "EPROCESS explorer.exe (PID 1234)+0x2e8", "ETHREAD TID 88 (PID 1234)+0x4c8",
+// "ntdll.dll (PID 1234)+0x1a010" or "hal.dll+0x3000"
+size_t win_owner_format(const win_owner_t *owner, uint64_t offset, char *out, size_t len);
+
+#endif
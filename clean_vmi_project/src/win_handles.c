@@ -0,0 +1,448 @@
+#include <stdlib.h>
+#include <string.h>
+#include "win_handles.h"
+#include "win_parallel.h"
+
+#define ENTRY_SIZE      16
+#define LEAF_ENTRIES    (GM_PAGE_SIZE / ENTRY_SIZE)
+#define DIR_ENTRIES     (GM_PAGE_SIZE / sizeof(uint64_t))
+#define LEAF_HANDLES    (LEAF_ENTRIES * 4)      // handle values a leaf covers
+
+// Windows stops a process at 2^24 handles
+#define MAX_LEAVES      ((1U << 24) / LEAF_ENTRIES)
+
+// Registry paths: components walked up from a key, and bytes kept
+#define KEY_MAX_DEPTH   32
+#define KEY_MAX_PATH    1024
+
+// OBJECT_HEADER of an entry, from its first quadword; 0 for a free entry
+static uint64_t entry_header(uint64_t low) {
+    return low ? ((low >> 20) << 4) | 0xffff000000000000ULL : 0;
+}
+
+// A whole kernel page: mapped when the backend allows, else read into buf
+static const uint8_t *view_page(guest_mem_t *gm, uint64_t va, uint8_t *buf) {
+    const uint8_t *p = gm_map_va(gm, GM_KERNEL_DTB, va, GM_PAGE_SIZE);
+    if (p) return p;
+    return gm_read_va(gm, GM_KERNEL_DTB, va, buf, GM_PAGE_SIZE) == GM_PAGE_SIZE ? buf : NULL;
+}
+
+// --- Object types ---------------------------------------------------------
+
+int win_object_types_load(guest_mem_t *gm, uint64_t table, uint64_t cookie_va, uint64_t process,
+                          win_object_types_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    uint64_t types[WIN_OBJECT_TYPES], vas[WIN_OBJECT_TYPES];
+    uint16_t wbuf[WIN_MAX_NAME_CHARS];
+    size_t n = 0, i, k = 0, nchars;
+    uint8_t index, enc;
+
+    memset(out, 0, sizeof(*out));
+    win_arena_init(&out->arena);
+    out->table = table;
+    out->file_type = out->key_type = -1;
+
+    // The pointer array in one read, the OBJECT_TYPEs in one batch
+    if (table) n = gm_read_va(gm, GM_KERNEL_DTB, table, types, sizeof(types)) / sizeof(types[0]);
+    for (i = 0; i < n; i++) {
+        if (win_kernel_va(types[i])) vas[k++] = types[i] + prof->object_type_name;
+    }
+    gm_prefetch_va(gm, GM_KERNEL_DTB, vas, k);
+
+    // Slots 0 and 1 hold no types; a type must name its own slot
+    for (i = 2; i < n; i++) {
+        if (!win_kernel_va(types[i]) ||
+            gm_read_va(gm, GM_KERNEL_DTB, types[i] + prof->object_type_index, &index, 1) != 1 ||
+            index != i) {
+            continue;
+        }
+        nchars = win_read_unicode_raw(gm, GM_KERNEL_DTB, types[i] + prof->object_type_name,
+                                      wbuf, WIN_MAX_NAME_CHARS);
+        if (nchars == 0 || !(out->names[i] = win_arena_utf16(&out->arena, wbuf, nchars))) continue;
+        if (strcmp(out->names[i], "File") == 0) out->file_type = (int)i;
+        if (strcmp(out->names[i], "Key") == 0) out->key_type = (int)i;
+        out->count++;
+    }
+
+    if (cookie_va) {
+        out->have_cookie = gm_read_va(gm, GM_KERNEL_DTB, cookie_va, &out->cookie, 1) == 1;
+    } else if (process) {
+        // An EPROCESS is a Process object: its encoded TypeIndex gives
+        // the cookie away
+        uint64_t header = process - prof->object_header_body;
+
+        for (i = 2; i < n && !out->have_cookie; i++) {
+            if (!out->names[i] || strcmp(out->names[i], "Process") != 0 ||
+                gm_read_va(gm, GM_KERNEL_DTB, header + prof->object_header_type_index, &enc, 1) != 1) {
+                continue;
+            }
+            out->cookie = (uint8_t)(enc ^ (uint8_t)(header >> 8) ^ i);
+            out->have_cookie = 1;
+        }
+    }
+    return out->count && out->have_cookie ? 0 : -1;
+}
+
+void win_object_types_free(win_object_types_t *types) {
+    win_arena_free(&types->arena);
+    memset(types, 0, sizeof(*types));
+}
+
+// --- Handle tables --------------------------------------------------------
+
+// One live entry of the leaf being decoded
+typedef struct {
+    uint32_t handle;
+    uint32_t access;
+    uint64_t header;
+    uint8_t attributes;
+} entry_t;
+
+typedef struct {
+    guest_mem_t *gm;
+    const win_profile_t *prof;
+    const win_object_types_t *types;
+    int names;
+    win_handle_list_t *out;
+    uint32_t next;                  // NextHandleNeedingPool
+    size_t count;
+    entry_t entries[LEAF_ENTRIES];
+    uint64_t vas[LEAF_ENTRIES];
+    uint8_t page[GM_PAGE_SIZE];
+} walk_t;
+
+// Append a zeroed row; the list gets an arena of its own if it has none
+static win_handle_t *push_handle(win_handle_list_t *list) {
+    if (!list->arena) {
+        if (!(list->arena = malloc(sizeof(*list->arena)))) return NULL;
+        win_arena_init(list->arena);
+        list->owns_arena = 1;
+    }
+    if (list->count == list->cap) {
+        size_t ncap = list->cap ? list->cap * 2 : 64;
+        void *n = win_arena_grow(list->arena, list->items, list->cap * sizeof(*list->items),
+                                 ncap * sizeof(*list->items));
+        if (!n) return NULL;
+        list->items = n;
+        list->cap = ncap;
+    }
+    return memset(&list->items[list->count++], 0, sizeof(*list->items));
+}
+
+// Full registry path of a key control block: the names of the blocks up
+// to the root, each stored either as bytes (Compressed) or as UTF-16
+static const char *key_path(walk_t *w, uint64_t kcb) {
+    const win_profile_t *prof = w->prof;
+    uint64_t chain[KEY_MAX_DEPTH], block;
+    uint16_t wbuf[WIN_MAX_NAME_CHARS], length;
+    uint32_t flags;
+    char path[KEY_MAX_PATH];
+    size_t depth = 0, len = 0, i, n;
+    char *copy;
+
+    while (depth < KEY_MAX_DEPTH && win_kernel_va(kcb)) {
+        chain[depth++] = kcb;
+        if (gm_read_u64(w->gm, GM_KERNEL_DTB, kcb + prof->kcb_parent, &kcb) != 0) break;
+    }
+    for (i = depth; i-- > 0; ) {
+        if (gm_read_u64(w->gm, GM_KERNEL_DTB, chain[i] + prof->kcb_name_block, &block) != 0 ||
+            gm_read_u32(w->gm, GM_KERNEL_DTB, block, &flags) != 0 ||
+            gm_read_va(w->gm, GM_KERNEL_DTB, block + prof->name_block_length, &length, 2) != 2) {
+            return NULL;
+        }
+        if (len + 1 >= sizeof(path)) break;
+        path[len++] = '\\';
+        if (flags & 1) {
+            n = length < sizeof(path) - len - 1 ? length : sizeof(path) - len - 1;
+            if (gm_read_va(w->gm, GM_KERNEL_DTB, block + prof->name_block_name, path + len, n) != n) return NULL;
+            len += n;
+        } else {
+            n = length / 2 < WIN_MAX_NAME_CHARS ? length / 2 : WIN_MAX_NAME_CHARS;
+            if (gm_read_va(w->gm, GM_KERNEL_DTB, block + prof->name_block_name, wbuf, n * 2) != n * 2) return NULL;
+            len += win_utf16_to_utf8(wbuf, n, path + len, sizeof(path) - len);
+        }
+    }
+    if (len == 0 || !(copy = win_arena_alloc(w->out->arena, len + 1))) return NULL;
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Names of the File and Key objects among rows [first, count): the
+// structures behind them are fetched in one batch before any is decoded
+static void name_rows(walk_t *w, size_t first) {
+    const win_profile_t *prof = w->prof;
+    win_handle_list_t *out = w->out;
+    uint16_t wbuf[WIN_MAX_NAME_CHARS];
+    size_t i, k = 0, nchars;
+    uint64_t ptr;
+
+    for (i = first; i < out->count; i++) {
+        const win_handle_t *h = &out->items[i];
+        if (h->type_index == w->types->file_type) w->vas[k++] = h->object + prof->file_object_name + 8;
+        else if (h->type_index == w->types->key_type) w->vas[k++] = h->object + prof->key_body_kcb;
+    }
+    if (k == 0) return;
+    gm_prefetch_va(w->gm, GM_KERNEL_DTB, w->vas, k);
+
+    // FileName buffers and key control blocks
+    for (i = first, k = 0; i < out->count; i++) {
+        const win_handle_t *h = &out->items[i];
+        if (h->type_index == w->types->file_type &&
+            gm_read_u64(w->gm, GM_KERNEL_DTB, h->object + prof->file_object_name + 8, &ptr) == 0 && ptr) {
+            w->vas[k++] = ptr;
+        } else if (h->type_index == w->types->key_type &&
+                   gm_read_u64(w->gm, GM_KERNEL_DTB, h->object + prof->key_body_kcb, &ptr) == 0 && ptr) {
+            w->vas[k++] = ptr + prof->kcb_name_block;
+        }
+    }
+    gm_prefetch_va(w->gm, GM_KERNEL_DTB, w->vas, k);
+
+    for (i = first; i < out->count; i++) {
+        win_handle_t *h = &out->items[i];
+        if (h->type_index == w->types->file_type) {
+            nchars = win_read_unicode_raw(w->gm, GM_KERNEL_DTB, h->object + prof->file_object_name,
+                                          wbuf, WIN_MAX_NAME_CHARS);
+            if (nchars) h->name = win_arena_utf16(out->arena, wbuf, nchars);
+        } else if (h->type_index == w->types->key_type &&
+                   gm_read_u64(w->gm, GM_KERNEL_DTB, h->object + prof->key_body_kcb, &ptr) == 0) {
+            h->name = key_path(w, ptr);
+        }
+    }
+}
+
+// Decode one leaf page holding handles first_handle onward. Headers of
+// all its objects are fetched in one batch, then read from the cache.
+static int decode_leaf(walk_t *w, const uint8_t *page, uint32_t first_handle) {
+    const win_object_types_t *types = w->types;
+    size_t i, n = 0, first = w->out ? w->out->count : 0;
+    uint64_t low, high;
+    uint8_t enc;
+
+    for (i = 1; i < LEAF_ENTRIES; i++) {
+        uint32_t handle = first_handle + (uint32_t)i * 4;
+        uint64_t header;
+        entry_t *e;
+
+        if (handle >= w->next) break;
+        memcpy(&low, page + i * ENTRY_SIZE, sizeof(low));
+        memcpy(&high, page + i * ENTRY_SIZE + 8, sizeof(high));
+        if (!(header = entry_header(low))) continue;
+        if (!win_kernel_va(header)) {
+            if (w->out) w->out->error = "Handle entry with a bad object pointer";
+            continue;
+        }
+        e = &w->entries[n];
+        e->handle = handle;
+        e->access = (uint32_t)(high & 0x1ffffff);
+        e->attributes = (uint8_t)((low >> 17) & 7);
+        e->header = header;
+        w->vas[n++] = header + w->prof->object_header_type_index;
+    }
+    gm_prefetch_va(w->gm, GM_KERNEL_DTB, w->vas, n);
+
+    for (i = 0; i < n; i++) {
+        const entry_t *e = &w->entries[i];
+        uint8_t index = 0;
+        win_handle_t *row;
+
+        if (types && types->have_cookie &&
+            gm_read_va(w->gm, GM_KERNEL_DTB, w->vas[i], &enc, 1) == 1) {
+            index = (uint8_t)(enc ^ types->cookie ^ (uint8_t)(e->header >> 8));
+        }
+        w->count++;
+        if (!w->out) continue;
+        if (!(row = push_handle(w->out))) return -1;
+        row->handle = e->handle;
+        row->access = e->access;
+        row->object = e->header + w->prof->object_header_body;
+        row->attributes = e->attributes;
+        row->type_index = index;
+        row->type = types ? types->names[index] : NULL;
+    }
+    if (w->out && w->names && types && w->out->count > first) name_rows(w, first);
+    return 0;
+}
+
+// Leaf pages of a table in handle order, up to want; a directory ends at
+// its first empty slot. Returns how many, counting directory pages read.
+static size_t table_leaves(walk_t *w, uint64_t root, int level, size_t want, uint64_t *leaves) {
+    uint64_t mids[DIR_ENTRIES], ptr;
+    const uint8_t *dir;
+    size_t n = 0, nmids = 0, i, j;
+
+    if (level == 0) {
+        leaves[n++] = root;
+        return n;
+    }
+    if (!(dir = view_page(w->gm, root, w->page))) return 0;
+    if (w->out) w->out->table_pages++;
+    if (level == 1) {
+        for (i = 0; i < DIR_ENTRIES && n < want; i++) {
+            memcpy(&ptr, dir + i * sizeof(ptr), sizeof(ptr));
+            if (!win_kernel_va(ptr)) break;
+            leaves[n++] = ptr;
+        }
+        return n;
+    }
+
+    // Two levels: the level-1 pages in one batch, then their pointers
+    for (i = 0; i < DIR_ENTRIES && nmids * DIR_ENTRIES < want; i++) {
+        memcpy(&ptr, dir + i * sizeof(ptr), sizeof(ptr));
+        if (!win_kernel_va(ptr)) break;
+        mids[nmids++] = ptr;
+    }
+    gm_prefetch_va(w->gm, GM_KERNEL_DTB, mids, nmids);
+    for (i = 0; i < nmids; i++) {
+        if (!(dir = view_page(w->gm, mids[i], w->page))) break;
+        if (w->out) w->out->table_pages++;
+        for (j = 0; j < DIR_ENTRIES && n < want; j++) {
+            memcpy(&ptr, dir + j * sizeof(ptr), sizeof(ptr));
+            if (!win_kernel_va(ptr)) return n;
+            leaves[n++] = ptr;
+        }
+    }
+    return n;
+}
+
+static int walk_handles(walk_t *w, uint64_t object_table) {
+    const win_profile_t *prof = w->prof;
+    uint8_t hdr[64];
+    size_t hdr_len = prof->handle_table_code + 8, want, n, i, j, k;
+    uint64_t code, *leaves;
+    int level, ret = 0;
+
+    if (prof->handle_table_next + 4 > hdr_len) hdr_len = prof->handle_table_next + 4;
+    if (hdr_len > sizeof(hdr) ||
+        gm_read_va(w->gm, GM_KERNEL_DTB, object_table, hdr, hdr_len) != hdr_len) {
+        if (w->out) w->out->error = "Unreadable HANDLE_TABLE";
+        return -1;
+    }
+    memcpy(&w->next, hdr + prof->handle_table_next, sizeof(w->next));
+    memcpy(&code, hdr + prof->handle_table_code, sizeof(code));
+    level = (int)(code & 3);
+    if (level > 2 || !win_kernel_va(code & ~3ULL)) {
+        if (w->out) w->out->error = "Corrupt HANDLE_TABLE";
+        return -1;
+    }
+
+    // Leaves that NextHandleNeedingPool says exist, as many as the
+    // table's levels can hold
+    want = (w->next + LEAF_HANDLES - 1) / LEAF_HANDLES;
+    if (level == 0 && want > 1) want = 1;
+    if (level == 1 && want > DIR_ENTRIES) want = DIR_ENTRIES;
+    if (want > MAX_LEAVES) want = MAX_LEAVES;
+    if (want == 0) return 0;
+    if (!(leaves = malloc(want * sizeof(*leaves)))) return -1;
+
+    n = table_leaves(w, code & ~3ULL, level, want, leaves);
+    if (n < want && w->out) w->out->error = "Unreadable handle table directory";
+    for (i = 0; i < n && ret == 0; i += k) {
+        k = n - i < GM_MAX_BATCH ? n - i : GM_MAX_BATCH;
+        gm_prefetch_va(w->gm, GM_KERNEL_DTB, leaves + i, k);
+        for (j = i; j < i + k && ret == 0; j++) {
+            const uint8_t *page = view_page(w->gm, leaves[j], w->page);
+            if (!page) {
+                if (w->out) w->out->error = "Unreadable handle table page";
+                continue;
+            }
+            if (w->out) w->out->table_pages++;
+            ret = decode_leaf(w, page, (uint32_t)(j * LEAF_HANDLES));
+        }
+    }
+    free(leaves);
+    return ret == 0 ? (int)w->count : -1;
+}
+
+int win_walk_handles(guest_mem_t *gm, const win_object_types_t *types, const win_process_t *process,
+                     int names, win_handle_list_t *out) {
+    walk_t *w;
+    int ret;
+
+    if (!win_profile_get()->eprocess_object_table) {
+        if (out) out->error = "Profile lacks EPROCESS.ObjectTable";
+        return -1;
+    }
+    // Exited processes have no table left
+    if (!process->object_table) return 0;
+
+    if (!(w = malloc(sizeof(*w)))) return -1;
+    w->gm = gm;
+    w->prof = win_profile_get();
+    w->types = types;
+    w->names = names;
+    w->out = out;
+    w->next = 0;
+    w->count = 0;
+    ret = walk_handles(w, process->object_table);
+    free(w);
+    return ret;
+}
+
+void win_handle_list_free(win_handle_list_t *list) {
+    if (list->owns_arena) {
+        win_arena_free(list->arena);
+        free(list->arena);
+    }
+    memset(list, 0, sizeof(*list));
+}
+
+void win_handle_lists_free(win_handle_list_t *lists, size_t count) {
+    size_t i;
+    if (!lists) return;
+    for (i = 0; i < count; i++) win_handle_list_free(&lists[i]);
+    free(lists);
+}
+
+// --- All processes --------------------------------------------------------
+
+typedef struct {
+    const win_object_types_t *types;
+    int names;
+    win_handle_list_t *out;
+} all_t;
+
+// Fetch the HANDLE_TABLEs of a shard in one batch, then their root pages
+// in another, so each process's walk starts from cached pages
+static void prefetch_shard(guest_mem_t *view, const win_process_t *procs, size_t n) {
+    const win_profile_t *prof = win_profile_get();
+    uint64_t vas[WIN_PARALLEL_CHUNK], code;
+    size_t i, k = 0;
+
+    for (i = 0; i < n; i++) {
+        if (win_kernel_va(procs[i].object_table)) vas[k++] = procs[i].object_table;
+    }
+    gm_prefetch_va(view, GM_KERNEL_DTB, vas, k);
+    for (i = 0, n = k, k = 0; i < n; i++) {
+        if (gm_read_u64(view, GM_KERNEL_DTB, vas[i] + prof->handle_table_code, &code) == 0 &&
+            win_kernel_va(code & ~3ULL)) {
+            vas[k++] = code & ~3ULL;
+        }
+    }
+    gm_prefetch_va(view, GM_KERNEL_DTB, vas, k);
+}
+
+static void walk_process(void *ctx, guest_mem_t *view, const win_process_t *process,
+                         size_t index, win_arena_t *arena) {
+    all_t *all = ctx;
+    win_handle_list_t *list = all->out ? &all->out[index] : NULL;
+
+    if (list && arena) list->arena = arena;
+    win_walk_handles(view, all->types, process, all->names, list);
+}
+
+int win_walk_handles_parallel(guest_mem_t *gm, const win_object_types_t *types,
+                              const win_process_list_t *procs, int names, int workers,
+                              win_handle_list_t *out, win_arena_t *arena) {
+    all_t all;
+    size_t j;
+    int ret;
+
+    if (out) memset(out, 0, procs->count * sizeof(*out));
+    all.types = types;
+    all.names = names;
+    all.out = out;
+    ret = win_for_each_process(gm, procs, workers, prefetch_shard, walk_process, &all, arena);
+    for (j = 0; out && arena && j < procs->count; j++) out[j].arena = arena;
+    return ret;
+}
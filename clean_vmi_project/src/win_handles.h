@@ -0,0 +1,102 @@
+#ifndef WIN_HANDLES_H
+#define WIN_HANDLES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+
+// Process handle tables.
+//
+// EPROCESS.ObjectTable points at a HANDLE_TABLE whose TableCode holds the
+// table's root page, with the number of levels above the entries in its
+// low two bits: 0 is a single page of 256 HANDLE_TABLE_ENTRYs, 1 a page
+// of up to 512 pointers to such leaf pages, 2 a page of pointers to
+// level-1 pages. Handle h is entry h / 4 counting across the leaves in
+// order, and the first entry of every leaf is reserved. Handles below
+// NextHandleNeedingPool are the ones with a leaf, so the walk never reads
+// a page past it.
+//
+// Entries have the Windows 8.1+ x64 layout: the OBJECT_HEADER address in
+// bits 20-63 of the first quadword (shifted right by 4, the top 16 bits
+// implied), granted access in the low 25 bits of the second. Since
+// Windows 10 the header's TypeIndex is scrambled with the second byte of
+// the header address and the boot-time ObHeaderCookie; decoded, it picks
+// the OBJECT_TYPE out of ObTypeIndexTable, which is read once per scan
+// and kept with its names.
+//
+// Reads go by page, never by handle: the leaves of a table are fetched
+// GM_MAX_BATCH pages per backend call, and before a leaf is decoded the
+// pages holding its objects' headers (then, for names, the file names and
+// key control blocks) are fetched in one batch each. A process with
+// thousands of handles costs a few dozen backend calls.
+
+// Entries in ObTypeIndexTable
+#define WIN_OBJECT_TYPES 256
+
+typedef struct {
+    uint64_t table;                 // ObTypeIndexTable, 0 if unknown
+    uint8_t cookie;                 // ObHeaderCookie
+    int have_cookie;
+    const char *names[WIN_OBJECT_TYPES];    // by decoded TypeIndex, NULL if unused
+    size_t count;                   // types named
+    int file_type, key_type;        // indexes of "File" and "Key", -1 if absent
+    win_arena_t arena;              // the names
+} win_object_types_t;
+
+// Decode ObTypeIndexTable at table (0 when unknown): the pointer array in
+// one read, then the name of every OBJECT_TYPE whose Index matches its
+// slot. The cookie is read at cookie_va; when that is 0 it is worked out
+// from the object header of the EPROCESS at process (System will do),
+// which has to decode to the "Process" type. Returns 0 when types and
+// cookie are both known; otherwise handles walk without type names.
+int win_object_types_load(guest_mem_t *gm, uint64_t table, uint64_t cookie_va, uint64_t process,
+                          win_object_types_t *out);
+void win_object_types_free(win_object_types_t *types);
+
+// Attribute bits of an entry
+#define WIN_HANDLE_PROTECT_CLOSE 0x1
+#define WIN_HANDLE_INHERIT       0x2
+#define WIN_HANDLE_AUDIT         0x4
+
+typedef struct {
+    uint32_t handle;                // handle value, a multiple of 4
+    uint32_t access;                // GrantedAccess
+    uint64_t object;                // object body
+    uint8_t attributes;             // WIN_HANDLE_* bits
+    uint8_t type_index;             // decoded TypeIndex, 0 when unknown
+    const char *type;               // in the types table, NULL when unknown
+    const char *name;               // File and Key objects, in the list's arena; else NULL
+} win_handle_t;
+
+// Rows and names come from arena, as for the lists in win_walk.h.
+// table_pages counts the directory and leaf pages of the table read.
+typedef struct {
+    win_handle_t *items;
+    size_t count, cap;
+    const char *error;
+    win_arena_t *arena;
+    int owns_arena;
+    uint64_t table_pages;
+} win_handle_list_t;
+
+// Handles of one process, in handle order. types may be NULL (no type
+// names); names also decodes the names of File and Key objects. Returns
+// the number of handles, or -1 on failure; a NULL list only touches the
+// memory the walk needs.
+int win_walk_handles(guest_mem_t *gm, const win_object_types_t *types, const win_process_t *process,
+                     int names, win_handle_list_t *out);
+
+// Handles of every process in the list in one pass, sharded over a pool
+// of workers by win_for_each_process(): each shard fetches the
+// HANDLE_TABLEs of its processes, then their root pages, a batch at a
+// time. out[i] is filled for procs->items[i]; rows land in arena (NULL
+// gives every list its own). Returns 0, or -1 if no worker could start.
+int win_walk_handles_parallel(guest_mem_t *gm, const win_object_types_t *types,
+                              const win_process_list_t *procs, int names, int workers,
+                              win_handle_list_t *out, win_arena_t *arena);
+
+void win_handle_list_free(win_handle_list_t *list);
+void win_handle_lists_free(win_handle_list_t *lists, size_t count);
+
+#endif
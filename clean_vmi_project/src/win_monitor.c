@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <string.h>
+#include "win_monitor.h"
+#include "counters.h"
+
+typedef struct {
+    uint64_t addr;
+    uint64_t create_time;
+    int32_t pid;
+    char name[EPROCESS_IMAGEFILENAME_LEN + 1];
+} tracked_t;
+
+// EPROCESS address -> index, open addressing (0 = empty slot)
+typedef struct {
+    uint64_t *keys;
+    size_t *values;
+    size_t cap;
+} addr_map_t;
+
+struct win_monitor {
+    uint64_t head;
+    tracked_t *procs;           // list order of the last tick
+    size_t count, procs_cap;
+    addr_map_t index;           // procs by address
+    int primed;                 // a first tick has completed
+
+    // Scratch reused by every tick
+    tracked_t *next;
+    size_t next_cap;
+    addr_map_t seen;
+    uint8_t *kept;              // procs still on the list
+    size_t kept_cap;
+};
+
+static size_t map_slot(const addr_map_t *map, uint64_t addr) {
+    size_t i = (size_t)((addr >> 4) * 0x9e3779b97f4a7c15ULL) & (map->cap - 1);
+    while (map->keys[i] && map->keys[i] != addr) {
+        i = (i + 1) & (map->cap - 1);
+    }
+    return i;
+}
+
+// Empty the map with room for n entries at most half full
+static int map_reset(addr_map_t *map, size_t n) {
+    size_t cap = 64;
+
+    while (cap < n * 2) cap *= 2;
+    if (cap != map->cap) {
+        uint64_t *keys = malloc(cap * sizeof(*keys));
+        size_t *values = malloc(cap * sizeof(*values));
+        if (!keys || !values) {
+            free(keys);
+            free(values);
+            return -1;
+        }
+        free(map->keys);
+        free(map->values);
+        map->keys = keys;
+        map->values = values;
+        map->cap = cap;
+    }
+    memset(map->keys, 0, cap * sizeof(*map->keys));
+    return 0;
+}
+
+static void map_put(addr_map_t *map, uint64_t addr, size_t value) {
+    size_t i = map_slot(map, addr);
+    map->keys[i] = addr;
+    map->values[i] = value;
+}
+
+static int map_get(const addr_map_t *map, uint64_t addr, size_t *value) {
+    size_t i;
+
+    if (!map->cap) return 0;
+    i = map_slot(map, addr);
+    if (!map->keys[i]) return 0;
+    *value = map->values[i];
+    return 1;
+}
+
+static void map_free(addr_map_t *map) {
+    free(map->keys);
+    free(map->values);
+}
+
+win_monitor_t *win_monitor_create(uint64_t list_head) {
+    win_monitor_t *m = calloc(1, sizeof(*m));
+    if (m) m->head = list_head;
+    return m;
+}
+
+void win_monitor_destroy(win_monitor_t *m) {
+    if (!m) return;
+    free(m->procs);
+    free(m->next);
+    free(m->kept);
+    map_free(&m->index);
+    map_free(&m->seen);
+    free(m);
+}
+
+size_t win_monitor_count(const win_monitor_t *m) {
+    return m->count;
+}
+
+static void emit(win_event_type_t type, const tracked_t *t, win_event_fn fn, void *ctx,
+                 win_tick_stats_t *stats) {
+    win_event_t ev;
+
+    ev.type = type;
+    ev.addr = t->addr;
+    ev.create_time = t->create_time;
+    ev.pid = t->pid;
+    memcpy(ev.name, t->name, sizeof(ev.name));
+    stats->events++;
+    if (fn) fn(&ev, ctx);
+}
+
+// Fetch the pages holding the links of every known process in batches,
+// ahead of the one-by-one reads
+static void prefetch_links(win_monitor_t *m, guest_mem_t *gm, uint64_t offset) {
+    uint64_t vas[GM_MAX_BATCH];
+    size_t i, n = 0;
+
+    vas[n++] = m->head;
+    for (i = 0; i < m->count; i++) {
+        vas[n++] = m->procs[i].addr + offset;
+        if (n == GM_MAX_BATCH) {
+            gm_prefetch_va(gm, GM_KERNEL_DTB, vas, n);
+            n = 0;
+        }
+    }
+    if (n) gm_prefetch_va(gm, GM_KERNEL_DTB, vas, n);
+}
+
+static int grow_scratch(win_monitor_t *m, size_t n) {
+    if (n > m->next_cap) {
+        size_t cap = m->next_cap ? m->next_cap * 2 : 256;
+        tracked_t *next;
+
+        while (cap < n) cap *= 2;
+        next = realloc(m->next, cap * sizeof(*next));
+        if (!next) return -1;
+        m->next = next;
+        m->next_cap = cap;
+    }
+    return 0;
+}
+
+// Follow the list, reusing what is known and decoding what is new; the
+// result lands in m->next
+static int walk_links(win_monitor_t *m, guest_mem_t *gm, size_t *count, win_tick_stats_t *stats) {
+    const win_profile_t *prof = win_profile_get();
+    const win_span_t *span = &prof->eprocess_link_span;
+    uint64_t links = prof->eprocess_links, current;
+    uint8_t buf[WIN_PROFILE_MAX_SPAN];
+    size_t n = 0, known;
+
+    if (map_reset(&m->seen, m->count + 64) != 0) return -1;
+    if (gm_read_u64(gm, GM_KERNEL_DTB, m->head, &current) != 0) {
+        stats->error = "Unreadable process list head";
+        return -1;
+    }
+
+    while (current != m->head) {
+        uint64_t addr = current - links, create_time = 0;
+        tracked_t *t;
+
+        if (current == 0) {
+            stats->error = "Null link in process list";
+            return -1;
+        }
+        if (map_get(&m->seen, addr, &known)) {
+            stats->error = "Loop in process list";
+            return -1;
+        }
+        if (gm_read_va(gm, GM_KERNEL_DTB, addr + span->start, buf, span->size) != span->size) {
+            stats->error = "Unreadable EPROCESS in process list";
+            return -1;
+        }
+        stats->links_checked++;
+        memcpy(&current, buf + (links - span->start), sizeof(current));
+        if (prof->eprocess_create_time) {
+            memcpy(&create_time, buf + (prof->eprocess_create_time - span->start), sizeof(create_time));
+        }
+
+        if (grow_scratch(m, n + 1) != 0) return -1;
+        t = &m->next[n];
+        if (map_get(&m->index, addr, &known) && m->procs[known].create_time == create_time) {
+            *t = m->procs[known];
+        } else {
+            win_process_t proc;
+            if (win_read_process(gm, addr, &proc) == 0) {
+                stats->error = "Unreadable EPROCESS in process list";
+                return -1;
+            }
+            stats->objects_read++;
+            t->addr = addr;
+            t->create_time = create_time;
+            t->pid = proc.pid;
+            memcpy(t->name, proc.name, sizeof(t->name));
+        }
+
+        // Keep the seen map under half full
+        if ((n + 1) * 2 > m->seen.cap) {
+            size_t i;
+            if (map_reset(&m->seen, n * 2 + 64) != 0) return -1;
+            for (i = 0; i < n; i++) map_put(&m->seen, m->next[i].addr, i);
+        }
+        map_put(&m->seen, addr, n);
+        n++;
+    }
+    *count = n;
+    return 0;
+}
+
+int win_monitor_tick(win_monitor_t *m, guest_mem_t *gm, win_event_fn fn, void *ctx,
+                     win_tick_stats_t *stats) {
+    const win_profile_t *prof = win_profile_get();
+    ctr_scope_t scope;
+    size_t i, n = 0, known;
+    int ret = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    counters_begin(&scope, CTR_PROCESSES);
+
+    // The guest ran since the last tick
+    gm_invalidate(gm);
+    prefetch_links(m, gm, prof->eprocess_link_span.start);
+
+    if (walk_links(m, gm, &n, stats) != 0) {
+        if (!stats->error) stats->error = "Out of memory";
+        ret = -1;
+        goto out;
+    }
+
+    // Same entries in the same order: nothing happened
+    stats->changed = n != m->count || !m->primed;
+    for (i = 0; i < n && !stats->changed; i++) {
+        stats->changed = m->next[i].addr != m->procs[i].addr ||
+                         m->next[i].create_time != m->procs[i].create_time;
+    }
+    stats->processes = n;
+    if (!stats->changed) goto out;
+
+    // Exits: known entries that are gone or came back as someone else
+    if (m->count > m->kept_cap) {
+        uint8_t *kept = realloc(m->kept, m->count);
+        if (!kept) {
+            ret = -1;
+            stats->error = "Out of memory";
+            goto out;
+        }
+        m->kept = kept;
+        m->kept_cap = m->count;
+    }
+    if (m->count) memset(m->kept, 0, m->count);
+    for (i = 0; i < n; i++) {
+        if (map_get(&m->index, m->next[i].addr, &known) &&
+            m->procs[known].create_time == m->next[i].create_time) {
+            m->kept[known] = 1;
+        }
+    }
+    for (i = 0; i < m->count; i++) {
+        if (!m->kept[i]) emit(WIN_EVENT_EXIT, &m->procs[i], fn, ctx, stats);
+    }
+    for (i = 0; i < n; i++) {
+        if (!map_get(&m->index, m->next[i].addr, &known) ||
+            m->procs[known].create_time != m->next[i].create_time) {
+            emit(m->primed ? WIN_EVENT_CREATE : WIN_EVENT_PRESENT, &m->next[i], fn, ctx, stats);
+        }
+    }
+
+    // The new list becomes the reference; the old buffer is next tick's scratch
+    {
+        tracked_t *old = m->procs;
+        size_t old_cap = m->procs_cap;
+        m->procs = m->next;
+        m->procs_cap = m->next_cap;
+        m->next = old;
+        m->next_cap = old_cap;
+        m->count = n;
+    }
+    if (map_reset(&m->index, n) != 0) {
+        m->count = 0;
+        m->primed = 0;
+        stats->error = "Out of memory";
+        ret = -1;
+        goto out;
+    }
+    for (i = 0; i < n; i++) map_put(&m->index, m->procs[i].addr, i);
+    m->primed = 1;
+
+out:
+    counters_end(&scope);
+    return ret;
+}
@@ -0,0 +1,61 @@
+#ifndef WIN_MONITOR_H
+#define WIN_MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+
+// Incremental process-list tracking for long-running monitors.
+//
+// The monitor remembers the EPROCESS set of the previous tick, keyed by
+// address and CreateTime. A tick re-reads only the ActiveProcessLinks
+// and CreateTime of each entry (one small read per process, with the
+// pages fetched in batches), and decodes a full EPROCESS only for
+// entries it has not seen before. An address that comes back with a
+// different CreateTime is a new process in a recycled allocation.
+// Differences from the previous tick are reported as events.
+
+typedef enum {
+    WIN_EVENT_PRESENT,          // on the list at the first tick
+    WIN_EVENT_CREATE,
+    WIN_EVENT_EXIT
+} win_event_type_t;
+
+typedef struct {
+    win_event_type_t type;
+    uint64_t addr;              // EPROCESS
+    uint64_t create_time;       // FILETIME, 0 if the profile lacks it
+    int32_t pid;
+    char name[EPROCESS_IMAGEFILENAME_LEN + 1];
+} win_event_t;
+
+typedef void (*win_event_fn)(const win_event_t *event, void *ctx);
+
+typedef struct {
+    size_t processes;           // on the list after the tick
+    size_t links_checked;       // entries whose links were re-read
+    size_t objects_read;        // full EPROCESS reads
+    size_t events;
+    int changed;                // the list differed from the previous tick
+    const char *error;          // set when the tick was abandoned
+} win_tick_stats_t;
+
+typedef struct win_monitor win_monitor_t;
+
+// list_head is PsActiveProcessHead
+win_monitor_t *win_monitor_create(uint64_t list_head);
+void win_monitor_destroy(win_monitor_t *m);
+
+// Compare the list in guest memory with the previous tick and call fn for
+// every difference (exits first, then creations in list order). Guest
+// caches are invalidated first. A list that cannot be followed (broken or
+// looping links, e.g. while the guest edits it) leaves the state as it
+// was and returns -1 with stats->error set; retry on the next tick.
+int win_monitor_tick(win_monitor_t *m, guest_mem_t *gm, win_event_fn fn, void *ctx,
+                     win_tick_stats_t *stats);
+
+// Processes known after the last successful tick
+size_t win_monitor_count(const win_monitor_t *m);
+
+#endif
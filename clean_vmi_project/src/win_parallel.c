@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "win_parallel.h"
+
+typedef struct {
+    const win_process_list_t *procs;
+    win_shard_prefetch_fn prefetch;
+    win_process_fn fn;
+    void *ctx;
+    int use_arena;                  // give fn the worker's arena
+    size_t next;                    // next unclaimed process index
+} pool_t;
+
+typedef struct {
+    pool_t *pool;
+    guest_mem_t *view;
+    win_arena_t arena;              // rows of this worker's walks
+    pthread_t thread;
+    int started;
+} worker_t;
+
+int win_default_workers(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    pool_t *pool = w->pool;
+    size_t count = pool->procs->count;
+
+    for (;;) {
+        // Claim the next shard of the process list
+        size_t first = __atomic_fetch_add(&pool->next, WIN_PARALLEL_CHUNK, __ATOMIC_RELAXED);
+        size_t last, i;
+
+        if (first >= count) break;
+        last = first + WIN_PARALLEL_CHUNK < count ? first + WIN_PARALLEL_CHUNK : count;
+
+        if (pool->prefetch) pool->prefetch(w->view, pool->procs->items + first, last - first);
+        for (i = first; i < last; i++) {
+            pool->fn(pool->ctx, w->view, &pool->procs->items[i], i, pool->use_arena ? &w->arena : NULL);
+        }
+    }
+    return NULL;
+}
+
+int win_for_each_process(guest_mem_t *gm, const win_process_list_t *procs, int workers,
+                         win_shard_prefetch_fn prefetch, win_process_fn fn, void *ctx,
+                         win_arena_t *arena) {
+    pool_t pool;
+    worker_t *w;
+    int i, ran = 0;
+
+    if (workers < 1) workers = 1;
+    if ((size_t)workers > procs->count) workers = procs->count ? (int)procs->count : 1;
+
+    pool.procs = procs;
+    pool.prefetch = prefetch;
+    pool.fn = fn;
+    pool.ctx = ctx;
+    pool.use_arena = arena != NULL;
+    pool.next = 0;
+
+    w = calloc(workers, sizeof(*w));
+    if (!w) return -1;
+
+    for (i = 0; i < workers; i++) {
+        w[i].pool = &pool;
+        win_arena_init(&w[i].arena);
+        w[i].view = gm_clone(gm, WIN_PARALLEL_CACHE_PAGES);
+        if (!w[i].view) break;
+        // Worker 0 runs on the calling thread
+        if (i > 0) {
+            w[i].started = pthread_create(&w[i].thread, NULL, worker_main, &w[i]) == 0;
+            if (!w[i].started) break;
+        }
+    }
+
+    // Whatever workers did start still drain the whole list
+    if (w[0].view) {
+        worker_main(&w[0]);
+        ran = 1;
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (w[i].started) pthread_join(w[i].thread, NULL);
+        if (w[i].view) {
+            gm_merge_stats(gm, w[i].view);
+            gm_destroy(w[i].view);
+        }
+        if (arena) win_arena_adopt(arena, &w[i].arena);
+    }
+    free(w);
+    return ran ? 0 : -1;
+}
+
+// --- Modules and threads --------------------------------------------------
+
+// Fetch the first page every walk in the shard needs (PEB.Ldr and the
+// first ETHREAD) in one batched backend call
+static void prefetch_details(guest_mem_t *view, const win_process_t *procs, size_t n) {
+    uint64_t vas[WIN_PARALLEL_CHUNK], pas[WIN_PARALLEL_CHUNK], pfns[WIN_PARALLEL_CHUNK * 2];
+    size_t i, k = 0, m = 0;
+
+    // Each PEB is in its own process's address space
+    for (i = 0; i < n; i++) {
+        uint64_t pa;
+        if (procs[i].peb &&
+            gm_translate(view, win_process_dtb(&procs[i]), procs[i].peb + win_profile_get()->peb_ldr, &pa) == 0) {
+            pfns[m++] = pa >> GM_PAGE_SHIFT;
+        }
+        if (procs[i].thread_flink) vas[k++] = procs[i].thread_flink;
+    }
+    // ETHREADs are kernel objects, translated in one pass
+    if (k) gm_translate_batch(view, GM_KERNEL_DTB, vas, pas, k);
+    for (i = 0; i < k; i++) {
+        if (pas[i] != GM_NO_PA) pfns[m++] = pas[i] >> GM_PAGE_SHIFT;
+    }
+    gm_prefetch_pa(view, pfns, m);
+}
+
+static void walk_details(void *ctx, guest_mem_t *view, const win_process_t *process,
+                         size_t index, win_arena_t *arena) {
+    win_process_detail_t *out = ctx;
+    win_process_detail_t *d = out ? &out[index] : NULL;
+    int modules, threads;
+
+    if (d && arena) {
+        d->modules.arena = arena;
+        d->threads.arena = arena;
+    }
+    modules = win_walk_modules(view, process, d ? &d->modules : NULL);
+    threads = win_walk_threads(view, process, d ? &d->threads : NULL);
+    if (d) {
+        d->module_count = modules;
+        d->thread_count = threads;
+    }
+}
+
+int win_walk_details_parallel(guest_mem_t *gm, const win_process_list_t *procs,
+                              int workers, win_process_detail_t *out, win_arena_t *arena) {
+    size_t j;
+    int ret;
+
+    if (out) memset(out, 0, procs->count * sizeof(*out));
+    ret = win_for_each_process(gm, procs, workers, prefetch_details, walk_details, out, arena);
+    for (j = 0; out && arena && j < procs->count; j++) {
+        out[j].modules.arena = arena;
+        out[j].threads.arena = arena;
+    }
+    return ret;
+}
+
+void win_process_details_free(win_process_detail_t *details, size_t count) {
+    size_t i;
+    if (!details) return;
+    for (i = 0; i < count; i++) {
+        win_module_list_free(&details[i].modules);
+        win_thread_list_free(&details[i].threads);
+    }
+    free(details);
+}
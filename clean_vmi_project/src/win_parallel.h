@@ -0,0 +1,54 @@
+#ifndef WIN_PARALLEL_H
+#define WIN_PARALLEL_H
+
+#include "win_walk.h"
+
+// Modules and threads of one process
+typedef struct {
+    win_module_list_t modules;
+    int module_count;
+    win_thread_list_t threads;
+    int thread_count;
+} win_process_detail_t;
+
+// Processes handed to a worker per claim
+#define WIN_PARALLEL_CHUNK 8
+
+// Pages cached by each worker's private view
+#define WIN_PARALLEL_CACHE_PAGES 4096
+
+// Number of online CPUs, used as the default worker count
+int win_default_workers(void);
+
+// Called with each shard of the process list a worker claims, before the
+// processes in it, to batch the first reads of their walks
+typedef void (*win_shard_prefetch_fn)(guest_mem_t *view, const win_process_t *procs, size_t n);
+
+// Called for procs->items[index] on the worker's view. arena is the
+// worker's own when the walk was given one, NULL otherwise.
+typedef void (*win_process_fn)(void *ctx, guest_mem_t *view, const win_process_t *process,
+                               size_t index, win_arena_t *arena);
+
+// Run fn over every process in the list with a pool of workers. Each
+// worker reads through its own gm_clone() view and claims the list in
+// shards of WIN_PARALLEL_CHUNK; worker 0 runs on the calling thread. The
+// view's stats are merged into gm and the workers' arenas handed over to
+// arena when the walk is done. prefetch may be NULL. Returns 0 on
+// success, -1 if no worker could be set up.
+int win_for_each_process(guest_mem_t *gm, const win_process_list_t *procs, int workers,
+                         win_shard_prefetch_fn prefetch, win_process_fn fn, void *ctx,
+                         win_arena_t *arena);
+
+// Enumerate modules and threads of every process in the list with a pool
+// of workers. Each worker reads through its own gm_clone() view; rows land
+// in out[i] for procs->items[i], so the merged result is in list order
+// whatever the scheduling. A NULL out only gathers (see win_walk.h).
+// Rows and names land in arena: each worker fills one of its own, handed
+// over to arena when the walk is done. A NULL arena gives every list its
+// own. Returns 0 on success, -1 if no worker could be set up.
+int win_walk_details_parallel(guest_mem_t *gm, const win_process_list_t *procs,
+                              int workers, win_process_detail_t *out, win_arena_t *arena);
+
+void win_process_details_free(win_process_detail_t *details, size_t count);
+
+#endif
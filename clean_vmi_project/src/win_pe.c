@@ -0,0 +1,444 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "win_pe.h"
+
+// PE32+ layout, as far as sections, exports and the CodeView record
+#define PE_DOS_LFANEW           0x3c
+#define PE_DOS_SIZE             0x40
+#define PE_FILE_SECTIONS        6       // in IMAGE_FILE_HEADER, after "PE\0\0"
+#define PE_FILE_TIMESTAMP       8
+#define PE_FILE_OPT_SIZE        20
+#define PE_OPT_HEADER           24
+#define PE_OPT_MAGIC_64         0x20b
+#define PE_OPT_SIZE_OF_IMAGE    56
+#define PE_OPT_DIR_COUNT        108
+#define PE_OPT_EXPORT_DIR       112
+#define PE_OPT_DEBUG_DIR        (112 + 6 * 8)
+#define PE_NT_MIN               (PE_OPT_HEADER + PE_OPT_EXPORT_DIR + 8)
+#define PE_NT_DEBUG             (PE_OPT_HEADER + PE_OPT_DEBUG_DIR + 8)
+#define PE_SECTION_SIZE         40
+#define PE_EXPORT_DIR_SIZE      40
+#define PE_DEBUG_ENTRY_SIZE     28
+#define PE_DEBUG_TYPE_CV        2
+#define PE_MAX_DEBUG_ENTRIES    16
+#define PE_HEADER_BYTES         0x1000  // headers are read as one page
+
+struct win_pe_cache {
+    win_pe_image_t **slots;         // open addressing on (timestamp, size)
+    size_t cap, count;
+    win_pe_cache_stats_t stats;
+};
+
+static uint16_t le16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static uint32_t le32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+// Offset of the NT headers in the first got bytes of an image, 0 when
+// they are not those of a PE32+ image or not all there
+static uint32_t nt_offset(const uint8_t *hdr, size_t got) {
+    uint32_t lfanew;
+
+    if (got < PE_DOS_SIZE || hdr[0] != 'M' || hdr[1] != 'Z') return 0;
+    lfanew = le32(hdr + PE_DOS_LFANEW);
+    if (lfanew < PE_DOS_SIZE || lfanew > PE_HEADER_BYTES || lfanew + PE_NT_MIN > got ||
+        memcmp(hdr + lfanew, "PE\0\0", 4) != 0 || le16(hdr + lfanew + PE_OPT_HEADER) != PE_OPT_MAGIC_64) {
+        return 0;
+    }
+    return lfanew;
+}
+
+// The fields of win_pe_headers_t from len bytes of NT headers
+static void decode_headers(const uint8_t *nt, size_t len, win_pe_headers_t *out) {
+    const uint8_t *opt = nt + PE_OPT_HEADER;
+
+    out->timestamp = le32(nt + PE_FILE_TIMESTAMP);
+    out->size_of_image = le32(opt + PE_OPT_SIZE_OF_IMAGE);
+    out->debug_rva = out->debug_size = 0;
+    if (len >= PE_NT_DEBUG && le32(opt + PE_OPT_DIR_COUNT) > 6) {
+        out->debug_rva = le32(opt + PE_OPT_DEBUG_DIR);
+        out->debug_size = le32(opt + PE_OPT_DEBUG_DIR + 4);
+    }
+}
+
+int win_pe_headers(guest_mem_t *gm, uint64_t dtb, uint64_t base, win_pe_headers_t *out) {
+    uint8_t hdr[PE_HEADER_BYTES + PE_NT_DEBUG];
+    uint32_t lfanew;
+
+    // The DOS header, then only as much of the NT headers as is decoded
+    if (gm_read_va(gm, dtb, base, hdr, PE_DOS_SIZE) != PE_DOS_SIZE) return -1;
+    lfanew = le32(hdr + PE_DOS_LFANEW);
+    if (lfanew < PE_DOS_SIZE || lfanew > PE_HEADER_BYTES ||
+        gm_read_va(gm, dtb, base + lfanew, hdr + lfanew, PE_NT_DEBUG) != PE_NT_DEBUG ||
+        nt_offset(hdr, lfanew + PE_NT_DEBUG) != lfanew) {
+        return -1;
+    }
+    decode_headers(hdr + lfanew, PE_NT_DEBUG, out);
+    return 0;
+}
+
+int win_pe_debug_id(guest_mem_t *gm, uint64_t base, win_pdb_id_t *out) {
+    uint8_t dir[PE_MAX_DEBUG_ENTRIES * PE_DEBUG_ENTRY_SIZE], cv[24 + sizeof(out->pdb)];
+    win_pe_headers_t hdr;
+    uint32_t n, i;
+    size_t got;
+
+    memset(out, 0, sizeof(*out));
+    if (win_pe_headers(gm, GM_KERNEL_DTB, base, &hdr) != 0) return -1;
+    out->size_of_image = hdr.size_of_image;
+    if (!hdr.debug_rva) return -1;
+    n = hdr.debug_size / PE_DEBUG_ENTRY_SIZE;
+    if (n > PE_MAX_DEBUG_ENTRIES) n = PE_MAX_DEBUG_ENTRIES;
+    if (n == 0 || gm_read_va(gm, GM_KERNEL_DTB, base + hdr.debug_rva, dir, n * PE_DEBUG_ENTRY_SIZE) !=
+                  n * PE_DEBUG_ENTRY_SIZE) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        const uint8_t *e = dir + i * PE_DEBUG_ENTRY_SIZE;
+        uint32_t cv_rva = le32(e + 20);
+
+        if (le32(e + 12) != PE_DEBUG_TYPE_CV || le32(e + 16) < 24 || !cv_rva) continue;
+
+        // RSDS, GUID, age, then the PDB name; a short read still leaves
+        // a usable prefix of the name
+        got = gm_read_va(gm, GM_KERNEL_DTB, base + cv_rva, cv, sizeof(cv));
+        if (got < 24 || memcmp(cv, "RSDS", 4) != 0) continue;
+        snprintf(out->guid, sizeof(out->guid), "%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X",
+                 le32(cv + 4), le16(cv + 8), le16(cv + 10),
+                 cv[12], cv[13], cv[14], cv[15], cv[16], cv[17], cv[18], cv[19]);
+        out->age = le32(cv + 20);
+        memcpy(out->pdb, cv + 24, got - 24 < sizeof(out->pdb) ? got - 24 : sizeof(out->pdb));
+        out->pdb[sizeof(out->pdb) - 1] = '\0';
+        return 0;
+    }
+    return -1;
+}
+
+static size_t slot_of(const win_pe_cache_t *c, uint32_t timestamp, uint32_t size) {
+    size_t i = (size_t)((((uint64_t)size << 32) | timestamp) * 0x9e3779b97f4a7c15ULL >> 20) & (c->cap - 1);
+    while (c->slots[i] && (c->slots[i]->timestamp != timestamp || c->slots[i]->size_of_image != size)) {
+        i = (i + 1) & (c->cap - 1);
+    }
+    return i;
+}
+
+static int cache_grow(win_pe_cache_t *c) {
+    win_pe_image_t **old = c->slots;
+    size_t i, old_cap = c->cap;
+
+    c->cap = old_cap ? old_cap * 2 : 64;
+    c->slots = calloc(c->cap, sizeof(*c->slots));
+    if (!c->slots) {
+        c->slots = old;
+        c->cap = old_cap;
+        return -1;
+    }
+    for (i = 0; i < old_cap; i++) {
+        if (old[i]) c->slots[slot_of(c, old[i]->timestamp, old[i]->size_of_image)] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+win_pe_cache_t *win_pe_cache_create(void) {
+    win_pe_cache_t *c = calloc(1, sizeof(*c));
+    if (c && cache_grow(c) != 0) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void image_free(win_pe_image_t *pe) {
+    free(pe->sections);
+    free(pe->exports);
+    free(pe->names);
+    free(pe);
+}
+
+void win_pe_cache_destroy(win_pe_cache_t *c) {
+    size_t i;
+
+    if (!c) return;
+    for (i = 0; i < c->cap; i++) {
+        if (c->slots[i]) image_free(c->slots[i]);
+    }
+    free(c->slots);
+    free(c);
+}
+
+const win_pe_cache_stats_t *win_pe_cache_stats(const win_pe_cache_t *c) {
+    return &c->stats;
+}
+
+size_t win_pe_cache_count(const win_pe_cache_t *c) {
+    return c->count;
+}
+
+static int compare_export(const void *a, const void *b) {
+    const win_pe_export_t *x = a, *y = b;
+    if (x->rva != y->rva) return x->rva < y->rva ? -1 : 1;
+    return x->ordinal < y->ordinal ? -1 : x->ordinal > y->ordinal;
+}
+
+// Export directory at dir_rva. The tables are read whole; names one by
+// one, which the page cache turns into copies from a few pages. Anything
+// unreadable (paged out) is left out rather than failing the image.
+static void parse_exports(win_pe_image_t *pe, guest_mem_t *gm, uint64_t dtb, uint64_t base,
+                          uint32_t dir_rva, uint32_t dir_size) {
+    uint8_t dir[PE_EXPORT_DIR_SIZE];
+    uint32_t *functions = NULL, *name_rvas = NULL, *name_offsets = NULL;
+    uint16_t *ordinals = NULL;
+    uint32_t nfunctions, nnames, ordinal_base, i;
+    size_t names_len = 0, names_cap = 0, n = 0;
+
+    if (gm_read_va(gm, dtb, base + dir_rva, dir, sizeof(dir)) != sizeof(dir)) return;
+    ordinal_base = le32(dir + 0x10);
+    nfunctions = le32(dir + 0x14);
+    nnames = le32(dir + 0x18);
+    if (nfunctions > WIN_PE_MAX_EXPORTS) nfunctions = WIN_PE_MAX_EXPORTS;
+    if (nnames > nfunctions) nnames = nfunctions;
+    if (nfunctions == 0) return;
+
+    functions = calloc(nfunctions, sizeof(*functions));
+    name_offsets = calloc(nfunctions, sizeof(*name_offsets));   // 0: unnamed
+    name_rvas = calloc(nnames ? nnames : 1, sizeof(*name_rvas));
+    ordinals = calloc(nnames ? nnames : 1, sizeof(*ordinals));
+    pe->exports = calloc(nfunctions, sizeof(*pe->exports));
+    if (!functions || !name_offsets || !name_rvas || !ordinals || !pe->exports ||
+        gm_read_va(gm, dtb, base + le32(dir + 0x1c), functions,
+                   nfunctions * sizeof(*functions)) != nfunctions * sizeof(*functions)) {
+        goto out;
+    }
+    if (gm_read_va(gm, dtb, base + le32(dir + 0x20), name_rvas,
+                   nnames * sizeof(*name_rvas)) != nnames * sizeof(*name_rvas) ||
+        gm_read_va(gm, dtb, base + le32(dir + 0x24), ordinals,
+                   nnames * sizeof(*ordinals)) != nnames * sizeof(*ordinals)) {
+        nnames = 0;
+    }
+
+    // Names go into one buffer; offsets are 1-based so 0 means unnamed
+    for (i = 0; i < nnames; i++) {
+        char name[WIN_PE_MAX_EXPORT_NAME];
+        size_t got, len;
+
+        if (ordinals[i] >= nfunctions) continue;
+        got = gm_read_va(gm, dtb, base + name_rvas[i], name, sizeof(name));
+        len = strnlen(name, got);
+        if (len == 0 || len == got) continue;
+        if (names_len + len + 1 > names_cap) {
+            size_t cap = names_cap ? names_cap * 2 : 4096;
+            char *grown;
+            while (cap < names_len + len + 1) cap *= 2;
+            grown = realloc(pe->names, cap);
+            if (!grown) break;
+            pe->names = grown;
+            names_cap = cap;
+        }
+        memcpy(pe->names + names_len, name, len + 1);
+        name_offsets[ordinals[i]] = (uint32_t)names_len + 1;
+        names_len += len + 1;
+    }
+
+    for (i = 0; i < nfunctions; i++) {
+        uint32_t rva = functions[i];
+
+        // Forwarders point into the export directory at "dll.name"
+        if (rva == 0 || (rva >= dir_rva && rva - dir_rva < dir_size)) continue;
+        pe->exports[n].rva = rva;
+        pe->exports[n].ordinal = ordinal_base + i;
+        pe->exports[n].name = name_offsets[i];
+        n++;
+    }
+    pe->export_count = n;
+    qsort(pe->exports, n, sizeof(*pe->exports), compare_export);
+
+out:
+    free(functions);
+    free(name_rvas);
+    free(name_offsets);
+    free(ordinals);
+}
+
+// Sections and exports of the image whose header page is hdr (got bytes)
+static win_pe_image_t *parse_image(guest_mem_t *gm, uint64_t dtb, uint64_t base, const uint8_t *hdr,
+                                   size_t got, uint32_t lfanew) {
+    const uint8_t *nt = hdr + lfanew, *opt = nt + PE_OPT_HEADER;
+    win_pe_image_t *pe = calloc(1, sizeof(*pe));
+    uint32_t nsections = le16(nt + PE_FILE_SECTIONS);
+    uint32_t table = lfanew + PE_OPT_HEADER + le16(nt + PE_FILE_OPT_SIZE), i;
+    win_pe_headers_t h;
+
+    if (!pe) return NULL;
+    decode_headers(nt, got - lfanew, &h);
+    pe->timestamp = h.timestamp;
+    pe->size_of_image = h.size_of_image;
+
+    if (nsections > WIN_PE_MAX_SECTIONS) nsections = WIN_PE_MAX_SECTIONS;
+    if (table < got && nsections > (got - table) / PE_SECTION_SIZE) {
+        nsections = (uint32_t)((got - table) / PE_SECTION_SIZE);
+    }
+    if (table < got && nsections) {
+        pe->sections = calloc(nsections, sizeof(*pe->sections));
+        if (!pe->sections) {
+            image_free(pe);
+            return NULL;
+        }
+        for (i = 0; i < nsections; i++) {
+            const uint8_t *sec = hdr + table + i * PE_SECTION_SIZE;
+            win_pe_section_t *out = &pe->sections[i];
+
+            memcpy(out->name, sec, 8);
+            out->size = le32(sec + 8);
+            out->rva = le32(sec + 12);
+            out->characteristics = le32(sec + 36);
+        }
+        pe->section_count = nsections;
+    }
+
+    if (le32(opt + PE_OPT_DIR_COUNT) > 0 && le32(opt + PE_OPT_EXPORT_DIR)) {
+        parse_exports(pe, gm, dtb, base, le32(opt + PE_OPT_EXPORT_DIR), le32(opt + PE_OPT_EXPORT_DIR + 4));
+    }
+    return pe;
+}
+
+const win_pe_image_t *win_pe_cache_get(win_pe_cache_t *c, guest_mem_t *gm, uint64_t dtb, uint64_t base) {
+    uint8_t hdr[PE_HEADER_BYTES];
+    win_pe_headers_t h;
+    win_pe_image_t *pe;
+    uint32_t lfanew, timestamp, size;
+    size_t got, slot;
+
+    // The header page says which image this is
+    got = gm_read_va(gm, dtb, base, hdr, sizeof(hdr));
+    lfanew = nt_offset(hdr, got);
+    if (!lfanew) {
+        c->stats.failed++;
+        return NULL;
+    }
+    decode_headers(hdr + lfanew, got - lfanew, &h);
+    timestamp = h.timestamp;
+    size = h.size_of_image;
+
+    slot = slot_of(c, timestamp, size);
+    if (c->slots[slot]) {
+        c->stats.hits++;
+        return c->slots[slot];
+    }
+    pe = parse_image(gm, dtb, base, hdr, got, lfanew);
+    if (!pe) return NULL;
+    if ((c->count + 1) * 2 > c->cap) {
+        if (cache_grow(c) != 0) {
+            image_free(pe);
+            return NULL;
+        }
+        slot = slot_of(c, timestamp, size);
+    }
+    c->slots[slot] = pe;
+    c->count++;
+    c->stats.parsed++;
+    return pe;
+}
+
+const win_pe_section_t *win_pe_section_of(const win_pe_image_t *pe, uint32_t rva) {
+    size_t i;
+
+    for (i = 0; i < pe->section_count; i++) {
+        const win_pe_section_t *s = &pe->sections[i];
+        if (rva >= s->rva && rva - s->rva < s->size) return s;
+    }
+    return NULL;
+}
+
+const win_pe_export_t *win_pe_export_at(const win_pe_image_t *pe, uint32_t rva) {
+    const win_pe_section_t *section = win_pe_section_of(pe, rva);
+    size_t lo = 0, hi = pe->export_count;
+
+    if (!section) return NULL;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (pe->exports[mid].rva <= rva) lo = mid + 1;
+        else hi = mid;
+    }
+    // An export in another section says nothing about this address
+    if (lo == 0 || win_pe_section_of(pe, pe->exports[lo - 1].rva) != section) return NULL;
+    return &pe->exports[lo - 1];
+}
+
+const char *win_pe_export_name(const win_pe_image_t *pe, const win_pe_export_t *e) {
+    return e->name ? pe->names + e->name - 1 : NULL;
+}
+
+static int compare_mod(const void *a, const void *b) {
+    uint64_t x = ((const win_mod_t*)a)->module->base, y = ((const win_mod_t*)b)->module->base;
+    return x < y ? -1 : x > y;
+}
+
+int win_mod_map_build(win_mod_map_t *map, win_pe_cache_t *c, guest_mem_t *gm, uint64_t dtb,
+                      const win_module_list_t *modules) {
+    size_t i;
+
+    map->count = 0;
+    map->items = calloc(modules->count ? modules->count : 1, sizeof(*map->items));
+    if (!map->items) return -1;
+    for (i = 0; i < modules->count; i++) {
+        const win_module_t *m = &modules->items[i];
+        if (m->base == 0 || m->size == 0) continue;
+        map->items[map->count].module = m;
+        map->items[map->count].pe = win_pe_cache_get(c, gm, dtb, m->base);
+        map->count++;
+    }
+    qsort(map->items, map->count, sizeof(*map->items), compare_mod);
+    return 0;
+}
+
+void win_mod_map_free(win_mod_map_t *map) {
+    free(map->items);
+    memset(map, 0, sizeof(*map));
+}
+
+int win_mod_map_lookup(const win_mod_map_t *map, uint64_t va, win_mod_addr_t *out) {
+    const win_mod_t *k;
+    size_t lo = 0, hi = map->count;
+    uint32_t rva;
+
+    memset(out, 0, sizeof(*out));
+
+    // Last module based at or below va
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->items[mid].module->base <= va) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return -1;
+    k = &map->items[lo - 1];
+    if (va - k->module->base >= k->module->size) return -1;
+
+    rva = (uint32_t)(va - k->module->base);
+    out->mod = k;
+    out->offset = rva;
+    if (!k->pe) return 0;
+
+    out->section = win_pe_section_of(k->pe, rva);
+    out->symbol = win_pe_export_at(k->pe, rva);
+    if (out->symbol) out->offset = rva - out->symbol->rva;
+    return 0;
+}
+
+size_t win_mod_addr_format(const win_mod_addr_t *addr, char *out, size_t len) {
+    const char *name = addr->symbol ? win_pe_export_name(addr->mod->pe, addr->symbol) : NULL;
+    int n;
+
+    if (!addr->mod) {
+        n = snprintf(out, len, "?");
+    } else if (name) {
+        n = snprintf(out, len, "%s!%s+0x%llx", addr->mod->module->name, name, (unsigned long long)addr->offset);
+    } else if (addr->symbol) {
+        n = snprintf(out, len, "%s!#%u+0x%llx", addr->mod->module->name, addr->symbol->ordinal,
+                     (unsigned long long)addr->offset);
+    } else {
+        n = snprintf(out, len, "%s+0x%llx", addr->mod->module->name, (unsigned long long)addr->offset);
+    }
+    if (n < 0) return 0;
+    return (size_t)n < len ? (size_t)n : (len ? len - 1 : 0);
+}
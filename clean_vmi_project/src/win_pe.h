@@ -0,0 +1,140 @@
+#ifndef WIN_PE_H
+#define WIN_PE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+
+// PE images of loaded modules, and addresses resolved against them.
+//
+// Naming an address (a return address on a stack, a callback pointer, a
+// thread start address) as module!export+offset needs the module list
+// (win_walk_drivers for the kernel, win_walk_modules for a process) and,
+// per module, its section table and export directory. Parsing those takes
+// a few dozen guest reads per image, so parsed images are kept in a cache
+// keyed by the TimeDateStamp and SizeOfImage of the PE headers. Nothing
+// in a parse depends on where the image is mapped, so one parse serves
+// every process mapping the same DLL at any base: a later lookup only
+// reads the header page to check the stamp, and a module replaced by
+// another build is parsed afresh.
+//
+// A cache and the maps built on it are not thread-safe.
+
+// What the NT headers of an image say, read without parsing sections
+// or exports
+typedef struct {
+    uint32_t timestamp;
+    uint32_t size_of_image;
+    uint32_t debug_rva;             // debug directory, 0 if there is none
+    uint32_t debug_size;
+} win_pe_headers_t;
+
+// Headers of the PE32+ image at base in address space dtb; 0 on success,
+// -1 when there is no readable image header there
+int win_pe_headers(guest_mem_t *gm, uint64_t dtb, uint64_t base, win_pe_headers_t *out);
+
+#define WIN_PDB_GUID_LEN 33         // 32 hex digits and NUL
+
+// The build of an image, from its CodeView debug record
+typedef struct {
+    char guid[WIN_PDB_GUID_LEN];    // as in ISF metadata and symbol servers
+    uint32_t age;
+    char pdb[64];                   // e.g. ntkrnlmp.pdb
+    uint32_t size_of_image;
+} win_pdb_id_t;
+
+// Read the CodeView debug record of the kernel-space PE image at base;
+// 0 on success
+int win_pe_debug_id(guest_mem_t *gm, uint64_t base, win_pdb_id_t *out);
+
+#define WIN_PE_MAX_SECTIONS     96
+#define WIN_PE_MAX_EXPORTS      65536
+#define WIN_PE_MAX_EXPORT_NAME  128
+
+typedef struct {
+    char name[9];
+    uint32_t rva;
+    uint32_t size;
+    uint32_t characteristics;
+} win_pe_section_t;
+
+// One row of the export index, 12 bytes
+typedef struct {
+    uint32_t rva;
+    uint32_t ordinal;
+    uint32_t name;                  // offset in the image's names + 1, 0 if none
+} win_pe_export_t;
+
+typedef struct {
+    uint32_t timestamp;
+    uint32_t size_of_image;
+    win_pe_section_t *sections;
+    size_t section_count;
+    win_pe_export_t *exports;       // sorted by rva; forwarders left out
+    size_t export_count;
+    char *names;                    // NUL-separated export names
+} win_pe_image_t;
+
+typedef struct win_pe_cache win_pe_cache_t;
+
+typedef struct {
+    uint64_t hits;                  // header stamp matched a parsed image
+    uint64_t parsed;
+    uint64_t failed;                // no readable PE header at the base
+} win_pe_cache_stats_t;
+
+win_pe_cache_t *win_pe_cache_create(void);
+void win_pe_cache_destroy(win_pe_cache_t *c);
+
+// The image at base in address space dtb (GM_KERNEL_DTB for drivers),
+// parsed now or earlier; NULL when its header cannot be read. Owned by
+// the cache.
+const win_pe_image_t *win_pe_cache_get(win_pe_cache_t *c, guest_mem_t *gm, uint64_t dtb, uint64_t base);
+const win_pe_cache_stats_t *win_pe_cache_stats(const win_pe_cache_t *c);
+
+// Images parsed so far
+size_t win_pe_cache_count(const win_pe_cache_t *c);
+
+// Section holding rva, NULL if none
+const win_pe_section_t *win_pe_section_of(const win_pe_image_t *pe, uint32_t rva);
+
+// Nearest export at or below rva in the same section, by binary search;
+// NULL if there is none
+const win_pe_export_t *win_pe_export_at(const win_pe_image_t *pe, uint32_t rva);
+
+// Name of an export, NULL when it is exported by ordinal only
+const char *win_pe_export_name(const win_pe_image_t *pe, const win_pe_export_t *e);
+
+// Modules of one address space sorted by base, for resolving addresses
+typedef struct {
+    const win_module_t *module;     // from the module list
+    const win_pe_image_t *pe;       // NULL if the header was unreadable
+} win_mod_t;
+
+typedef struct {
+    win_mod_t *items;
+    size_t count;
+} win_mod_map_t;
+
+typedef struct {
+    const win_mod_t *mod;
+    const win_pe_section_t *section;    // NULL if none holds the address
+    const win_pe_export_t *symbol;      // nearest export below, same section
+    uint64_t offset;                    // from the symbol, else from the base
+} win_mod_addr_t;
+
+// Index a module list (which must outlive the map) of address space dtb,
+// parsing each image through the cache. Returns 0, or -1 when out of
+// memory.
+int win_mod_map_build(win_mod_map_t *map, win_pe_cache_t *c, guest_mem_t *gm, uint64_t dtb,
+                      const win_module_list_t *modules);
+void win_mod_map_free(win_mod_map_t *map);
+
+// Module, section and export holding va; -1 when no module does
+int win_mod_map_lookup(const win_mod_map_t *map, uint64_t va, win_mod_addr_t *out);
+
+// "hal.dll!HalExport+0x12", "hal.dll!#7+0x12" or "hal.dll+0x1234"
+size_t win_mod_addr_format(const win_mod_addr_t *addr, char *out, size_t len);
+
+#endif
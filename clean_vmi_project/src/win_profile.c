@@ -0,0 +1,592 @@
+#include <stdlib.h>
+#include <string.h>
+#include "win_profile.h"
+
+// Deepest key path we track while scanning an ISF file
+#define ISF_MAX_DEPTH 8
+
+// Fields collected from user_types.<type>.fields.<field>.offset
+enum {
+    F_PCB, F_KPROCESS_DTB, F_PID, F_LINKS, F_PEB, F_NAME, F_THREADS, F_CREATE_TIME,
+    F_PEB_LDR, F_INLOAD, F_DLLBASE, F_SIZEOFIMAGE, F_FULLDLLNAME, F_BASEDLLNAME,
+    F_THREADLISTENTRY, F_CID, F_CID_PROCESS, F_CID_THREAD,
+    F_OBJECT_TABLE, F_HT_NEXT, F_HT_CODE, F_OH_TYPE_INDEX, F_OH_BODY, F_OT_NAME, F_OT_INDEX,
+    F_FILE_NAME, F_KEY_KCB, F_KCB_PARENT, F_KCB_NAME_BLOCK, F_NCB_HASH, F_HASH_LENGTH, F_HASH_NAME,
+    F_VAD_ROOT, F_VAD_NODE, F_NODE_LEFT, F_NODE_RIGHT, F_VAD_START, F_VAD_END, F_VAD_START_HIGH,
+    F_VAD_END_HIGH, F_VAD_U, F_VAD_TYPE, F_VAD_PROTECTION, F_VAD_PRIVATE, F_VAD_SUBSECTION,
+    F_SUB_CONTROL_AREA, F_CA_FILE,
+    F_COUNT
+};
+
+static const struct {
+    const char *type;
+    const char *field;
+    int optional;
+} isf_fields[F_COUNT] = {
+    [F_PCB]             = { "_EPROCESS", "Pcb", 1 },
+    [F_KPROCESS_DTB]    = { "_KPROCESS", "DirectoryTableBase", 0 },
+    [F_PID]             = { "_EPROCESS", "UniqueProcessId", 0 },
+    [F_LINKS]           = { "_EPROCESS", "ActiveProcessLinks", 0 },
+    [F_PEB]             = { "_EPROCESS", "Peb", 0 },
+    [F_NAME]            = { "_EPROCESS", "ImageFileName", 0 },
+    [F_THREADS]         = { "_EPROCESS", "ThreadListHead", 0 },
+    [F_CREATE_TIME]     = { "_EPROCESS", "CreateTime", 1 },
+    [F_PEB_LDR]         = { "_PEB", "Ldr", 0 },
+    [F_INLOAD]          = { "_PEB_LDR_DATA", "InLoadOrderModuleList", 0 },
+    [F_DLLBASE]         = { "_LDR_DATA_TABLE_ENTRY", "DllBase", 0 },
+    [F_SIZEOFIMAGE]     = { "_LDR_DATA_TABLE_ENTRY", "SizeOfImage", 0 },
+    [F_FULLDLLNAME]     = { "_LDR_DATA_TABLE_ENTRY", "FullDllName", 0 },
+    [F_BASEDLLNAME]     = { "_LDR_DATA_TABLE_ENTRY", "BaseDllName", 0 },
+    [F_THREADLISTENTRY] = { "_ETHREAD", "ThreadListEntry", 0 },
+    [F_CID]             = { "_ETHREAD", "Cid", 0 },
+    [F_CID_PROCESS]     = { "_CLIENT_ID", "UniqueProcess", 0 },
+    [F_CID_THREAD]      = { "_CLIENT_ID", "UniqueThread", 0 },
+    [F_OBJECT_TABLE]    = { "_EPROCESS", "ObjectTable", 1 },
+    [F_HT_NEXT]         = { "_HANDLE_TABLE", "NextHandleNeedingPool", 1 },
+    [F_HT_CODE]         = { "_HANDLE_TABLE", "TableCode", 1 },
+    [F_OH_TYPE_INDEX]   = { "_OBJECT_HEADER", "TypeIndex", 1 },
+    [F_OH_BODY]         = { "_OBJECT_HEADER", "Body", 1 },
+    [F_OT_NAME]         = { "_OBJECT_TYPE", "Name", 1 },
+    [F_OT_INDEX]        = { "_OBJECT_TYPE", "Index", 1 },
+    [F_FILE_NAME]       = { "_FILE_OBJECT", "FileName", 1 },
+    [F_KEY_KCB]         = { "_CM_KEY_BODY", "KeyControlBlock", 1 },
+    [F_KCB_PARENT]      = { "_CM_KEY_CONTROL_BLOCK", "ParentKcb", 1 },
+    [F_KCB_NAME_BLOCK]  = { "_CM_KEY_CONTROL_BLOCK", "NameBlock", 1 },
+    [F_NCB_HASH]        = { "_CM_NAME_CONTROL_BLOCK", "NameHash", 1 },
+    [F_HASH_LENGTH]     = { "_CM_NAME_HASH", "NameLength", 1 },
+    [F_HASH_NAME]       = { "_CM_NAME_HASH", "Name", 1 },
+    [F_VAD_ROOT]        = { "_EPROCESS", "VadRoot", 1 },
+    [F_VAD_NODE]        = { "_MMVAD_SHORT", "VadNode", 1 },
+    [F_NODE_LEFT]       = { "_RTL_BALANCED_NODE", "Left", 1 },
+    [F_NODE_RIGHT]      = { "_RTL_BALANCED_NODE", "Right", 1 },
+    [F_VAD_START]       = { "_MMVAD_SHORT", "StartingVpn", 1 },
+    [F_VAD_END]         = { "_MMVAD_SHORT", "EndingVpn", 1 },
+    [F_VAD_START_HIGH]  = { "_MMVAD_SHORT", "StartingVpnHigh", 1 },
+    [F_VAD_END_HIGH]    = { "_MMVAD_SHORT", "EndingVpnHigh", 1 },
+    [F_VAD_U]           = { "_MMVAD_SHORT", "u", 1 },
+    [F_VAD_TYPE]        = { "_MMVAD_FLAGS", "VadType", 1 },
+    [F_VAD_PROTECTION]  = { "_MMVAD_FLAGS", "Protection", 1 },
+    [F_VAD_PRIVATE]     = { "_MMVAD_FLAGS", "PrivateMemory", 1 },
+    [F_VAD_SUBSECTION]  = { "_MMVAD", "Subsection", 1 },
+    [F_SUB_CONTROL_AREA] = { "_SUBSECTION", "ControlArea", 1 },
+    [F_CA_FILE]         = { "_CONTROL_AREA", "FilePointer", 1 },
+};
+
+// Kernel symbols collected from symbols.<name>.address
+enum { S_ACTIVE_HEAD, S_SYSTEM_PROCESS, S_LOADED_MODULES, S_TYPE_INDEX_TABLE, S_HEADER_COOKIE, S_COUNT };
+
+static const char *isf_symbols[S_COUNT] = {
+    [S_ACTIVE_HEAD]     = "PsActiveProcessHead",
+    [S_SYSTEM_PROCESS]  = "PsInitialSystemProcess",
+    [S_LOADED_MODULES]  = "PsLoadedModuleList",
+    [S_TYPE_INDEX_TABLE] = "ObTypeIndexTable",
+    [S_HEADER_COOKIE]   = "ObHeaderCookie",
+};
+
+typedef struct {
+    const char *p, *end;
+    int depth;
+    const char *key[ISF_MAX_DEPTH];
+    size_t key_len[ISF_MAX_DEPTH];
+
+    uint64_t field[F_COUNT];
+    int have_field[F_COUNT];
+    uint64_t bit[F_COUNT];          // type.bit_position of bitfields
+    int have_bit[F_COUNT];
+    uint64_t symbol[S_COUNT];
+    char guid[40];
+    uint64_t age;
+} isf_scan_t;
+
+static win_profile_t active_profile;
+static int active_set = 0;
+
+void win_profile_builtin(win_profile_t *out) {
+    memset(out, 0, sizeof(*out));
+    snprintf(out->name, sizeof(out->name), "built-in Windows 10 x64");
+
+    out->eprocess_dtb = 0x28;
+    out->eprocess_pid = 0x2e0;
+    out->eprocess_links = 0x2e8;
+    out->eprocess_peb = 0x3f8;
+    out->eprocess_name = 0x5a8;
+    out->eprocess_threads = 0x5e0;
+    out->eprocess_create_time = 0x308;
+
+    out->peb_ldr = 0x18;
+    out->ldr_inloadorder = 0x10;
+    out->ldr_dllbase = 0x30;
+    out->ldr_sizeofimage = 0x40;
+    out->ldr_fulldllname = 0x48;
+    out->ldr_basedllname = 0x60;
+
+    out->ethread_threadlistentry = 0x5e0;
+    out->ethread_cid_process = 0x644;
+    out->ethread_cid_thread = 0x648;
+
+    out->eprocess_object_table = 0x418;
+    out->handle_table_next = 0x0;
+    out->handle_table_code = 0x8;
+    out->object_header_type_index = 0x18;
+    out->object_header_body = 0x30;
+    out->object_type_name = 0x10;
+    out->object_type_index = 0x28;
+    out->file_object_name = 0x58;
+    out->key_body_kcb = 0x8;
+    out->kcb_parent = 0x48;
+    out->kcb_name_block = 0x50;
+    out->name_block_length = 0x18;
+    out->name_block_name = 0x1a;
+
+    out->eprocess_vad_root = 0x628;
+    out->vad_left = 0x0;
+    out->vad_right = 0x8;
+    out->vad_start = 0x18;
+    out->vad_end = 0x1c;
+    out->vad_start_high = 0x20;
+    out->vad_end_high = 0x21;
+    out->vad_flags = 0x30;
+    out->vad_type_bit = 4;
+    out->vad_protection_bit = 7;
+    out->vad_private_bit = 20;
+    out->vad_subsection = 0x48;
+    out->subsection_control_area = 0x0;
+    out->control_area_file = 0x40;
+
+    win_profile_compile(out);
+}
+
+// Span covering fields given as (offset, size) pairs
+static win_span_t span_of(const uint32_t (*fields)[2], size_t n) {
+    uint32_t lo = UINT32_MAX, hi = 0;
+    win_span_t span;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (fields[i][0] < lo) lo = fields[i][0];
+        if (fields[i][0] + fields[i][1] > hi) hi = fields[i][0] + fields[i][1];
+    }
+    span.start = lo;
+    span.size = hi - lo;
+    return span;
+}
+
+int win_profile_compile(win_profile_t *prof) {
+    // Sizes are what the walkers actually decode from each field
+    const uint32_t eprocess[][2] = {
+        { prof->eprocess_dtb, 8 },
+        { prof->eprocess_pid, 4 },
+        { prof->eprocess_links, 16 },
+        { prof->eprocess_peb, 8 },
+        { prof->eprocess_name, 15 },
+        { prof->eprocess_threads, 16 },
+        { prof->eprocess_create_time, 8 },
+        { prof->eprocess_object_table, 8 },
+        { prof->eprocess_vad_root, 8 },
+    };
+    const uint32_t links[][2] = {
+        { prof->eprocess_links, 16 },
+        { prof->eprocess_create_time ? prof->eprocess_create_time : prof->eprocess_links, 8 },
+    };
+    const uint32_t ldr[][2] = {
+        { 0, 8 },                           // InLoadOrderLinks.Flink
+        { prof->ldr_dllbase, 8 },
+        { prof->ldr_sizeofimage, 4 },
+        { prof->ldr_basedllname, 16 },
+    };
+    const uint32_t ethread[][2] = {
+        { prof->ethread_threadlistentry, 16 },
+        { prof->ethread_cid_process, 4 },
+        { prof->ethread_cid_thread, 4 },
+    };
+
+    // EPROCESS reads start at the object so a short read still decodes
+    // the fields in front of an unmapped page
+    prof->eprocess_span = span_of(eprocess, sizeof(eprocess) / sizeof(eprocess[0]));
+    prof->eprocess_span.size += prof->eprocess_span.start;
+    prof->eprocess_span.start = 0;
+    prof->ldr_span = span_of(ldr, sizeof(ldr) / sizeof(ldr[0]));
+    prof->ethread_span = span_of(ethread, sizeof(ethread) / sizeof(ethread[0]));
+    prof->eprocess_link_span = span_of(links, sizeof(links) / sizeof(links[0]));
+
+    if (prof->eprocess_span.size > WIN_PROFILE_MAX_SPAN ||
+        prof->ldr_span.size > WIN_PROFILE_MAX_SPAN ||
+        prof->ethread_span.size > WIN_PROFILE_MAX_SPAN) {
+        return -1;
+    }
+    return 0;
+}
+
+// --- Minimal JSON scanner -------------------------------------------------
+//
+// ISF files are several MB of nested objects; we only need a few dozen
+// numbers from them, so the scanner walks the document once and looks at
+// the key path of each scalar instead of building a tree.
+
+static int key_is(const isf_scan_t *s, int level, const char *str) {
+    size_t len = strlen(str);
+    return level < s->depth && level < ISF_MAX_DEPTH &&
+           s->key_len[level] == len && memcmp(s->key[level], str, len) == 0;
+}
+
+static void skip_ws(isf_scan_t *s) {
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r')) {
+        s->p++;
+    }
+}
+
+// Raw string contents (escapes left in place); returns 0 on success
+static int scan_string(isf_scan_t *s, const char **str, size_t *len) {
+    const char *start;
+
+    if (s->p >= s->end || *s->p != '"') return -1;
+    start = ++s->p;
+    while (s->p < s->end && *s->p != '"') {
+        if (*s->p == '\\') s->p++;
+        s->p++;
+    }
+    if (s->p >= s->end) return -1;
+    *str = start;
+    *len = (size_t)(s->p - start);
+    s->p++;
+    return 0;
+}
+
+static void on_number(isf_scan_t *s, uint64_t value) {
+    int i;
+
+    // user_types.<type>.fields.<field>.offset
+    if (s->depth == 5 && key_is(s, 0, "user_types") && key_is(s, 2, "fields") && key_is(s, 4, "offset")) {
+        for (i = 0; i < F_COUNT; i++) {
+            if (key_is(s, 1, isf_fields[i].type) && key_is(s, 3, isf_fields[i].field)) {
+                s->field[i] = value;
+                s->have_field[i] = 1;
+            }
+        }
+    // user_types.<type>.fields.<field>.type.bit_position
+    } else if (s->depth == 6 && key_is(s, 0, "user_types") && key_is(s, 2, "fields") &&
+               key_is(s, 4, "type") && key_is(s, 5, "bit_position")) {
+        for (i = 0; i < F_COUNT; i++) {
+            if (key_is(s, 1, isf_fields[i].type) && key_is(s, 3, isf_fields[i].field)) {
+                s->bit[i] = value;
+                s->have_bit[i] = 1;
+            }
+        }
+    // symbols.<name>.address
+    } else if (s->depth == 3 && key_is(s, 0, "symbols") && key_is(s, 2, "address")) {
+        for (i = 0; i < S_COUNT; i++) {
+            if (key_is(s, 1, isf_symbols[i])) s->symbol[i] = value;
+        }
+    } else if (s->depth == 4 && key_is(s, 0, "metadata") && key_is(s, 1, "windows") &&
+               key_is(s, 2, "pdb") && key_is(s, 3, "age")) {
+        s->age = value;
+    }
+}
+
+static void on_string(isf_scan_t *s, const char *str, size_t len) {
+    if (s->depth == 4 && key_is(s, 0, "metadata") && key_is(s, 1, "windows") &&
+        key_is(s, 2, "pdb") && key_is(s, 3, "GUID") && len < sizeof(s->guid)) {
+        memcpy(s->guid, str, len);
+        s->guid[len] = '\0';
+    }
+}
+
+static int scan_value(isf_scan_t *s);
+
+static void push_key(isf_scan_t *s, const char *key, size_t len) {
+    if (s->depth < ISF_MAX_DEPTH) {
+        s->key[s->depth] = key;
+        s->key_len[s->depth] = len;
+    }
+    s->depth++;
+}
+
+static int scan_object(isf_scan_t *s) {
+    s->p++;                                 // '{'
+    skip_ws(s);
+    if (s->p < s->end && *s->p == '}') {
+        s->p++;
+        return 0;
+    }
+    for (;;) {
+        const char *key;
+        size_t len;
+
+        skip_ws(s);
+        if (scan_string(s, &key, &len) != 0) return -1;
+        skip_ws(s);
+        if (s->p >= s->end || *s->p++ != ':') return -1;
+
+        push_key(s, key, len);
+        if (scan_value(s) != 0) return -1;
+        s->depth--;
+
+        skip_ws(s);
+        if (s->p >= s->end) return -1;
+        if (*s->p == ',') {
+            s->p++;
+            continue;
+        }
+        if (*s->p++ != '}') return -1;
+        return 0;
+    }
+}
+
+static int scan_array(isf_scan_t *s) {
+    s->p++;                                 // '['
+    skip_ws(s);
+    if (s->p < s->end && *s->p == ']') {
+        s->p++;
+        return 0;
+    }
+    for (;;) {
+        push_key(s, "", 0);
+        if (scan_value(s) != 0) return -1;
+        s->depth--;
+
+        skip_ws(s);
+        if (s->p >= s->end) return -1;
+        if (*s->p == ',') {
+            s->p++;
+            continue;
+        }
+        if (*s->p++ != ']') return -1;
+        return 0;
+    }
+}
+
+static int scan_value(isf_scan_t *s) {
+    const char *str;
+    size_t len;
+
+    skip_ws(s);
+    if (s->p >= s->end) return -1;
+
+    switch (*s->p) {
+    case '{':
+        return scan_object(s);
+    case '[':
+        return scan_array(s);
+    case '"':
+        if (scan_string(s, &str, &len) != 0) return -1;
+        on_string(s, str, len);
+        return 0;
+    default:
+        if (*s->p >= '0' && *s->p <= '9') {
+            on_number(s, strtoull(s->p, NULL, 10));
+        } else if (*s->p != '-' && *s->p != 't' && *s->p != 'f' && *s->p != 'n') {
+            return -1;
+        }
+        // Skip the rest of the number or literal
+        while (s->p < s->end && strchr("0123456789+-.eEtruefalsn", *s->p)) s->p++;
+        return 0;
+    }
+}
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    char *buf = NULL;
+    long size;
+
+    if (!fp) return NULL;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        buf = malloc((size_t)size + 1);
+        if (buf && fread(buf, 1, (size_t)size, fp) == (size_t)size) {
+            buf[size] = '\0';
+            *len = (size_t)size;
+        } else {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+    return buf;
+}
+
+// A field the ISF file has, else the built-in value
+static uint32_t field_or(const isf_scan_t *s, int f, uint32_t builtin) {
+    return s->have_field[f] ? (uint32_t)s->field[f] : builtin;
+}
+
+// Bit position of a bitfield the ISF file has, else the built-in value
+static uint32_t bit_or(const isf_scan_t *s, int f, uint32_t builtin) {
+    return s->have_bit[f] ? (uint32_t)s->bit[f] : builtin;
+}
+
+int win_profile_load_isf(const char *path, win_profile_t *out, char *err, size_t err_len) {
+    win_profile_t ref;
+    isf_scan_t *s;
+    const char *base;
+    size_t len = 0;
+    char *doc;
+    int i;
+
+    doc = read_file(path, &len);
+    if (!doc) {
+        snprintf(err, err_len, "cannot read %s", path);
+        return -1;
+    }
+    s = calloc(1, sizeof(*s));
+    if (!s) {
+        free(doc);
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    s->p = doc;
+    s->end = doc + len;
+
+    if (scan_value(s) != 0) {
+        snprintf(err, err_len, "%s: malformed JSON near byte %ld", path, (long)(s->p - doc));
+        free(s);
+        free(doc);
+        return -1;
+    }
+    free(doc);
+
+    for (i = 0; i < F_COUNT; i++) {
+        if (!s->have_field[i] && !isf_fields[i].optional) {
+            snprintf(err, err_len, "%s: missing %s.%s", path, isf_fields[i].type, isf_fields[i].field);
+            free(s);
+            return -1;
+        }
+    }
+
+    memset(out, 0, sizeof(*out));
+    base = strrchr(path, '/');
+    snprintf(out->name, sizeof(out->name), "%s", base ? base + 1 : path);
+    snprintf(out->pdb_guid, sizeof(out->pdb_guid), "%s", s->guid);
+    out->pdb_age = (uint32_t)s->age;
+
+    out->eprocess_dtb = (uint32_t)(s->field[F_PCB] + s->field[F_KPROCESS_DTB]);
+    out->eprocess_pid = (uint32_t)s->field[F_PID];
+    out->eprocess_links = (uint32_t)s->field[F_LINKS];
+    out->eprocess_peb = (uint32_t)s->field[F_PEB];
+    out->eprocess_name = (uint32_t)s->field[F_NAME];
+    out->eprocess_threads = (uint32_t)s->field[F_THREADS];
+    out->eprocess_create_time = (uint32_t)s->field[F_CREATE_TIME];
+
+    out->peb_ldr = (uint32_t)s->field[F_PEB_LDR];
+    out->ldr_inloadorder = (uint32_t)s->field[F_INLOAD];
+    out->ldr_dllbase = (uint32_t)s->field[F_DLLBASE];
+    out->ldr_sizeofimage = (uint32_t)s->field[F_SIZEOFIMAGE];
+    out->ldr_fulldllname = (uint32_t)s->field[F_FULLDLLNAME];
+    out->ldr_basedllname = (uint32_t)s->field[F_BASEDLLNAME];
+
+    out->ethread_threadlistentry = (uint32_t)s->field[F_THREADLISTENTRY];
+    out->ethread_cid_process = (uint32_t)(s->field[F_CID] + s->field[F_CID_PROCESS]);
+    out->ethread_cid_thread = (uint32_t)(s->field[F_CID] + s->field[F_CID_THREAD]);
+
+    // Handle walking needs ObjectTable; the structures behind it rarely
+    // move between builds
+    win_profile_builtin(&ref);
+    out->eprocess_object_table = (uint32_t)s->field[F_OBJECT_TABLE];
+    out->handle_table_next = field_or(s, F_HT_NEXT, ref.handle_table_next);
+    out->handle_table_code = field_or(s, F_HT_CODE, ref.handle_table_code);
+    out->object_header_type_index = field_or(s, F_OH_TYPE_INDEX, ref.object_header_type_index);
+    out->object_header_body = field_or(s, F_OH_BODY, ref.object_header_body);
+    out->object_type_name = field_or(s, F_OT_NAME, ref.object_type_name);
+    out->object_type_index = field_or(s, F_OT_INDEX, ref.object_type_index);
+    out->file_object_name = field_or(s, F_FILE_NAME, ref.file_object_name);
+    out->key_body_kcb = field_or(s, F_KEY_KCB, ref.key_body_kcb);
+    out->kcb_parent = field_or(s, F_KCB_PARENT, ref.kcb_parent);
+    out->kcb_name_block = field_or(s, F_KCB_NAME_BLOCK, ref.kcb_name_block);
+    if (s->have_field[F_NCB_HASH] && s->have_field[F_HASH_LENGTH] && s->have_field[F_HASH_NAME]) {
+        out->name_block_length = (uint32_t)(s->field[F_NCB_HASH] + s->field[F_HASH_LENGTH]);
+        out->name_block_name = (uint32_t)(s->field[F_NCB_HASH] + s->field[F_HASH_NAME]);
+    } else {
+        out->name_block_length = ref.name_block_length;
+        out->name_block_name = ref.name_block_name;
+    }
+
+    // Likewise VadRoot is needed for VAD walks and the rest defaults.
+    // VadFlags is a union member in u, so its bits count from there.
+    out->eprocess_vad_root = (uint32_t)s->field[F_VAD_ROOT];
+    out->vad_left = field_or(s, F_VAD_NODE, 0) + field_or(s, F_NODE_LEFT, ref.vad_left);
+    out->vad_right = field_or(s, F_VAD_NODE, 0) + field_or(s, F_NODE_RIGHT, ref.vad_right);
+    out->vad_start = field_or(s, F_VAD_START, ref.vad_start);
+    out->vad_end = field_or(s, F_VAD_END, ref.vad_end);
+    out->vad_start_high = field_or(s, F_VAD_START_HIGH, ref.vad_start_high);
+    out->vad_end_high = field_or(s, F_VAD_END_HIGH, ref.vad_end_high);
+    out->vad_flags = field_or(s, F_VAD_U, ref.vad_flags);
+    out->vad_type_bit = bit_or(s, F_VAD_TYPE, ref.vad_type_bit);
+    out->vad_protection_bit = bit_or(s, F_VAD_PROTECTION, ref.vad_protection_bit);
+    out->vad_private_bit = bit_or(s, F_VAD_PRIVATE, ref.vad_private_bit);
+    out->vad_subsection = field_or(s, F_VAD_SUBSECTION, ref.vad_subsection);
+    out->subsection_control_area = field_or(s, F_SUB_CONTROL_AREA, ref.subsection_control_area);
+    out->control_area_file = field_or(s, F_CA_FILE, ref.control_area_file);
+
+    out->rva_ps_active_process_head = s->symbol[S_ACTIVE_HEAD];
+    out->rva_ps_initial_system_process = s->symbol[S_SYSTEM_PROCESS];
+    out->rva_ps_loaded_module_list = s->symbol[S_LOADED_MODULES];
+    out->rva_ob_type_index_table = s->symbol[S_TYPE_INDEX_TABLE];
+    out->rva_ob_header_cookie = s->symbol[S_HEADER_COOKIE];
+    free(s);
+
+    if (win_profile_compile(out) != 0) {
+        snprintf(err, err_len, "%s: structure span larger than %d bytes", path, WIN_PROFILE_MAX_SPAN);
+        return -1;
+    }
+    return 0;
+}
+
+const win_profile_t *win_profile_get(void) {
+    if (!active_set) {
+        win_profile_builtin(&active_profile);
+        active_set = 1;
+    }
+    return &active_profile;
+}
+
+void win_profile_use(const win_profile_t *prof) {
+    active_profile = *prof;
+    active_set = 1;
+}
+
+int win_profile_select(const char *path, char *err, size_t err_len) {
+    win_profile_t prof;
+
+    if (!path) path = getenv("VMI_PROFILE");
+    if (!path || !*path) {
+        win_profile_builtin(&prof);
+    } else if (win_profile_load_isf(path, &prof, err, err_len) != 0) {
+        return -1;
+    }
+    win_profile_use(&prof);
+    return 0;
+}
+
+void win_profile_print(const win_profile_t *prof, FILE *out) {
+    fprintf(out, "Structure profile: %s", prof->name);
+    if (prof->pdb_guid[0]) fprintf(out, " (PDB %s age %u)", prof->pdb_guid, prof->pdb_age);
+    fprintf(out, "\n");
+    fprintf(out, "  EPROCESS: DirectoryTableBase 0x%x, UniqueProcessId 0x%x, ActiveProcessLinks 0x%x,\n"
+                 "            Peb 0x%x, ImageFileName 0x%x, ThreadListHead 0x%x, CreateTime 0x%x\n",
+            prof->eprocess_dtb, prof->eprocess_pid, prof->eprocess_links,
+            prof->eprocess_peb, prof->eprocess_name, prof->eprocess_threads,
+            prof->eprocess_create_time);
+    fprintf(out, "  Handles: EPROCESS.ObjectTable 0x%x, HANDLE_TABLE.TableCode 0x%x, NextHandleNeedingPool 0x%x,\n"
+                 "           OBJECT_HEADER.TypeIndex 0x%x, Body 0x%x, OBJECT_TYPE.Name 0x%x, Index 0x%x\n",
+            prof->eprocess_object_table, prof->handle_table_code, prof->handle_table_next,
+            prof->object_header_type_index, prof->object_header_body, prof->object_type_name,
+            prof->object_type_index);
+    fprintf(out, "  Object names: FILE_OBJECT.FileName 0x%x, CM_KEY_BODY.KeyControlBlock 0x%x,\n"
+                 "                CM_KEY_CONTROL_BLOCK.ParentKcb 0x%x, NameBlock 0x%x, name length 0x%x, name 0x%x\n",
+            prof->file_object_name, prof->key_body_kcb, prof->kcb_parent, prof->kcb_name_block,
+            prof->name_block_length, prof->name_block_name);
+    fprintf(out, "  VADs: EPROCESS.VadRoot 0x%x, MMVAD_SHORT Left 0x%x, Right 0x%x, StartingVpn 0x%x/0x%x,\n"
+                 "        EndingVpn 0x%x/0x%x, VadFlags 0x%x (type bit %u, protection bit %u, private bit %u),\n"
+                 "        MMVAD.Subsection 0x%x, SUBSECTION.ControlArea 0x%x, CONTROL_AREA.FilePointer 0x%x\n",
+            prof->eprocess_vad_root, prof->vad_left, prof->vad_right, prof->vad_start, prof->vad_start_high,
+            prof->vad_end, prof->vad_end_high, prof->vad_flags, prof->vad_type_bit, prof->vad_protection_bit,
+            prof->vad_private_bit, prof->vad_subsection, prof->subsection_control_area,
+            prof->control_area_file);
+    fprintf(out, "  PEB.Ldr 0x%x, PEB_LDR_DATA.InLoadOrderModuleList 0x%x\n",
+            prof->peb_ldr, prof->ldr_inloadorder);
+    fprintf(out, "  LDR_DATA_TABLE_ENTRY: DllBase 0x%x, SizeOfImage 0x%x, FullDllName 0x%x, BaseDllName 0x%x\n",
+            prof->ldr_dllbase, prof->ldr_sizeofimage, prof->ldr_fulldllname, prof->ldr_basedllname);
+    fprintf(out, "  ETHREAD: ThreadListEntry 0x%x, Cid.UniqueProcess 0x%x, Cid.UniqueThread 0x%x\n",
+            prof->ethread_threadlistentry, prof->ethread_cid_process, prof->ethread_cid_thread);
+    fprintf(out, "  Reads per structure: EPROCESS 0x%x bytes, LDR entry 0x%x bytes, ETHREAD 0x%x bytes at +0x%x\n",
+            prof->eprocess_span.size, prof->ldr_span.size,
+            prof->ethread_span.size, prof->ethread_span.start);
+}
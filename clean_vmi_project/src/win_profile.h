@@ -0,0 +1,122 @@
+#ifndef WIN_PROFILE_H
+#define WIN_PROFILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Windows structure profiles.
+//
+// Every structure field the walkers decode lives in one flat offset table,
+// filled either from the built-in Windows 10 x64 values or from a
+// Volatility 3 ISF JSON file (the symbol/type files generated from the
+// kernel PDB). Loading also compiles a read span per structure: the one
+// contiguous range that covers every field we decode, so a walker reads
+// each EPROCESS, LDR_DATA_TABLE_ENTRY and ETHREAD with a single read.
+
+// Largest structure span we accept (keeps walker buffers on the stack)
+#define WIN_PROFILE_MAX_SPAN 0x1000
+
+typedef struct {
+    uint32_t start;                 // first byte read, relative to the struct
+    uint32_t size;                  // bytes read from there
+} win_span_t;
+
+typedef struct {
+    char name[96];                  // where the offsets came from
+    char pdb_guid[40];              // kernel PDB GUID and age (ISF metadata)
+    uint32_t pdb_age;
+
+    // _EPROCESS (DirectoryTableBase is _EPROCESS.Pcb + _KPROCESS field)
+    uint32_t eprocess_dtb;
+    uint32_t eprocess_pid;
+    uint32_t eprocess_links;        // ActiveProcessLinks
+    uint32_t eprocess_peb;
+    uint32_t eprocess_name;         // ImageFileName
+    uint32_t eprocess_threads;      // ThreadListHead
+    uint32_t eprocess_create_time;  // CreateTime (0 when the profile lacks it)
+    uint32_t eprocess_object_table; // ObjectTable (0 when the profile lacks it)
+    uint32_t eprocess_vad_root;     // VadRoot (0 when the profile lacks it)
+
+    // _PEB, _PEB_LDR_DATA, _LDR_DATA_TABLE_ENTRY
+    uint32_t peb_ldr;
+    uint32_t ldr_inloadorder;       // InLoadOrderModuleList
+    uint32_t ldr_dllbase;
+    uint32_t ldr_sizeofimage;
+    uint32_t ldr_fulldllname;
+    uint32_t ldr_basedllname;
+
+    // _ETHREAD (Cid fields are _ETHREAD.Cid + _CLIENT_ID field)
+    uint32_t ethread_threadlistentry;
+    uint32_t ethread_cid_process;
+    uint32_t ethread_cid_thread;
+
+    // _HANDLE_TABLE, _OBJECT_HEADER, _OBJECT_TYPE and the objects whose
+    // names the handle walk decodes: _FILE_OBJECT and registry keys
+    // (_CM_KEY_BODY -> _CM_KEY_CONTROL_BLOCK -> _CM_NAME_CONTROL_BLOCK,
+    // whose NameLength and Name are NameHash + _CM_NAME_HASH fields).
+    // An ISF file without them keeps the built-in values.
+    uint32_t handle_table_next;     // NextHandleNeedingPool
+    uint32_t handle_table_code;     // TableCode
+    uint32_t object_header_type_index;
+    uint32_t object_header_body;
+    uint32_t object_type_name;
+    uint32_t object_type_index;
+    uint32_t file_object_name;      // FileName
+    uint32_t key_body_kcb;          // KeyControlBlock
+    uint32_t kcb_parent;            // ParentKcb
+    uint32_t kcb_name_block;        // NameBlock
+    uint32_t name_block_length;
+    uint32_t name_block_name;
+
+    // _MMVAD_SHORT (node links are VadNode + _RTL_BALANCED_NODE fields),
+    // the VadFlags bits in u, and the path from a mapped view's _MMVAD to
+    // its file: Subsection -> _SUBSECTION.ControlArea ->
+    // _CONTROL_AREA.FilePointer. An ISF file without them keeps the
+    // built-in values.
+    uint32_t vad_left;
+    uint32_t vad_right;
+    uint32_t vad_start;             // StartingVpn
+    uint32_t vad_end;               // EndingVpn
+    uint32_t vad_start_high;        // StartingVpnHigh
+    uint32_t vad_end_high;          // EndingVpnHigh
+    uint32_t vad_flags;             // u (VadFlags)
+    uint32_t vad_type_bit;          // bit positions in VadFlags
+    uint32_t vad_protection_bit;
+    uint32_t vad_private_bit;       // PrivateMemory
+    uint32_t vad_subsection;        // _MMVAD.Subsection
+    uint32_t subsection_control_area;
+    uint32_t control_area_file;     // FilePointer, an _EX_FAST_REF
+
+    // Kernel symbol RVAs from the ISF (0 when unknown)
+    uint64_t rva_ps_active_process_head;
+    uint64_t rva_ps_initial_system_process;
+    uint64_t rva_ps_loaded_module_list;
+    uint64_t rva_ob_type_index_table;
+    uint64_t rva_ob_header_cookie;
+
+    // Compiled by win_profile_compile()
+    win_span_t eprocess_span;
+    win_span_t ldr_span;
+    win_span_t ethread_span;
+    win_span_t eprocess_link_span;  // ActiveProcessLinks and CreateTime
+} win_profile_t;
+
+// Offsets the inspectors have always used (Windows 10 x64)
+void win_profile_builtin(win_profile_t *out);
+
+// Parse an ISF JSON file. Returns 0, or -1 with a message in err.
+int win_profile_load_isf(const char *path, win_profile_t *out, char *err, size_t err_len);
+
+// Compute the per-structure read spans; -1 if a span is too large
+int win_profile_compile(win_profile_t *prof);
+
+// Active profile used by every walker. Select it before starting
+// worker threads; path NULL falls back to $VMI_PROFILE, then built-in.
+const win_profile_t *win_profile_get(void);
+void win_profile_use(const win_profile_t *prof);
+int win_profile_select(const char *path, char *err, size_t err_len);
+
+void win_profile_print(const win_profile_t *prof, FILE *out);
+
+#endif
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "win_profile.h"
+#include "win_scan.h"
+#include "win_psscan.h"
+
+// x64 layout: a 16-byte POOL_HEADER (BlockSize and PoolType in its first
+// dword, the tag in the second), the optional object header infos, the
+// 0x30-byte OBJECT_HEADER and then the EPROCESS
+#define POOL_HEADER_SIZE     0x10
+#define POOL_TAG_OFFSET      4
+#define OBJECT_HEADER_SIZE   0x30
+#define OPTIONAL_HEADERS_MAX 0xc0
+#define PROTECTED_TAG        (WIN_POOL_TAG_PROCESS | 0x80000000U)  // "Pro\xe3", before Windows 8
+#define PROCESS_OBJECT       3      // Pcb.Header.Type
+#define MAX_PID              (1 << 26)
+
+typedef struct {
+    int avx2;
+    uint64_t tags;
+    win_psscan_result_t *lists;     // one per worker, merged afterwards
+} psscan_t;
+
+static int push(win_psscan_result_t *r, const win_pool_process_t *item) {
+    if (r->count == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 64;
+        win_pool_process_t *items = realloc(r->items, cap * sizeof(*items));
+        if (!items) return -1;
+        r->items = items;
+        r->cap = cap;
+    }
+    r->items[r->count++] = *item;
+    return 0;
+}
+
+// Cheap structural checks; the dispatcher type was checked already
+static int plausible(const win_process_t *p) {
+    size_t i;
+
+    if (p->valid < win_profile_get()->eprocess_span.size) return 0;
+    if (p->pid <= 0 || (p->pid & 3) || p->pid >= MAX_PID) return 0;
+    if (p->dtb == 0 || (p->dtb >> 52)) return 0;
+    if (!win_kernel_va(p->flink) || !win_kernel_va(p->blink) ||
+        !win_kernel_va(p->thread_flink) || !win_kernel_va(p->thread_blink)) return 0;
+    if (!p->name[0]) return 0;
+    for (i = 0; p->name[i]; i++) {
+        if (p->name[i] < 0x20 || p->name[i] > 0x7e) return 0;
+    }
+    return 1;
+}
+
+static int maps_to(guest_mem_t *gm, uint64_t va, uint64_t pa) {
+    uint64_t got;
+    return gm_translate(gm, GM_KERNEL_DTB, va, &got) == 0 && got == pa;
+}
+
+// Kernel VA of the EPROCESS at pa, 0 if no list leads back to it
+static uint64_t process_va(guest_mem_t *gm, uint64_t pa, const win_process_t *p) {
+    const win_profile_t *prof = win_profile_get();
+    uint64_t back;
+
+    // A list pointing at itself (no threads left, or unlinked) names it
+    if (maps_to(gm, p->thread_flink - prof->eprocess_threads, pa)) return p->thread_flink - prof->eprocess_threads;
+    if (maps_to(gm, p->flink - prof->eprocess_links, pa)) return p->flink - prof->eprocess_links;
+
+    // Otherwise a neighbour's Blink does: the first thread's, then the
+    // next process's
+    if (gm_read_u64(gm, GM_KERNEL_DTB, p->thread_flink + 8, &back) == 0 &&
+        maps_to(gm, back - prof->eprocess_threads, pa)) return back - prof->eprocess_threads;
+    if (gm_read_u64(gm, GM_KERNEL_DTB, p->flink + 8, &back) == 0 &&
+        maps_to(gm, back - prof->eprocess_links, pa)) return back - prof->eprocess_links;
+    return 0;
+}
+
+// Decode the EPROCESS at pa (in page when it fits); 0 if it is not one
+static int read_candidate(guest_mem_t *gm, uint64_t pa, const uint8_t *page, win_process_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    uint8_t copy[WIN_PROFILE_MAX_SPAN];
+    uint64_t off = pa & GM_PAGE_MASK;
+    const uint8_t *buf;
+    size_t valid;
+
+    if (page && off + prof->eprocess_span.size <= GM_PAGE_SIZE) {
+        buf = page + off;
+        valid = prof->eprocess_span.size;
+    } else {
+        buf = copy;
+        valid = gm_read_pa(gm, pa, copy, prof->eprocess_span.size);
+    }
+    if (valid == 0 || buf[0] != PROCESS_OBJECT) return 0;
+    win_decode_process(buf, valid, 0, out);
+    return plausible(out);
+}
+
+// Pool header at page + off: find the body behind the optional headers
+static void check_pool(psscan_t *ps, int worker, guest_mem_t *view, uint64_t pa,
+                       const uint8_t *page, size_t off) {
+    win_pool_process_t item;
+    uint32_t header, size, skip;
+
+    memcpy(&header, page + off, 4);
+    size = ((header >> 16) & 0xff) * 16;
+    if ((header >> 24) == 0 || size < POOL_HEADER_SIZE + OBJECT_HEADER_SIZE + 8) return;   // free
+
+    memset(&item, 0, sizeof(item));
+    for (skip = 0; skip <= OPTIONAL_HEADERS_MAX; skip += 16) {
+        uint64_t body = off + POOL_HEADER_SIZE + skip + OBJECT_HEADER_SIZE;
+
+        if (body + 8 > off + size) break;
+        // The type byte rules out most offsets without a read
+        if (body < GM_PAGE_SIZE && page[body] != PROCESS_OBJECT) continue;
+        if (!read_candidate(view, pa + body, body < GM_PAGE_SIZE ? page : NULL, &item.proc)) continue;
+        item.pa = pa + body;
+        item.proc.addr = process_va(view, item.pa, &item.proc);
+        if (push(&ps->lists[worker], &item) != 0) ps->lists[worker].error = "Out of memory";
+        return;
+    }
+}
+
+// The tag sits at offset 4 of a 16-byte aligned header, which is bit 4
+// of every 16 in a byte move mask
+#define TAG_LANES 0x0010001000100010ULL
+
+static void check_mask(psscan_t *ps, int worker, guest_mem_t *view, uint64_t pa,
+                       const uint8_t *page, size_t i, uint64_t mask) {
+    mask &= TAG_LANES;
+    __atomic_add_fetch(&ps->tags, (uint64_t)__builtin_popcountll(mask), __ATOMIC_RELAXED);
+    while (mask) {
+        check_pool(ps, worker, view, pa, page, i + (size_t)__builtin_ctzll(mask) - POOL_TAG_OFFSET);
+        mask &= mask - 1;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void scan_page_avx2(psscan_t *ps, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    const __m256i tag = _mm256_set1_epi32((int)WIN_POOL_TAG_PROCESS);
+    const __m256i protected_tag = _mm256_set1_epi32((int)PROTECTED_TAG);
+    size_t i;
+
+    for (i = 0; i < GM_PAGE_SIZE; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(page + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(page + i + 32));
+        uint64_t mask;
+
+        a = _mm256_or_si256(_mm256_cmpeq_epi32(a, tag), _mm256_cmpeq_epi32(a, protected_tag));
+        b = _mm256_or_si256(_mm256_cmpeq_epi32(b, tag), _mm256_cmpeq_epi32(b, protected_tag));
+        mask = (uint32_t)_mm256_movemask_epi8(a) | (uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32;
+        if (mask & TAG_LANES) check_mask(ps, worker, view, pa, page, i, mask);
+    }
+}
+
+static void scan_page_sse2(psscan_t *ps, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    const __m128i tag = _mm_set1_epi32((int)WIN_POOL_TAG_PROCESS);
+    const __m128i protected_tag = _mm_set1_epi32((int)PROTECTED_TAG);
+    size_t i, j;
+
+    for (i = 0; i < GM_PAGE_SIZE; i += 64) {
+        uint64_t mask = 0;
+
+        for (j = 0; j < 64; j += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(page + i + j));
+            v = _mm_or_si128(_mm_cmpeq_epi32(v, tag), _mm_cmpeq_epi32(v, protected_tag));
+            mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(v) << j;
+        }
+        if (mask & TAG_LANES) check_mask(ps, worker, view, pa, page, i, mask);
+    }
+}
+
+static void scan_page(void *ctx, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    psscan_t *ps = ctx;
+
+    if (ps->avx2) scan_page_avx2(ps, worker, view, pa, page);
+    else scan_page_sse2(ps, worker, view, pa, page);
+}
+#else
+static void scan_page(void *ctx, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    uint64_t mask = 0;
+    size_t i, j;
+
+    for (i = 0; i < GM_PAGE_SIZE; i += 64) {
+        for (j = POOL_TAG_OFFSET, mask = 0; j < 64; j += 16) {
+            uint32_t tag;
+            memcpy(&tag, page + i + j, 4);
+            if (tag == WIN_POOL_TAG_PROCESS || tag == PROTECTED_TAG) mask |= 1ULL << j;
+        }
+        if (mask) check_mask(ctx, worker, view, pa, page, i, mask);
+    }
+}
+#endif
+
+static int compare_pa(const void *a, const void *b) {
+    uint64_t x = ((const win_pool_process_t*)a)->pa, y = ((const win_pool_process_t*)b)->pa;
+    return x < y ? -1 : x > y;
+}
+
+int win_psscan(guest_mem_t *gm, int workers, win_psscan_result_t *out) {
+    win_sweep_stats_t stats;
+    psscan_t ps;
+    int i, ret;
+
+    memset(out, 0, sizeof(*out));
+    if (workers < 1) workers = 1;
+    memset(&ps, 0, sizeof(ps));
+    ps.avx2 = win_scan_avx2();
+    ps.lists = calloc(workers, sizeof(*ps.lists));
+    if (!ps.lists) return -1;
+
+    ret = win_sweep_phys(gm, workers, scan_page, &ps, &stats);
+    out->tags = ps.tags;
+    out->bytes = stats.bytes;
+    out->ns = stats.ns;
+    out->workers = stats.workers;
+
+    for (i = 0; i < workers; i++) {
+        win_psscan_result_t *l = &ps.lists[i];
+        size_t j;
+
+        if (l->error) out->error = l->error;
+        for (j = 0; j < l->count && !out->error; j++) {
+            if (push(out, &l->items[j]) != 0) out->error = "Out of memory";
+        }
+        free(l->items);
+    }
+    free(ps.lists);
+
+    // Workers finish in any order; report in physical order
+    if (out->count) qsort(out->items, out->count, sizeof(*out->items), compare_pa);
+    if (ret != 0 && !out->error) out->error = "Guest RAM size unknown";
+    return out->error ? -1 : 0;
+}
+
+typedef struct {
+    uint64_t pa, va;
+} linked_t;
+
+static int compare_linked(const void *a, const void *b) {
+    uint64_t x = ((const linked_t*)a)->pa, y = ((const linked_t*)b)->pa;
+    return x < y ? -1 : x > y;
+}
+
+void win_psscan_diff(guest_mem_t *gm, const win_process_list_t *linked, win_psscan_result_t *result) {
+    const win_profile_t *prof = win_profile_get();
+    linked_t *map, key;
+    size_t i, j, m, n = 0, kept = 0;
+
+    result->linked = result->hidden = result->exited = 0;
+    map = calloc(linked->count ? linked->count : 1, sizeof(*map));
+    if (!map) {
+        result->error = "Out of memory";
+        return;
+    }
+    // Linked objects are translated in batches that share their page walks
+    for (i = 0; i < linked->count; i += m) {
+        uint64_t vas[GM_MAX_BATCH], pas[GM_MAX_BATCH];
+
+        m = linked->count - i < GM_MAX_BATCH ? linked->count - i : GM_MAX_BATCH;
+        for (j = 0; j < m; j++) vas[j] = linked->items[i + j].addr;
+        gm_translate_batch(gm, GM_KERNEL_DTB, vas, pas, m);
+        for (j = 0; j < m; j++) {
+            if (pas[j] == GM_NO_PA) continue;
+            map[n].pa = pas[j];
+            map[n++].va = vas[j];
+        }
+    }
+    qsort(map, n, sizeof(*map), compare_linked);
+
+    for (i = 0; i < result->count; i++) {
+        win_pool_process_t item = result->items[i];
+        const linked_t *hit;
+
+        key.pa = item.pa;
+        hit = bsearch(&key, map, n, sizeof(*map), compare_linked);
+        if (hit) {
+            item.proc.addr = hit->va;
+            item.state = WIN_POOL_LINKED;
+            result->linked++;
+        } else {
+            // Not linked: look again now that the guest holds still
+            if (!read_candidate(gm, item.pa, NULL, &item.proc)) continue;
+            item.proc.addr = process_va(gm, item.pa, &item.proc);
+            if (item.proc.addr && item.proc.thread_flink == item.proc.addr + prof->eprocess_threads) {
+                item.state = WIN_POOL_EXITED;
+                result->exited++;
+            } else {
+                item.state = WIN_POOL_HIDDEN;
+                result->hidden++;
+            }
+        }
+        result->items[kept++] = item;
+    }
+    result->count = kept;
+    free(map);
+}
+
+void win_psscan_free(win_psscan_result_t *result) {
+    free(result->items);
+    memset(result, 0, sizeof(*result));
+}
@@ -0,0 +1,57 @@
+#ifndef WIN_PSSCAN_H
+#define WIN_PSSCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+
+// Pool-tag process scan (psscan).
+//
+// The process walk only sees what is linked into ActiveProcessLinks, so a
+// process unlinked by a rootkit (DKOM) is invisible to it. Every EPROCESS
+// is still a kernel pool allocation tagged "Proc", though, so sweeping
+// guest RAM for that tag finds it regardless of the list. The sweep runs
+// on the workers of win_sweep_phys(); tags are compared a vector at a
+// time at the one offset a POOL_HEADER tag can have (4 mod 16), and each
+// hit is checked structurally: dispatcher type ProcessObject, a plausible
+// PID and DTB, kernel list pointers and a printable image name.
+//
+// The sweep does not need the guest paused. Diffing its result against a
+// process walk does, so a live scan sweeps first and only pauses for the
+// walk and the diff, which re-reads the few objects that are not linked.
+
+#define WIN_POOL_TAG_PROCESS 0x636f7250U    // "Proc"
+
+typedef enum {
+    WIN_POOL_LINKED,            // on ActiveProcessLinks
+    WIN_POOL_HIDDEN,            // not linked, but has threads
+    WIN_POOL_EXITED,            // not linked and no threads: exited, still referenced
+} win_pool_state_t;
+
+typedef struct {
+    uint64_t pa;                // EPROCESS body in guest RAM
+    win_process_t proc;         // decoded; proc.addr is its VA, 0 if unknown
+    win_pool_state_t state;
+} win_pool_process_t;
+
+typedef struct {
+    win_pool_process_t *items;  // sorted by pa
+    size_t count, cap;
+    uint64_t tags;              // "Proc" pool headers seen
+    size_t linked, hidden, exited;
+    uint64_t bytes, ns;         // sweep
+    int workers;
+    const char *error;
+} win_psscan_result_t;
+
+// Sweep guest RAM for EPROCESS pool allocations; returns 0 or -1
+int win_psscan(guest_mem_t *gm, int workers, win_psscan_result_t *out);
+
+// Classify the sweep's processes against a walk of the linked list taken
+// while the guest was paused; objects freed since the sweep are dropped
+void win_psscan_diff(guest_mem_t *gm, const win_process_list_t *linked, win_psscan_result_t *result);
+
+void win_psscan_free(win_psscan_result_t *result);
+
+#endif
@@ -0,0 +1,359 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "win_parallel.h"
+#include "win_scan.h"
+
+// Signatures. Both blocks are 8-byte aligned, and each anchor sits at an
+// 8-byte aligned offset inside its block, so a candidate never straddles
+// a page: "KDBG" at KDBG+0x10, MachineType 0x8664 at KdVersionBlock+8.
+#define KDBG_TAG            0x4742444bU     // "KDBG"
+#define KDBG_TAG_OFFSET     0x10
+#define KDBG_SIZE           0x58            // through PsActiveProcessHead
+#define KDVB_MACHINE        0x8664
+#define KDVB_MACHINE_OFFSET 8
+#define KDVB_SIZE           0x28
+
+// The most a kernel image spans
+#define KERNEL_IMAGE_MAX    (64ULL << 20)
+
+#define MAX_CANDIDATES      16
+
+typedef struct {
+    uint64_t pa;
+    uint64_t kernel_base;
+    uint64_t modules;
+    uint64_t processes;             // KDBG only
+    uint16_t build;                 // KdVersionBlock only
+} candidate_t;
+
+// One sweep over guest RAM, shared by its workers
+typedef struct {
+    uint64_t end_pfn;
+    uint64_t next;                  // next unclaimed chunk, in pages
+    win_sweep_fn fn;
+    void *ctx;
+} sweep_t;
+
+typedef struct {
+    sweep_t *sweep;
+    int index;
+    guest_mem_t *view;
+    uint8_t *buf;                   // WIN_SCAN_CHUNK_PAGES pages
+    uint64_t bytes;
+    pthread_t thread;
+    int started;
+} worker_t;
+
+// Kernel discovery state
+typedef struct {
+    int avx2;
+    uint64_t pe_images;
+    pthread_mutex_t lock;           // candidates are rare; one lock will do
+    candidate_t versions[MAX_CANDIDATES], kdbgs[MAX_CANDIDATES];
+    int nversions, nkdbgs;
+} scan_t;
+
+static int inside_image(uint64_t base, uint64_t va) {
+    return va > base && va - base < KERNEL_IMAGE_MAX;
+}
+
+// PE32+ AMD64 image with the native subsystem (the kernel or a driver)
+// starting at this page
+static int native_pe(const uint8_t *page) {
+    uint32_t lfanew;
+    uint16_t machine, magic, subsystem;
+
+    if (page[0] != 'M' || page[1] != 'Z') return 0;
+    memcpy(&lfanew, page + 0x3c, 4);
+    if (lfanew < 0x40 || lfanew > GM_PAGE_SIZE - 24 - 70) return 0;
+    if (memcmp(page + lfanew, "PE\0\0", 4) != 0) return 0;
+    memcpy(&machine, page + lfanew + 4, 2);
+    memcpy(&magic, page + lfanew + 24, 2);
+    memcpy(&subsystem, page + lfanew + 24 + 68, 2);
+    return machine == 0x8664 && magic == 0x20b && subsystem == 1;
+}
+
+static void add_candidate(scan_t *scan, candidate_t *list, int *count, const candidate_t *c) {
+    pthread_mutex_lock(&scan->lock);
+    if (*count < MAX_CANDIDATES) list[(*count)++] = *c;
+    pthread_mutex_unlock(&scan->lock);
+}
+
+// DBGKD_GET_VERSION64 at pa: NT major version, KD protocol 6, and
+// KernBase / PsLoadedModuleList pointing into one kernel image
+static void check_version(scan_t *scan, guest_mem_t *view, uint64_t pa) {
+    uint8_t b[KDVB_SIZE];
+    candidate_t c;
+    uint16_t major;
+
+    if (gm_read_pa(view, pa, b, sizeof(b)) != sizeof(b)) return;
+    memcpy(&major, b, 2);
+    if (major != 0x000f || b[4] != 6) return;
+    memset(&c, 0, sizeof(c));
+    c.pa = pa;
+    memcpy(&c.build, b + 2, 2);
+    memcpy(&c.kernel_base, b + 0x10, 8);
+    memcpy(&c.modules, b + 0x18, 8);
+    if (!win_kernel_va(c.kernel_base) || (c.kernel_base & GM_PAGE_MASK) ||
+        !inside_image(c.kernel_base, c.modules)) return;
+    add_candidate(scan, scan->versions, &scan->nversions, &c);
+}
+
+// KDDEBUGGER_DATA64 header at pa, readable only when not encoded
+static void check_kdbg(scan_t *scan, guest_mem_t *view, uint64_t pa) {
+    uint8_t b[KDBG_SIZE];
+    candidate_t c;
+    uint32_t size;
+
+    if (gm_read_pa(view, pa, b, sizeof(b)) != sizeof(b)) return;
+    memcpy(&size, b + 0x14, 4);
+    if (size < KDBG_SIZE || size > GM_PAGE_SIZE) return;
+    memset(&c, 0, sizeof(c));
+    c.pa = pa;
+    memcpy(&c.kernel_base, b + 0x18, 8);
+    memcpy(&c.modules, b + 0x48, 8);
+    memcpy(&c.processes, b + 0x50, 8);
+    if (!win_kernel_va(c.kernel_base) || (c.kernel_base & GM_PAGE_MASK) ||
+        !inside_image(c.kernel_base, c.modules) || !inside_image(c.kernel_base, c.processes)) return;
+    add_candidate(scan, scan->kdbgs, &scan->nkdbgs, &c);
+}
+
+// Look at the 8-byte aligned qwords of page[off, off + len)
+static void check_qwords(scan_t *scan, guest_mem_t *view, uint64_t pa, const uint8_t *page, size_t off, size_t len) {
+    size_t i;
+
+    for (i = off; i < off + len; i += 8) {
+        uint32_t tag;
+        uint16_t machine;
+
+        memcpy(&tag, page + i, 4);
+        memcpy(&machine, page + i, 2);
+        // A block may start on the previous page; the reads handle that
+        if (tag == KDBG_TAG && pa + i >= KDBG_TAG_OFFSET) check_kdbg(scan, view, pa + i - KDBG_TAG_OFFSET);
+        if (machine == KDVB_MACHINE && pa + i >= KDVB_MACHINE_OFFSET) check_version(scan, view, pa + i - KDVB_MACHINE_OFFSET);
+    }
+}
+
+// Both anchors are compared a whole vector at a time: "KDBG" as 32-bit
+// lanes, 0x8664 as 16-bit lanes. Only lanes starting on an 8-byte
+// boundary count, which is the low byte of every 8 in the move mask.
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void scan_page_avx2(scan_t *scan, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    const __m256i tag = _mm256_set1_epi32((int)KDBG_TAG);
+    const __m256i machine = _mm256_set1_epi16((short)KDVB_MACHINE);
+    size_t i;
+
+    for (i = 0; i < GM_PAGE_SIZE; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(page + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(page + i + 32));
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi32(a, tag), _mm256_cmpeq_epi16(a, machine)),
+            _mm256_or_si256(_mm256_cmpeq_epi32(b, tag), _mm256_cmpeq_epi16(b, machine)));
+
+        // Lanes of a and b are folded together, so recheck all 64 bytes
+        if ((uint32_t)_mm256_movemask_epi8(hit) & 0x01010101U) check_qwords(scan, view, pa, page, i, 64);
+    }
+}
+
+static void scan_page_sse2(scan_t *scan, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    const __m128i tag = _mm_set1_epi32((int)KDBG_TAG);
+    const __m128i machine = _mm_set1_epi16((short)KDVB_MACHINE);
+    size_t i, j;
+
+    for (i = 0; i < GM_PAGE_SIZE; i += 64) {
+        __m128i hit = _mm_setzero_si128();
+
+        for (j = 0; j < 64; j += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(page + i + j));
+            hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi32(v, tag), _mm_cmpeq_epi16(v, machine)));
+        }
+        if (_mm_movemask_epi8(hit) & 0x0101) check_qwords(scan, view, pa, page, i, 64);
+    }
+}
+
+static void scan_page(void *ctx, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    scan_t *scan = ctx;
+
+    (void)worker;
+    if (native_pe(page)) __atomic_add_fetch(&scan->pe_images, 1, __ATOMIC_RELAXED);
+    if (scan->avx2) scan_page_avx2(scan, view, pa, page);
+    else scan_page_sse2(scan, view, pa, page);
+}
+#else
+static void scan_page(void *ctx, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page) {
+    scan_t *scan = ctx;
+
+    (void)worker;
+    if (native_pe(page)) __atomic_add_fetch(&scan->pe_images, 1, __ATOMIC_RELAXED);
+    check_qwords(scan, view, pa, page, 0, GM_PAGE_SIZE);
+}
+#endif
+
+int win_scan_avx2(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+int win_scan_ssse3(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("ssse3") ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    sweep_t *sweep = w->sweep;
+    const uint8_t *pages[WIN_SCAN_CHUNK_PAGES];
+
+    for (;;) {
+        uint64_t pfn = __atomic_fetch_add(&sweep->next, WIN_SCAN_CHUNK_PAGES, __ATOMIC_RELAXED);
+        size_t n, i;
+
+        if (pfn >= sweep->end_pfn) break;
+        n = sweep->end_pfn - pfn < WIN_SCAN_CHUNK_PAGES ? (size_t)(sweep->end_pfn - pfn) : WIN_SCAN_CHUNK_PAGES;
+
+        // Holes (e.g. below 4 GiB) just come back unreadable
+        if (gm_fetch_pages(w->view, pfn, n, w->buf, pages) == 0) continue;
+        for (i = 0; i < n; i++) {
+            if (!pages[i]) continue;
+            sweep->fn(sweep->ctx, w->index, w->view, (pfn + i) << GM_PAGE_SHIFT, pages[i]);
+            w->bytes += GM_PAGE_SIZE;
+        }
+    }
+    return NULL;
+}
+
+int win_sweep_phys(guest_mem_t *gm, int workers, win_sweep_fn fn, void *ctx, win_sweep_stats_t *stats) {
+    uint64_t start = gm_now_ns();
+    sweep_t sweep;
+    worker_t *w;
+    int i, ran = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (workers < 1) workers = 1;
+    sweep.end_pfn = gm_phys_end(gm) >> GM_PAGE_SHIFT;
+    sweep.next = 0;
+    sweep.fn = fn;
+    sweep.ctx = ctx;
+    if (sweep.end_pfn == 0) return -1;
+    if ((uint64_t)workers > sweep.end_pfn / WIN_SCAN_CHUNK_PAGES + 1) {
+        workers = (int)(sweep.end_pfn / WIN_SCAN_CHUNK_PAGES + 1);
+    }
+
+    w = calloc(workers, sizeof(*w));
+    if (!w) return -1;
+    for (i = 0; i < workers; i++) {
+        w[i].sweep = &sweep;
+        w[i].index = i;
+        w[i].view = gm_clone(gm, 64);
+        w[i].buf = malloc(WIN_SCAN_CHUNK_PAGES * GM_PAGE_SIZE);
+        if (!w[i].view || !w[i].buf) break;
+        // Worker 0 runs on the calling thread
+        if (i > 0) {
+            w[i].started = pthread_create(&w[i].thread, NULL, worker_main, &w[i]) == 0;
+            if (!w[i].started) break;
+        }
+    }
+    // Whatever workers did start still sweep the whole range
+    if (w[0].view && w[0].buf) {
+        worker_main(&w[0]);
+        ran = 1;
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (w[i].started) pthread_join(w[i].thread, NULL);
+        if (w[i].started || (i == 0 && ran)) stats->workers++;
+        stats->bytes += w[i].bytes;
+        if (w[i].view) {
+            gm_merge_stats(gm, w[i].view);
+            gm_destroy(w[i].view);
+        }
+        free(w[i].buf);
+    }
+    free(w);
+    stats->ns = gm_now_ns() - start;
+    return ran ? 0 : -1;
+}
+
+// Does the kernel VA map to a native image header?
+static int confirm_base(guest_mem_t *gm, uint64_t base, uint64_t *pa) {
+    const uint8_t *page;
+
+    if (gm_translate(gm, GM_KERNEL_DTB, base, pa) != 0) return 0;
+    page = gm_map_pa(gm, *pa, GM_PAGE_SIZE);
+    return page && native_pe(page);
+}
+
+// Prefer a candidate whose base maps to an image header; with several
+// (or no way to translate) take the first
+static const candidate_t *pick(guest_mem_t *gm, const candidate_t *list, int n, uint64_t *kernel_pa) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (confirm_base(gm, list[i].kernel_base, kernel_pa)) return &list[i];
+    }
+    *kernel_pa = 0;
+    return n ? &list[0] : NULL;
+}
+
+static int compare_pa(const void *a, const void *b) {
+    uint64_t x = ((const candidate_t*)a)->pa, y = ((const candidate_t*)b)->pa;
+    return x < y ? -1 : x > y;
+}
+
+int win_scan_kernel(guest_mem_t *gm, int workers, win_scan_result_t *out) {
+    const candidate_t *version, *kdbg = NULL;
+    win_sweep_stats_t stats;
+    uint64_t kernel_pa = 0;
+    scan_t scan;
+    int i;
+
+    memset(out, 0, sizeof(*out));
+    memset(&scan, 0, sizeof(scan));
+    scan.avx2 = win_scan_avx2();
+    pthread_mutex_init(&scan.lock, NULL);
+    win_sweep_phys(gm, workers, scan_page, &scan, &stats);
+    pthread_mutex_destroy(&scan.lock);
+    out->bytes = stats.bytes;
+    out->ns = stats.ns;
+    out->workers = stats.workers;
+    out->pe_images = scan.pe_images;
+
+    // Workers finish in any order; keep the answer deterministic
+    qsort(scan.versions, scan.nversions, sizeof(candidate_t), compare_pa);
+    qsort(scan.kdbgs, scan.nkdbgs, sizeof(candidate_t), compare_pa);
+
+    version = pick(gm, scan.versions, scan.nversions, &kernel_pa);
+    for (i = 0; version && i < scan.nkdbgs; i++) {
+        if (scan.kdbgs[i].kernel_base == version->kernel_base) {
+            kdbg = &scan.kdbgs[i];
+            break;
+        }
+    }
+    if (!version) kdbg = pick(gm, scan.kdbgs, scan.nkdbgs, &kernel_pa);
+
+    if (version) {
+        out->kernel_base = version->kernel_base;
+        out->kd_version_pa = version->pa;
+        out->ps_loaded_module_list = version->modules;
+        out->build = version->build;
+    }
+    if (kdbg) {
+        out->kernel_base = kdbg->kernel_base;
+        out->kdbg_pa = kdbg->pa;
+        out->ps_loaded_module_list = kdbg->modules;
+        out->ps_active_process_head = kdbg->processes;
+    }
+    out->kernel_pa = kernel_pa;
+    return out->kernel_base ? 0 : -1;
+}
@@ -0,0 +1,70 @@
+#ifndef WIN_SCAN_H
+#define WIN_SCAN_H
+
+#include <stdint.h>
+#include "guest_mem.h"
+
+// Cold-start kernel discovery by scanning guest physical memory.
+//
+// Without a symbol cache hit, finding the kernel means asking LibVMI to
+// locate it, which is slow and needs a complete libvmi.conf. The scan
+// instead sweeps all of guest RAM once, split by physical range over a
+// pool of workers, and looks for three signatures:
+//
+//   - KdVersionBlock (DBGKD_GET_VERSION64): major version 0xf and machine
+//     type 0x8664, holding KernBase and PsLoadedModuleList. It lives in
+//     the kernel's data section and is never encoded.
+//   - KDBG (KDDEBUGGER_DATA64): the "KDBG" owner tag, holding KernBase,
+//     PsLoadedModuleList and PsActiveProcessHead. Since Windows 8 the
+//     block is encoded unless the kernel was booted with debugging on, so
+//     it is a bonus rather than something to rely on.
+//   - Page-aligned PE32+ native images (the kernel and its drivers), used
+//     to confirm that KernBase really maps to an image header.
+//
+// Candidates are found 16 or 32 bytes at a time with SIMD compares and
+// verified with a few small reads. The scan reads pages straight from the
+// backend, so it neither needs nor disturbs the page cache.
+
+#define WIN_SCAN_CHUNK_PAGES 64
+
+// Sweep of all of guest RAM that the kernel scan and the pool scanners
+// share: fn is called once per readable page, from one of the workers.
+// worker (0 .. workers-1) indexes per-worker state; view is that worker's
+// gm_clone(), for reads beyond the page. Returns 0, or -1 when the
+// backend cannot tell how much RAM there is.
+typedef void (*win_sweep_fn)(void *ctx, int worker, guest_mem_t *view, uint64_t pa, const uint8_t *page);
+
+typedef struct {
+    uint64_t bytes;                 // guest RAM swept
+    uint64_t ns;
+    int workers;                    // workers that ran
+} win_sweep_stats_t;
+
+int win_sweep_phys(guest_mem_t *gm, int workers, win_sweep_fn fn, void *ctx, win_sweep_stats_t *stats);
+
+// Whether the CPU has AVX2 / SSSE3, for sweep callbacks, page diffs and
+// signature scans picking a vector width
+int win_scan_avx2(void);
+int win_scan_ssse3(void);
+
+typedef struct {
+    uint64_t kernel_base;           // VA of the kernel image, 0 if not found
+    uint64_t kernel_pa;             // its PE header, 0 if not confirmed
+    uint64_t kd_version_pa;         // KdVersionBlock, 0 if not found
+    uint64_t kdbg_pa;               // KDBG header, 0 if not found or encoded
+    uint64_t ps_loaded_module_list; // from either block, 0 if unknown
+    uint64_t ps_active_process_head;// from KDBG only, 0 if unknown
+    uint16_t build;                 // NT build from KdVersionBlock
+
+    uint64_t pe_images;             // native PE images seen
+    uint64_t bytes;                 // guest RAM scanned
+    uint64_t ns;                    // wall time of the scan
+    int workers;
+} win_scan_result_t;
+
+// Scan guest RAM for the kernel with the given number of workers (each
+// reads through its own gm_clone() view). Returns 0 when the kernel base
+// was found, -1 otherwise; out is filled either way.
+int win_scan_kernel(guest_mem_t *gm, int workers, win_scan_result_t *out);
+
+#endif
@@ -0,0 +1,840 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "win_parallel.h"
+#include "win_scan.h"
+#include "win_sigscan.h"
+
+// Longest anchor; longer runs only add states, not selectivity
+#define ANCHOR_MAX      16
+
+// Transitions into a state that ends an anchor carry this bit, so the
+// scan loop tests for output without a second load
+#define OUT_FLAG        0x80000000U
+#define STATE_MASK      0x7fffffffU
+
+// Start bytes up to which skipping to the next one beats stepping the
+// automaton over every byte
+#define SKIP_MAX_START  96
+
+typedef struct {
+    char *name;
+    uint8_t *bytes;
+    uint8_t *mask;                  // 0xff where the byte must match, 0 for ??
+    uint16_t len;
+    uint16_t anchor;                // offset of the anchor in the pattern
+    uint16_t anchor_len;
+    int32_t next_out;               // next pattern whose anchor ends in the same state
+} sig_t;
+
+struct win_sig_set {
+    sig_t *sigs;
+    size_t count, cap;
+
+    uint32_t *delta;                // states x 256 transitions
+    int32_t *out;                   // first pattern whose anchor ends in a state, -1 if none
+    uint32_t *dict;                 // nearest state down the fail links that ends an anchor
+    size_t states;
+    uint8_t nib[2][16];             // start bytes as pshufb tables (see next_start)
+    int start_bytes;
+    size_t (*next_start)(const struct win_sig_set *set, const uint8_t *p, size_t i, size_t n);
+    int compiled;
+};
+
+win_sig_set_t *win_sig_set_create(void) {
+    return calloc(1, sizeof(win_sig_set_t));
+}
+
+void win_sig_set_destroy(win_sig_set_t *set) {
+    size_t i;
+
+    if (!set) return;
+    for (i = 0; i < set->count; i++) {
+        free(set->sigs[i].name);
+        free(set->sigs[i].bytes);
+    }
+    free(set->sigs);
+    free(set->delta);
+    free(set->out);
+    free(set->dict);
+    free(set);
+}
+
+static int hex_digit(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// "text" or w"text" with C escapes; returns 0, or -1
+static int parse_string(const char *t, int wide, uint8_t *bytes, uint8_t *mask, size_t *len,
+                        char *error, size_t error_len) {
+    const char *p = t + 1;
+    size_t n = 0;
+
+    while (*p && *p != '"') {
+        int c = (unsigned char)*p++;
+
+        if (c == '\\') {
+            switch (*p) {
+            case 'n': c = '\n'; p++; break;
+            case 'r': c = '\r'; p++; break;
+            case 't': c = '\t'; p++; break;
+            case '0': c = 0; p++; break;
+            case 'x':
+                if (hex_digit(p[1]) < 0 || hex_digit(p[2]) < 0) {
+                    snprintf(error, error_len, "Bad \\x escape");
+                    return -1;
+                }
+                c = hex_digit(p[1]) * 16 + hex_digit(p[2]);
+                p += 3;
+                break;
+            case '\0':
+                snprintf(error, error_len, "Unterminated string");
+                return -1;
+            default: c = (unsigned char)*p++; break;
+            }
+        }
+        if (n + (wide ? 2 : 1) > WIN_SIG_MAX_LEN) {
+            snprintf(error, error_len, "Pattern longer than %d bytes", WIN_SIG_MAX_LEN);
+            return -1;
+        }
+        bytes[n] = (uint8_t)c;
+        mask[n++] = 0xff;
+        if (wide) {
+            bytes[n] = 0;
+            mask[n++] = 0xff;
+        }
+    }
+    if (*p != '"') {
+        snprintf(error, error_len, "Unterminated string");
+        return -1;
+    }
+    for (p++; isspace((unsigned char)*p); p++) {}
+    if (*p) {
+        snprintf(error, error_len, "Text after the string");
+        return -1;
+    }
+    *len = n;
+    return 0;
+}
+
+// Hex bytes and ?? wildcards, spaces optional
+static int parse_hex(const char *t, uint8_t *bytes, uint8_t *mask, size_t *len, char *error, size_t error_len) {
+    size_t n = 0;
+
+    for (;;) {
+        while (isspace((unsigned char)*t)) t++;
+        if (!*t) break;
+        if (n == WIN_SIG_MAX_LEN) {
+            snprintf(error, error_len, "Pattern longer than %d bytes", WIN_SIG_MAX_LEN);
+            return -1;
+        }
+        if (t[0] == '?' && t[1] == '?') {
+            bytes[n] = 0;
+            mask[n++] = 0;
+        } else if (hex_digit(t[0]) >= 0 && hex_digit(t[1]) >= 0) {
+            bytes[n] = (uint8_t)(hex_digit(t[0]) * 16 + hex_digit(t[1]));
+            mask[n++] = 0xff;
+        } else {
+            snprintf(error, error_len, "Expected a hex byte or ?? at \"%.8s\"", t);
+            return -1;
+        }
+        t += 2;
+    }
+    *len = n;
+    return 0;
+}
+
+// How much a byte narrows down where an anchor can match: zeros and the
+// fill bytes are everywhere, text and UTF-16 text are common
+static int byte_weight(uint8_t b) {
+    if (b == 0x00) return 1;
+    if (b == 0xff || b == 0x20 || b == 0xcc) return 2;
+    if (isalnum(b)) return 3;
+    return 4;
+}
+
+// Anchor: the run of at most ANCHOR_MAX bytes without wildcards whose
+// bytes together are least likely to occur by chance. A common first
+// byte costs extra, as every one of them stops the skip to start bytes.
+static void pick_anchor(sig_t *sig) {
+    size_t i, j, k, end;
+    int best = -1;
+
+    for (i = 0; i < sig->len; i++) {
+        if (!sig->mask[i]) continue;
+        for (end = i; end < sig->len && sig->mask[end]; end++) {}
+        for (j = i; j < end; j++) {
+            size_t run = end - j < ANCHOR_MAX ? end - j : ANCHOR_MAX;
+            int score = byte_weight(sig->bytes[j]) - 4;
+
+            for (k = j; k < j + run; k++) score += byte_weight(sig->bytes[k]);
+            if (score > best) {
+                best = score;
+                sig->anchor = (uint16_t)j;
+                sig->anchor_len = (uint16_t)run;
+            }
+        }
+        i = end;
+    }
+}
+
+int win_sig_add(win_sig_set_t *set, const char *name, const char *pattern, char *error, size_t error_len) {
+    uint8_t bytes[WIN_SIG_MAX_LEN], mask[WIN_SIG_MAX_LEN];
+    char number[32];
+    size_t len = 0, i;
+    sig_t *sig;
+    int rc;
+
+    while (isspace((unsigned char)*pattern)) pattern++;
+    if (pattern[0] == '"') rc = parse_string(pattern, 0, bytes, mask, &len, error, error_len);
+    else if (pattern[0] == 'w' && pattern[1] == '"') rc = parse_string(pattern + 1, 1, bytes, mask, &len, error, error_len);
+    else rc = parse_hex(pattern, bytes, mask, &len, error, error_len);
+    if (rc != 0) return -1;
+    for (i = 0; i < len && !mask[i]; i++) {}
+    if (i == len) {
+        snprintf(error, error_len, len ? "Pattern has only wildcards" : "Empty pattern");
+        return -1;
+    }
+    if (set->count == WIN_SIG_MAX_PATTERNS) {
+        snprintf(error, error_len, "More than %d patterns", WIN_SIG_MAX_PATTERNS);
+        return -1;
+    }
+    if (set->count == set->cap) {
+        size_t cap = set->cap ? set->cap * 2 : 16;
+        sig_t *grown = realloc(set->sigs, cap * sizeof(*grown));
+
+        if (!grown) {
+            snprintf(error, error_len, "Out of memory");
+            return -1;
+        }
+        set->sigs = grown;
+        set->cap = cap;
+    }
+
+    sig = &set->sigs[set->count];
+    memset(sig, 0, sizeof(*sig));
+    snprintf(number, sizeof(number), "sig%zu", set->count);
+    sig->name = strdup(name ? name : number);
+    sig->bytes = malloc(2 * len);
+    if (!sig->name || !sig->bytes) {
+        free(sig->name);
+        free(sig->bytes);
+        snprintf(error, error_len, "Out of memory");
+        return -1;
+    }
+    sig->mask = sig->bytes + len;
+    memcpy(sig->bytes, bytes, len);
+    memcpy(sig->mask, mask, len);
+    sig->len = (uint16_t)len;
+    pick_anchor(sig);
+    set->compiled = 0;
+    return (int)set->count++;
+}
+
+int win_sig_load(win_sig_set_t *set, const char *path, char *error, size_t error_len) {
+    char line[4096], message[256];
+    FILE *f = fopen(path, "r");
+    int added = 0, number = 0;
+
+    if (!f) {
+        snprintf(error, error_len, "Cannot open %s", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *name = line, *pattern, *end;
+
+        number++;
+        while (isspace((unsigned char)*name)) name++;
+        if (!*name || *name == '#') continue;
+        for (pattern = name; *pattern && !isspace((unsigned char)*pattern); pattern++) {}
+        if (*pattern) *pattern++ = '\0';
+        for (end = pattern + strlen(pattern); end > pattern && isspace((unsigned char)end[-1]); end--) {}
+        *end = '\0';
+        if (win_sig_add(set, name, pattern, message, sizeof(message)) < 0) {
+            snprintf(error, error_len, "%s:%d: %s", path, number, message);
+            fclose(f);
+            return -1;
+        }
+        added++;
+    }
+    fclose(f);
+    return added;
+}
+
+// Next byte at or after i that can start an anchor, n if none. The set
+// of start bytes is tested a vector at a time: one pshufb on the low
+// nibble picks a mask of high nibbles (one table for high nibbles 0-7,
+// one for 8-f) and a second on the high nibble picks the bit to test.
+static size_t next_start_scalar(const win_sig_set_t *set, const uint8_t *p, size_t i, size_t n) {
+    for (; i < n; i++) {
+        if (set->nib[p[i] >> 7][p[i] & 0xf] & (1 << ((p[i] >> 4) & 7))) break;
+    }
+    return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static const uint8_t nibble_bit[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+
+__attribute__((target("avx2")))
+static size_t next_start_avx2(const win_sig_set_t *set, const uint8_t *p, size_t i, size_t n) {
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->nib[0]));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->nib[1]));
+    const __m256i bits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibble_bit));
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f), seven = _mm256_set1_epi8(7);
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i lo = _mm256_and_si256(v, low_nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+        __m256i upper = _mm256_cmpgt_epi8(hi, seven);
+        __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_table, lo),
+                                         _mm256_shuffle_epi8(high_table, lo), upper);
+        __m256i hit = _mm256_and_si256(row, _mm256_shuffle_epi8(bits, hi));
+        uint32_t m = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, _mm256_setzero_si256()));
+
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+    return next_start_scalar(set, p, i, n);
+}
+
+__attribute__((target("ssse3")))
+static size_t next_start_ssse3(const win_sig_set_t *set, const uint8_t *p, size_t i, size_t n) {
+    const __m128i low_table = _mm_loadu_si128((const __m128i*)set->nib[0]);
+    const __m128i high_table = _mm_loadu_si128((const __m128i*)set->nib[1]);
+    const __m128i bits = _mm_loadu_si128((const __m128i*)nibble_bit);
+    const __m128i low_nibble = _mm_set1_epi8(0x0f), seven = _mm_set1_epi8(7);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i lo = _mm_and_si128(v, low_nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+        __m128i upper = _mm_cmpgt_epi8(hi, seven);
+        __m128i row = _mm_or_si128(_mm_andnot_si128(upper, _mm_shuffle_epi8(low_table, lo)),
+                                   _mm_and_si128(upper, _mm_shuffle_epi8(high_table, lo)));
+        __m128i hit = _mm_and_si128(row, _mm_shuffle_epi8(bits, hi));
+        uint32_t m = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) & 0xffff;
+
+        if (m) return i + (size_t)__builtin_ctz(m);
+    }
+    return next_start_scalar(set, p, i, n);
+}
+#endif
+
+int win_sig_compile(win_sig_set_t *set) {
+    uint32_t *fail = NULL, *queue = NULL;
+    uint8_t *ends = NULL;
+    size_t cap = 1, i, k, head, tail;
+
+    free(set->delta);
+    free(set->out);
+    free(set->dict);
+    set->delta = NULL;
+    set->out = NULL;
+    set->dict = NULL;
+    set->compiled = 0;
+    if (set->count == 0) return -1;
+
+    // The trie, in the transition table: a missing edge is 0 until the
+    // state's row is completed below
+    for (i = 0; i < set->count; i++) cap += set->sigs[i].anchor_len;
+    set->delta = calloc(cap * 256, sizeof(*set->delta));
+    set->out = malloc(cap * sizeof(*set->out));
+    set->dict = calloc(cap, sizeof(*set->dict));
+    fail = calloc(cap, sizeof(*fail));
+    queue = malloc(cap * sizeof(*queue));
+    ends = calloc(cap, 1);
+    if (!set->delta || !set->out || !set->dict || !fail || !queue || !ends) goto fail;
+    for (i = 0; i < cap; i++) set->out[i] = -1;
+    set->states = 1;
+    for (i = 0; i < set->count; i++) {
+        sig_t *sig = &set->sigs[i];
+        uint32_t s = 0;
+
+        for (k = 0; k < sig->anchor_len; k++) {
+            uint32_t *edge = &set->delta[(size_t)s * 256 + sig->bytes[sig->anchor + k]];
+            if (!*edge) *edge = (uint32_t)set->states++;
+            s = *edge;
+        }
+        sig->next_out = set->out[s];
+        set->out[s] = (int32_t)i;
+    }
+
+    // Fail links breadth first; a row is completed from its fail state's,
+    // which is shallower and so done already
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        uint32_t r = queue[head++];
+
+        for (k = 0; k < 256; k++) {
+            uint32_t *edge = &set->delta[(size_t)r * 256 + k];
+
+            if (*edge) {
+                uint32_t u = *edge;
+                fail[u] = r ? set->delta[(size_t)fail[r] * 256 + k] : 0;
+                set->dict[u] = set->out[fail[u]] >= 0 ? fail[u] : set->dict[fail[u]];
+                queue[tail++] = u;
+            } else if (r) {
+                *edge = set->delta[(size_t)fail[r] * 256 + k];
+            }
+        }
+    }
+
+    for (i = 0; i < set->states; i++) ends[i] = set->out[i] >= 0 || set->dict[i];
+    for (i = 0; i < set->states * 256; i++) {
+        if (ends[set->delta[i]]) set->delta[i] |= OUT_FLAG;
+    }
+
+    memset(set->nib, 0, sizeof(set->nib));
+    set->start_bytes = 0;
+    for (k = 0; k < 256; k++) {
+        if (!set->delta[k]) continue;
+        set->nib[k >> 7][k & 0xf] |= (uint8_t)(1 << ((k >> 4) & 7));
+        set->start_bytes++;
+    }
+    set->next_start = next_start_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if (win_scan_avx2()) set->next_start = next_start_avx2;
+    else if (win_scan_ssse3()) set->next_start = next_start_ssse3;
+#endif
+    if (set->start_bytes > SKIP_MAX_START) set->next_start = NULL;
+
+    free(fail);
+    free(queue);
+    free(ends);
+    set->compiled = 1;
+    return 0;
+
+fail:
+    free(fail);
+    free(queue);
+    free(ends);
+    free(set->delta);
+    free(set->out);
+    free(set->dict);
+    set->delta = NULL;
+    set->out = NULL;
+    set->dict = NULL;
+    return -1;
+}
+
+size_t win_sig_count(const win_sig_set_t *set) {
+    return set->count;
+}
+
+const char *win_sig_name(const win_sig_set_t *set, size_t id) {
+    return id < set->count ? set->sigs[id].name : NULL;
+}
+
+size_t win_sig_length(const win_sig_set_t *set, size_t id) {
+    return id < set->count ? set->sigs[id].len : 0;
+}
+
+size_t win_sig_states(const win_sig_set_t *set) {
+    return set->compiled ? set->states : 0;
+}
+
+int win_sig_ranges_add(win_sig_ranges_t *ranges, uint64_t start, uint64_t end) {
+    if (end <= start) return 0;
+    if (ranges->count == ranges->cap) {
+        size_t cap = ranges->cap ? ranges->cap * 2 : 64;
+        win_sig_range_t *grown = realloc(ranges->items, cap * sizeof(*grown));
+
+        if (!grown) return -1;
+        ranges->items = grown;
+        ranges->cap = cap;
+    }
+    ranges->items[ranges->count].start = start;
+    ranges->items[ranges->count].end = end;
+    ranges->count++;
+    return 0;
+}
+
+static int compare_range(const void *a, const void *b) {
+    const win_sig_range_t *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+void win_sig_ranges_normalize(win_sig_ranges_t *ranges) {
+    size_t i, n = 0;
+
+    for (i = 0; i < ranges->count; i++) {
+        ranges->items[i].start &= ~(uint64_t)GM_PAGE_MASK;
+        ranges->items[i].end = (ranges->items[i].end + GM_PAGE_MASK) & ~(uint64_t)GM_PAGE_MASK;
+    }
+    qsort(ranges->items, ranges->count, sizeof(*ranges->items), compare_range);
+    for (i = 0; i < ranges->count; i++) {
+        if (n && ranges->items[i].start <= ranges->items[n - 1].end) {
+            if (ranges->items[i].end > ranges->items[n - 1].end) ranges->items[n - 1].end = ranges->items[i].end;
+        } else {
+            ranges->items[n++] = ranges->items[i];
+        }
+    }
+    ranges->count = n;
+}
+
+void win_sig_ranges_free(win_sig_ranges_t *ranges) {
+    free(ranges->items);
+    memset(ranges, 0, sizeof(*ranges));
+}
+
+int win_sig_target_process(win_sig_target_t *target, const win_process_t *process,
+                           const win_vad_map_t *vads, const win_module_list_t *modules) {
+    size_t i;
+    int rc = 0;
+
+    memset(target, 0, sizeof(*target));
+    target->dtb = win_process_dtb(process);
+    for (i = 0; vads && i < vads->count; i++) {
+        rc |= win_sig_ranges_add(&target->ranges, vads->items[i].start, vads->items[i].end);
+    }
+    for (i = 0; modules && i < modules->count; i++) {
+        rc |= win_sig_ranges_add(&target->ranges, modules->items[i].base,
+                                 modules->items[i].base + modules->items[i].size);
+    }
+    win_sig_ranges_normalize(&target->ranges);
+    return rc;
+}
+
+// A piece of one range handed to a worker. Hits starting in [start, end)
+// are its own; it reads up to a page past end so they are found whole.
+typedef struct {
+    uint32_t target;
+    uint64_t start, end, to;
+} span_t;
+
+// A match whose pattern runs on into the next page
+typedef struct {
+    uint64_t va;
+    uint32_t pattern;
+} pending_t;
+
+typedef struct {
+    const win_sig_set_t *set;
+    const win_sig_target_t *targets;
+    const span_t *spans;
+    size_t span_count;
+    size_t next;                    // next unclaimed span
+    size_t hits;                    // over all workers, for the cap
+    int dropped;
+} scan_t;
+
+typedef struct {
+    scan_t *scan;
+    guest_mem_t *view;
+    uint8_t *buf;                   // GM_MAX_BATCH pages
+    uint8_t *carry;                 // previous page when buf is reused
+    const span_t *span;
+    uint32_t state;
+    const uint8_t *prev;            // page before the current one, NULL after a gap
+    uint64_t prev_va;
+    pending_t *pending;
+    size_t pending_count, pending_cap;
+    win_sig_hit_t *hits;
+    size_t hit_count, hit_cap;
+    uint64_t bytes, absent;
+    pthread_t thread;
+    int started;
+} worker_t;
+
+static void add_hit(worker_t *w, uint64_t va, uint32_t pattern) {
+    if (__atomic_add_fetch(&w->scan->hits, 1, __ATOMIC_RELAXED) > WIN_SIG_MAX_HITS) {
+        __atomic_store_n(&w->scan->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (w->hit_count == w->hit_cap) {
+        size_t cap = w->hit_cap ? w->hit_cap * 2 : 256;
+        win_sig_hit_t *grown = realloc(w->hits, cap * sizeof(*grown));
+
+        if (!grown) {
+            __atomic_store_n(&w->scan->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        w->hits = grown;
+        w->hit_cap = cap;
+    }
+    w->hits[w->hit_count].va = va;
+    w->hits[w->hit_count].pattern = pattern;
+    w->hits[w->hit_count].target = w->span->target;
+    w->hit_count++;
+}
+
+// Whole pattern at va, reading from page (at page_va) and the one before
+static int verify(const worker_t *w, const sig_t *sig, uint64_t va, const uint8_t *page, uint64_t page_va) {
+    size_t k;
+
+    for (k = 0; k < sig->len; k++) {
+        uint64_t at = va + k;
+        uint8_t b = at >= page_va ? page[at - page_va] : w->prev[at - w->prev_va];
+
+        if ((b ^ sig->bytes[k]) & sig->mask[k]) return 0;
+    }
+    return 1;
+}
+
+// Checked once the next page is in
+static void push_pending(worker_t *w, uint64_t va, uint32_t pattern) {
+    if (w->pending_count == w->pending_cap) {
+        size_t cap = w->pending_cap ? w->pending_cap * 2 : 16;
+        pending_t *grown = realloc(w->pending, cap * sizeof(*grown));
+
+        if (!grown) {
+            __atomic_store_n(&w->scan->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        w->pending = grown;
+        w->pending_cap = cap;
+    }
+    w->pending[w->pending_count].va = va;
+    w->pending[w->pending_count].pattern = pattern;
+    w->pending_count++;
+}
+
+// Anchors ending at end_va in state s
+static void report(worker_t *w, uint32_t s, uint64_t end_va, const uint8_t *page, uint64_t page_va) {
+    const win_sig_set_t *set = w->scan->set;
+    uint64_t first = w->prev ? w->prev_va : page_va;
+
+    for (; s; s = set->dict[s]) {
+        int32_t p;
+
+        for (p = set->out[s]; p >= 0; p = set->sigs[p].next_out) {
+            const sig_t *sig = &set->sigs[p];
+            uint64_t back = (uint64_t)sig->anchor + sig->anchor_len - 1, va;
+
+            if (end_va - first < back) continue;        // starts before readable memory
+            va = end_va - back;
+            if (va < w->span->start || va >= w->span->end) continue;
+            if (va + sig->len <= page_va + GM_PAGE_SIZE) {
+                if (verify(w, sig, va, page, page_va)) add_hit(w, va, (uint32_t)p);
+            } else {
+                push_pending(w, va, (uint32_t)p);
+            }
+        }
+    }
+}
+
+static void scan_page(worker_t *w, const uint8_t *page, uint64_t va) {
+    const win_sig_set_t *set = w->scan->set;
+    const uint32_t *delta = set->delta;
+    uint32_t state = w->state, e;
+    size_t i = 0;
+
+    // Matches begun on the previous page end on this one
+    for (i = 0; i < w->pending_count; i++) {
+        const pending_t *q = &w->pending[i];
+        if (verify(w, &set->sigs[q->pattern], q->va, page, va)) add_hit(w, q->va, q->pattern);
+    }
+    w->pending_count = 0;
+
+    i = 0;
+    if (!set->next_start) {
+        for (; i < GM_PAGE_SIZE; i++) {
+            e = delta[(size_t)state * 256 + page[i]];
+            state = e & STATE_MASK;
+            if (e & OUT_FLAG) report(w, state, va + i, page, va);
+        }
+    } else {
+        while (i < GM_PAGE_SIZE) {
+            if (!state) {
+                i = set->next_start(set, page, i, GM_PAGE_SIZE);
+                if (i >= GM_PAGE_SIZE) break;
+            }
+            do {
+                e = delta[(size_t)state * 256 + page[i]];
+                state = e & STATE_MASK;
+                if (e & OUT_FLAG) report(w, state, va + i, page, va);
+                i++;
+            } while (state && i < GM_PAGE_SIZE);
+        }
+    }
+    w->state = state;
+    w->prev = page;
+    w->prev_va = va;
+}
+
+// Pages of one span, GM_MAX_BATCH at a time: one translation pass and
+// one backend fetch per batch
+static void scan_span(worker_t *w, const span_t *span) {
+    uint64_t dtb = w->scan->targets[span->target].dtb;
+    uint64_t vas[GM_MAX_BATCH], pas[GM_MAX_BATCH], pfns[GM_MAX_BATCH];
+    const uint8_t *pages[GM_MAX_BATCH];
+    uint64_t va;
+    size_t n, m, j;
+
+    w->span = span;
+    w->state = 0;
+    w->prev = NULL;
+    w->pending_count = 0;
+    for (va = span->start; va < span->to; va += n * GM_PAGE_SIZE) {
+        n = (span->to - va) >> GM_PAGE_SHIFT;
+        if (n > GM_MAX_BATCH) n = GM_MAX_BATCH;
+        for (j = 0; j < n; j++) vas[j] = va + j * GM_PAGE_SIZE;
+
+        // The page kept from the last batch is about to be overwritten
+        if (w->prev >= w->buf && w->prev < w->buf + GM_MAX_BATCH * GM_PAGE_SIZE) {
+            memcpy(w->carry, w->prev, GM_PAGE_SIZE);
+            w->prev = w->carry;
+        }
+        gm_translate_batch(w->view, dtb, vas, pas, n);
+        for (j = m = 0; j < n; j++) {
+            if (pas[j] != GM_NO_PA) pfns[m++] = pas[j] >> GM_PAGE_SHIFT;
+        }
+        gm_fetch_pfns(w->view, pfns, m, w->buf, pages);
+
+        for (j = m = 0; j < n; j++) {
+            const uint8_t *page = pas[j] != GM_NO_PA ? pages[m++] : NULL;
+            int own = vas[j] < span->end;
+
+            if (!page) {
+                if (own) w->absent++;
+                w->state = 0;
+                w->prev = NULL;
+                w->pending_count = 0;
+                continue;
+            }
+            if (own) w->bytes += GM_PAGE_SIZE;
+            scan_page(w, page, vas[j]);
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    scan_t *scan = w->scan;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&scan->next, 1, __ATOMIC_RELAXED);
+        if (i >= scan->span_count) break;
+        scan_span(w, &scan->spans[i]);
+    }
+    return NULL;
+}
+
+static int compare_hit(const void *a, const void *b) {
+    const win_sig_hit_t *x = a, *y = b;
+
+    if (x->target != y->target) return x->target < y->target ? -1 : 1;
+    if (x->va != y->va) return x->va < y->va ? -1 : 1;
+    return x->pattern < y->pattern ? -1 : x->pattern > y->pattern;
+}
+
+// Every range cut into spans of WIN_SIG_SPAN_PAGES
+static span_t *make_spans(const win_sig_target_t *targets, size_t count, size_t *n) {
+    const uint64_t span_bytes = (uint64_t)WIN_SIG_SPAN_PAGES << GM_PAGE_SHIFT;
+    span_t *spans = NULL;
+    size_t i, k, total = 0, cap = 0;
+
+    for (i = 0; i < count; i++) {
+        for (k = 0; k < targets[i].ranges.count; k++) {
+            const win_sig_range_t *r = &targets[i].ranges.items[k];
+            uint64_t va;
+
+            for (va = r->start; va < r->end; va += span_bytes) {
+                if (total == cap) {
+                    span_t *grown;
+                    cap = cap ? cap * 2 : 256;
+                    grown = realloc(spans, cap * sizeof(*grown));
+                    if (!grown) {
+                        free(spans);
+                        return NULL;
+                    }
+                    spans = grown;
+                }
+                spans[total].target = (uint32_t)i;
+                spans[total].start = va;
+                spans[total].end = r->end - va > span_bytes ? va + span_bytes : r->end;
+                spans[total].to = r->end - spans[total].end > GM_PAGE_SIZE ? spans[total].end + GM_PAGE_SIZE
+                                                                            : r->end;
+                total++;
+            }
+        }
+    }
+    *n = total;
+    return spans ? spans : malloc(sizeof(*spans));
+}
+
+int win_sig_scan(guest_mem_t *gm, const win_sig_set_t *set, const win_sig_target_t *targets, size_t count,
+                 int workers, win_sig_result_t *out) {
+    uint64_t start = gm_now_ns();
+    scan_t scan;
+    worker_t *w;
+    size_t total = 0;
+    int i, ran = 0;
+
+    memset(out, 0, sizeof(*out));
+    if (!set->compiled) return -1;
+    memset(&scan, 0, sizeof(scan));
+    scan.set = set;
+    scan.targets = targets;
+    scan.spans = make_spans(targets, count, &scan.span_count);
+    if (!scan.spans) return -1;
+    if (workers < 1) workers = 1;
+    if ((size_t)workers > scan.span_count) workers = scan.span_count ? (int)scan.span_count : 1;
+
+    w = calloc(workers, sizeof(*w));
+    if (!w) {
+        free((void*)scan.spans);
+        return -1;
+    }
+    for (i = 0; i < workers; i++) {
+        w[i].scan = &scan;
+        w[i].view = gm_clone(gm, 64);
+        w[i].buf = malloc((GM_MAX_BATCH + 1) * GM_PAGE_SIZE);
+        if (!w[i].view || !w[i].buf) break;
+        w[i].carry = w[i].buf + GM_MAX_BATCH * GM_PAGE_SIZE;
+        // Worker 0 runs on the calling thread
+        if (i > 0) {
+            w[i].started = pthread_create(&w[i].thread, NULL, worker_main, &w[i]) == 0;
+            if (!w[i].started) break;
+        }
+    }
+    // Whatever workers did start still claim every span
+    if (w[0].view && w[0].buf) {
+        worker_main(&w[0]);
+        ran = 1;
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (w[i].started) pthread_join(w[i].thread, NULL);
+        if (w[i].started || (i == 0 && ran)) out->workers++;
+        total += w[i].hit_count;
+    }
+    out->items = malloc((total ? total : 1) * sizeof(*out->items));
+    for (i = 0; i < workers; i++) {
+        if (out->items && w[i].hit_count) {
+            memcpy(out->items + out->count, w[i].hits, w[i].hit_count * sizeof(*out->items));
+            out->count += w[i].hit_count;
+        }
+        out->bytes += w[i].bytes;
+        out->absent += w[i].absent;
+        if (w[i].view) {
+            gm_merge_stats(gm, w[i].view);
+            gm_destroy(w[i].view);
+        }
+        free(w[i].buf);
+        free(w[i].hits);
+        free(w[i].pending);
+    }
+    free(w);
+    free((void*)scan.spans);
+
+    if (!out->items) scan.dropped = 1;
+    qsort(out->items, out->count, sizeof(*out->items), compare_hit);
+    out->cap = out->count;
+    if (scan.dropped) out->error = "Too many hits, some were dropped";
+    out->ns = gm_now_ns() - start;
+    return ran ? 0 : -1;
+}
+
+void win_sig_result_free(win_sig_result_t *result) {
+    free(result->items);
+    memset(result, 0, sizeof(*result));
+}
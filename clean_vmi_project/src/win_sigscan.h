@@ -0,0 +1,114 @@
+#ifndef WIN_SIGSCAN_H
+#define WIN_SIGSCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_vad.h"
+#include "win_walk.h"
+
+// Signature scans of process memory, without an agent in the guest.
+//
+// A set of byte patterns ("48 8b ?? ?? e8", with ?? matching any byte,
+// or "quoted" strings, w"..." for UTF-16) is compiled once. Each pattern
+// is reduced to its anchor, the longest run of bytes without a wildcard,
+// and the anchors of all patterns go into one Aho-Corasick automaton
+// with a full transition table, so every byte costs one table load
+// whatever the number of patterns. While the automaton sits in its root
+// state, the bytes that cannot start an anchor are skipped 16 or 32 at a
+// time with a vector lookup of the start bytes. A match of the anchor is
+// then checked against the whole pattern.
+//
+// The memory scanned is given per process as ranges (the VAD regions,
+// the modules). The ranges are cut into spans that a pool of workers
+// claims one at a time, so one large process is shared out like many
+// small ones. A worker translates the VAs of up to GM_MAX_BATCH pages in
+// one pass over the page tables and fetches the pages behind them in one
+// backend call, past the page cache. Pages that do not translate (never
+// touched, paged out) are counted and skipped. Patterns are found across
+// page and span boundaries.
+
+#define WIN_SIG_MAX_LEN         256     // bytes in one pattern
+#define WIN_SIG_MAX_PATTERNS    16384
+#define WIN_SIG_MAX_HITS        (1 << 20)
+#define WIN_SIG_SPAN_PAGES      256     // pages a worker claims at a time
+
+typedef struct win_sig_set win_sig_set_t;
+
+win_sig_set_t *win_sig_set_create(void);
+void win_sig_set_destroy(win_sig_set_t *set);
+
+// Add a pattern under name (NULL names it by number). Returns its id, or
+// -1 with a message in error.
+int win_sig_add(win_sig_set_t *set, const char *name, const char *pattern, char *error, size_t error_len);
+
+// Patterns from a file, one "name pattern" per line; blank lines and
+// lines starting with # are skipped. Returns the number added, or -1
+// with a message naming the line in error.
+int win_sig_load(win_sig_set_t *set, const char *path, char *error, size_t error_len);
+
+// Build the automaton once every pattern is in; returns 0, or -1 when
+// there is nothing to compile or no memory for it
+int win_sig_compile(win_sig_set_t *set);
+
+size_t win_sig_count(const win_sig_set_t *set);
+const char *win_sig_name(const win_sig_set_t *set, size_t id);
+size_t win_sig_length(const win_sig_set_t *set, size_t id);
+
+// States of the compiled automaton
+size_t win_sig_states(const win_sig_set_t *set);
+
+// Ranges of one address space; normalize sorts them, widens them to
+// whole pages and merges the ones that overlap or touch
+typedef struct {
+    uint64_t start, end;            // end is one past the last byte
+} win_sig_range_t;
+
+typedef struct {
+    win_sig_range_t *items;
+    size_t count, cap;
+} win_sig_ranges_t;
+
+int win_sig_ranges_add(win_sig_ranges_t *ranges, uint64_t start, uint64_t end);
+void win_sig_ranges_normalize(win_sig_ranges_t *ranges);
+void win_sig_ranges_free(win_sig_ranges_t *ranges);
+
+// One address space to scan (win_process_dtb() of a process, or
+// GM_KERNEL_DTB)
+typedef struct {
+    uint64_t dtb;
+    win_sig_ranges_t ranges;
+} win_sig_target_t;
+
+// A process as a target: its VAD regions and its modules (the image VADs
+// cover those, but the tree may be unknown to the profile), normalized.
+// vads and modules may be NULL. Returns 0, or -1 when out of memory.
+int win_sig_target_process(win_sig_target_t *target, const win_process_t *process,
+                           const win_vad_map_t *vads, const win_module_list_t *modules);
+
+typedef struct {
+    uint64_t va;                    // first byte of the match
+    uint32_t pattern;
+    uint32_t target;                // index into the targets scanned
+} win_sig_hit_t;
+
+// Hits sorted by target, address and pattern
+typedef struct {
+    win_sig_hit_t *items;
+    size_t count, cap;
+    const char *error;              // set when hits were dropped
+    uint64_t bytes;                 // bytes of resident pages scanned
+    uint64_t absent;                // pages in the ranges that did not translate
+    uint64_t ns;
+    int workers;                    // workers that ran
+} win_sig_result_t;
+
+// Scan every target's ranges (normalized) with a compiled set. Each
+// worker reads through its own gm_clone() view. Returns 0, or -1 when
+// the set is not compiled or no worker could start.
+int win_sig_scan(guest_mem_t *gm, const win_sig_set_t *set, const win_sig_target_t *targets, size_t count,
+                 int workers, win_sig_result_t *out);
+
+void win_sig_result_free(win_sig_result_t *result);
+
+#endif
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "win_str.h"
+
+#define ARENA_ALIGN 16
+
+struct win_arena_chunk {
+    win_arena_chunk_t *next;
+    size_t size;                    // usable bytes in data
+    uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+void win_arena_init(win_arena_t *a) {
+    memset(a, 0, sizeof(*a));
+    a->next_size = WIN_ARENA_FIRST_CHUNK;
+}
+
+void *win_arena_alloc(win_arena_t *a, size_t size) {
+    size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    win_arena_chunk_t *c = a->chunks;
+    void *p;
+
+    if (!c || c->size - a->used < need) {
+        size_t csize = a->next_size ? a->next_size : WIN_ARENA_FIRST_CHUNK;
+
+        if (csize < need) csize = need;
+        c = malloc(sizeof(*c) + csize);
+        if (!c) return NULL;
+        c->size = csize;
+        c->next = a->chunks;
+        a->chunks = c;
+        a->used = 0;
+        a->bytes += sizeof(*c) + csize;
+        if (a->next_size < WIN_ARENA_MAX_CHUNK) a->next_size = (a->next_size ? a->next_size : csize) * 2;
+    }
+    p = c->data + a->used;
+    a->used += need;
+    return p;
+}
+
+void *win_arena_grow(win_arena_t *a, void *p, size_t old_size, size_t new_size) {
+    win_arena_chunk_t *c = a->chunks;
+    size_t old_need = (old_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    size_t new_need = (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    void *n;
+
+    // The latest allocation just moves the end of the chunk
+    if (p && c && (uint8_t*)p + old_need == c->data + a->used &&
+        (size_t)((uint8_t*)p - c->data) + new_need <= c->size) {
+        a->used = (size_t)((uint8_t*)p - c->data) + new_need;
+        return p;
+    }
+    n = win_arena_alloc(a, new_size);
+    if (n && p) memcpy(n, p, old_size < new_size ? old_size : new_size);
+    return n;
+}
+
+char *win_arena_utf16(win_arena_t *a, const uint16_t *wbuf, size_t nchars) {
+    size_t cap = nchars * 3 + 1, len;
+    char *out = win_arena_alloc(a, cap);
+
+    if (!out) return NULL;
+    len = win_utf16_to_utf8(wbuf, nchars, out, cap);
+
+    // Hand the unused tail back; out is the latest allocation
+    return win_arena_grow(a, out, cap, len + 1);
+}
+
+void win_arena_adopt(win_arena_t *dst, win_arena_t *src) {
+    win_arena_chunk_t *last;
+
+    if (!src->chunks) return;
+    if (!dst->chunks) {
+        *dst = *src;
+    } else {
+        // src's chunks go behind dst's current one, which keeps filling
+        for (last = src->chunks; last->next; last = last->next) {}
+        last->next = dst->chunks->next;
+        dst->chunks->next = src->chunks;
+        dst->bytes += src->bytes;
+    }
+    win_arena_init(src);
+}
+
+void win_arena_free(win_arena_t *a) {
+    win_arena_chunk_t *c = a->chunks, *next;
+
+    for (; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    win_arena_init(a);
+}
+
+// One code point at wbuf[*i]; returns the bytes written, 0 if it does not fit
+static size_t encode_one(const uint16_t *wbuf, size_t nchars, size_t *i, char *out, size_t room) {
+    uint32_t cp = wbuf[*i];
+    size_t used = 1;
+
+    if (cp >= 0xd800 && cp < 0xdc00 && *i + 1 < nchars &&
+        wbuf[*i + 1] >= 0xdc00 && wbuf[*i + 1] < 0xe000) {
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (wbuf[*i + 1] - 0xdc00);
+        used = 2;
+    }
+    if (cp < 0x80) {
+        if (room < 1) return 0;
+        out[0] = (char)cp;
+        *i += used;
+        return 1;
+    } else if (cp < 0x800) {
+        if (room < 2) return 0;
+        out[0] = (char)(0xc0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        *i += used;
+        return 2;
+    } else if (cp < 0x10000) {
+        if (room < 3) return 0;
+        out[0] = (char)(0xe0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        *i += used;
+        return 3;
+    }
+    if (room < 4) return 0;
+    out[0] = (char)(0xf0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    *i += used;
+    return 4;
+}
+
+size_t win_utf16_to_utf8(const uint16_t *wbuf, size_t nchars, char *out, size_t out_len) {
+    size_t i = 0, o = 0, n;
+
+    if (out_len == 0) return 0;
+
+    while (i < nchars) {
+#if defined(__x86_64__) || defined(__i386__)
+        // Eight ASCII code units narrow to eight bytes with one pack
+        if (i + 8 <= nchars && o + 8 < out_len) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(wbuf + i));
+            __m128i high = _mm_and_si128(v, _mm_set1_epi16((short)0xff80));
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xffff) {
+                _mm_storel_epi64((__m128i*)(out + o), _mm_packus_epi16(v, v));
+                i += 8;
+                o += 8;
+                continue;
+            }
+        }
+#endif
+        n = encode_one(wbuf, nchars, &i, out + o, out_len - 1 - o);
+        if (n == 0) break;
+        o += n;
+    }
+    out[o] = '\0';
+    return o;
+}
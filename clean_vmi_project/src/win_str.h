@@ -0,0 +1,52 @@
+#ifndef WIN_STR_H
+#define WIN_STR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Storage and decoding of what the walkers read out of the guest.
+//
+// A scan produces tens of thousands of rows and names that all die
+// together, so they come from a bump arena: allocation is a pointer add,
+// and the whole scan is released with one win_arena_free(). Module names
+// (UNICODE_STRING, UTF-16LE) are nearly always ASCII; the converter
+// narrows eight code units per step while that holds and falls back to
+// full UTF-8 encoding (with surrogate pairs) for the rest.
+
+typedef struct win_arena_chunk win_arena_chunk_t;
+
+typedef struct {
+    win_arena_chunk_t *chunks;      // newest first; allocations come from it
+    size_t used;                    // bytes taken in the newest chunk
+    size_t next_size;               // size of the next chunk
+    size_t bytes;                   // total held, chunk headers included
+} win_arena_t;
+
+// First chunk size; later chunks double up to WIN_ARENA_MAX_CHUNK
+#define WIN_ARENA_FIRST_CHUNK 4096
+#define WIN_ARENA_MAX_CHUNK   (1024 * 1024)
+
+void win_arena_init(win_arena_t *a);
+
+// 16-byte aligned, uninitialised; NULL when out of memory
+void *win_arena_alloc(win_arena_t *a, size_t size);
+
+// Resize an allocation of old_size bytes: in place when it is the latest
+// one and still fits, otherwise by copying (the old block stays until the
+// arena is freed)
+void *win_arena_grow(win_arena_t *a, void *p, size_t old_size, size_t new_size);
+
+// UTF-16LE as a NUL-terminated UTF-8 string in the arena
+char *win_arena_utf16(win_arena_t *a, const uint16_t *wbuf, size_t nchars);
+
+// Move every chunk of src into dst (e.g. a worker's arena into the
+// scan's); src is left empty
+void win_arena_adopt(win_arena_t *dst, win_arena_t *src);
+
+void win_arena_free(win_arena_t *a);
+
+// Convert UTF-16LE to NUL-terminated UTF-8; returns the output length.
+// Output is cut at a code point boundary when out_len is too small.
+size_t win_utf16_to_utf8(const uint16_t *wbuf, size_t nchars, char *out, size_t out_len);
+
+#endif
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "win_profile.h"
+#include "win_symcache.h"
+
+typedef struct {
+    char key[WIN_PDB_KEY_LEN];
+    char name[64];
+    uint64_t rva;
+} cached_symbol_t;
+
+typedef struct {
+    char key[WIN_PDB_KEY_LEN];
+    uint64_t base;
+    char *domain;
+} cached_base_t;
+
+struct win_symcache {
+    char *path;
+    char *domain;
+    cached_symbol_t *symbols;
+    size_t symbol_count, symbol_cap;
+    cached_base_t *bases;
+    size_t base_count, base_cap;
+    int dirty;
+
+    // The running kernel, once identified
+    int identified;
+    win_pdb_id_t id;
+    char key[WIN_PDB_KEY_LEN];
+    uint64_t base;
+};
+
+void win_pdb_key(const win_pdb_id_t *id, char key[WIN_PDB_KEY_LEN]) {
+    snprintf(key, WIN_PDB_KEY_LEN, "%s%X", id->guid, id->age);
+}
+
+int win_find_image_base(guest_mem_t *gm, uint64_t va, uint64_t *base) {
+    uint64_t page = va & ~(uint64_t)0xfff;
+    win_pe_headers_t hdr;
+    uint8_t mz[2];
+
+    for (; va - page < WIN_SYMCACHE_MAX_SCAN; page -= 0x1000) {
+        if (gm_read_va(gm, GM_KERNEL_DTB, page, mz, 2) == 2 && mz[0] == 'M' && mz[1] == 'Z' &&
+            win_pe_headers(gm, GM_KERNEL_DTB, page, &hdr) == 0 && va - page < hdr.size_of_image) {
+            *base = page;
+            return 0;
+        }
+        if (page == 0) break;
+    }
+    return -1;
+}
+
+const char *win_symcache_default_path(char *buf, size_t len) {
+    const char *env = getenv("VMI_SYMBOL_CACHE");
+    int n;
+
+    if (env && *env) {
+        n = snprintf(buf, len, "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME")) && *env) {
+        n = snprintf(buf, len, "%s/kvm-vmi/symbols", env);
+    } else if ((env = getenv("HOME")) && *env) {
+        n = snprintf(buf, len, "%s/.cache/kvm-vmi/symbols", env);
+    } else {
+        return NULL;
+    }
+    return n > 0 && (size_t)n < len ? buf : NULL;
+}
+
+static int add_symbol(win_symcache_t *c, const char *key, const char *name, uint64_t rva) {
+    size_t i;
+
+    for (i = 0; i < c->symbol_count; i++) {
+        if (strcmp(c->symbols[i].key, key) == 0 && strcmp(c->symbols[i].name, name) == 0) {
+            c->symbols[i].rva = rva;
+            return 0;
+        }
+    }
+    if (c->symbol_count == c->symbol_cap) {
+        size_t cap = c->symbol_cap ? c->symbol_cap * 2 : 16;
+        cached_symbol_t *s = realloc(c->symbols, cap * sizeof(*s));
+        if (!s) return -1;
+        c->symbols = s;
+        c->symbol_cap = cap;
+    }
+    snprintf(c->symbols[c->symbol_count].key, WIN_PDB_KEY_LEN, "%s", key);
+    snprintf(c->symbols[c->symbol_count].name, sizeof(c->symbols[0].name), "%s", name);
+    c->symbols[c->symbol_count].rva = rva;
+    c->symbol_count++;
+    return 0;
+}
+
+static int set_base(win_symcache_t *c, const char *domain, const char *key, uint64_t base) {
+    size_t i;
+
+    for (i = 0; i < c->base_count; i++) {
+        if (strcmp(c->bases[i].domain, domain) == 0) break;
+    }
+    if (i == c->base_count) {
+        if (c->base_count == c->base_cap) {
+            size_t cap = c->base_cap ? c->base_cap * 2 : 4;
+            cached_base_t *b = realloc(c->bases, cap * sizeof(*b));
+            if (!b) return -1;
+            c->bases = b;
+            c->base_cap = cap;
+        }
+        c->bases[i].domain = strdup(domain);
+        if (!c->bases[i].domain) return -1;
+        c->base_count++;
+    }
+    snprintf(c->bases[i].key, WIN_PDB_KEY_LEN, "%s", key);
+    c->bases[i].base = base;
+    return 0;
+}
+
+// Records that do not parse are dropped; the file is rewritten on save
+static void load(win_symcache_t *c, FILE *f) {
+    char line[1024], key[WIN_PDB_KEY_LEN], name[64];
+    unsigned long long value;
+    int n;
+
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (sscanf(line, "symbol %40s %63s %llx", key, name, &value) == 3) {
+            add_symbol(c, key, name, value);
+        } else if (sscanf(line, "base %40s %llx %n", key, &value, &n) == 2 && line[n]) {
+            set_base(c, line + n, key, value);
+        }
+    }
+}
+
+win_symcache_t *win_symcache_open(const char *path, const char *domain) {
+    win_symcache_t *c = calloc(1, sizeof(*c));
+    FILE *f;
+
+    if (!c) return NULL;
+    c->path = strdup(path);
+    c->domain = strdup(domain);
+    if (!c->path || !c->domain) {
+        win_symcache_close(c);
+        return NULL;
+    }
+    f = fopen(path, "r");
+    if (f) {
+        load(c, f);
+        fclose(f);
+    }
+    return c;
+}
+
+static int known_key(const win_symcache_t *c, const char *key) {
+    size_t i;
+
+    for (i = 0; i < c->symbol_count; i++) {
+        if (strcmp(c->symbols[i].key, key) == 0) return 1;
+    }
+    return 0;
+}
+
+// Adopt the kernel at base when its build is the expected one (or any
+// build, for expect == NULL)
+static int identify(win_symcache_t *c, guest_mem_t *gm, uint64_t base, const char *expect) {
+    win_pdb_id_t id;
+    char key[WIN_PDB_KEY_LEN];
+
+    if (win_pe_debug_id(gm, base, &id) != 0) return -1;
+    win_pdb_key(&id, key);
+    if (expect && strcmp(key, expect) != 0) return -1;
+
+    c->identified = 1;
+    c->id = id;
+    c->base = base;
+    memcpy(c->key, key, sizeof(key));
+    return 0;
+}
+
+int win_symcache_validate(win_symcache_t *c, guest_mem_t *gm, uint64_t hint) {
+    uint64_t base;
+    size_t i;
+
+    // Same boot as last time: the kernel is where we left it
+    for (i = 0; i < c->base_count; i++) {
+        if (strcmp(c->bases[i].domain, c->domain) == 0 &&
+            identify(c, gm, c->bases[i].base, c->bases[i].key) == 0) {
+            return 0;
+        }
+    }
+
+    // Rebooted: find the image around hint, usable if its build is known
+    if (hint && win_find_image_base(gm, hint, &base) == 0 && identify(c, gm, base, NULL) == 0) {
+        if (known_key(c, c->key)) {
+            if (set_base(c, c->domain, c->key, c->base) == 0) c->dirty = 1;
+            return 0;
+        }
+        // A new build; keep the identity so learned symbols land under it
+        if (set_base(c, c->domain, c->key, c->base) == 0) c->dirty = 1;
+        return -1;
+    }
+    return -1;
+}
+
+int win_symcache_lookup(win_symcache_t *c, const char *name, uint64_t profile_rva, uint64_t *va) {
+    const win_profile_t *prof = win_profile_get();
+    size_t i;
+
+    if (!c->identified) return -1;
+    for (i = 0; i < c->symbol_count; i++) {
+        if (strcmp(c->symbols[i].key, c->key) == 0 && strcmp(c->symbols[i].name, name) == 0) {
+            *va = c->base + c->symbols[i].rva;
+            return 0;
+        }
+    }
+    if (profile_rva && prof->pdb_guid[0] && prof->pdb_age == c->id.age &&
+        strcasecmp(prof->pdb_guid, c->id.guid) == 0) {
+        *va = c->base + profile_rva;
+        return 0;
+    }
+    return -1;
+}
+
+int win_symcache_learn(win_symcache_t *c, guest_mem_t *gm, const char *name, uint64_t va) {
+    uint64_t base;
+
+    if (!c->identified) {
+        if (win_find_image_base(gm, va, &base) != 0 || identify(c, gm, base, NULL) != 0) {
+            return -1;
+        }
+        if (set_base(c, c->domain, c->key, c->base) != 0) return -1;
+        c->dirty = 1;
+    }
+    if (va < c->base || va - c->base >= c->id.size_of_image) return -1;
+    if (add_symbol(c, c->key, name, va - c->base) != 0) return -1;
+    c->dirty = 1;
+    return 0;
+}
+
+const win_pdb_id_t *win_symcache_kernel(const win_symcache_t *c) {
+    return c->identified ? &c->id : NULL;
+}
+
+uint64_t win_symcache_kernel_base(const win_symcache_t *c) {
+    return c->identified ? c->base : 0;
+}
+
+// mkdir -p of the directory holding path
+static void make_parent(const char *path) {
+    char dir[4096];
+    char *p;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    p = strrchr(dir, '/');
+    if (!p || p == dir) return;
+    *p = '\0';
+    for (p = dir + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+    mkdir(dir, 0755);
+}
+
+int win_symcache_save(win_symcache_t *c) {
+    char tmp[4096];
+    FILE *f;
+    size_t i;
+
+    if (!c->dirty) return 0;
+    make_parent(c->path);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", c->path);
+    f = fopen(tmp, "w");
+    if (!f) return -1;
+
+    fprintf(f, "# KVM-VMI kernel symbol cache, rewritten by the inspectors\n");
+    for (i = 0; i < c->symbol_count; i++) {
+        fprintf(f, "symbol %s %s 0x%llx\n", c->symbols[i].key, c->symbols[i].name,
+                (unsigned long long)c->symbols[i].rva);
+    }
+    for (i = 0; i < c->base_count; i++) {
+        fprintf(f, "base %s 0x%llx %s\n", c->bases[i].key, (unsigned long long)c->bases[i].base,
+                c->bases[i].domain);
+    }
+    // Replace the file in one step, so a concurrent run never sees half of it
+    if (fclose(f) != 0 || rename(tmp, c->path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    c->dirty = 0;
+    return 0;
+}
+
+void win_symcache_close(win_symcache_t *c) {
+    size_t i;
+
+    if (!c) return;
+    for (i = 0; i < c->base_count; i++) free(c->bases[i].domain);
+    free(c->bases);
+    free(c->symbols);
+    free(c->path);
+    free(c->domain);
+    free(c);
+}
@@ -0,0 +1,70 @@
+#ifndef WIN_SYMCACHE_H
+#define WIN_SYMCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_pe.h"
+
+// Persistent kernel symbol cache.
+//
+// Resolving kernel symbols through LibVMI means finding the kernel and
+// its debug data again on every run. The cache remembers, per kernel
+// build, the RVA of every symbol resolved once, and per domain where
+// that kernel was last loaded. A kernel build is identified by the
+// CodeView record of its PE image (PDB GUID and age), the same key a
+// symbol server uses, so a cached entry is checked at startup with a few
+// small reads of the kernel headers.
+//
+// After a reboot KASLR moves the kernel; given any address inside it
+// (e.g. the syscall entry in MSR_LSTAR) the image base is found again by
+// scanning back to its PE header, and the cached RVAs still apply as long
+// as the build did not change.
+//
+// The file is plain text, one record per line:
+//   symbol <key> <name> <rva>
+//   base <key> <va> <domain>
+
+#define WIN_PDB_KEY_LEN  41         // GUID followed by the age in hex
+
+// Symbol-server key of a build: GUID followed by the age in hex
+void win_pdb_key(const win_pdb_id_t *id, char key[WIN_PDB_KEY_LEN]);
+
+// Base of the PE image containing va, scanning back page by page up to
+// WIN_SYMCACHE_MAX_SCAN bytes; 0 on success
+#define WIN_SYMCACHE_MAX_SCAN (64ULL << 20)
+int win_find_image_base(guest_mem_t *gm, uint64_t va, uint64_t *base);
+
+typedef struct win_symcache win_symcache_t;
+
+// $VMI_SYMBOL_CACHE, else $XDG_CACHE_HOME/kvm-vmi/symbols, else
+// ~/.cache/kvm-vmi/symbols; NULL when none can be formed
+const char *win_symcache_default_path(char *buf, size_t len);
+
+// Load the cache at path (a missing or unreadable file is an empty
+// cache) for the named domain or image; NULL only when out of memory
+win_symcache_t *win_symcache_open(const char *path, const char *domain);
+
+// Identify the running kernel: first at the base this domain used last
+// time, then by scanning back from hint (0 for none). Returns 0 when the
+// kernel was identified, -1 when lookups will miss until learned.
+int win_symcache_validate(win_symcache_t *c, guest_mem_t *gm, uint64_t hint);
+
+// VA of a symbol of the identified kernel: cached, or the profile RVA
+// when the structure profile was generated from this very build
+int win_symcache_lookup(win_symcache_t *c, const char *name, uint64_t profile_rva, uint64_t *va);
+
+// Record a symbol resolved the slow way. Identifies the kernel from the
+// symbol's address first if needed. Returns 0 when it was recorded.
+int win_symcache_learn(win_symcache_t *c, guest_mem_t *gm, const char *name, uint64_t va);
+
+// Identified kernel (NULL if not identified) and its base
+const win_pdb_id_t *win_symcache_kernel(const win_symcache_t *c);
+uint64_t win_symcache_kernel_base(const win_symcache_t *c);
+
+// Write the file if anything was learned, creating its directory;
+// returns 0, or -1 with errno set
+int win_symcache_save(win_symcache_t *c);
+void win_symcache_close(win_symcache_t *c);
+
+#endif
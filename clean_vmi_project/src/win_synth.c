@@ -0,0 +1,1145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "guest_mem.h"
+#include "x86_pt.h"
+#include "win_profile.h"
+#include "win_walk.h"
+#include "win_synth.h"
+
+// Virtual placement: kernel objects (list head, EPROCESS, ETHREAD) live in
+// one kernel region, PEBs, loader data and module names in one user-range
+// region. Both are mapped with 4 KiB pages in a single address space. The
+// kernel region starts with a two-page "kernel image": a PE header whose
+// debug directory names the kernel build, then the page holding the
+// list-head symbols and the debugger data a cold-start scan looks for.
+#define SYNTH_KERNEL_VA     0xfffff80000000000ULL
+#define SYNTH_USER_VA       0x00007ff700000000ULL
+#define SYNTH_DTB           0x1000ULL
+
+// CreateTime of System (a FILETIME in 2022); processes follow a second apart
+#define SYNTH_CREATE_TIME   133000000000000000ULL
+
+// Kernel image: PE header page and symbol page, and its CodeView identity
+#define SYNTH_IMAGE_SIZE    0x2000
+#define SYNTH_PE_OFFSET     0x80
+#define SYNTH_DEBUG_RVA     0x200
+#define SYNTH_CV_RVA        0x240
+#define SYNTH_EXPORT_RVA    0x300
+#define SYNTH_BUILD         19041
+
+// Drivers and DLLs: a header page and one code page each. TimeDateStamps
+// derive from the build (pdb_age), as a real update would change them.
+#define SYNTH_CODE_SIZE     0x2000
+#define SYNTH_DRIVER_EXPORTS WIN_SYNTH_DRIVER_EXPORTS
+#define SYNTH_STAMP         0x5f7e3c00U
+static const uint8_t synth_pdb_guid[16] = {
+    0xb9, 0xdb, 0x44, 0x38, 0x17, 0x20, 0x67, 0x49,
+    0xbe, 0x7a, 0xa4, 0xa2, 0xc2, 0x04, 0x30, 0xfa
+};
+
+// Every EPROCESS is a pool allocation: POOL_HEADER ("Proc" tag), then the
+// OBJECT_HEADER, then the body
+#define SYNTH_POOL_PREFIX   0x40
+#define SYNTH_OBJECT_HEADER 0x30
+
+// Module name buffer per LDR entry (UTF-16, so 32 characters)
+#define SYNTH_NAME_BYTES    64
+
+// Object manager: the cookie scrambling every TypeIndex, and the objects
+// all handle tables share. Handle k refers to a File, a Key, an Event or
+// another process, in turn; closed handles leave every 16th entry free.
+#define SYNTH_HEADER_COOKIE 0x6d
+#define SYNTH_FILES         64
+#define SYNTH_KEYS          64
+#define SYNTH_EVENTS        16
+#define SYNTH_HANDLE_RUN    15
+#define SYNTH_LEAF_SLOTS    255         // entry 0 of every leaf is reserved
+#define SYNTH_KCB_BYTES     0x100       // key control block and name block
+
+// VAD trees: views of SYNTH_VAD_FILES shared files, and the two address
+// ranges the VADs are spread over
+#define SYNTH_VAD_FILES     32
+#define SYNTH_VAD_LOW       0x10000ULL
+#define SYNTH_VAD_HIGH      0x7ff000000000ULL
+#define SYNTH_VAD_STRIDE    0x20000ULL
+
+// Private data regions, one per process with an unmapped page between,
+// at 1 TiB: above the low VADs and below the high ones
+#define SYNTH_DATA_VA       0x0000010000000000ULL
+
+enum { SYNTH_TYPE_PROCESS = 7, SYNTH_TYPE_EVENT = 16, SYNTH_TYPE_FILE = 37, SYNTH_TYPE_KEY = 44 };
+
+static const struct {
+    uint8_t index;
+    const char *name;
+} synth_types[] = {
+    { 2, "Type" }, { SYNTH_TYPE_PROCESS, "Process" }, { 8, "Thread" },
+    { SYNTH_TYPE_EVENT, "Event" }, { SYNTH_TYPE_FILE, "File" }, { SYNTH_TYPE_KEY, "Key" },
+};
+
+static const struct {
+    const char *type;
+    uint32_t access;
+} synth_handle_kinds[4] = {
+    { "File", 0x0012019f }, { "Key", 0x00020019 }, { "Event", 0x001f0003 }, { "Process", 0x001fffff },
+};
+
+// VAD k by k % 8: VadType, protection, private, whether it maps a file
+static const struct {
+    uint8_t type, protection, private_memory;
+} synth_vad_kinds[8] = {
+    { 2, 7, 0 },                    // image view, EXECUTE_WRITECOPY
+    { 0, 4, 1 },                    // READWRITE
+    { 0, 1, 0 },                    // data view, READONLY
+    { 0, 4, 1 },
+    { 0, 6, 1 },                    // EXECUTE_READWRITE, as injected code
+    { 0, 1, 1 },
+    { 0, 5, 0 },                    // data view, WRITECOPY
+    { 0, 0x14, 1 },                 // READWRITE | GUARD
+};
+
+// QEMUCPUState as written in the "QEMU" ELF note, and where cr[3] sits
+#define SYNTH_QEMU_STATE_SIZE 440
+#define SYNTH_QEMU_STATE_CR3  (8 + 18 * 8 + 10 * 24 + 3 * 8)
+
+// Headers, program headers and note of the ELF core; guest RAM follows
+#define SYNTH_ELF_DATA_OFFSET 0x1000
+
+typedef struct {
+    uint64_t va;
+    uint64_t pa;
+    uint64_t len;
+    uint64_t used;
+} region_t;
+
+typedef struct {
+    uint8_t *ram;               // guest physical memory, ram_size bytes
+    uint64_t ram_size;
+    uint64_t pt_next, pt_end;   // page-table page allocator
+    region_t kern, user;
+    region_t data;              // data pages of every process, mapped apart
+} synth_t;
+
+void win_synth_defaults(win_synth_opts_t *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->processes = 1000;
+    opts->modules = 4;
+    opts->threads = 4;
+    opts->loop_at = -1;
+    opts->torn_at = -1;
+    opts->unmapped_at = -1;
+    opts->module_loop_at = -1;
+    opts->thread_loop_at = -1;
+    opts->unlinked_at = -1;
+    opts->exited_at = -1;
+    opts->blink_at = -1;
+    opts->pdb_age = 1;
+    opts->drivers = 2;
+    opts->heavy_at = -1;
+    opts->vad_loop_at = -1;
+}
+
+static uint64_t align_up(uint64_t v, uint64_t a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+// Bump allocation inside a region; the caller sized the region up front
+static uint64_t region_alloc(region_t *r, uint64_t size, uint64_t align) {
+    uint64_t off = align_up(r->used, align);
+    r->used = off + size;
+    return r->va + off;
+}
+
+static uint8_t *host(synth_t *s, uint64_t va) {
+    const region_t *r = va >= s->kern.va ? &s->kern : &s->user;
+    return s->ram + r->pa + (va - r->va);
+}
+
+static void put_u16(synth_t *s, uint64_t va, uint16_t v) { memcpy(host(s, va), &v, sizeof(v)); }
+static void put_u32(synth_t *s, uint64_t va, uint32_t v) { memcpy(host(s, va), &v, sizeof(v)); }
+static void put_u64(synth_t *s, uint64_t va, uint64_t v) { memcpy(host(s, va), &v, sizeof(v)); }
+
+// PTE slot for va, creating intermediate tables on the way when asked
+static uint8_t *pte_slot(synth_t *s, uint64_t va, int create) {
+    uint64_t table = SYNTH_DTB;
+    int level;
+
+    for (level = 3; level >= 1; level--) {
+        uint8_t *slot = s->ram + table + ((va >> (12 + 9 * level)) & 0x1ff) * 8;
+        uint64_t entry;
+
+        memcpy(&entry, slot, sizeof(entry));
+        if (!(entry & X86_PTE_PRESENT)) {
+            if (!create || s->pt_next >= s->pt_end) return NULL;
+            entry = s->pt_next | X86_PTE_PRESENT | 0x2;     // present, writable
+            s->pt_next += X86_PAGE_4K;
+            memcpy(slot, &entry, sizeof(entry));
+        }
+        table = entry & X86_PADDR_MASK;
+    }
+    return s->ram + table + ((va >> 12) & 0x1ff) * 8;
+}
+
+// Data pages of every process, with the page after each left unmapped
+static int map_data(synth_t *s, const win_synth_opts_t *o) {
+    uint64_t pa = s->data.pa;
+    size_t i, j;
+
+    for (i = 0; i < o->processes; i++) {
+        win_synth_data_t d;
+
+        win_synth_data(o, i, &d);
+        for (j = 0; j < o->data_pages; j++, pa += X86_PAGE_4K) {
+            uint8_t *slot = pte_slot(s, d.va + j * X86_PAGE_4K, 1);
+            uint64_t pte = pa | X86_PTE_PRESENT | 0x2;
+            if (!slot) return -1;
+            memcpy(slot, &pte, sizeof(pte));
+        }
+    }
+    return 0;
+}
+
+static int map_region(synth_t *s, const region_t *r) {
+    uint64_t off;
+
+    for (off = 0; off < r->len; off += X86_PAGE_4K) {
+        uint8_t *slot = pte_slot(s, r->va + off, 1);
+        uint64_t pte = (r->pa + off) | X86_PTE_PRESENT | 0x2;
+        if (!slot) return -1;
+        memcpy(slot, &pte, sizeof(pte));
+    }
+    return 0;
+}
+
+// Page-table pages needed to map len bytes at a 4 KiB granularity
+static uint64_t table_pages(uint64_t len) {
+    return len / X86_PAGE_1G + len / X86_PAGE_2M + len / (512 * X86_PAGE_1G) + 6;
+}
+
+// UNICODE_STRING at va describing len UTF-16 units at buffer
+static void put_unicode(synth_t *s, uint64_t va, uint64_t buffer, const char *text) {
+    size_t i, n = strlen(text);
+
+    if (n > SYNTH_NAME_BYTES / 2) n = SYNTH_NAME_BYTES / 2;
+    for (i = 0; i < n; i++) {
+        put_u16(s, buffer + i * 2, (uint8_t)text[i]);
+    }
+    put_u16(s, va, (uint16_t)(n * 2));
+    put_u16(s, va + 2, (uint16_t)(n * 2));
+    put_u64(s, va + 8, buffer);
+}
+
+void win_synth_module_name(size_t j, char *out, size_t len) {
+    static const char *known[] = { "ntdll.dll", "kernel32.dll", "KERNELBASE.dll", "user32.dll" };
+    if (j < sizeof(known) / sizeof(known[0])) {
+        snprintf(out, len, "%s", known[j]);
+    } else {
+        snprintf(out, len, "module%zu.dll", j);
+    }
+}
+
+typedef struct {
+    const char *name;           // NULL: exported by ordinal only
+    uint32_t rva;
+} synth_export_t;
+
+// Export directory at SYNTH_EXPORT_RVA of the image at va: the named and
+// ordinal-only exports given, then a forwarder to the kernel
+static void put_exports(synth_t *s, uint64_t va, const char *dll, const synth_export_t *exports, size_t n) {
+    uint64_t opt = va + SYNTH_PE_OFFSET + 24, dir = va + SYNTH_EXPORT_RVA;
+    uint32_t functions = SYNTH_EXPORT_RVA + 40, names, ordinals, cursor, named = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (exports[i].name) named++;
+    }
+    names = functions + (uint32_t)(n + 1) * 4;
+    ordinals = names + named * 4;
+    cursor = ordinals + named * 2;
+
+    put_u32(s, dir + 0x0c, cursor);                 // Name
+    memcpy(host(s, va + cursor), dll, strlen(dll) + 1);
+    cursor += (uint32_t)strlen(dll) + 1;
+    put_u32(s, dir + 0x10, 1);                      // Base (ordinal of the first function)
+    put_u32(s, dir + 0x14, (uint32_t)n + 1);        // NumberOfFunctions
+    put_u32(s, dir + 0x18, named);                  // NumberOfNames
+    put_u32(s, dir + 0x1c, functions);
+    put_u32(s, dir + 0x20, names);
+    put_u32(s, dir + 0x24, ordinals);
+
+    for (i = 0, named = 0; i < n; i++) {
+        put_u32(s, va + functions + i * 4, exports[i].rva);
+        if (!exports[i].name) continue;
+        put_u32(s, va + names + named * 4, cursor);
+        put_u16(s, va + ordinals + named * 2, (uint16_t)i);
+        memcpy(host(s, va + cursor), exports[i].name, strlen(exports[i].name) + 1);
+        cursor += (uint32_t)strlen(exports[i].name) + 1;
+        named++;
+    }
+    put_u32(s, va + functions + n * 4, cursor);     // forwarder: RVA of its target name
+    memcpy(host(s, va + cursor), "ntoskrnl.KeBugCheckEx", sizeof("ntoskrnl.KeBugCheckEx"));
+    cursor += sizeof("ntoskrnl.KeBugCheckEx");
+
+    put_u32(s, opt + 112, SYNTH_EXPORT_RVA);        // export directory
+    put_u32(s, opt + 112 + 4, cursor - SYNTH_EXPORT_RVA);
+}
+
+// Minimal native PE32+ header at va with one section covering every page
+// after the header page
+static void put_pe_image(synth_t *s, uint64_t va, uint32_t size, uint32_t stamp,
+                         const char *section, uint32_t characteristics) {
+    uint64_t nt = va + SYNTH_PE_OFFSET, opt = nt + 24, sec = opt + 0xf0;
+
+    memcpy(host(s, va), "MZ", 2);
+    put_u32(s, va + 0x3c, SYNTH_PE_OFFSET);
+    memcpy(host(s, nt), "PE\0\0", 4);
+    put_u16(s, nt + 4, 0x8664);                     // Machine: AMD64
+    put_u16(s, nt + 6, 1);                          // NumberOfSections
+    put_u32(s, nt + 8, stamp);                      // TimeDateStamp
+    put_u16(s, nt + 20, 0xf0);                      // SizeOfOptionalHeader
+    put_u16(s, opt, 0x20b);                         // PE32+
+    put_u64(s, opt + 24, va);                       // ImageBase
+    put_u32(s, opt + 56, size);                     // SizeOfImage
+    put_u16(s, opt + 68, 1);                        // Subsystem: native
+    put_u32(s, opt + 108, 16);                      // NumberOfRvaAndSizes
+
+    memcpy(host(s, sec), section, strlen(section)); // IMAGE_SECTION_HEADER
+    put_u32(s, sec + 8, size - 0x1000);             // VirtualSize
+    put_u32(s, sec + 12, 0x1000);                   // VirtualAddress
+    put_u32(s, sec + 36, characteristics);
+}
+
+// The kernel image: exports of the symbol page and a debug directory with
+// one CodeView (RSDS) record, which is all symbol caching looks at
+static void put_kernel_image(synth_t *s, uint64_t va, uint32_t age, const synth_export_t *exports, size_t n) {
+    uint64_t opt = va + SYNTH_PE_OFFSET + 24;
+
+    put_pe_image(s, va, SYNTH_IMAGE_SIZE, SYNTH_STAMP + age, ".data", 0xc0000040);
+    put_exports(s, va, "ntoskrnl.exe", exports, n);
+    put_u32(s, opt + 112 + 6 * 8, SYNTH_DEBUG_RVA); // debug directory
+    put_u32(s, opt + 112 + 6 * 8 + 4, 28);
+
+    put_u32(s, va + SYNTH_DEBUG_RVA + 12, 2);       // IMAGE_DEBUG_TYPE_CODEVIEW
+    put_u32(s, va + SYNTH_DEBUG_RVA + 16, 24 + sizeof("ntkrnlmp.pdb"));
+    put_u32(s, va + SYNTH_DEBUG_RVA + 20, SYNTH_CV_RVA);
+    memcpy(host(s, va + SYNTH_CV_RVA), "RSDS", 4);
+    memcpy(host(s, va + SYNTH_CV_RVA + 4), synth_pdb_guid, sizeof(synth_pdb_guid));
+    put_u32(s, va + SYNTH_CV_RVA + 20, age);
+    memcpy(host(s, va + SYNTH_CV_RVA + 24), "ntkrnlmp.pdb", sizeof("ntkrnlmp.pdb"));
+}
+
+// Driver j: hal.dll first, then drvNNN.sys, each with SYNTH_DRIVER_EXPORTS
+// named functions 0x100 apart in its code page and one by ordinal only
+void win_synth_driver_name(size_t j, char *out, size_t len) {
+    if (j == 0) snprintf(out, len, "hal.dll");
+    else snprintf(out, len, "drv%03zu.sys", j);
+}
+
+void win_synth_driver_export(size_t j, size_t k, char *out, size_t len) {
+    if (j == 0) snprintf(out, len, "HalExport%zu", k);
+    else snprintf(out, len, "Drv%03zuExport%zu", j, k);
+}
+
+// User-mode module j: the same layout, in one image every process maps
+void win_synth_module_export(size_t j, size_t k, char *out, size_t len) {
+    snprintf(out, len, "Dll%zuExport%zu", j, k);
+}
+
+// Code image of a driver or DLL: the named exports 0x100 apart from RVA
+// 0x1000 and one exported by ordinal only at 0x1f00
+static void put_code_image(synth_t *s, uint64_t va, uint32_t stamp, const char *dll,
+                           char names[][32]) {
+    synth_export_t exports[SYNTH_DRIVER_EXPORTS + 1];
+    size_t k;
+
+    for (k = 0; k < SYNTH_DRIVER_EXPORTS; k++) {
+        exports[k].name = names[k];
+        exports[k].rva = (uint32_t)(0x1000 + k * 0x100);
+    }
+    exports[k].name = NULL;
+    exports[k].rva = 0x1f00;
+    put_pe_image(s, va, SYNTH_CODE_SIZE, stamp, ".text", 0x60000020);
+    put_exports(s, va, dll, exports, SYNTH_DRIVER_EXPORTS + 1);
+}
+
+static void put_driver_image(synth_t *s, uint64_t va, size_t j, uint32_t age) {
+    char dll[32], names[SYNTH_DRIVER_EXPORTS][32];
+    size_t k;
+
+    for (k = 0; k < SYNTH_DRIVER_EXPORTS; k++) {
+        win_synth_driver_export(j, k, names[k], sizeof(names[k]));
+    }
+    win_synth_driver_name(j, dll, sizeof(dll));
+    put_code_image(s, va, SYNTH_STAMP + (uint32_t)(j + 1) * 0x1000 + age, dll, names);
+}
+
+static void put_dll_image(synth_t *s, uint64_t va, size_t j, uint32_t age) {
+    char dll[32], names[SYNTH_DRIVER_EXPORTS][32];
+    size_t k;
+
+    for (k = 0; k < SYNTH_DRIVER_EXPORTS; k++) {
+        win_synth_module_export(j, k, names[k], sizeof(names[k]));
+    }
+    win_synth_module_name(j, dll, sizeof(dll));
+    put_code_image(s, va, SYNTH_STAMP - (uint32_t)(j + 1) * 0x1000 + age, dll, names);
+    put_u16(s, va + SYNTH_PE_OFFSET + 24 + 68, 3);  // Subsystem: Windows CUI, not a kernel image
+}
+
+// KdVersionBlock (DBGKD_GET_VERSION64) and the KDBG (KDDEBUGGER_DATA64)
+// header. Unless the kernel was booted with debugging on, Windows 8 and
+// later keep the KDBG encoded; a fixed XOR stands in for that.
+static void put_debug_data(synth_t *s, uint64_t version, uint64_t kdbg, uint64_t base,
+                           uint64_t modules, uint64_t processes, int encoded) {
+    size_t i;
+
+    put_u16(s, version, 0x000f);                    // MajorVersion: NT
+    put_u16(s, version + 2, SYNTH_BUILD);           // MinorVersion: build
+    *host(s, version + 4) = 6;                      // ProtocolVersion
+    put_u16(s, version + 8, 0x8664);                // MachineType
+    put_u64(s, version + 0x10, base);               // KernBase
+    put_u64(s, version + 0x18, modules);            // PsLoadedModuleList
+    put_u64(s, version + 0x20, kdbg);               // DebuggerDataList
+
+    put_u64(s, kdbg, kdbg);                         // Header.List
+    put_u64(s, kdbg + 8, kdbg);
+    memcpy(host(s, kdbg + 0x10), "KDBG", 4);        // Header.OwnerTag
+    put_u32(s, kdbg + 0x14, 0x368);                 // Header.Size
+    put_u64(s, kdbg + 0x18, base);                  // KernBase
+    put_u64(s, kdbg + 0x48, modules);               // PsLoadedModuleList
+    put_u64(s, kdbg + 0x50, processes);             // PsActiveProcessHead
+    for (i = 0; encoded && i < 0x58; i++) {
+        host(s, kdbg)[i] ^= (uint8_t)(0xa5 + i * 7);
+    }
+}
+
+// OBJECT_HEADER of an object of the given type
+static void put_object_header(synth_t *s, const win_profile_t *prof, uint64_t header, uint8_t type) {
+    put_u64(s, header, 1);                          // PointerCount
+    put_u64(s, header + 8, 1);                      // HandleCount
+    *host(s, header + prof->object_header_type_index) =
+        (uint8_t)(type ^ SYNTH_HEADER_COOKIE ^ (uint8_t)(header >> 8));
+}
+
+// POOL_HEADER of a nonpaged "Proc" allocation and its OBJECT_HEADER
+static void put_pool_header(synth_t *s, const win_profile_t *prof, uint64_t va, uint64_t body_size) {
+    uint64_t blocks = (SYNTH_POOL_PREFIX + body_size) / 16;
+
+    put_u32(s, va, (uint32_t)((blocks > 0xff ? 0xff : blocks) << 16) | (2U << 24));
+    memcpy(host(s, va + 4), "Proc", 4);             // PoolTag
+    put_object_header(s, prof, va + SYNTH_POOL_PREFIX - SYNTH_OBJECT_HEADER, SYNTH_TYPE_PROCESS);
+}
+
+// An object of body_size bytes behind its header; returns the body
+static uint64_t put_object(synth_t *s, const win_profile_t *prof, uint64_t body_size, uint8_t type) {
+    uint64_t header = region_alloc(&s->kern, prof->object_header_body + align_up(body_size, 16), 16);
+
+    put_object_header(s, prof, header, type);
+    return header + prof->object_header_body;
+}
+
+void win_synth_handle(size_t k, win_synth_handle_t *out) {
+    size_t slot = k + k / SYNTH_HANDLE_RUN, kind = k % 4;
+
+    memset(out, 0, sizeof(*out));
+    out->handle = (uint32_t)(((slot / SYNTH_LEAF_SLOTS) * 256 + slot % SYNTH_LEAF_SLOTS + 1) * 4);
+    out->access = synth_handle_kinds[kind].access;
+    out->attributes = k % 5 == 0 ? 0x2 : 0;        // OBJ_INHERIT
+    out->type = synth_handle_kinds[kind].type;
+    if (kind == 0) {
+        snprintf(out->name, sizeof(out->name), "\\Windows\\Temp\\file%03zu.log", (k / 4) % SYNTH_FILES);
+    } else if (kind == 1) {
+        snprintf(out->name, sizeof(out->name), "\\REGISTRY\\MACHINE\\SOFTWARE\\Vendor\\Key%03zu",
+                 (k / 4) % SYNTH_KEYS);
+    }
+}
+
+size_t win_synth_handle_count(const win_synth_opts_t *opts, size_t i) {
+    if ((long)i == opts->exited_at) return 0;
+    return (long)i == opts->heavy_at ? opts->heavy_handles : opts->handles;
+}
+
+// Leaf pages a table of n handles needs
+static size_t handle_leaves(size_t n) {
+    size_t slots = n ? n + (n - 1) / SYNTH_HANDLE_RUN : 0;
+    return slots ? (slots + SYNTH_LEAF_SLOTS - 1) / SYNTH_LEAF_SLOTS : 1;
+}
+
+// Kernel bytes a table of n handles takes, page alignment included
+static uint64_t handle_table_bytes(size_t n) {
+    size_t leaves = handle_leaves(n), dirs = 0;
+
+    if (leaves > 1) dirs = 1;
+    if (leaves > 512) dirs += (leaves + 511) / 512;
+    return (leaves + dirs + 1) * X86_PAGE_4K + 0x80;
+}
+
+// Shared objects: the OBJECT_TYPEs, Files, registry keys and Events
+typedef struct {
+    uint64_t files[SYNTH_FILES];
+    uint64_t keys[SYNTH_KEYS];
+    uint64_t events[SYNTH_EVENTS];
+    uint64_t views[SYNTH_VAD_FILES];        // SUBSECTION of each mapped file
+} synth_objects_t;
+
+static uint64_t objects_bytes(const win_profile_t *prof) {
+    uint64_t header = prof->object_header_body;
+
+    return sizeof(synth_types) / sizeof(synth_types[0]) * (0x100 + SYNTH_NAME_BYTES) +
+           SYNTH_FILES * (header + align_up(prof->file_object_name + 16, 16) + SYNTH_NAME_BYTES + 16) +
+           SYNTH_KEYS * (header + align_up(prof->key_body_kcb + 8, 16) + 2 * SYNTH_KCB_BYTES) +
+           SYNTH_EVENTS * (header + 0x20) + 8 * SYNTH_KCB_BYTES +
+           SYNTH_VAD_FILES * (header + align_up(prof->file_object_name + 16, 16) + SYNTH_NAME_BYTES +
+                              align_up(prof->control_area_file + 8, 16) +
+                              align_up(prof->subsection_control_area + 8, 16) + 64);
+}
+
+// Key control block with its name block; the name is stored as bytes
+// (Compressed) unless wide is set
+static uint64_t put_kcb(synth_t *s, const win_profile_t *prof, uint64_t parent, const char *name, int wide) {
+    uint64_t kcb = region_alloc(&s->kern, align_up(prof->kcb_name_block + 8, 16), 16);
+    uint64_t block = region_alloc(&s->kern, prof->name_block_name + 2 * strlen(name), 16);
+    size_t i, n = strlen(name);
+
+    put_u64(s, kcb + prof->kcb_parent, parent);
+    put_u64(s, kcb + prof->kcb_name_block, block);
+    put_u32(s, block, wide ? 0 : 1);               // Compressed
+    put_u16(s, block + prof->name_block_length, (uint16_t)(wide ? 2 * n : n));
+    for (i = 0; i < n; i++) {
+        if (wide) put_u16(s, block + prof->name_block_name + 2 * i, (uint8_t)name[i]);
+        else *host(s, block + prof->name_block_name + i) = (uint8_t)name[i];
+    }
+    return kcb;
+}
+
+// ObTypeIndexTable and the objects every handle table points at
+static void put_objects(synth_t *s, const win_profile_t *prof, uint64_t table, synth_objects_t *obj) {
+    win_synth_handle_t h;
+    uint64_t vendor, parent;
+    size_t j;
+
+    put_u64(s, table + 8, 0xbad0b0b0);              // slot 1 is never a type
+    for (j = 0; j < sizeof(synth_types) / sizeof(synth_types[0]); j++) {
+        uint64_t type = region_alloc(&s->kern, 0x100, 16);
+        uint64_t buf = region_alloc(&s->kern, SYNTH_NAME_BYTES, 16);
+
+        put_unicode(s, type + prof->object_type_name, buf, synth_types[j].name);
+        *host(s, type + prof->object_type_index) = synth_types[j].index;
+        put_u64(s, table + synth_types[j].index * 8, type);
+    }
+
+    for (j = 0; j < SYNTH_FILES; j++) {
+        uint64_t file = put_object(s, prof, prof->file_object_name + 16, SYNTH_TYPE_FILE);
+        uint64_t buf = region_alloc(&s->kern, SYNTH_NAME_BYTES, 16);
+
+        win_synth_handle(j * 4, &h);
+        obj->files[j] = file;
+        put_u16(s, file, 5);                        // Type: IO_TYPE_FILE
+        put_unicode(s, file + prof->file_object_name, buf, h.name);
+    }
+
+    // \REGISTRY\MACHINE\SOFTWARE\Vendor\KeyNNN, Vendor stored wide
+    parent = put_kcb(s, prof, 0, "REGISTRY", 0);
+    parent = put_kcb(s, prof, parent, "MACHINE", 0);
+    parent = put_kcb(s, prof, parent, "SOFTWARE", 0);
+    vendor = put_kcb(s, prof, parent, "Vendor", 1);
+    for (j = 0; j < SYNTH_KEYS; j++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "Key%03zu", j);
+        obj->keys[j] = put_object(s, prof, prof->key_body_kcb + 8, SYNTH_TYPE_KEY);
+        put_u32(s, obj->keys[j], 0x6b793032);       // Type: 'kby2'
+        put_u64(s, obj->keys[j] + prof->key_body_kcb, put_kcb(s, prof, vendor, name, 0));
+    }
+    for (j = 0; j < SYNTH_EVENTS; j++) {
+        obj->events[j] = put_object(s, prof, 0x18, SYNTH_TYPE_EVENT);
+        *host(s, obj->events[j]) = 1;               // Header.Type: EventNotificationObject
+    }
+
+    // Mapped files: SUBSECTION -> CONTROL_AREA -> FILE_OBJECT, with a
+    // reference count in the low bits of FilePointer
+    for (j = 0; j < SYNTH_VAD_FILES; j++) {
+        uint64_t file = put_object(s, prof, prof->file_object_name + 16, SYNTH_TYPE_FILE);
+        uint64_t buf = region_alloc(&s->kern, SYNTH_NAME_BYTES, 16);
+        uint64_t area = region_alloc(&s->kern, prof->control_area_file + 8, 16);
+        char name[64];
+
+        snprintf(name, sizeof(name), "\\Windows\\System32\\map%02zu.dll", j);
+        put_u16(s, file, 5);                        // Type: IO_TYPE_FILE
+        put_unicode(s, file + prof->file_object_name, buf, name);
+        put_u64(s, area + prof->control_area_file, file | 5);
+        obj->views[j] = region_alloc(&s->kern, prof->subsection_control_area + 8, 16);
+        put_u64(s, obj->views[j] + prof->subsection_control_area, area);
+    }
+}
+
+// HANDLE_TABLE of process i holding n handles; returns its address
+static uint64_t put_handle_table(synth_t *s, const win_profile_t *prof, const synth_objects_t *obj,
+                                 const uint64_t *eproc, size_t processes, size_t i, size_t n) {
+    size_t leaves = handle_leaves(n), k, j;
+    uint64_t table = region_alloc(&s->kern, 0x80, 16);
+    uint64_t leaf = region_alloc(&s->kern, leaves * X86_PAGE_4K, X86_PAGE_4K);
+    uint64_t code = leaf;
+    win_synth_handle_t h;
+
+    for (k = 0; k < n; k++) {
+        uint64_t body, header, entry;
+
+        win_synth_handle(k, &h);
+        switch (k % 4) {
+        case 0: body = obj->files[(k / 4) % SYNTH_FILES]; break;
+        case 1: body = obj->keys[(k / 4) % SYNTH_KEYS]; break;
+        case 2: body = obj->events[(k / 4) % SYNTH_EVENTS]; break;
+        default: body = eproc[(i + k) % processes]; break;
+        }
+        header = body - prof->object_header_body;
+        entry = leaf + (h.handle / 4) * 16;
+        // Object pointer bits, attributes and the Unlocked bit; access
+        put_u64(s, entry, (((header & 0xffffffffffffULL) >> 4) << 20) | ((uint64_t)h.attributes << 17) | 1);
+        put_u64(s, entry + 8, h.access);
+    }
+
+    // One directory level up to 512 leaves, two beyond
+    if (leaves > 512) {
+        uint64_t top = region_alloc(&s->kern, X86_PAGE_4K, X86_PAGE_4K);
+        size_t mids = (leaves + 511) / 512;
+        uint64_t mid = region_alloc(&s->kern, mids * X86_PAGE_4K, X86_PAGE_4K);
+
+        for (j = 0; j < mids; j++) put_u64(s, top + j * 8, mid + j * X86_PAGE_4K);
+        for (j = 0; j < leaves; j++) put_u64(s, mid + j * 8, leaf + j * X86_PAGE_4K);
+        code = top | 2;
+    } else if (leaves > 1) {
+        uint64_t dir = region_alloc(&s->kern, X86_PAGE_4K, X86_PAGE_4K);
+
+        for (j = 0; j < leaves; j++) put_u64(s, dir + j * 8, leaf + j * X86_PAGE_4K);
+        code = dir | 1;
+    }
+    put_u32(s, table + prof->handle_table_next, (uint32_t)(leaves * 256 * 4));
+    put_u64(s, table + prof->handle_table_code, code);
+    return table;
+}
+
+void win_synth_vad(const win_synth_opts_t *opts, size_t i, size_t k, win_synth_vad_t *out) {
+    size_t kind = k % 8;
+
+    memset(out, 0, sizeof(*out));
+    if (opts->data_pages && k + 1 == win_synth_vad_count(opts, i)) {
+        win_synth_data_t d;
+
+        win_synth_data(opts, i, &d);
+        out->start = d.va;
+        out->end = d.va + opts->data_pages * X86_PAGE_4K;
+        out->protection = 4;                            // MM_READWRITE
+        out->private_memory = 1;
+        return;
+    }
+    out->start = (k & 1 ? SYNTH_VAD_HIGH : SYNTH_VAD_LOW) + (k / 2) * SYNTH_VAD_STRIDE;
+    out->end = out->start + (1 + k % 7) * X86_PAGE_4K;
+    out->type = synth_vad_kinds[kind].type;
+    out->protection = synth_vad_kinds[kind].protection;
+    out->private_memory = synth_vad_kinds[kind].private_memory;
+    if (!out->private_memory) {
+        snprintf(out->file, sizeof(out->file), "\\Windows\\System32\\map%02zu.dll", (k / 8) % SYNTH_VAD_FILES);
+    }
+}
+
+size_t win_synth_vad_count(const win_synth_opts_t *opts, size_t i) {
+    if ((long)i == opts->exited_at) return 0;
+    return ((long)i == opts->heavy_at ? opts->heavy_vads : opts->vads) + (opts->data_pages ? 1 : 0);
+}
+
+void win_synth_data(const win_synth_opts_t *opts, size_t i, win_synth_data_t *out) {
+    out->va = SYNTH_DATA_VA + i * (opts->data_pages + 1) * X86_PAGE_4K;
+    out->ascii = out->va + 0x100;
+    out->wide = opts->data_pages >= 2 ? out->va + (opts->data_pages / 2) * X86_PAGE_4K - 9 : 0;
+}
+
+// Bytes of a VAD node: an _MMVAD through Subsection, for short ones too
+static uint64_t vad_node_bytes(const win_profile_t *prof) {
+    uint64_t len = prof->vad_subsection + 8;
+
+    if (prof->vad_flags + 4 > len) len = prof->vad_flags + 4;
+    if (prof->vad_right + 8 > len) len = prof->vad_right + 8;
+    if (prof->vad_left + 8 > len) len = prof->vad_left + 8;
+    return align_up(len, 16);
+}
+
+// VAD k at sorted position p: the low half in order, the data region
+// (VAD n - 1) if there is one, then the high half
+static size_t vad_at(size_t p, size_t n, int data) {
+    size_t low = (n - data + 1) / 2;
+
+    if (p < low) return 2 * p;
+    if (data && p == low) return n - 1;
+    return 2 * (p - low - data) + 1;
+}
+
+// Balanced subtree over sorted positions [lo, hi); returns its root
+static uint64_t put_vad_subtree(synth_t *s, const win_profile_t *prof, uint64_t nodes, size_t n, int data,
+                                size_t lo, size_t hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    uint64_t node;
+
+    if (lo >= hi) return 0;
+    node = nodes + vad_at(mid, n, data) * vad_node_bytes(prof);
+    put_u64(s, node + prof->vad_left, put_vad_subtree(s, prof, nodes, n, data, lo, mid));
+    put_u64(s, node + prof->vad_right, put_vad_subtree(s, prof, nodes, n, data, mid + 1, hi));
+    return node;
+}
+
+// VAD tree of process i, allocated in VAD order rather than address
+// order as pool allocations would be; returns the root
+static uint64_t put_vad_tree(synth_t *s, const win_profile_t *prof, const synth_objects_t *obj,
+                             const win_synth_opts_t *o, size_t i) {
+    size_t n = win_synth_vad_count(o, i), k;
+    uint64_t size = vad_node_bytes(prof), nodes = region_alloc(&s->kern, n * size, 16), root, last;
+    int data = o->data_pages ? 1 : 0;
+    win_synth_vad_t v;
+
+    for (k = 0; k < n; k++) {
+        uint64_t node = nodes + k * size, vpn, end;
+
+        win_synth_vad(o, i, k, &v);
+        vpn = v.start >> 12;
+        end = (v.end >> 12) - 1;
+        put_u32(s, node + prof->vad_start, (uint32_t)vpn);
+        put_u32(s, node + prof->vad_end, (uint32_t)end);
+        *host(s, node + prof->vad_start_high) = (uint8_t)(vpn >> 32);
+        *host(s, node + prof->vad_end_high) = (uint8_t)(end >> 32);
+        put_u32(s, node + prof->vad_flags, (uint32_t)v.type << prof->vad_type_bit |
+                                           (uint32_t)v.protection << prof->vad_protection_bit |
+                                           (uint32_t)v.private_memory << prof->vad_private_bit);
+        if (!v.private_memory) put_u64(s, node + prof->vad_subsection, obj->views[(k / 8) % SYNTH_VAD_FILES]);
+    }
+    root = put_vad_subtree(s, prof, nodes, n, data, 0, n);
+    if ((long)i == o->vad_loop_at) {
+        // The highest VAD's right link leads back to the root
+        last = nodes + vad_at(n - 1, n, data) * size;
+        put_u64(s, last + prof->vad_right, root);
+    }
+    return root;
+}
+
+// WIN_SYNTH_SIG_CODE at the mark RVA of user-mode module j; the bytes
+// under the pattern's wildcards are j's own
+static void put_code_mark(synth_t *s, uint64_t image, size_t j) {
+    uint8_t mark[16] = { 0x48, 0x8b, 0x05, 0, 0, 0, 0, 0x48, 0x85, 0xc0, 0x74, 0, 0xff, 0xd0, 0xc3, 0xcc };
+    uint32_t rel = (uint32_t)(0x10000 + j * 0x100);
+
+    memcpy(mark + 3, &rel, sizeof(rel));
+    mark[11] = (uint8_t)(0x10 + j);
+    memcpy(host(s, image + WIN_SYNTH_SIG_CODE_RVA), mark, sizeof(mark));
+}
+
+// Page j of process i's data: zeros, random bytes, ASCII text and UTF-16
+// text in turn, from a generator seeded by both
+static void fill_data_page(uint8_t *page, size_t i, size_t j) {
+    static const char text[] = "etaoin shrdlucmfwypvbgkqjxz";
+    uint64_t x = (i + 1) * 0x9e3779b97f4a7c15ULL ^ (j + 1) * 0xbf58476d1ce4e5b9ULL;
+    size_t k, b;
+
+    if ((i + j) % 4 == 0) return;                       // the file is zeroed
+    for (k = 0; k < X86_PAGE_4K; k += 8) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        switch ((i + j) % 4) {
+        case 1:
+            memcpy(page + k, &x, sizeof(x));
+            break;
+        case 2:
+            for (b = 0; b < 8; b++) page[k + b] = (uint8_t)text[(x >> (b * 6)) % (sizeof(text) - 1)];
+            break;
+        default:
+            for (b = 0; b < 8; b += 2) page[k + b] = (uint8_t)text[(x >> (b * 6)) % (sizeof(text) - 1)];
+            break;
+        }
+    }
+}
+
+// Data regions of every process, with the marks planted in them
+static void put_data(synth_t *s, const win_synth_opts_t *o) {
+    const size_t mark_len = sizeof(WIN_SYNTH_SIG_DATA) - 1;
+    uint64_t pages = o->data_pages;
+    size_t i, j, k;
+
+    for (i = 0; i < o->processes; i++) {
+        uint8_t *base = s->ram + s->data.pa + i * pages * X86_PAGE_4K;
+        win_synth_data_t d;
+
+        for (j = 0; j < pages; j++) fill_data_page(base + j * X86_PAGE_4K, i, j);
+        win_synth_data(o, i, &d);
+        memcpy(base + (d.ascii - d.va), WIN_SYNTH_SIG_DATA, mark_len);
+        for (k = 0; d.wide && k < mark_len; k++) {
+            base[d.wide - d.va + 2 * k] = (uint8_t)WIN_SYNTH_SIG_DATA[k];
+            base[d.wide - d.va + 2 * k + 1] = 0;
+        }
+    }
+}
+
+// Taken off ActiveProcessLinks, as by a rootkit or at exit
+static int unlinked(const win_synth_opts_t *o, size_t i) {
+    return (long)i == o->unlinked_at || (long)i == o->exited_at;
+}
+
+// ELF core header page: one PT_NOTE with the vCPU state, one PT_LOAD
+static void write_elf_header(uint8_t *file, uint64_t ram_size, uint64_t cr3) {
+    Elf64_Ehdr *eh = (Elf64_Ehdr*)file;
+    Elf64_Phdr *ph = (Elf64_Phdr*)(file + sizeof(*eh));
+    Elf64_Nhdr *nh = (Elf64_Nhdr*)(ph + 2);
+    uint8_t *name = (uint8_t*)(nh + 1);
+    uint8_t *desc = name + 8;
+
+    memcpy(eh->e_ident, ELFMAG, SELFMAG);
+    eh->e_ident[EI_CLASS] = ELFCLASS64;
+    eh->e_ident[EI_DATA] = ELFDATA2LSB;
+    eh->e_ident[EI_VERSION] = EV_CURRENT;
+    eh->e_type = ET_CORE;
+    eh->e_machine = EM_X86_64;
+    eh->e_version = EV_CURRENT;
+    eh->e_phoff = sizeof(*eh);
+    eh->e_ehsize = sizeof(*eh);
+    eh->e_phentsize = sizeof(*ph);
+    eh->e_phnum = 2;
+
+    nh->n_namesz = 5;
+    nh->n_descsz = SYNTH_QEMU_STATE_SIZE;
+    nh->n_type = 0;
+    memcpy(name, "QEMU", 5);
+    memcpy(desc + SYNTH_QEMU_STATE_CR3, &cr3, sizeof(cr3));
+
+    ph[0].p_type = PT_NOTE;
+    ph[0].p_offset = (uint64_t)((uint8_t*)nh - file);
+    ph[0].p_filesz = sizeof(*nh) + 8 + SYNTH_QEMU_STATE_SIZE;
+    ph[1].p_type = PT_LOAD;
+    ph[1].p_offset = SYNTH_ELF_DATA_OFFSET;
+    ph[1].p_paddr = 0;
+    ph[1].p_filesz = ph[1].p_memsz = ram_size;
+}
+
+// Lay out and fill every object; s->ram is zeroed and large enough
+static void build(synth_t *s, const win_synth_opts_t *o, const win_profile_t *prof,
+                  win_synth_info_t *info) {
+    uint64_t eproc_size = align_up(prof->eprocess_span.start + prof->eprocess_span.size, 16);
+    uint64_t ethread_size = align_up(prof->ethread_span.size, 16);
+    uint64_t ldr_size = align_up(prof->ldr_span.start + prof->ldr_span.size, 16);
+    uint64_t links = prof->eprocess_links;
+    uint64_t tle = prof->ethread_threadlistentry;
+    uint64_t base, head, sysproc, modules, drivers, dlls, version, kdbg, types, cookie, prev, *eproc;
+    uint64_t hole = s->kern.va + s->kern.len + X86_PAGE_2M;   // never mapped
+    synth_objects_t objects;
+    size_t i, j, last, reached, *next;
+
+    eproc = calloc(o->processes, sizeof(*eproc));
+    next = calloc(o->processes, sizeof(*next));
+    if (!eproc || !next) {
+        free(eproc);
+        free(next);
+        return;
+    }
+
+    base = region_alloc(&s->kern, X86_PAGE_4K, X86_PAGE_4K);
+    head = region_alloc(&s->kern, 16, 16);
+    sysproc = region_alloc(&s->kern, 8, 16);
+    modules = region_alloc(&s->kern, 16, 16);
+    version = region_alloc(&s->kern, 0x28, 16);
+    kdbg = region_alloc(&s->kern, 0x58, 16);
+    types = region_alloc(&s->kern, 256 * 8, 16);
+    cookie = region_alloc(&s->kern, 8, 16);
+    s->kern.used = SYNTH_IMAGE_SIZE;
+    {
+        synth_export_t exports[] = {
+            { "PsInitialSystemProcess", (uint32_t)(sysproc - base) },
+            { "PsLoadedModuleList", (uint32_t)(modules - base) },
+        };
+        put_kernel_image(s, base, o->pdb_age, exports, 2);
+    }
+    put_debug_data(s, version, kdbg, base, modules, head, o->encoded_kdbg);
+    *host(s, cookie) = SYNTH_HEADER_COOKIE;
+    put_objects(s, prof, types, &objects);
+
+    // PsLoadedModuleList: the kernel, then the drivers, whose images
+    // follow the kernel's back to back
+    drivers = region_alloc(&s->kern, o->drivers * SYNTH_CODE_SIZE, X86_PAGE_4K);
+    prev = modules;
+    for (j = 0; j <= o->drivers; j++) {
+        uint64_t image = j ? drivers + (j - 1) * SYNTH_CODE_SIZE : base;
+        uint64_t m = region_alloc(&s->kern, ldr_size, 16);
+        uint64_t buf = region_alloc(&s->kern, SYNTH_NAME_BYTES, 16);
+        char dname[32];
+
+        if (j) {
+            put_driver_image(s, image, j - 1, o->pdb_age);
+            win_synth_driver_name(j - 1, dname, sizeof(dname));
+        } else {
+            snprintf(dname, sizeof(dname), "ntoskrnl.exe");
+        }
+        put_unicode(s, m + prof->ldr_basedllname, buf, dname);
+        put_u64(s, m + prof->ldr_dllbase, image);
+        put_u32(s, m + prof->ldr_sizeofimage, j ? SYNTH_CODE_SIZE : SYNTH_IMAGE_SIZE);
+        put_u64(s, m + 8, prev);
+        put_u64(s, prev, m);
+        prev = m;
+    }
+    put_u64(s, prev, modules);
+    put_u64(s, modules + 8, prev);
+
+    // The user-mode modules are one set of images mapped by every process
+    dlls = region_alloc(&s->user, o->modules * SYNTH_CODE_SIZE, X86_PAGE_4K);
+    for (j = 0; j < o->modules; j++) {
+        put_dll_image(s, dlls + j * SYNTH_CODE_SIZE, j, o->pdb_age);
+        if (o->data_pages) put_code_mark(s, dlls + j * SYNTH_CODE_SIZE, j);
+    }
+    if (o->data_pages) put_data(s, o);
+
+    for (i = 0; i < o->processes; i++) {
+        uint64_t pool;
+
+        // A process to be unmapped gets a page of its own
+        if ((long)i == o->unmapped_at) {
+            pool = region_alloc(&s->kern, SYNTH_POOL_PREFIX + eproc_size, X86_PAGE_4K);
+            s->kern.used = align_up(s->kern.used, X86_PAGE_4K);
+        } else {
+            pool = region_alloc(&s->kern, SYNTH_POOL_PREFIX + eproc_size, 16);
+        }
+        eproc[i] = pool + SYNTH_POOL_PREFIX;
+        put_pool_header(s, prof, pool, eproc_size);
+    }
+
+    // PsActiveProcessHead <-> EPROCESS[0] <-> ... <-> EPROCESS[n-1], with
+    // unlinked processes skipped over as DKOM leaves them
+    for (i = 0; i < o->processes; i++) {
+        next[i] = i + 1;
+        while (next[i] < o->processes && unlinked(o, next[i])) next[i]++;
+    }
+    for (i = o->processes; i-- > 0; ) {
+        if (!unlinked(o, i)) break;
+    }
+    put_u64(s, head, eproc[0] + links);
+    put_u64(s, head + 8, eproc[i] + links);
+    put_u64(s, sysproc, eproc[0]);
+
+    for (i = 0, last = 0; i < o->processes; i++) {
+        uint64_t e = eproc[i];
+        uint64_t flink = next[i] < o->processes ? eproc[next[i]] + links : head;
+        uint64_t blink = i > 0 ? eproc[last] + links : head;
+        uint64_t thread_head = e + prof->eprocess_threads, second;
+        char name[EPROCESS_IMAGEFILENAME_LEN + 1];
+        size_t threads = (long)i == o->exited_at ? 0 : o->threads;
+
+        if ((long)i == o->loop_at) flink = eproc[i / 2] + links;
+        if ((long)i == o->torn_at) flink = hole;
+        if ((long)i == o->blink_at && i > 0) blink = eproc[i / 2] + links;
+        if (unlinked(o, i)) {
+            flink = blink = e + links;                  // points at itself
+        } else {
+            last = i;
+        }
+
+        snprintf(name, sizeof(name), i == 0 ? "System" : "proc%06u.exe", (unsigned)(i % 1000000));
+        *host(s, e) = 3;                                // Pcb.Header.Type: ProcessObject
+        memcpy(host(s, e + prof->eprocess_name), name, strlen(name));
+        put_u64(s, e + prof->eprocess_pid, i == 0 ? 4 : (i + 1) * 4);
+        put_u64(s, e + prof->eprocess_dtb, SYNTH_DTB);
+        if (prof->eprocess_create_time) {
+            put_u64(s, e + prof->eprocess_create_time, SYNTH_CREATE_TIME + i * 10000000ULL);
+        }
+        put_u64(s, e + links, flink);
+        put_u64(s, e + links + 8, blink);
+        if (prof->eprocess_object_table && win_synth_handle_count(o, i)) {
+            put_u64(s, e + prof->eprocess_object_table,
+                    put_handle_table(s, prof, &objects, eproc, o->processes, i, win_synth_handle_count(o, i)));
+        }
+        if (prof->eprocess_vad_root && win_synth_vad_count(o, i)) {
+            put_u64(s, e + prof->eprocess_vad_root,
+                    put_vad_tree(s, prof, &objects, o, i));
+        }
+
+        // Threads: ETHREAD bases sit below their allocation, since only
+        // the span from ThreadListEntry up is ever read
+        prev = thread_head;
+        second = 0;
+        for (j = 0; j < threads; j++) {
+            uint64_t t = region_alloc(&s->kern, ethread_size, 16) - prof->ethread_span.start;
+            uint32_t tid = (uint32_t)(0x10000 + (i * o->threads + j) * 4);
+
+            put_u32(s, t + prof->ethread_cid_process, i == 0 ? 4 : (uint32_t)((i + 1) * 4));
+            put_u32(s, t + prof->ethread_cid_thread, tid);
+            put_u64(s, t + tle + 8, prev);
+            put_u64(s, prev, t + tle);
+            if (j == 1) second = t + tle;
+            prev = t + tle;
+        }
+        if ((long)i == o->thread_loop_at && threads > 0) {
+            put_u64(s, prev, second ? second : prev);   // last -> second entry
+        } else {
+            put_u64(s, prev, thread_head);
+        }
+        put_u64(s, thread_head + 8, prev);
+
+        // System has no PEB; everyone else gets PEB -> Ldr -> modules
+        if (i > 0) {
+            uint64_t peb = region_alloc(&s->user, align_up(prof->peb_ldr + 8, 16), 16);
+            uint64_t ldr = region_alloc(&s->user, align_up(prof->ldr_inloadorder + 16, 16), 16);
+            uint64_t mod_head = ldr + prof->ldr_inloadorder;
+
+            put_u64(s, e + prof->eprocess_peb, peb);
+            put_u64(s, peb + prof->peb_ldr, ldr);
+
+            prev = mod_head;
+            second = 0;
+            for (j = 0; j < o->modules; j++) {
+                uint64_t m = region_alloc(&s->user, ldr_size, 16);
+                uint64_t buf = region_alloc(&s->user, SYNTH_NAME_BYTES, 16);
+                char mname[32];
+
+                win_synth_module_name(j, mname, sizeof(mname));
+                put_unicode(s, m + prof->ldr_basedllname, buf, mname);
+                put_u64(s, m + prof->ldr_dllbase, dlls + j * SYNTH_CODE_SIZE);
+                put_u32(s, m + prof->ldr_sizeofimage, SYNTH_CODE_SIZE);
+                put_u64(s, m + 8, prev);
+                put_u64(s, prev, m);
+                if (j == 1) second = m;
+                prev = m;
+            }
+            if ((long)i == o->module_loop_at && o->modules > 0) {
+                put_u64(s, prev, second ? second : prev);   // last -> second entry
+            } else {
+                put_u64(s, prev, mod_head);
+            }
+            put_u64(s, mod_head + 8, prev);
+        }
+    }
+
+    info->dtb = SYNTH_DTB;
+    info->kernel_base = s->kern.va;
+    info->ps_active_process_head = head;
+    info->ps_initial_system_process = sysproc;
+    info->ps_loaded_module_list = modules;
+    info->kd_version_block = version;
+    info->kdbg = kdbg;
+    info->first_process = eproc[0];
+    info->ob_type_index_table = types;
+    info->ob_header_cookie = cookie;
+    info->image_size = s->ram_size;
+
+    // A correct walk stops at the first fault on the process list
+    info->expect_processes = o->processes;
+    if (o->loop_at >= 0 && (size_t)o->loop_at + 1 < info->expect_processes) {
+        info->expect_processes = (size_t)o->loop_at + 1;
+    }
+    if (o->torn_at >= 0 && (size_t)o->torn_at + 1 < info->expect_processes) {
+        info->expect_processes = (size_t)o->torn_at + 1;
+    }
+    if (o->unmapped_at >= 0 && (size_t)o->unmapped_at < info->expect_processes) {
+        info->expect_processes = (size_t)o->unmapped_at;
+    }
+    for (i = 0; i < o->processes; i++) {
+        if (unlinked(o, i)) info->expect_processes--;
+    }
+    info->expect_threads = info->expect_processes * o->threads;
+    info->expect_modules = info->expect_processes > 0 ? (info->expect_processes - 1) * o->modules : 0;
+    info->expect_drivers = o->drivers + 1;
+    for (i = 0, reached = 0; i < o->processes && reached < info->expect_processes; i++) {
+        if (unlinked(o, i)) continue;
+        info->expect_handles += win_synth_handle_count(o, i);
+        info->expect_vads += win_synth_vad_count(o, i);
+        reached++;
+    }
+
+    if (o->unmapped_at >= 0 && (size_t)o->unmapped_at < o->processes) {
+        uint8_t *slot = pte_slot(s, eproc[o->unmapped_at], 0);
+        if (slot) memset(slot, 0, 8);
+    }
+    free(eproc);
+    free(next);
+}
+
+int win_synth_write(const char *path, const win_synth_opts_t *opts, win_synth_info_t *info) {
+    const win_profile_t *prof = win_profile_get();
+    uint64_t eproc_size, kern_len, user_len, pt_pages, data_offset, file_size;
+    synth_t s;
+    size_t i;
+    uint8_t *file;
+    int fd;
+
+    if (opts->processes == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&s, 0, sizeof(s));
+    memset(info, 0, sizeof(*info));
+
+    // Size both regions for the worst case of the bump allocations
+    eproc_size = align_up(prof->eprocess_span.start + prof->eprocess_span.size, 16);
+    kern_len = SYNTH_IMAGE_SIZE + opts->processes * (SYNTH_POOL_PREFIX + eproc_size) +
+               opts->processes * opts->threads * align_up(prof->ethread_span.size, 16) +
+               opts->drivers * SYNTH_CODE_SIZE +
+               (opts->drivers + 1) * (align_up(prof->ldr_span.start + prof->ldr_span.size, 16) +
+                                      SYNTH_NAME_BYTES) +
+               objects_bytes(prof) + 2 * X86_PAGE_4K;
+    for (i = 0; i < opts->processes; i++) {
+        if (win_synth_handle_count(opts, i)) kern_len += handle_table_bytes(win_synth_handle_count(opts, i));
+        kern_len += win_synth_vad_count(opts, i) * vad_node_bytes(prof) + 16;
+    }
+    user_len = opts->modules * SYNTH_CODE_SIZE + opts->processes * (align_up(prof->peb_ldr + 8, 16) +
+                                  align_up(prof->ldr_inloadorder + 16, 16) +
+                                  opts->modules * (align_up(prof->ldr_span.start + prof->ldr_span.size, 16) +
+                                                   SYNTH_NAME_BYTES));
+    kern_len = align_up(kern_len, X86_PAGE_4K);
+    user_len = align_up(user_len + 16, X86_PAGE_4K);
+
+    // Physical: [0] unused, [DTB] PML4, page tables, kernel data, user
+    // data, process data
+    if (opts->data_pages) {
+        s.data.va = SYNTH_DATA_VA;
+        s.data.len = opts->processes * (opts->data_pages + 1) * X86_PAGE_4K;
+    }
+    pt_pages = 1 + table_pages(kern_len) + table_pages(user_len) + (s.data.len ? table_pages(s.data.len) : 0);
+    s.pt_next = SYNTH_DTB + X86_PAGE_4K;
+    s.pt_end = SYNTH_DTB + pt_pages * X86_PAGE_4K;
+    s.kern.va = opts->kernel_va ? opts->kernel_va & ~(X86_PAGE_4K - 1) : SYNTH_KERNEL_VA;
+    s.kern.pa = s.pt_end;
+    s.kern.len = kern_len;
+    s.user.va = SYNTH_USER_VA;
+    s.user.pa = s.kern.pa + kern_len;
+    s.user.len = user_len;
+    s.data.pa = s.user.pa + user_len;
+    s.ram_size = s.data.pa + opts->processes * opts->data_pages * X86_PAGE_4K;
+
+    data_offset = opts->raw ? 0 : SYNTH_ELF_DATA_OFFSET;
+    file_size = data_offset + s.ram_size;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)file_size) != 0) {
+        close(fd);
+        return -1;
+    }
+    file = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) return -1;
+
+    s.ram = file + data_offset;
+    if (map_region(&s, &s.kern) != 0 || map_region(&s, &s.user) != 0 || map_data(&s, opts) != 0) {
+        munmap(file, file_size);
+        errno = ENOSPC;
+        return -1;
+    }
+    build(&s, opts, prof, info);
+    if (!opts->raw) {
+        write_elf_header(file, s.ram_size, SYNTH_DTB);
+    }
+
+    munmap(file, file_size);
+    if (info->first_process == 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
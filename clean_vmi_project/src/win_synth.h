@@ -0,0 +1,165 @@
+#ifndef WIN_SYNTH_H
+#define WIN_SYNTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Synthetic Windows guest memory for testing the walkers without a VM.
+//
+// Writes a physical memory image (raw, or an ELF core with a QEMU CR3
+// note) holding 4-level page tables and N EPROCESS objects linked on an
+// ActiveProcessLinks list, each with a PEB -> PEB_LDR_DATA module list and
+// an ETHREAD list. Field offsets come from the active structure profile,
+// so the image decodes exactly the way the inspectors expect. Objects are
+// packed: only the bytes a walker reads (the profile's read spans) are
+// backed, which keeps 100k processes in a few hundred MiB.
+//
+// Every EPROCESS sits in a "Proc" pool allocation, as pool scanners
+// expect. PsLoadedModuleList holds the kernel and a number of drivers,
+// each a PE image with one section and an export directory; the modules
+// on every process's loader list are such images too, mapped once and
+// shared by all processes, as system DLLs are.
+//
+// With handles, every process gets a HANDLE_TABLE (one, two or three
+// levels, by size) whose entries point at shared File, Key and Event
+// objects and at other processes; every object has an OBJECT_HEADER with
+// its TypeIndex scrambled by the header cookie, and ObTypeIndexTable sits
+// next to the list-head symbols.
+//
+// With VADs, every process gets a balanced tree of _MMVAD nodes over
+// private regions and views of shared mapped files; each file sits behind
+// a SUBSECTION and CONTROL_AREA as on Windows.
+//
+// With data pages, every process also gets a private read-write region
+// of its own, described by one more VAD and filled with a mix of zero
+// pages, random bytes and ASCII and UTF-16 text, for signature scans.
+// Marks are planted in it and in the code of every user-mode module.
+//
+// Faults can be injected into the lists. Each takes the index of the
+// process it applies to, or -1 for none; they are not meant to be
+// combined.
+
+typedef struct {
+    size_t processes;           // EPROCESS objects, the first is System
+    size_t modules;             // LDR entries per process (System has none)
+    size_t threads;             // ETHREADs per process
+    int raw;                    // raw dump instead of an ELF core
+    size_t drivers;             // on PsLoadedModuleList after the kernel
+
+    long loop_at;               // Flink of process i points back to process i/2
+    long torn_at;               // Flink of process i points at unmapped memory
+    long unmapped_at;           // the page holding process i is not mapped
+    long module_loop_at;        // module list of process i loops past its head
+    long thread_loop_at;        // thread list of process i loops past its head
+    long unlinked_at;           // process i is unlinked (DKOM), threads intact
+    long exited_at;             // process i exited: unlinked, no threads left
+    long blink_at;              // Blink of process i (> 0) points at process i/2
+
+    uint64_t kernel_va;         // kernel image base, 0 for the default
+    uint32_t pdb_age;           // CodeView age of the kernel image (its build)
+    int encoded_kdbg;           // KDBG scrambled, as without a kernel debugger
+
+    size_t handles;             // handles per process
+    long heavy_at;              // process i has heavy_handles and heavy_vads instead
+    size_t heavy_handles;
+
+    size_t vads;                // VADs per process
+    size_t heavy_vads;
+    long vad_loop_at;           // last VAD of process i links back to its root
+
+    size_t data_pages;          // pages of private data per process
+} win_synth_opts_t;
+
+typedef struct {
+    uint64_t dtb;               // kernel PML4 (also every process's DTB)
+    uint64_t kernel_base;       // kernel image (PE header with a CodeView record)
+    uint64_t ps_active_process_head;
+    uint64_t ps_initial_system_process;
+    uint64_t ps_loaded_module_list;
+    uint64_t kd_version_block;  // DBGKD_GET_VERSION64
+    uint64_t kdbg;              // KDDEBUGGER_DATA64, unencoded
+    uint64_t first_process;     // EPROCESS of System
+    uint64_t ob_type_index_table;
+    uint64_t ob_header_cookie;
+    uint64_t image_size;        // bytes of guest physical memory
+
+    // What a correct walk of the image finds
+    size_t expect_processes;
+    size_t expect_modules;      // over the processes the walk reaches
+    size_t expect_threads;
+    size_t expect_drivers;      // the kernel included
+    size_t expect_handles;
+    size_t expect_vads;
+} win_synth_info_t;
+
+void win_synth_defaults(win_synth_opts_t *opts);
+
+// Write the image; returns 0, or -1 with errno set
+int win_synth_write(const char *path, const win_synth_opts_t *opts, win_synth_info_t *info);
+
+// BaseDllName of driver j (0 .. drivers-1) and name of its export k; the
+// exports are at RVA 0x1000 + k * 0x100
+#define WIN_SYNTH_DRIVER_EXPORTS 4
+void win_synth_driver_name(size_t j, char *out, size_t len);
+void win_synth_driver_export(size_t j, size_t k, char *out, size_t len);
+
+// Same for user-mode module j (0 .. modules-1), whose image is shared by
+// every process
+void win_synth_module_name(size_t j, char *out, size_t len);
+void win_synth_module_export(size_t j, size_t k, char *out, size_t len);
+
+// Handle k (0 .. handles-1) of every process: its value (closed handles leave
+// a free entry after every 15), what it was opened with, and the name
+// the object carries ("" for Event and Process objects, which have none
+// the walk decodes)
+typedef struct {
+    uint32_t handle;
+    uint32_t access;
+    uint8_t attributes;
+    const char *type;
+    char name[64];
+} win_synth_handle_t;
+
+void win_synth_handle(size_t k, win_synth_handle_t *out);
+
+// Handles process i has under opts
+size_t win_synth_handle_count(const win_synth_opts_t *opts, size_t i);
+
+// VAD k of process i. Even VADs lie low in the address space, odd ones
+// above 16 TiB (so their VPNs need the high byte); in turn they are image
+// views, private, data views and private executable memory. With data
+// pages, the last VAD is the process's data region. file is "" for
+// private memory.
+typedef struct {
+    uint64_t start, end;        // end is one past the last byte
+    uint8_t protection;         // MM protection value
+    uint8_t type;               // VadType
+    uint8_t private_memory;
+    char file[64];
+} win_synth_vad_t;
+
+void win_synth_vad(const win_synth_opts_t *opts, size_t i, size_t k, win_synth_vad_t *out);
+
+// VADs process i has under opts
+size_t win_synth_vad_count(const win_synth_opts_t *opts, size_t i);
+
+// Marks planted with data pages: WIN_SYNTH_SIG_DATA in ASCII and UTF-16
+// in every data region, and the bytes of WIN_SYNTH_SIG_CODE (a hex
+// pattern; the wildcards differ per module) at WIN_SYNTH_SIG_CODE_RVA of
+// every user-mode module
+#define WIN_SYNTH_SIG_DATA      "VMI-SYNTH-SIGNATURE"
+#define WIN_SYNTH_SIG_CODE      "48 8b 05 ?? ?? ?? ?? 48 85 c0 74 ?? ff d0 c3 cc"
+#define WIN_SYNTH_SIG_CODE_RVA  0x1800
+
+// Data region of process i: va .. va + data_pages pages. The ASCII mark
+// sits at ascii, the UTF-16 one at wide, across the boundary of the
+// middle page (0 with a single page).
+typedef struct {
+    uint64_t va;
+    uint64_t ascii;
+    uint64_t wide;
+} win_synth_data_t;
+
+void win_synth_data(const win_synth_opts_t *opts, size_t i, win_synth_data_t *out);
+
+#endif
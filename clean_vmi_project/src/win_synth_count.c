@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <string.h>
+#include "win_synth_count.h"
+
+static size_t count_read_pages(void *priv, const uint64_t *pfns, size_t n, uint8_t *const *pages, int *ok) {
+    win_synth_counter_t *c = priv;
+    size_t i, done = 0;
+
+    __atomic_add_fetch(&c->calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->pages, n, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&c->lock);
+    for (i = 0; i < n; i++) {
+        ok[i] = gm_read_pa(c->img, pfns[i] << GM_PAGE_SHIFT, pages[i], GM_PAGE_SIZE) == GM_PAGE_SIZE;
+        done += ok[i];
+    }
+    pthread_mutex_unlock(&c->lock);
+    return done;
+}
+
+static int count_read_page(void *priv, uint64_t pfn, uint8_t *page) {
+    int ok;
+    return count_read_pages(priv, &pfn, 1, &page, &ok) == 1 ? 0 : -1;
+}
+
+static const gm_backend_ops_t count_ops = {
+    .name = "counting",
+    .read_page = count_read_page,
+    .read_pages = count_read_pages,
+};
+
+int win_synth_count_open(win_synth_counter_t *c, guest_mem_t *img, const win_synth_info_t *info) {
+    memset(c, 0, sizeof(*c));
+    c->img = img;
+    pthread_mutex_init(&c->lock, NULL);
+    c->gm = gm_create(&count_ops, c, GM_DEFAULT_CACHE_PAGES, GM_DEFAULT_TLB_ENTRIES);
+    if (!c->gm) {
+        pthread_mutex_destroy(&c->lock);
+        return -1;
+    }
+    gm_set_kernel_dtb(c->gm, info->dtb);
+    return 0;
+}
+
+void win_synth_count_close(win_synth_counter_t *c) {
+    gm_destroy(c->gm);
+    c->gm = NULL;
+    pthread_mutex_destroy(&c->lock);
+}
+
+int win_synth_count_ok(const win_synth_counter_t *c, uint64_t units, uint64_t per_call, const char *what) {
+    if (c->calls * per_call <= units) return 1;
+    printf("✗ %llu %s cost %llu backend calls (%llu pages)\n", (unsigned long long)units, what,
+           (unsigned long long)c->calls, (unsigned long long)c->pages);
+    return 0;
+}
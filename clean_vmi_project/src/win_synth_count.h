@@ -0,0 +1,30 @@
+#ifndef WIN_SYNTH_COUNT_H
+#define WIN_SYNTH_COUNT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "guest_mem.h"
+#include "win_synth.h"
+
+// A view of a synthetic image through a backend without map_page that
+// counts its calls, so walks have to go through the page cache and its
+// batched fetches. Counters are updated atomically and reads of img are
+// serialized: gm_clone() views of gm, as the worker pools make, share both.
+typedef struct {
+    guest_mem_t *gm;            // the counting view, cold when opened
+    guest_mem_t *img;           // what it reads from
+    pthread_mutex_t lock;       // img is not safe to read from two threads
+    uint64_t calls;             // backend calls
+    uint64_t pages;             // pages they read
+} win_synth_counter_t;
+
+// Open the view over img with the kernel DTB of info; c must stay put
+// until it is closed. Returns 0, or -1 when out of memory.
+int win_synth_count_open(win_synth_counter_t *c, guest_mem_t *img, const win_synth_info_t *info);
+void win_synth_count_close(win_synth_counter_t *c);
+
+// Whether reading units things (handles, regions, pages) cost at most one
+// backend call per per_call of them; if not, says so on a ✗ line
+int win_synth_count_ok(const win_synth_counter_t *c, uint64_t units, uint64_t per_call, const char *what);
+
+#endif
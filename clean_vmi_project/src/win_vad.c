@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include "win_vad.h"
+#include "win_parallel.h"
+
+// Nodes taken off the stack, and mapped views named, per fetch
+#define VAD_BATCH       1024
+
+// Bytes of a node we decode, at most
+#define VAD_NODE_MAX    256
+
+// Regions per process beyond which the tree is taken to be garbage
+#define VAD_MAX         (1U << 22)
+
+// VPNs are 32 bits plus a high byte
+#define VPN_MAX         ((1ULL << 40) - 1)
+
+// A node waiting on the stack, with the page range its ancestors leave it
+typedef struct {
+    uint64_t node;
+    uint64_t lo, hi;                // inclusive VPN bounds
+} pending_t;
+
+typedef struct {
+    guest_mem_t *gm;
+    const win_profile_t *prof;
+    int files;
+    win_vad_map_t *out;
+    size_t count;
+    size_t node_len;                // bytes every node has
+    size_t view_len;                // bytes of an _MMVAD, through Subsection
+    pending_t *stack;
+    size_t depth, cap;
+    pending_t batch[VAD_BATCH];
+    uint64_t vas[VAD_BATCH];
+    uint64_t files_at[VAD_BATCH];
+    size_t rows[VAD_BATCH];
+} walk_t;
+
+static size_t max_end(size_t len, uint32_t offset, size_t size) {
+    return offset + size > len ? offset + size : len;
+}
+
+static int push(walk_t *w, uint64_t node, uint64_t lo, uint64_t hi) {
+    if (w->depth == w->cap) {
+        size_t ncap = w->cap ? w->cap * 2 : 256;
+        pending_t *n = realloc(w->stack, ncap * sizeof(*n));
+        if (!n) return -1;
+        w->stack = n;
+        w->cap = ncap;
+    }
+    w->stack[w->depth].node = node;
+    w->stack[w->depth].lo = lo;
+    w->stack[w->depth].hi = hi;
+    w->depth++;
+    return 0;
+}
+
+// Append a zeroed row; the map gets an arena of its own if it has none
+static win_vad_t *push_vad(win_vad_map_t *map) {
+    if (!map->arena) {
+        if (!(map->arena = malloc(sizeof(*map->arena)))) return NULL;
+        win_arena_init(map->arena);
+        map->owns_arena = 1;
+    }
+    if (map->count == map->cap) {
+        size_t ncap = map->cap ? map->cap * 2 : 64;
+        void *n = win_arena_grow(map->arena, map->items, map->cap * sizeof(*map->items),
+                                 ncap * sizeof(*map->items));
+        if (!n) return NULL;
+        map->items = n;
+        map->cap = ncap;
+    }
+    return memset(&map->items[map->count++], 0, sizeof(*map->items));
+}
+
+// Decode one node and stack its children with their narrowed ranges
+static int decode_node(walk_t *w, const pending_t *p) {
+    const win_profile_t *prof = w->prof;
+    uint8_t buf[VAD_NODE_MAX];
+    uint64_t left, right, start, end;
+    uint32_t start_low, end_low, flags;
+    uint8_t private_memory;
+    size_t got;
+    win_vad_t *row;
+
+    got = gm_read_va(w->gm, GM_KERNEL_DTB, p->node, buf, w->view_len);
+    if (got < w->node_len) {
+        if (w->out) w->out->error = "Unreadable VAD node";
+        return 0;
+    }
+    memcpy(&left, buf + prof->vad_left, sizeof(left));
+    memcpy(&right, buf + prof->vad_right, sizeof(right));
+    memcpy(&start_low, buf + prof->vad_start, sizeof(start_low));
+    memcpy(&end_low, buf + prof->vad_end, sizeof(end_low));
+    memcpy(&flags, buf + prof->vad_flags, sizeof(flags));
+    start = (uint64_t)buf[prof->vad_start_high] << 32 | start_low;
+    end = (uint64_t)buf[prof->vad_end_high] << 32 | end_low;
+
+    if (start > end || start < p->lo || end > p->hi) {
+        if (w->out) w->out->error = "VAD tree out of order";
+        return 0;
+    }
+    if (w->count == VAD_MAX) {
+        if (w->out) w->out->error = "VAD tree too large";
+        return 0;
+    }
+    w->count++;
+    private_memory = (uint8_t)((flags >> prof->vad_private_bit) & 1);
+    if (w->out) {
+        if (!(row = push_vad(w->out))) return -1;
+        row->start = start << 12;
+        row->end = (end + 1) << 12;
+        row->vad = p->node;
+        row->protection = (uint8_t)((flags >> prof->vad_protection_bit) & 0x1f);
+        row->type = (uint8_t)((flags >> prof->vad_type_bit) & 7);
+        row->private_memory = private_memory;
+        w->out->nodes++;
+    }
+
+    // Nothing fits left of page 0 or right of the last page
+    if (win_kernel_va(left)) {
+        if (start == 0) {
+            if (w->out) w->out->error = "VAD tree out of order";
+        } else if (push(w, left, p->lo, start - 1) != 0) {
+            return -1;
+        }
+    }
+    if (win_kernel_va(right)) {
+        if (end == VPN_MAX) {
+            if (w->out) w->out->error = "VAD tree out of order";
+        } else if (push(w, right, end + 1, p->hi) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int by_start(const void *a, const void *b) {
+    const win_vad_t *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// Files behind the mapped views among rows [first, first + n): each step
+// of Subsection -> ControlArea -> FilePointer -> FileName.Buffer is one
+// fetch for the whole chunk
+static void name_views(walk_t *w, size_t first, size_t n) {
+    const win_profile_t *prof = w->prof;
+    win_vad_map_t *out = w->out;
+    const uint32_t next[4] = { prof->subsection_control_area, prof->control_area_file,
+                               prof->file_object_name + 8, 0 };
+    uint16_t wbuf[WIN_MAX_NAME_CHARS];
+    size_t i, j, k = 0, step, nchars;
+    uint64_t ptr;
+
+    for (i = first; i < first + n; i++) {
+        if (out->items[i].private_memory) continue;
+        w->rows[k] = i;
+        w->vas[k++] = out->items[i].vad + prof->vad_subsection;
+    }
+    for (step = 0; step < 4 && k; step++) {
+        for (i = 0, j = 0; i < k; i++) {
+            if (gm_read_u64(w->gm, GM_KERNEL_DTB, w->vas[i], &ptr) != 0) continue;
+            if (step == 2) ptr &= ~0xfULL;          // reference count bits of the _EX_FAST_REF
+            if (!win_kernel_va(ptr)) continue;
+            if (step == 2) w->files_at[j] = ptr;
+            else if (step > 2) w->files_at[j] = w->files_at[i];
+            w->rows[j] = w->rows[i];
+            w->vas[j++] = ptr + next[step];
+        }
+        k = j;
+        gm_prefetch_va(w->gm, GM_KERNEL_DTB, w->vas, k);
+    }
+    for (i = 0; i < k; i++) {
+        nchars = win_read_unicode_raw(w->gm, GM_KERNEL_DTB, w->files_at[i] + prof->file_object_name,
+                                      wbuf, WIN_MAX_NAME_CHARS);
+        if (nchars) out->items[w->rows[i]].file = win_arena_utf16(out->arena, wbuf, nchars);
+    }
+}
+
+static int walk_vads(walk_t *w, uint64_t root) {
+    size_t i, n;
+
+    if (push(w, root, 0, VPN_MAX) != 0) return -1;
+    while (w->depth) {
+        // The top of the stack in one fetch, then decoded from the cache
+        n = w->depth < VAD_BATCH ? w->depth : VAD_BATCH;
+        w->depth -= n;
+        memcpy(w->batch, w->stack + w->depth, n * sizeof(*w->batch));
+        for (i = 0; i < n; i++) w->vas[i] = w->batch[i].node;
+        gm_prefetch_va(w->gm, GM_KERNEL_DTB, w->vas, n);
+        for (i = 0; i < n; i++) {
+            if (decode_node(w, &w->batch[i]) != 0) return -1;
+        }
+    }
+    if (!w->out) return (int)w->count;
+
+    // Ancestors bound every node, so the ranges are disjoint
+    qsort(w->out->items, w->out->count, sizeof(*w->out->items), by_start);
+    for (i = 0; w->files && i < w->out->count; i += VAD_BATCH) {
+        name_views(w, i, w->out->count - i < VAD_BATCH ? w->out->count - i : VAD_BATCH);
+    }
+    return (int)w->count;
+}
+
+int win_walk_vads(guest_mem_t *gm, const win_process_t *process, int files, win_vad_map_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    walk_t *w;
+    size_t len = 0;
+    int ret;
+
+    if (!prof->eprocess_vad_root) {
+        if (out) out->error = "Profile lacks EPROCESS.VadRoot";
+        return -1;
+    }
+    // Exited processes have an empty tree
+    if (!win_kernel_va(process->vad_root)) return 0;
+
+    len = max_end(len, prof->vad_left, 8);
+    len = max_end(len, prof->vad_right, 8);
+    len = max_end(len, prof->vad_start, 4);
+    len = max_end(len, prof->vad_end, 4);
+    len = max_end(len, prof->vad_start_high, 1);
+    len = max_end(len, prof->vad_end_high, 1);
+    len = max_end(len, prof->vad_flags, 4);
+    if (len > VAD_NODE_MAX || prof->vad_subsection + 8 > VAD_NODE_MAX) {
+        if (out) out->error = "VAD node larger than the walk reads";
+        return -1;
+    }
+
+    if (!(w = malloc(sizeof(*w)))) return -1;
+    w->gm = gm;
+    w->prof = prof;
+    w->files = files;
+    w->out = out;
+    w->count = 0;
+    w->node_len = len;
+    w->view_len = max_end(len, prof->vad_subsection, 8);
+    w->stack = NULL;
+    w->depth = w->cap = 0;
+    ret = walk_vads(w, process->vad_root);
+    free(w->stack);
+    free(w);
+    return ret;
+}
+
+const win_vad_t *win_vad_lookup(const win_vad_map_t *map, uint64_t va) {
+    size_t lo = 0, hi = map->count;
+
+    // Last region starting at or below va
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->items[mid].start <= va) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0 || va >= map->items[lo - 1].end) return NULL;
+    return &map->items[lo - 1];
+}
+
+const char *win_vad_protection_name(uint8_t protection) {
+    static const char *names[8] = {
+        "NOACCESS", "READONLY", "EXECUTE", "EXECUTE_READ",
+        "READWRITE", "WRITECOPY", "EXECUTE_READWRITE", "EXECUTE_WRITECOPY",
+    };
+    return names[protection & 7];
+}
+
+// One bit per access value: EXECUTE, EXECUTE_READ, EXECUTE_READWRITE and
+// EXECUTE_WRITECOPY execute; READWRITE up to EXECUTE_WRITECOPY write
+int win_vad_executable(uint8_t protection) {
+    return (0xcc >> (protection & 7)) & 1;
+}
+
+int win_vad_writable(uint8_t protection) {
+    return (0xf0 >> (protection & 7)) & 1;
+}
+
+void win_vad_map_free(win_vad_map_t *map) {
+    if (map->owns_arena) {
+        win_arena_free(map->arena);
+        free(map->arena);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+void win_vad_maps_free(win_vad_map_t *maps, size_t count) {
+    size_t i;
+    if (!maps) return;
+    for (i = 0; i < count; i++) win_vad_map_free(&maps[i]);
+    free(maps);
+}
+
+// --- All processes --------------------------------------------------------
+
+typedef struct {
+    int files;
+    win_vad_map_t *out;
+} all_t;
+
+// Fetch the root nodes of a shard in one batch
+static void prefetch_shard(guest_mem_t *view, const win_process_t *procs, size_t n) {
+    uint64_t vas[WIN_PARALLEL_CHUNK];
+    size_t i, k = 0;
+
+    for (i = 0; i < n; i++) {
+        if (win_kernel_va(procs[i].vad_root)) vas[k++] = procs[i].vad_root;
+    }
+    gm_prefetch_va(view, GM_KERNEL_DTB, vas, k);
+}
+
+static void walk_process(void *ctx, guest_mem_t *view, const win_process_t *process,
+                         size_t index, win_arena_t *arena) {
+    all_t *all = ctx;
+    win_vad_map_t *map = all->out ? &all->out[index] : NULL;
+
+    if (map && arena) map->arena = arena;
+    win_walk_vads(view, process, all->files, map);
+}
+
+int win_walk_vads_parallel(guest_mem_t *gm, const win_process_list_t *procs, int files, int workers,
+                           win_vad_map_t *out, win_arena_t *arena) {
+    all_t all;
+    size_t j;
+    int ret;
+
+    if (out) memset(out, 0, procs->count * sizeof(*out));
+    all.files = files;
+    all.out = out;
+    ret = win_for_each_process(gm, procs, workers, prefetch_shard, walk_process, &all, arena);
+    for (j = 0; out && arena && j < procs->count; j++) out[j].arena = arena;
+    return ret;
+}
@@ -0,0 +1,89 @@
+#ifndef WIN_VAD_H
+#define WIN_VAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_walk.h"
+
+// Process memory regions from the VAD tree.
+//
+// EPROCESS.VadRoot points at the root of a balanced binary tree of
+// _MMVAD_SHORT nodes (an _MMVAD for mapped views), keyed by the virtual
+// page range each one describes. Loader lists only know the DLLs that
+// came in through the loader; the tree has every reserved range,
+// including private executable memory and views mapped by hand.
+//
+// The walk is iterative: nodes wait on an explicit stack and are taken
+// off up to a batch at a time, whose pages are fetched in one go before
+// any node is decoded. Nodes are small pool allocations, so one fetch
+// covers many of them. Each node carries the page range its ancestors
+// leave it; a node outside it (a link pointing back up the tree, or a
+// torn or reordered tree) is reported and not followed, so every walk
+// ends without keeping a visited set.
+//
+// The result is a compact array sorted by address for range lookups.
+
+// Protection values of VadFlags.Protection (MM_*): the low three bits
+// pick the access, the upper two add NOCACHE, GUARD or WRITECOMBINE
+#define WIN_VAD_NOACCESS          0
+#define WIN_VAD_READONLY          1
+#define WIN_VAD_EXECUTE           2
+#define WIN_VAD_EXECUTE_READ      3
+#define WIN_VAD_READWRITE         4
+#define WIN_VAD_WRITECOPY         5
+#define WIN_VAD_EXECUTE_READWRITE 6
+#define WIN_VAD_EXECUTE_WRITECOPY 7
+#define WIN_VAD_NOCACHE           0x08
+#define WIN_VAD_GUARD             0x10
+#define WIN_VAD_WRITECOMBINE      0x18
+
+// VadFlags.VadType values worth naming
+#define WIN_VAD_TYPE_NONE         0
+#define WIN_VAD_TYPE_IMAGE        2
+
+typedef struct {
+    uint64_t start;                 // first byte of the region
+    uint64_t end;                   // one past its last byte
+    uint64_t vad;                   // the _MMVAD_SHORT / _MMVAD node
+    const char *file;               // backing file of a mapped view, else NULL
+    uint8_t protection;             // WIN_VAD_* value the region was created with
+    uint8_t type;                   // VadFlags.VadType
+    uint8_t private_memory;         // VadFlags.PrivateMemory
+} win_vad_t;
+
+// Regions by start address; rows and file names come from arena, as for
+// the lists in win_walk.h. nodes counts the tree nodes read.
+typedef struct {
+    win_vad_t *items;
+    size_t count, cap;
+    const char *error;
+    win_arena_t *arena;
+    int owns_arena;
+    uint64_t nodes;
+} win_vad_map_t;
+
+// Regions of one process. files also decodes the file behind each mapped
+// view. Returns the number of regions, or -1 on failure; a NULL map only
+// touches the memory the walk needs.
+int win_walk_vads(guest_mem_t *gm, const win_process_t *process, int files, win_vad_map_t *out);
+
+// Regions of every process in the list in one pass, sharded over a pool
+// of workers by win_for_each_process(). out[i] is filled for
+// procs->items[i]; rows land in arena (NULL gives every map its own).
+// Returns 0, or -1 if no worker could start.
+int win_walk_vads_parallel(guest_mem_t *gm, const win_process_list_t *procs, int files, int workers,
+                           win_vad_map_t *out, win_arena_t *arena);
+
+// Region holding va, or NULL; a binary search of the map
+const win_vad_t *win_vad_lookup(const win_vad_map_t *map, uint64_t va);
+
+// "EXECUTE_READWRITE" and the like, for the access part of a protection
+const char *win_vad_protection_name(uint8_t protection);
+int win_vad_executable(uint8_t protection);
+int win_vad_writable(uint8_t protection);
+
+void win_vad_map_free(win_vad_map_t *map);
+void win_vad_maps_free(win_vad_map_t *maps, size_t count);
+
+#endif
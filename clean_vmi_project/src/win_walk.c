@@ -0,0 +1,614 @@
+#include <stdlib.h>
+#include <string.h>
+#include "win_walk.h"
+#include "counters.h"
+
+// Arena of a result list, created on first use when the caller gave none
+static win_arena_t *list_arena(win_arena_t **arena, int *owns) {
+    if (!*arena && (*arena = malloc(sizeof(**arena))) != NULL) {
+        win_arena_init(*arena);
+        *owns = 1;
+    }
+    return *arena;
+}
+
+// Append one zeroed row to a growable array; returns NULL on OOM
+static void *list_push(void **items, size_t *count, size_t *cap, size_t size,
+                       win_arena_t **arena, int *owns) {
+    win_arena_t *a = list_arena(arena, owns);
+
+    if (!a) return NULL;
+    if (*count == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 64;
+        void *n = win_arena_grow(a, *items, *cap * size, ncap * size);
+        if (!n) return NULL;
+        *items = n;
+        *cap = ncap;
+    }
+    return memset((uint8_t*)*items + (*count)++ * size, 0, size);
+}
+
+#define LIST_PUSH(list) list_push((void**)&(list)->items, &(list)->count, &(list)->cap, \
+                                  sizeof(*(list)->items), &(list)->arena, &(list)->owns_arena)
+
+// Forget a list; its storage goes with its own arena, or with the scan's
+#define LIST_FREE(list) do {                                        \
+        if ((list)->owns_arena) {                                   \
+            win_arena_free((list)->arena);                          \
+            free((list)->arena);                                    \
+        }                                                           \
+        memset((list), 0, sizeof(*(list)));                         \
+    } while (0)
+
+// Set of list entries already visited, so a list that loops without
+// passing its head ends the walk. Open addressing; starts in the inline
+// slots, which cover the usual module and thread lists without malloc.
+#define VISITED_INLINE 128
+
+typedef struct {
+    uint64_t *slots;
+    size_t cap, count;
+    uint64_t inline_slots[VISITED_INLINE];
+} visited_t;
+
+static void visited_init(visited_t *v) {
+    v->slots = v->inline_slots;
+    v->cap = VISITED_INLINE;
+    v->count = 0;
+    memset(v->inline_slots, 0, sizeof(v->inline_slots));
+}
+
+static void visited_free(visited_t *v) {
+    if (v->slots != v->inline_slots) free(v->slots);
+}
+
+static size_t visited_slot(const uint64_t *slots, size_t cap, uint64_t addr) {
+    size_t i = (size_t)((addr >> 3) * 0x9e3779b97f4a7c15ULL) & (cap - 1);
+    while (slots[i] != 0 && slots[i] != addr) {
+        i = (i + 1) & (cap - 1);
+    }
+    return i;
+}
+
+static int visited_has(const visited_t *v, uint64_t addr) {
+    return v->slots[visited_slot(v->slots, v->cap, addr)] == addr;
+}
+
+// Returns 1 if addr was new, 0 if already visited, -1 on OOM. addr != 0.
+static int visited_add(visited_t *v, uint64_t addr) {
+    size_t i;
+
+    if ((v->count + 1) * 2 > v->cap) {
+        size_t ncap = v->cap * 2, j;
+        uint64_t *n = calloc(ncap, sizeof(*n));
+        if (!n) return -1;
+        for (j = 0; j < v->cap; j++) {
+            if (v->slots[j]) n[visited_slot(n, ncap, v->slots[j])] = v->slots[j];
+        }
+        visited_free(v);
+        v->slots = n;
+        v->cap = ncap;
+    }
+    i = visited_slot(v->slots, v->cap, addr);
+    if (v->slots[i] == addr) return 0;
+    v->slots[i] = addr;
+    v->count++;
+    return 1;
+}
+
+// Set by win_walk_set_live(); read by every walker thread
+static int walk_live = 0;
+
+void win_walk_set_live(int live) {
+    walk_live = live;
+}
+
+int win_walk_live(void) {
+    return walk_live;
+}
+
+// Position in a doubly linked list, by links (LIST_ENTRY) address, for
+// checking that each entry links back to the one before it
+typedef struct {
+    guest_mem_t *gm;
+    uint64_t dtb;
+    uint64_t prev;                 // links the walk came from, 0 if unknown
+    int tries;                     // re-reads spent on the current entry
+    size_t retries, unconfirmed;
+} link_walk_t;
+
+static void link_walk_init(link_walk_t *w, guest_mem_t *gm, uint64_t dtb, uint64_t head) {
+    memset(w, 0, sizeof(*w));
+    w->gm = gm;
+    w->dtb = dtb;
+    w->prev = head;
+}
+
+// Whether the entry at links is on the list: its Blink points at the
+// entry the walk came from, or at one whose Flink points back at it (the
+// entry the walk came from was unlinked meanwhile)
+static int link_confirms(const link_walk_t *w, uint64_t links, int have_blink, uint64_t blink) {
+    uint64_t flink;
+
+    if (w->prev == 0 || (have_blink && blink == w->prev)) return 1;
+    return have_blink && blink != 0 && 0 == gm_read_u64(w->gm, w->dtb, blink, &flink) && flink == links;
+}
+
+// The entry at links did not check out. Returns 1 with *next set to the
+// links to read instead (the previous entry's Flink, read afresh, since
+// an insert or unlink may have raced the walk), or 0 once retries run out.
+static int link_retry(link_walk_t *w, uint64_t links, uint64_t *next) {
+    uint64_t flink;
+
+    if (!walk_live || w->tries == WIN_WALK_RETRIES) return 0;
+    w->tries++;
+    w->retries++;
+    gm_invalidate(w->gm);
+    *next = links;
+    if (w->prev && 0 == gm_read_u64(w->gm, w->dtb, w->prev, &flink)) {
+        *next = flink;
+    }
+    return 1;
+}
+
+// The entry at links is taken; the next one must link back to it
+static void link_advance(link_walk_t *w, uint64_t links) {
+    w->prev = links;
+    w->tries = 0;
+}
+
+// Little-endian field decoders; return 0 when the field was not read
+static int field_u16(const uint8_t *buf, size_t valid, size_t off, uint16_t *out) {
+    if (off + sizeof(*out) > valid) return 0;
+    memcpy(out, buf + off, sizeof(*out));
+    return 1;
+}
+
+static int field_u32(const uint8_t *buf, size_t valid, size_t off, uint32_t *out) {
+    if (off + sizeof(*out) > valid) return 0;
+    memcpy(out, buf + off, sizeof(*out));
+    return 1;
+}
+
+static int field_u64(const uint8_t *buf, size_t valid, size_t off, uint64_t *out) {
+    if (off + sizeof(*out) > valid) return 0;
+    memcpy(out, buf + off, sizeof(*out));
+    return 1;
+}
+
+static int field_name(const uint8_t *buf, size_t valid, size_t off, char *out) {
+    if (off + EPROCESS_IMAGEFILENAME_LEN > valid) return 0;
+    memcpy(out, buf + off, EPROCESS_IMAGEFILENAME_LEN);
+    out[EPROCESS_IMAGEFILENAME_LEN] = '\0';
+    return 1;
+}
+
+// Guest bytes to decode: a pointer straight into mapped guest RAM when the
+// backend has one, otherwise a copy in buf. Returns the bytes available,
+// which is a prefix of len when the copy is cut short.
+static size_t view_va(guest_mem_t *gm, uint64_t dtb, uint64_t va,
+                      uint8_t *buf, size_t len, const uint8_t **out) {
+    const uint8_t *p = gm_map_va(gm, dtb, va, len);
+    if (p) {
+        *out = p;
+        return len;
+    }
+    *out = buf;
+    return gm_read_va(gm, dtb, va, buf, len);
+}
+
+void win_decode_process(const uint8_t *buf, size_t valid, uint64_t process_addr, win_process_t *out) {
+    const win_profile_t *prof = win_profile_get();
+
+    memset(out, 0, sizeof(*out));
+    out->addr = process_addr;
+    out->valid = valid;
+
+    field_name(buf, valid, prof->eprocess_name, out->name);
+    field_u32(buf, valid, prof->eprocess_pid, (uint32_t*)&out->pid);
+    field_u64(buf, valid, prof->eprocess_dtb, &out->dtb);
+    field_u64(buf, valid, prof->eprocess_peb, &out->peb);
+    field_u64(buf, valid, prof->eprocess_links, &out->flink);
+    field_u64(buf, valid, prof->eprocess_links + 8, &out->blink);
+    field_u64(buf, valid, prof->eprocess_threads, &out->thread_flink);
+    field_u64(buf, valid, prof->eprocess_threads + 8, &out->thread_blink);
+    if (prof->eprocess_create_time) {
+        field_u64(buf, valid, prof->eprocess_create_time, &out->create_time);
+    }
+    if (prof->eprocess_object_table) {
+        field_u64(buf, valid, prof->eprocess_object_table, &out->object_table);
+    }
+    if (prof->eprocess_vad_root) {
+        field_u64(buf, valid, prof->eprocess_vad_root, &out->vad_root);
+    }
+}
+
+int win_kernel_va(uint64_t va) {
+    return va >= 0xffff800000000000ULL;
+}
+
+uint64_t win_process_dtb(const win_process_t *process) {
+    const win_profile_t *prof = win_profile_get();
+
+    // Low bits of DirectoryTableBase carry flags (KVA shadow, PCID)
+    if (process->valid < prof->eprocess_dtb + sizeof(uint64_t) ||
+        (process->dtb & ~(uint64_t)GM_PAGE_MASK) == 0) {
+        return GM_KERNEL_DTB;
+    }
+    return process->dtb & ~(uint64_t)GM_PAGE_MASK;
+}
+
+size_t win_read_process(guest_mem_t *gm, uint64_t process_addr, win_process_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    uint8_t copy[WIN_PROFILE_MAX_SPAN];
+    const uint8_t *buf;
+    size_t valid;
+
+    // One read covers every field of the profile; a short read still
+    // returns a prefix (e.g. second page not mapped)
+    valid = view_va(gm, GM_KERNEL_DTB, process_addr, copy, prof->eprocess_span.size, &buf);
+    if (valid == 0) {
+        memset(out, 0, sizeof(*out));
+        out->addr = process_addr;
+        return 0;
+    }
+    win_decode_process(buf, valid, process_addr, out);
+    return valid;
+}
+
+// Fetch the UTF-16 characters of a UNICODE_STRING whose header is known
+static size_t read_unicode_buffer(guest_mem_t *gm, uint64_t dtb, uint16_t length,
+                                  uint64_t buffer, uint16_t *wbuf, size_t max_chars) {
+    size_t nchars;
+
+    if (length == 0 || buffer == 0) {
+        return 0;
+    }
+    nchars = length / 2;
+    if (nchars > max_chars) nchars = max_chars;
+    if (gm_read_va(gm, dtb, buffer, wbuf, nchars * 2) != nchars * 2) {
+        return 0;
+    }
+    return nchars;
+}
+
+size_t win_read_unicode_raw(guest_mem_t *gm, uint64_t dtb, uint64_t va,
+                            uint16_t *wbuf, size_t max_chars) {
+    uint8_t hdr[16];
+    uint16_t length;
+    uint64_t buffer;
+
+    // UNICODE_STRING: Length, MaximumLength, padding, Buffer
+    if (gm_read_va(gm, dtb, va, hdr, sizeof(hdr)) != sizeof(hdr)) {
+        return 0;
+    }
+    memcpy(&length, hdr, sizeof(length));
+    memcpy(&buffer, hdr + 8, sizeof(buffer));
+    return read_unicode_buffer(gm, dtb, length, buffer, wbuf, max_chars);
+}
+
+static int walk_processes(guest_mem_t *gm, uint64_t first_process, uint64_t list_head,
+                          win_process_list_t *out) {
+    uint64_t links = win_profile_get()->eprocess_links;
+    uint64_t current = first_process, next;
+    link_walk_t lw;
+    visited_t seen;
+    win_process_t proc;
+    size_t count = 0, valid;
+    int added, ret = 0;
+
+    link_walk_init(&lw, gm, GM_KERNEL_DTB, list_head);
+    visited_init(&seen);
+    for (;;) {
+        // One guest read per process: name, PID, DTB and links together
+        valid = win_read_process(gm, current, &proc);
+        if (valid == 0 || (walk_live && (visited_has(&seen, current) ||
+            !link_confirms(&lw, current + links, valid >= links + 2 * sizeof(uint64_t), proc.blink)))) {
+            if (link_retry(&lw, current + links, &next)) {
+                if (next == 0 || next == list_head) break;
+                current = next - links;
+                continue;
+            }
+            proc.unconfirmed = valid != 0;
+        }
+        if (valid == 0) {
+            if (out) out->error = "Unreadable EPROCESS in process list";
+            break;
+        }
+        added = visited_add(&seen, current);
+        if (added <= 0) {
+            if (added < 0) ret = -1;
+            else if (out) out->error = "Loop in process list";
+            break;
+        }
+        if (out) {
+            win_process_t *row = LIST_PUSH(out);
+            if (!row) {
+                ret = -1;
+                break;
+            }
+            *row = proc;
+        }
+        lw.unconfirmed += proc.unconfirmed;
+        count++;
+        if (proc.valid < links + 2 * sizeof(uint64_t)) {
+            if (out) out->error = "Truncated EPROCESS in process list";
+            break;
+        }
+
+        // The System process is first on the list, so its Blink is the head
+        if (list_head == 0) {
+            list_head = proc.blink;
+        }
+        link_advance(&lw, current + links);
+
+        // Next process (EPROCESS.ActiveProcessLinks.Flink); the head is
+        // not an EPROCESS and ends the walk
+        if (proc.flink == 0 || proc.flink == list_head) {
+            break;
+        }
+        current = proc.flink - links;
+    }
+    visited_free(&seen);
+    if (out) {
+        out->retries += lw.retries;
+        out->unconfirmed += lw.unconfirmed;
+    }
+
+    return ret ? ret : (int)count;
+}
+
+// An InLoadOrder list of LDR_DATA_TABLE_ENTRY (a process's modules) or
+// KLDR_DATA_TABLE_ENTRY (PsLoadedModuleList); both have the links, base,
+// size and BaseDllName where the profile says
+static int walk_ldr_list(guest_mem_t *gm, uint64_t dtb, uint64_t head, win_module_list_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    uint64_t current;
+    uint16_t wbuf[WIN_MAX_NAME_CHARS];
+    link_walk_t lw;
+    visited_t seen;
+    size_t count = 0;
+    int added, ret = 0;
+
+    if (0 != gm_read_u64(gm, dtb, head, &current)) {
+        if (out) out->error = "Failed to read module list";
+        return -1;
+    }
+
+    link_walk_init(&lw, gm, dtb, head);
+    visited_init(&seen);
+    while (current != 0 && current != head) {
+        uint8_t copy[WIN_PROFILE_MAX_SPAN];
+        const uint8_t *entry;
+        uint64_t base = 0, buffer = 0, blink = 0, next;
+        uint32_t size = 0;
+        uint16_t length = 0;
+        size_t valid, nchars = 0;
+        int have_blink, unconfirmed = 0;
+
+        // One read (or mapped view) per LDR_DATA_TABLE_ENTRY; the
+        // InLoadOrderLinks come first
+        valid = view_va(gm, dtb, current, copy, prof->ldr_span.size, &entry);
+        have_blink = field_u64(entry, valid, 8, &blink);
+        if (valid == 0 || (walk_live && (visited_has(&seen, current) ||
+            !link_confirms(&lw, current, have_blink, blink)))) {
+            if (link_retry(&lw, current, &next)) {
+                current = next;
+                continue;
+            }
+            unconfirmed = valid != 0;
+        }
+
+        added = visited_add(&seen, current);
+        if (added <= 0) {
+            if (added < 0) ret = -1;
+            else if (out) out->error = "Loop in module list";
+            break;
+        }
+
+        // LDR_DATA_TABLE_ENTRY.BaseDllName
+        if (field_u16(entry, valid, prof->ldr_basedllname, &length) &&
+            field_u64(entry, valid, prof->ldr_basedllname + 8, &buffer)) {
+            nchars = read_unicode_buffer(gm, dtb, length, buffer, wbuf, WIN_MAX_NAME_CHARS);
+        }
+        if (nchars > 0) {
+            field_u64(entry, valid, prof->ldr_dllbase, &base);
+            field_u32(entry, valid, prof->ldr_sizeofimage, &size);
+
+            if (out) {
+                win_module_t *row = LIST_PUSH(out);
+                if (!row) {
+                    ret = -1;
+                    break;
+                }
+                row->entry = current;
+                row->base = base;
+                row->size = size;
+                row->unconfirmed = unconfirmed;
+                row->name = win_arena_utf16(out->arena, wbuf, nchars);
+                if (!row->name) {
+                    out->count--;
+                    ret = -1;
+                    break;
+                }
+            }
+            lw.unconfirmed += unconfirmed;
+            count++;
+        }
+        link_advance(&lw, current);
+
+        // Next module (Flink)
+        if (!field_u64(entry, valid, 0, &current)) {
+            if (out) out->error = "Unreadable entry in module list";
+            break;
+        }
+    }
+    visited_free(&seen);
+    if (out) {
+        out->retries += lw.retries;
+        out->unconfirmed += lw.unconfirmed;
+    }
+
+    return ret ? ret : (int)count;
+}
+
+static int walk_modules(guest_mem_t *gm, const win_process_t *process, win_module_list_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    uint64_t dtb = win_process_dtb(process);
+    uint64_t ldr = 0;
+
+    // PEB address (EPROCESS.Peb) comes from the process snapshot
+    if (process->valid < prof->eprocess_peb + sizeof(uint64_t)) {
+        if (out) out->error = "Failed to read PEB address";
+        return -1;
+    }
+    if (process->peb == 0) {
+        if (out) out->error = "PEB is NULL (likely system process)";
+        return 0;
+    }
+
+    // PEB.Ldr and PEB_LDR_DATA.InLoadOrderModuleList, in the process's
+    // own address space
+    if (0 != gm_read_u64(gm, dtb, process->peb + prof->peb_ldr, &ldr)) {
+        if (out) out->error = "Failed to read PEB.Ldr";
+        return -1;
+    }
+    if (ldr == 0) {
+        if (out) out->error = "PEB.Ldr is NULL";
+        return 0;
+    }
+    return walk_ldr_list(gm, dtb, ldr + prof->ldr_inloadorder, out);
+}
+
+static int walk_threads(guest_mem_t *gm, const win_process_t *process, win_thread_list_t *out) {
+    const win_profile_t *prof = win_profile_get();
+    const win_span_t *span = &prof->ethread_span;
+    uint64_t head, next, entry_links;
+    link_walk_t lw;
+    visited_t seen;
+    size_t count = 0;
+    int added, ret = 0;
+
+    // ThreadListHead.Flink comes from the process snapshot
+    if (process->valid < prof->eprocess_threads + 2 * sizeof(uint64_t)) {
+        if (out) out->error = "Failed to read thread list";
+        return -1;
+    }
+
+    head = process->addr + prof->eprocess_threads;
+    next = process->thread_flink;
+    entry_links = prof->ethread_threadlistentry - span->start;
+
+    link_walk_init(&lw, gm, GM_KERNEL_DTB, head);
+    visited_init(&seen);
+    while (next != 0 && next != head) {
+        uint8_t copy[WIN_PROFILE_MAX_SPAN];
+        const uint8_t *ethread;
+        uint64_t current = next - prof->ethread_threadlistentry, blink = 0;
+        uint32_t thread_id = 0, process_id = 0;
+        size_t valid;
+        int have_blink, unconfirmed = 0;
+
+        // ThreadListEntry through Cid in one read (or mapped view)
+        valid = view_va(gm, GM_KERNEL_DTB, current + span->start, copy, span->size, &ethread);
+        have_blink = field_u64(ethread, valid, entry_links + 8, &blink);
+        if (valid == 0 || (walk_live && (visited_has(&seen, current) ||
+            !link_confirms(&lw, next, have_blink, blink)))) {
+            if (link_retry(&lw, next, &next)) continue;
+            unconfirmed = valid != 0;
+        }
+
+        added = visited_add(&seen, current);
+        if (added <= 0) {
+            if (added < 0) ret = -1;
+            else if (out) out->error = "Loop in thread list";
+            break;
+        }
+
+        // ETHREAD.Cid.UniqueThread / ETHREAD.Cid.UniqueProcess
+        if (field_u32(ethread, valid, prof->ethread_cid_thread - span->start, &thread_id)) {
+            field_u32(ethread, valid, prof->ethread_cid_process - span->start, &process_id);
+            if (out) {
+                win_thread_t *row = LIST_PUSH(out);
+                if (!row) {
+                    ret = -1;
+                    break;
+                }
+                row->ethread = current;
+                row->tid = thread_id;
+                row->pid = process_id;
+                row->unconfirmed = unconfirmed;
+            }
+            lw.unconfirmed += unconfirmed;
+            count++;
+        }
+        link_advance(&lw, next);
+
+        // Next thread (ThreadListEntry.Flink)
+        if (!field_u64(ethread, valid, entry_links, &next)) {
+            if (out) out->error = "Unreadable entry in thread list";
+            break;
+        }
+    }
+    visited_free(&seen);
+    if (out) {
+        out->retries += lw.retries;
+        out->unconfirmed += lw.unconfirmed;
+    }
+
+    return ret ? ret : (int)count;
+}
+
+// Public walkers attribute their guest accesses to their list (counters.h)
+int win_walk_processes(guest_mem_t *gm, uint64_t first_process, uint64_t list_head,
+                       win_process_list_t *out) {
+    ctr_scope_t scope;
+    int n;
+
+    counters_begin(&scope, CTR_PROCESSES);
+    n = walk_processes(gm, first_process, list_head, out);
+    counters_end(&scope);
+    return n;
+}
+
+int win_walk_modules(guest_mem_t *gm, const win_process_t *process, win_module_list_t *out) {
+    ctr_scope_t scope;
+    int n;
+
+    counters_begin(&scope, CTR_MODULES);
+    n = walk_modules(gm, process, out);
+    counters_end(&scope);
+    return n;
+}
+
+int win_walk_drivers(guest_mem_t *gm, uint64_t list_head, win_module_list_t *out) {
+    ctr_scope_t scope;
+    int n;
+
+    counters_begin(&scope, CTR_MODULES);
+    n = walk_ldr_list(gm, GM_KERNEL_DTB, list_head, out);
+    counters_end(&scope);
+    return n;
+}
+
+int win_walk_threads(guest_mem_t *gm, const win_process_t *process, win_thread_list_t *out) {
+    ctr_scope_t scope;
+    int n;
+
+    counters_begin(&scope, CTR_THREADS);
+    n = walk_threads(gm, process, out);
+    counters_end(&scope);
+    return n;
+}
+
+void win_process_list_free(win_process_list_t *list) {
+    LIST_FREE(list);
+}
+
+void win_module_list_free(win_module_list_t *list) {
+    LIST_FREE(list);
+}
+
+void win_thread_list_free(win_thread_list_t *list) {
+    LIST_FREE(list);
+}
@@ -0,0 +1,134 @@
+#ifndef WIN_WALK_H
+#define WIN_WALK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "guest_mem.h"
+#include "win_profile.h"
+#include "win_str.h"
+
+// Structure offsets come from the active profile (win_profile.h)
+#define EPROCESS_IMAGEFILENAME_LEN 15
+
+// Longest UNICODE_STRING we decode, in UTF-16 code units
+#define WIN_MAX_NAME_CHARS 256
+
+// Fields decoded from a single bulk read of an EPROCESS
+typedef struct {
+    uint64_t addr;
+    size_t valid;                  // bytes actually read from guest memory
+    char name[EPROCESS_IMAGEFILENAME_LEN + 1];
+    int32_t pid;
+    uint64_t dtb;
+    uint64_t peb;
+    uint64_t flink;                // ActiveProcessLinks.Flink
+    uint64_t blink;                // ActiveProcessLinks.Blink
+    uint64_t thread_flink;         // ThreadListHead.Flink
+    uint64_t thread_blink;         // ThreadListHead.Blink
+    uint64_t create_time;          // CreateTime (FILETIME), 0 if unknown
+    uint64_t object_table;         // ObjectTable (HANDLE_TABLE), 0 if none or unknown
+    uint64_t vad_root;             // VadRoot (root _MMVAD), 0 if none or unknown
+    int unconfirmed;               // live walk: links never checked out
+} win_process_t;
+
+typedef struct {
+    uint64_t entry;                // LDR_DATA_TABLE_ENTRY address
+    uint64_t base;
+    uint32_t size;
+    const char *name;              // UTF-8, in the list's arena
+    int unconfirmed;
+} win_module_t;
+
+typedef struct {
+    uint64_t ethread;
+    uint32_t tid;
+    uint32_t pid;
+    int unconfirmed;
+} win_thread_t;
+
+// Growable result arrays; error is set when the walk stopped early. Rows
+// and names come from arena: set it to a scan's arena before the walk and
+// the list is released with that arena; left NULL, the list gets an arena
+// of its own, released by the *_list_free function. retries and
+// unconfirmed count what a live walk (win_walk_set_live) had to re-read
+// and what it could not confirm.
+typedef struct {
+    win_process_t *items;
+    size_t count, cap;
+    const char *error;
+    win_arena_t *arena;
+    int owns_arena;
+    size_t retries, unconfirmed;
+} win_process_list_t;
+
+typedef struct {
+    win_module_t *items;
+    size_t count, cap;
+    const char *error;
+    win_arena_t *arena;
+    int owns_arena;
+    size_t retries, unconfirmed;
+} win_module_list_t;
+
+typedef struct {
+    win_thread_t *items;
+    size_t count, cap;
+    const char *error;
+    win_arena_t *arena;
+    int owns_arena;
+    size_t retries, unconfirmed;
+} win_thread_list_t;
+
+// Read one EPROCESS; returns the number of bytes read (0 if unreadable)
+size_t win_read_process(guest_mem_t *gm, uint64_t process_addr, win_process_t *out);
+
+// Decode the first valid bytes of an EPROCESS already in buf
+void win_decode_process(const uint8_t *buf, size_t valid, uint64_t process_addr, win_process_t *out);
+
+// Address space of a process's user-mode memory (PEB, loader data): its
+// DirectoryTableBase, or GM_KERNEL_DTB when that was not read
+uint64_t win_process_dtb(const win_process_t *process);
+
+// Whether va is in the kernel half of the address space (canonical, with
+// bit 47 set)
+int win_kernel_va(uint64_t va);
+
+// Read a UNICODE_STRING as raw UTF-16LE; returns the number of code units
+size_t win_read_unicode_raw(guest_mem_t *gm, uint64_t dtb, uint64_t va,
+                            uint16_t *wbuf, size_t max_chars);
+
+// Walkers. A NULL list only touches the memory the walk needs (used to
+// gather a page snapshot); otherwise rows are appended to the list.
+// Each returns the number of entries visited, or -1 on failure.
+//
+// Lists have no length limit. A walk ends when it gets back to the list
+// head, which is never decoded as an entry; an entry seen twice (a loop
+// that skips the head) or an unreadable link ends it early with error set.
+// For processes, list_head is PsActiveProcessHead; 0 takes it from the
+// first process's Blink, which holds when that is the System process.
+int win_walk_processes(guest_mem_t *gm, uint64_t first_process, uint64_t list_head,
+                       win_process_list_t *out);
+int win_walk_modules(guest_mem_t *gm, const win_process_t *process, win_module_list_t *out);
+int win_walk_threads(guest_mem_t *gm, const win_process_t *process, win_thread_list_t *out);
+
+// Kernel modules (drivers) on PsLoadedModuleList, the kernel first
+int win_walk_drivers(guest_mem_t *gm, uint64_t list_head, win_module_list_t *out);
+
+// Live walks, for a guest that keeps running while its lists are read.
+// Every entry must link back: its Blink has to point at the entry the
+// walk came from, or at one whose Flink points at it (the entry the walk
+// came from was just unlinked). When it does not, or it is unreadable or
+// seen before, the walk may have raced an insert or unlink; it reads the
+// previous entry's Flink again (past the page cache) and follows it, up
+// to WIN_WALK_RETRIES times. An entry that still does not link back is
+// kept with unconfirmed set; an unreadable link or a loop still ends the
+// walk. Off by default, when the guest is expected to be paused.
+#define WIN_WALK_RETRIES 3
+void win_walk_set_live(int live);
+int win_walk_live(void);
+
+void win_process_list_free(win_process_list_t *list);
+void win_module_list_free(win_module_list_t *list);
+void win_thread_list_free(win_thread_list_t *list);
+
+#endif
@@ -0,0 +1,111 @@
+#include <string.h>
+#include "x86_pt.h"
+
+#define PT_INDEX(va, shift) (((va) >> (shift)) & 0x1ff)
+#define VA_MASK             0x0000ffffffffffffULL   // drop the sign extension
+#define NO_TAG              (~0ULL)
+
+// Bits mapped below a PML4E, PDPTE and PDE
+static const unsigned level_shift[3] = { 39, 30, 21 };
+
+static inline x86_pwc_entry_t *pwc_slot(x86_pwc_t *pwc, int level, uint64_t cr3, uint64_t tag) {
+    uint64_t h = (tag ^ (cr3 >> 12) * 0xff51afd7ed558ccdULL) * 0x9e3779b97f4a7c15ULL;
+    return &pwc->level[level][(h >> 32) & (X86_PWC_ENTRIES - 1)];
+}
+
+void x86_pwc_init(x86_pwc_t *pwc) {
+    memset(pwc, 0, sizeof(*pwc));
+    pwc->gen = 1;
+}
+
+void x86_pwc_flush(x86_pwc_t *pwc) {
+    pwc->gen++;
+}
+
+void x86_walk_init(x86_walk_t *w, x86_read_pte_fn read_pte, void *ctx,
+                   x86_pwc_t *pwc, uint64_t cr3) {
+    w->read_pte = read_pte;
+    w->ctx = ctx;
+    w->pwc = pwc;
+    w->cr3 = cr3;
+    w->tags[0] = w->tags[1] = w->tags[2] = NO_TAG;
+}
+
+int x86_walk(x86_walk_t *w, uint64_t va, uint64_t *pa, uint64_t *page_size) {
+    uint64_t v = va & VA_MASK;
+    uint64_t entry = 0, pte, table;
+    int level;
+
+    // Deepest upper level already known, from the previous walk or the cache
+    for (level = 2; level >= 0; level--) {
+        uint64_t tag = v >> level_shift[level];
+        if (w->tags[level] == tag) {
+            entry = w->entries[level];
+            break;
+        }
+        if (w->pwc) {
+            x86_pwc_entry_t *e = pwc_slot(w->pwc, level, w->cr3, tag);
+            if (e->gen == w->pwc->gen && e->cr3 == w->cr3 && e->tag == tag) {
+                w->tags[level] = tag;
+                w->entries[level] = entry = e->entry;
+                break;
+            }
+        }
+    }
+    if (w->pwc) {
+        if (level >= 0) w->pwc->hits++;
+        else w->pwc->misses++;
+    }
+
+    // Walk down from there to the PDE, stopping early at a 1 GiB page
+    while (level < 2 && !(level == 1 && (entry & X86_PTE_PS))) {
+        table = level < 0 ? w->cr3 : entry;
+        level++;
+        if (w->pwc) w->pwc->pte_reads++;
+        if (w->read_pte(w->ctx, (table & X86_PADDR_MASK) + PT_INDEX(v, level_shift[level]) * 8, &entry) != 0 ||
+            !(entry & X86_PTE_PRESENT)) {
+            return -1;
+        }
+        w->tags[level] = v >> level_shift[level];
+        w->entries[level] = entry;
+        if (w->pwc) {
+            x86_pwc_entry_t *e = pwc_slot(w->pwc, level, w->cr3, w->tags[level]);
+            e->cr3 = w->cr3;
+            e->tag = w->tags[level];
+            e->entry = entry;
+            e->gen = w->pwc->gen;
+        }
+    }
+
+    if (level == 1) {
+        *pa = (entry & X86_PADDR_MASK & ~(X86_PAGE_1G - 1)) | (va & (X86_PAGE_1G - 1));
+        if (page_size) *page_size = X86_PAGE_1G;
+        return 0;
+    }
+    if (entry & X86_PTE_PS) {
+        *pa = (entry & X86_PADDR_MASK & ~(X86_PAGE_2M - 1)) | (va & (X86_PAGE_2M - 1));
+        if (page_size) *page_size = X86_PAGE_2M;
+        return 0;
+    }
+
+    if (w->pwc) w->pwc->pte_reads++;
+    if (w->read_pte(w->ctx, (entry & X86_PADDR_MASK) + PT_INDEX(v, 12) * 8, &pte) != 0) {
+        return -1;
+    }
+    // Transition pages are not present but their contents are still in RAM
+    if (!(pte & X86_PTE_PRESENT) &&
+        !((pte & X86_PTE_TRANSITION) && !(pte & X86_PTE_PROTOTYPE))) {
+        return -1;
+    }
+    *pa = (pte & X86_PADDR_MASK) | (va & (X86_PAGE_4K - 1));
+    if (page_size) *page_size = X86_PAGE_4K;
+    return 0;
+}
+
+int x86_translate(x86_read_pte_fn read_pte, void *ctx, uint64_t cr3,
+                  uint64_t va, uint64_t *pa, uint64_t *page_size) {
+    x86_walk_t w;
+
+    x86_walk_init(&w, read_pte, ctx, NULL, cr3);
+    return x86_walk(&w, va, pa, page_size);
+}
@@ -0,0 +1,72 @@
+#ifndef X86_PT_H
+#define X86_PT_H
+
+#include <stdint.h>
+
+// x86-64 4-level paging (PML4 -> PDPT -> PD -> PT)
+
+#define X86_PTE_PRESENT     (1ULL << 0)
+#define X86_PTE_PS          (1ULL << 7)     // 1 GiB / 2 MiB page at PDPT / PD level
+#define X86_PTE_PROTOTYPE   (1ULL << 10)    // Windows: prototype PTE
+#define X86_PTE_TRANSITION  (1ULL << 11)    // Windows: page in transition, still in RAM
+#define X86_PADDR_MASK      0x000ffffffffff000ULL
+
+#define X86_PAGE_4K (1ULL << 12)
+#define X86_PAGE_2M (1ULL << 21)
+#define X86_PAGE_1G (1ULL << 30)
+
+// Read a 64-bit page-table entry at a physical address; 0 on success
+typedef int (*x86_read_pte_fn)(void *ctx, uint64_t pa, uint64_t *pte);
+
+// Translate va through the tables rooted at cr3. On success returns 0,
+// stores the physical address and, if page_size is not NULL, the size
+// of the page that maps it.
+int x86_translate(x86_read_pte_fn read_pte, void *ctx, uint64_t cr3,
+                  uint64_t va, uint64_t *pa, uint64_t *page_size);
+
+// Paging-structure cache: present PML4, PDPT and PD entries, keyed by the
+// table root and the VA bits above the level they map, like the CPU's own
+// PML4/PDPTE/PDE caches. A walk starts below the deepest level it finds,
+// so it usually costs one PTE read, and none inside a large page. Entries
+// of different roots (processes) live side by side; flush when the guest
+// may have changed its tables.
+#define X86_PWC_ENTRIES 256             // per level, direct-mapped
+
+typedef struct {
+    uint64_t cr3;
+    uint64_t tag;                       // va >> (bits mapped below the entry)
+    uint64_t entry;
+    uint64_t gen;                       // valid only when equal to pwc->gen
+} x86_pwc_entry_t;
+
+typedef struct {
+    x86_pwc_entry_t level[3][X86_PWC_ENTRIES];  // PML4E, PDPTE, PDE
+    uint64_t gen;
+    uint64_t hits;                      // walks that started below the root
+    uint64_t misses;
+    uint64_t pte_reads;                 // entries read from guest memory
+} x86_pwc_t;
+
+void x86_pwc_init(x86_pwc_t *pwc);
+void x86_pwc_flush(x86_pwc_t *pwc);
+
+// A run of walks through one root. Consecutive addresses that share upper
+// levels reuse them without even probing the cache, so translating a
+// vector of VAs (sorted or not) costs one pass over distinct tables.
+// pwc may be NULL.
+typedef struct {
+    x86_read_pte_fn read_pte;
+    void *ctx;
+    x86_pwc_t *pwc;
+    uint64_t cr3;
+    uint64_t tags[3];                   // upper levels of the previous walk
+    uint64_t entries[3];
+} x86_walk_t;
+
+void x86_walk_init(x86_walk_t *w, x86_read_pte_fn read_pte, void *ctx,
+                   x86_pwc_t *pwc, uint64_t cr3);
+
+// Same contract as x86_translate()
+int x86_walk(x86_walk_t *w, uint64_t va, uint64_t *pa, uint64_t *page_size);
+
+#endif
@@ -84,6 +84,127 @@ fi
 echo "Dependencies: $deps_ok/3 available"
 echo
 
+# Test the mmap and /proc/PID/mem backends against fake RAM on tmpfs
+echo "7. Testing guest RAM backends..."
+if make check-backends >/dev/null 2>&1; then
+    echo "✓ mmap, /proc/PID/mem and memory-image backend reads match"
+else
+    echo "✗ Guest RAM backend check failed"
+fi
+echo
+
+echo "8. Testing structure profile loading..."
+if make check-profile >/dev/null 2>&1; then
+    echo "✓ ISF profile matches the built-in offsets"
+else
+    echo "✗ Structure profile check failed"
+fi
+echo
+
+echo "9. Testing walkers on synthetic images..."
+if make check-scale >/dev/null 2>&1; then
+    echo "✓ Walks of 100k-process and corrupted images match"
+else
+    echo "✗ Synthetic image walk check failed"
+fi
+echo
+
+echo "10. Testing process monitor..."
+if make check-monitor >/dev/null 2>&1; then
+    echo "✓ Process creations and exits tracked incrementally"
+else
+    echo "✗ Process monitor check failed"
+fi
+echo
+
+echo "11. Testing kernel symbol cache..."
+if make check-symcache >/dev/null 2>&1; then
+    echo "✓ Cached symbols survive reboots and reject other kernel builds"
+else
+    echo "✗ Symbol cache check failed"
+fi
+echo
+
+echo "12. Testing cold-start kernel scan..."
+if make check-scan >/dev/null 2>&1; then
+    echo "✓ Kernel found by scanning RAM for KdVersionBlock/KDBG"
+else
+    echo "✗ Kernel scan check failed"
+fi
+echo
+
+echo "13. Testing pool-tag process scan..."
+if make check-psscan >/dev/null 2>&1; then
+    echo "✓ Unlinked (DKOM) and exited processes found by pool scan"
+else
+    echo "✗ Pool scan check failed"
+fi
+echo
+
+echo "14. Testing page-table walker..."
+if make check-pt >/dev/null 2>&1; then
+    echo "✓ Cached and batched page walks match plain walks"
+else
+    echo "✗ Page walker check failed"
+fi
+echo
+
+echo "15. Testing driver and DLL export index..."
+if make check-drivers >/dev/null 2>&1; then
+    echo "✓ Kernel and user addresses resolved to exports, shared DLLs parsed once"
+else
+    echo "✗ Export index check failed"
+fi
+echo
+
+echo "16. Testing pause-free walks..."
+if make check-live >/dev/null 2>&1; then
+    echo "✓ Live walks stayed consistent while the process list was edited"
+else
+    echo "✗ Live walk check failed"
+fi
+echo
+
+echo "17. Testing memory capture and diff..."
+if make check-diff >/dev/null 2>&1; then
+    echo "✓ Captures walk offline and every edit was mapped to its owner"
+else
+    echo "✗ Memory diff check failed"
+fi
+echo
+
+echo "18. Testing packed captures..."
+if make check-pack >/dev/null 2>&1; then
+    echo "✓ Packed captures matched their images page for page"
+else
+    echo "✗ Packed capture check failed"
+fi
+echo
+
+echo "19. Testing handle tables..."
+if make check-handles >/dev/null 2>&1; then
+    echo "✓ Every handle decoded with its type and name"
+else
+    echo "✗ Handle table check failed"
+fi
+echo
+
+echo "20. Testing VAD trees..."
+if make check-vads >/dev/null 2>&1; then
+    echo "✓ Every VAD region decoded with its protection and file"
+else
+    echo "✗ VAD tree check failed"
+fi
+echo
+
+echo "21. Testing signature scans..."
+if make check-sigscan >/dev/null 2>&1; then
+    echo "✓ Every signature found across page and span boundaries"
+else
+    echo "✗ Signature scan check failed"
+fi
+echo
+
 echo "==== PROJECT STRUCTURE ===="
 echo "Current directory structure:"
 find . -type f -name "*.c" -o -name "*.h" -o -name "Makefile" -o -name "README.md" -o -name "*.conf" -o -name "*.xml" | sort